@@ -0,0 +1,211 @@
+/* JAudioEngine.c Source file for the PortAudio context shared by every stream
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "JAudioEngine.h"
+
+/* The engine of the process, NULL while no one holds it.  sharedLock guards it and
+ * the reference count.  It is a spin lock because it must work before anything could
+ * have initialized a JMutex, and it is only held for a count or for PortAudio to
+ * start and stop. */
+static JAudioEngine *sharedEngine = NULL;
+static int sharedLock = 0;
+
+static void lockShared( void );
+static void unlockShared( void );
+static JAudioEngine* createEngine( void );
+static void destroyEngine( JAudioEngine *engine );
+
+
+JAudioEngine* JAudioEngineAcquire( void )
+{
+    JAudioEngine *engine;
+
+    lockShared();
+    if( sharedEngine == NULL )
+        sharedEngine = createEngine();
+    engine = sharedEngine;
+    if( engine != NULL )
+        engine->refCount++;
+    unlockShared();
+
+    return engine;
+}
+
+
+void JAudioEngineRelease( JAudioEngine **enginePtr )
+{
+    JAudioEngine *engine = *enginePtr;
+
+    if( engine == NULL )
+        return;
+
+    lockShared();
+    if( --engine->refCount == 0 )
+    {
+        destroyEngine( engine );
+        sharedEngine = NULL;
+    }
+    unlockShared();
+    *enginePtr = NULL;
+
+    return;
+}
+
+
+int JAudioEngineIsFormatSupported( JAudioEngine *engine, int channelCount,
+                                   PaSampleFormat sampleFormat, double sampleRate )
+{
+    PaStreamParameters  parameters;
+    JEngineFormat       *format;
+    int                 bSupported;
+    unsigned            i;
+
+    if( engine->device == paNoDevice )
+        return FALSE;
+
+    JPlatformMutexLock( &engine->lock );
+    for( i=0; i<engine->formatCount; i++ )
+    {
+        format = &engine->formats[i];
+        if( format->channelCount == channelCount && format->sampleFormat == sampleFormat &&
+            format->sampleRate == sampleRate )
+        {
+            bSupported = format->bSupported;
+            JPlatformMutexUnlock( &engine->lock );
+            return bSupported;
+        }
+    }
+
+    /* Some host APIs open the device to answer, so ask only once per format */
+    parameters.device = engine->device;
+    parameters.channelCount = channelCount;
+    parameters.sampleFormat = sampleFormat;
+    parameters.suggestedLatency = engine->defaultLowOutputLatency;
+    parameters.hostApiSpecificStreamInfo = NULL;
+    bSupported = Pa_IsFormatSupported( NULL, &parameters, sampleRate ) == paFormatIsSupported;
+
+    if( engine->formatCount < JENGINE_FORMAT_CACHE_SIZE )
+        format = &engine->formats[engine->formatCount++];
+    else
+    {
+        format = &engine->formats[engine->nextFormat];
+        engine->nextFormat = ( engine->nextFormat + 1 ) % JENGINE_FORMAT_CACHE_SIZE;
+    }
+    format->channelCount = channelCount;
+    format->sampleFormat = sampleFormat;
+    format->sampleRate = sampleRate;
+    format->bSupported = bSupported;
+    JPlatformMutexUnlock( &engine->lock );
+
+    return bSupported;
+}
+
+
+void JAudioEngineStreamOpened( JAudioEngine *engine )
+{
+    JPlatformMutexLock( &engine->lock );
+    engine->streamsOpen++;
+    engine->streamsOpened++;
+    JPlatformMutexUnlock( &engine->lock );
+    return;
+}
+
+
+void JAudioEngineStreamClosed( JAudioEngine *engine )
+{
+    JPlatformMutexLock( &engine->lock );
+    engine->streamsOpen--;
+    JPlatformMutexUnlock( &engine->lock );
+    return;
+}
+
+
+static void lockShared( void )
+{
+    while( __atomic_exchange_n( &sharedLock, 1, __ATOMIC_ACQUIRE ) )
+        JPlatformYield();
+    return;
+}
+
+
+static void unlockShared( void )
+{
+    __atomic_store_n( &sharedLock, 0, __ATOMIC_RELEASE );
+    return;
+}
+
+
+/* Initializes PortAudio and records what it reports about the default output device */
+static JAudioEngine* createEngine( void )
+{
+    JAudioEngine        *engine;
+    const PaDeviceInfo  *deviceInfo;
+    unsigned long long  startNs;
+    PaError             err;
+
+    engine = (JAudioEngine*)calloc( 1, sizeof(JAudioEngine) );
+    if( engine == NULL )
+        return NULL;
+    if( JPlatformMutexInit( &engine->lock ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        free( engine );
+        return NULL;
+    }
+
+    startNs = JPlatformGetTimeNs();
+    err = Pa_Initialize();
+    if( err != paNoError )
+    {
+        printf( "  Error: Pa_Initialize\n" );
+        printf( "  Error number: %d\n", err );
+        printf( "  Error message: %s\n", Pa_GetErrorText( err ) );
+        JPlatformMutexDestroy( &engine->lock );
+        free( engine );
+        return NULL;
+    }
+    engine->initNs = JPlatformGetTimeNs() - startNs;
+
+    engine->device = Pa_GetDefaultOutputDevice();
+    if( engine->device != paNoDevice && ( deviceInfo = Pa_GetDeviceInfo( engine->device ) ) != NULL )
+    {
+        strncpy( engine->deviceName, deviceInfo->name != NULL ? deviceInfo->name : "", sizeof(engine->deviceName) - 1 );
+        engine->maxOutputChannels = deviceInfo->maxOutputChannels;
+        engine->defaultSampleRate = deviceInfo->defaultSampleRate;
+        engine->defaultLowOutputLatency = deviceInfo->defaultLowOutputLatency;
+    }
+    else
+        engine->device = paNoDevice;
+
+    return engine;
+}
+
+
+static void destroyEngine( JAudioEngine *engine )
+{
+    Pa_Terminate();
+    JPlatformMutexDestroy( &engine->lock );
+    free( engine );
+    return;
+}
@@ -0,0 +1,95 @@
+/* JAudioEngine.h Header file for the PortAudio context shared by every stream
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JAUDIOENGINE_H_INCLUDED
+#define JAUDIOENGINE_H_INCLUDED
+
+#include "portaudio.h"
+
+#include "JPlatform.h"
+
+#define JENGINE_FORMAT_CACHE_SIZE 16    /* Stream formats remembered as supported or not */
+
+/** Answer of Pa_IsFormatSupported for one format of the default device */
+typedef struct
+{
+    int             channelCount;
+    PaSampleFormat  sampleFormat;
+    double          sampleRate;
+    int             bSupported;
+}
+JEngineFormat;
+
+/** PortAudio, initialized once for the whole process, and what it reported about the
+  * default output device.  Initializing PortAudio enumerates every device, which is
+  * far slower than opening a stream, so each stream and each user of the engine holds
+  * a reference and PortAudio is only terminated when the last one is released.
+  * Applications that create players one after another should hold a reference of
+  * their own for as long as they run.
+  * @see JAudioEngineAcquire
+  */
+typedef struct
+{
+    unsigned        refCount;           /* Guarded by the lock of the shared engine */
+    JMutex          lock;               /* Guards the format cache and the counters */
+
+    PaDeviceIndex   device;             /* Default output device, paNoDevice if none */
+    char            deviceName[128];
+    int             maxOutputChannels;
+    double          defaultSampleRate;
+    PaTime          defaultLowOutputLatency;
+
+    JEngineFormat   formats[JENGINE_FORMAT_CACHE_SIZE];
+    unsigned        formatCount;
+    unsigned        nextFormat;         /* Entry replaced once the cache is full */
+
+    unsigned        streamsOpen;
+    unsigned long   streamsOpened;
+    unsigned long long initNs;          /* Time Pa_Initialize took */
+}
+JAudioEngine;
+
+/** @brief Returns the engine shared by the process, initializing PortAudio if no one
+  * holds it.  JAudioEngineRelease must be called once for every call to
+  * JAudioEngineAcquire.
+  * @return Pointer to the JAudioEngine, returns NULL on failure
+  */
+JAudioEngine* JAudioEngineAcquire( void );
+
+/** @brief Drops a reference to the engine, terminating PortAudio with the last one
+  * @param enginePtr Pointer to a pointer to a JAudioEngine, set to NULL
+  */
+void JAudioEngineRelease( JAudioEngine **enginePtr );
+
+/** @brief Checks whether the default device can play a stream format, asking
+  * PortAudio only the first time each format is checked
+  * @return TRUE if the format is supported
+  */
+int JAudioEngineIsFormatSupported( JAudioEngine *engine, int channelCount,
+                                   PaSampleFormat sampleFormat, double sampleRate );
+
+/** @brief Counts a stream opened on the engine, to be matched by
+  * JAudioEngineStreamClosed.  Called by the PortAudio output backend. */
+void JAudioEngineStreamOpened( JAudioEngine *engine );
+
+/** @brief Counts a stream closed on the engine */
+void JAudioEngineStreamClosed( JAudioEngine *engine );
+
+#endif // JAUDIOENGINE_H_INCLUDED
@@ -0,0 +1,383 @@
+/* JAudioOutput.c Contains the PortAudio and null audio output backends
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef WIN32
+#include <process.h>
+#endif
+
+#include "JAudioOutput.h"
+
+/* Frames per call used by the null backend when the stream leaves it unspecified */
+#define NULL_DEFAULT_FRAMES_PER_BUFFER 256
+
+/** Stream of the PortAudio backend and the engine it was opened on */
+typedef struct
+{
+    PaStream        *stream;
+    JAudioEngine    *engine;
+}
+JPaOutput;
+
+/** State of the null backend's render thread */
+typedef struct
+{
+    JThread     thread;
+    void        *buffer;            /* Buffer the stream callback renders into */
+    double      streamTime;         /* Simulated stream time in seconds */
+    volatile int bRunning;
+}
+JNullOutput;
+
+static PaError paOutputStart( JAudioOutput *output );
+static PaError paOutputStop( JAudioOutput *output );
+static void paOutputClose( JAudioOutput *output );
+static PaError nullOutputStart( JAudioOutput *output );
+static PaError nullOutputStop( JAudioOutput *output );
+static void nullOutputClose( JAudioOutput *output );
+static THREAD_ROUTINE_SIGNATURE nullOutputThread( void *threadArg );
+
+static const JAudioOutputOps paOutputOps = { paOutputStart, paOutputStop, paOutputClose };
+static const JAudioOutputOps nullOutputOps = { nullOutputStart, nullOutputStop, nullOutputClose };
+
+static void printPaError( const char *function, PaError err )
+{
+    printf( "  Error: %s\n", function );
+    printf( "  Error number: %d\n", err );
+    printf( "  Error message: %s\n", Pa_GetErrorText( err ) );
+    return;
+}
+
+
+void JAudioOutputGetDefaultConfig( JAudioOutputConfig *config )
+{
+    config->backend = JOUTPUT_PORTAUDIO;
+    config->nullClock = JNULL_CLOCK_FREERUN;
+    config->nullSampleRate = 0;
+    config->sink = NULL;
+    config->sinkUserData = NULL;
+    return;
+}
+
+
+double JAudioOutputGetDefaultSampleRate( const JAudioOutputConfig *config )
+{
+    JAudioEngine *engine;
+    double sampleRate = 0;
+
+    switch( config->backend )
+    {
+        case JOUTPUT_PORTAUDIO:
+            engine = JAudioEngineAcquire();
+            if( engine == NULL )
+                return 0;
+            sampleRate = engine->defaultSampleRate;
+            JAudioEngineRelease( &engine );
+            break;
+        case JOUTPUT_NULL:
+            sampleRate = config->nullSampleRate;
+            break;
+    }
+    return sampleRate;
+}
+
+
+JAudioOutput* JAudioOutputOpen( const JAudioOutputConfig *config, const JAudioOutputParams *params )
+{
+    JAudioOutput *output = NULL;
+    PaError err;
+
+    output = (JAudioOutput*)malloc( sizeof(JAudioOutput) );
+    if( output == NULL )
+        return NULL;
+    output->config = *config;
+    output->params = *params;
+    output->backendData = NULL;
+
+    switch( config->backend )
+    {
+        case JOUTPUT_PORTAUDIO:
+        {
+            PaStreamParameters outputParameters;
+            JPaOutput *paOutput;
+
+            output->ops = &paOutputOps;
+
+            paOutput = (JPaOutput*)malloc( sizeof(JPaOutput) );
+            if( paOutput == NULL )
+            {
+                free( output );
+                return NULL;
+            }
+
+            /* PortAudio is only initialized by the first stream of the process */
+            paOutput->engine = JAudioEngineAcquire();
+            if( paOutput->engine == NULL )
+            {
+                free( paOutput );
+                free( output );
+                return NULL;
+            }
+
+            outputParameters.device = paOutput->engine->device;
+            if( outputParameters.device == paNoDevice )
+            {
+                printf( "  Error: No default output device\n" );
+                JAudioEngineRelease( &paOutput->engine );
+                free( paOutput );
+                free( output );
+                return NULL;
+            }
+            outputParameters.channelCount = params->channelCount;
+            outputParameters.sampleFormat = params->sampleFormat;
+            outputParameters.suggestedLatency = paOutput->engine->defaultLowOutputLatency;
+            outputParameters.hostApiSpecificStreamInfo = NULL;
+            if( params->fallbackFormats != 0 &&
+                !JAudioEngineIsFormatSupported( paOutput->engine, params->channelCount,
+                                                params->sampleFormat, params->sampleRate ) )
+            {
+                /* Best integer format first, so only as few bits as the device forces
+                 * are lost, then float */
+                static const PaSampleFormat ladder[] = { paInt32, paInt24, paInt16, paFloat32 };
+                int i;
+
+                for( i=0; i<(int)( sizeof(ladder) / sizeof(ladder[0]) ); i++ )
+                {
+                    if( ( params->fallbackFormats & ladder[i] ) != 0 &&
+                        JAudioEngineIsFormatSupported( paOutput->engine, params->channelCount,
+                                                       ladder[i], params->sampleRate ) )
+                    {
+                        outputParameters.sampleFormat = ladder[i];
+                        output->params.sampleFormat = ladder[i];
+                        break;
+                    }
+                }
+            }
+
+            err = Pa_OpenStream(
+                      &paOutput->stream,
+                      NULL, /* no input */
+                      &outputParameters,
+                      params->sampleRate,
+                      params->framesPerBuffer,
+                      paNoFlag,
+                      params->callback,
+                      params->userData );
+            if( err != paNoError )
+            {
+                printPaError( "Pa_OpenStream", err );
+                JAudioEngineRelease( &paOutput->engine );
+                free( paOutput );
+                free( output );
+                return NULL;
+            }
+            JAudioEngineStreamOpened( paOutput->engine );
+            output->backendData = paOutput;
+            break;
+        }
+        case JOUTPUT_NULL:
+        {
+            JNullOutput *nullOutput;
+            unsigned long bytesPerSample;
+
+            output->ops = &nullOutputOps;
+            if( output->params.framesPerBuffer == paFramesPerBufferUnspecified )
+                output->params.framesPerBuffer = NULL_DEFAULT_FRAMES_PER_BUFFER;
+
+            switch( output->params.sampleFormat & ~paNonInterleaved )
+            {
+                case paInt16:   bytesPerSample = 2; break;
+                case paInt24:   bytesPerSample = 3; break;
+                default:        bytesPerSample = 4; break;
+            }
+
+            nullOutput = (JNullOutput*)malloc( sizeof(JNullOutput) );
+            if( nullOutput == NULL )
+            {
+                free( output );
+                return NULL;
+            }
+            nullOutput->buffer = malloc( bytesPerSample * params->channelCount * output->params.framesPerBuffer );
+            if( nullOutput->buffer == NULL )
+            {
+                printf( "  Error using malloc\n" );
+                free( nullOutput );
+                free( output );
+                return NULL;
+            }
+            nullOutput->streamTime = 0.0;
+            nullOutput->bRunning = FALSE;
+            output->backendData = nullOutput;
+            break;
+        }
+        default:
+            printf( "  Error: Unknown output backend %d\n", (int)config->backend );
+            free( output );
+            return NULL;
+    }
+
+    return output;
+}
+
+
+PaError JAudioOutputStart( JAudioOutput *output )
+{
+    return output->ops->start( output );
+}
+
+
+PaError JAudioOutputStop( JAudioOutput *output )
+{
+    return output->ops->stop( output );
+}
+
+
+void JAudioOutputClose( JAudioOutput **outputPtr )
+{
+    JAudioOutput *output = *outputPtr;
+
+    if( output == NULL )
+        return;
+
+    output->ops->close( output );
+    free( output );
+    *outputPtr = NULL;
+
+    return;
+}
+
+
+static PaError paOutputStart( JAudioOutput *output )
+{
+    PaError err = Pa_StartStream( ((JPaOutput*)output->backendData)->stream );
+
+    if( err != paNoError )
+        printPaError( "Pa_StartStream", err );
+    return err;
+}
+
+
+static PaError paOutputStop( JAudioOutput *output )
+{
+    PaError err = Pa_StopStream( ((JPaOutput*)output->backendData)->stream );
+
+    if( err != paNoError )
+        printPaError( "Pa_StopStream", err );
+    return err;
+}
+
+
+static void paOutputClose( JAudioOutput *output )
+{
+    JPaOutput *paOutput = (JPaOutput*)output->backendData;
+
+    Pa_CloseStream( paOutput->stream );
+    JAudioEngineStreamClosed( paOutput->engine );
+    JAudioEngineRelease( &paOutput->engine );
+    free( paOutput );
+    return;
+}
+
+
+static PaError nullOutputStart( JAudioOutput *output )
+{
+    JNullOutput *nullOutput = (JNullOutput*)output->backendData;
+
+    if( nullOutput->bRunning )
+        return paNoError;
+
+    nullOutput->bRunning = TRUE;
+    if( JPlatformThreadCreate( &nullOutput->thread, nullOutputThread, output ) )
+    {
+        printf( "  Error creating null output thread\n" );
+        nullOutput->bRunning = FALSE;
+        return paInsufficientMemory;
+    }
+    return paNoError;
+}
+
+
+static PaError nullOutputStop( JAudioOutput *output )
+{
+    JNullOutput *nullOutput = (JNullOutput*)output->backendData;
+
+    if( nullOutput->bRunning )
+    {
+        nullOutput->bRunning = FALSE;
+        JPlatformThreadJoin( &nullOutput->thread );
+    }
+    return paNoError;
+}
+
+
+static void nullOutputClose( JAudioOutput *output )
+{
+    JNullOutput *nullOutput = (JNullOutput*)output->backendData;
+
+    nullOutputStop( output );
+    free( nullOutput->buffer );
+    free( nullOutput );
+    return;
+}
+
+
+/* Stands in for the audio device: calls the stream callback exactly as PortAudio
+ * would, either back to back or on the period of a simulated clock */
+static THREAD_ROUTINE_SIGNATURE nullOutputThread( void *threadArg )
+{
+    JAudioOutput        *output = (JAudioOutput*)threadArg;
+    JNullOutput         *nullOutput = (JNullOutput*)output->backendData;
+    const JAudioOutputParams *params = &output->params;
+    const unsigned long long periodNs = (unsigned long long)( 1e9 * (double)params->framesPerBuffer / params->sampleRate );
+    unsigned long long  deadline = JPlatformGetTimeNs();
+    PaStreamCallbackTimeInfo timeInfo;
+
+    timeInfo.inputBufferAdcTime = 0;
+
+    while( nullOutput->bRunning )
+    {
+        if( output->config.nullClock == JNULL_CLOCK_REALTIME )
+        {
+            deadline += periodNs;
+            JPlatformSleepUntilNs( deadline );
+        }
+        else if( params->ready != NULL && !params->ready( params->userData ) )
+        {
+            JPlatformYield();
+            continue;
+        }
+
+        timeInfo.currentTime = nullOutput->streamTime;
+        timeInfo.outputBufferDacTime = nullOutput->streamTime;
+        if( params->callback( NULL, nullOutput->buffer, params->framesPerBuffer,
+                              &timeInfo, 0, params->userData ) != paContinue )
+            break;
+        if( output->config.sink != NULL )
+            output->config.sink( nullOutput->buffer, params->framesPerBuffer, output->config.sinkUserData );
+
+        nullOutput->streamTime += (double)params->framesPerBuffer / params->sampleRate;
+    }
+#ifdef WIN32
+    _endthreadex( 0 );
+#endif
+    return 0;
+}
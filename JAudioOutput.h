@@ -0,0 +1,137 @@
+/* JAudioOutput.h Header file for audio output backends
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JAUDIOOUTPUT_H_INCLUDED
+#define JAUDIOOUTPUT_H_INCLUDED
+
+#include "portaudio.h"
+
+#include "JAudioEngine.h"
+#include "JPlatform.h"
+
+/** Which driver an audio output uses */
+typedef enum
+{
+    JOUTPUT_PORTAUDIO,  /* Default output device through PortAudio */
+    JOUTPUT_NULL        /* No device, the callback is driven by a thread of our own */
+}
+JOutputBackendType;
+
+/** How the null backend paces calls to the stream callback */
+typedef enum
+{
+    JNULL_CLOCK_FREERUN,    /* Call as fast as the callback has audio ready */
+    JNULL_CLOCK_REALTIME    /* Call once per buffer period of a simulated clock */
+}
+JNullClockMode;
+
+/** Routine handed every buffer the null backend renders, e.g. to write it to a file
+  * @param frames Interleaved frames in the sample format of the stream
+  * @param frameCount Number of frames in the buffer
+  * @param userData Pointer given in JAudioOutputConfig
+  */
+typedef void (*JOutputSinkCallback)( const void *frames, unsigned long frameCount, void *userData );
+
+/** Routine the null backend uses in JNULL_CLOCK_FREERUN mode to check if the stream
+  * callback can be called without running out of audio
+  * @return TRUE if audio is ready
+  */
+typedef int (*JOutputReadyCallback)( void *userData );
+
+/** Backend selection and backend specific settings */
+typedef struct
+{
+    JOutputBackendType  backend;
+    JNullClockMode      nullClock;
+    double              nullSampleRate; /* Default rate the null backend reports, 0 for none */
+    JOutputSinkCallback sink;           /* Optional, null backend only */
+    void                *sinkUserData;
+}
+JAudioOutputConfig;
+
+/** Format of the stream and the routine that fills it */
+typedef struct
+{
+    int                 channelCount;
+    PaSampleFormat      sampleFormat;
+    PaSampleFormat      fallbackFormats;    /* Formats to try if the device does not
+                                             * support sampleFormat, any of paInt32,
+                                             * paInt24, paInt16 and paFloat32 tried in
+                                             * that order, 0 to fail instead.
+                                             * JAudioOutput.params holds the format
+                                             * the stream was opened with. */
+    double              sampleRate;
+    unsigned long       framesPerBuffer;
+    PaStreamCallback    *callback;
+    JOutputReadyCallback    ready;      /* Optional, see JOutputReadyCallback */
+    void                *userData;      /* Passed to callback and ready */
+}
+JAudioOutputParams;
+
+typedef struct JAudioOutput JAudioOutput;
+
+/** Operations every backend implements */
+typedef struct
+{
+    PaError (*start)( JAudioOutput *output );
+    PaError (*stop)( JAudioOutput *output );
+    void    (*close)( JAudioOutput *output );
+}
+JAudioOutputOps;
+
+/** An open output stream.  Backends keep their own state behind backendData. */
+struct JAudioOutput
+{
+    const JAudioOutputOps   *ops;
+    JAudioOutputConfig      config;
+    JAudioOutputParams      params;
+    void                    *backendData;
+};
+
+/** @brief Fills in a JAudioOutputConfig selecting the PortAudio backend */
+void JAudioOutputGetDefaultConfig( JAudioOutputConfig *config );
+
+/** @brief Returns the default sample rate of the device the backend in config uses
+  * @return Rate in Hz, 0 if the device has no preference or cannot be queried
+  */
+double JAudioOutputGetDefaultSampleRate( const JAudioOutputConfig *config );
+
+/** @brief Opens an output stream on the backend selected in config.  JAudioOutputClose
+  * must be called to free resources allocated by JAudioOutputOpen.
+  * @return Pointer to an open stream, returns NULL on failure
+  */
+JAudioOutput* JAudioOutputOpen( const JAudioOutputConfig *config, const JAudioOutputParams *params );
+
+/** @brief Starts calling the stream callback
+  * @return paNoError on success
+  */
+PaError JAudioOutputStart( JAudioOutput *output );
+
+/** @brief Stops calling the stream callback, returning once the last call finished
+  * @return paNoError on success
+  */
+PaError JAudioOutputStop( JAudioOutput *output );
+
+/** @brief Closes the stream.  The stream must be stopped first.
+  * @param outputPtr Pointer to a pointer to a JAudioOutput, set to NULL after closing
+  */
+void JAudioOutputClose( JAudioOutput **outputPtr );
+
+#endif // JAUDIOOUTPUT_H_INCLUDED
@@ -21,6 +21,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 
 #ifdef WIN32
 #include <windows.h>
@@ -28,6 +30,7 @@
 #else
 #include <pthread.h>
 #include <semaphore.h>
+#include <errno.h>
 #include <time.h>   // timespec
 #endif
 
@@ -41,56 +44,294 @@
 #define SIGNAL_SYNCHRONIZATION_OBJECT sem_post( &audioPlayer->audioBuffer.producerThreadSemaphore );
 #endif
 
-JAudioPlayer* JAudioPlayerCreate( const char *filePath )
+/* Playback that must run smoothly before the buffer is made a block shorter */
+#define DEPTH_WINDOW_NS 10000000000ULL
+/* Refills must take at most this fraction of the time the spare blocks last */
+#define DEPTH_JITTER_MARGIN 2
+/* Longest the null output waits in audioReady for a pause to end */
+#define RESUME_WAIT_MS 100
+
+static JAudioPlayer* createPlayer( const char *filePath, const JByteSource *byteSource,
+                                   const JAudioPlayerConfig *config );
+static void allocAudioBuffer( JCircularBuffer *buffer );
+static void freeAudioBuffer( JCircularBuffer *buffer );
+static int lockAudioBuffer( JCircularBuffer *buffer, int bLock );
+static JMemoryLock lockMemory( JAudioPlayer *audioPlayer, JMemoryLock memoryLock );
+static void unlockMemory( JAudioPlayer *audioPlayer );
+static void setProducerScheduling( JAudioPlayer *audioPlayer );
+static void warnOnce( int *bWarned, const char *message );
+static sf_count_t readBlock( JAudioPlayer *audioPlayer, unsigned char *block, float *floatBlock );
+static void processEffects( JAudioPlayer *audioPlayer, unsigned char *block, float *floatBlock );
+static int switchTrack( JAudioPlayer *audioPlayer, sf_count_t *framesRead );
+static int initTrackQueue( JTrackQueue *queue );
+static void freeTrackQueue( JAudioPlayer *audioPlayer );
+static void clearTrackQueue( JTrackQueue *queue );
+static THREAD_ROUTINE_SIGNATURE trackLoader( void *threadArg );
+static void initTrackIndexer( JAudioPlayer *audioPlayer, const JAudioPlayerConfig *config );
+static void freeTrackIndexer( JAudioPlayer *audioPlayer );
+static void setIndexedTrack( JAudioPlayer *audioPlayer, const JAudioTrack *track, const char *filePath );
+static void prepareIndexedSource( JAudioPlayer *audioPlayer );
+static void stopTrackIndexer( JAudioPlayer *audioPlayer );
+static void swapIndexedSource( JAudioPlayer *audioPlayer );
+static THREAD_ROUTINE_SIGNATURE trackIndexer( void *threadArg );
+static unsigned applySeekRequest( JAudioPlayer *audioPlayer, unsigned generation );
+static sf_count_t seekTrack( JAudioPlayer *audioPlayer, sf_count_t frames, int whence );
+static void publishPosition( JAudioPlayer *audioPlayer, const JPlayPosition *position );
+static void getPlayedPosition( JAudioPlayer *audioPlayer, JPlayPosition *position );
+static void releaseCacheRun( JAudioPlayer *audioPlayer );
+static void seekPastCacheRun( JAudioPlayer *audioPlayer );
+static int audioReady( void *userData );
+static PaError stopOutput( JAudioPlayer *audioPlayer );
+static void renderFadeOut( JAudioPlayer *audioPlayer, unsigned char *out, unsigned long frames );
+static void updateMax( unsigned long long *max, unsigned long long value );
+static void recordCallbackDuration( JCallbackCounters *counters, unsigned long long durationNs );
+static void adaptBufferDepth( JAudioPlayer *audioPlayer, unsigned blocksRefilled, unsigned long long wakeToReadyNs );
+static unsigned getCallbackBlocks( JAudioPlayer *audioPlayer );
+static void updateLowWatermark( JAudioPlayer *audioPlayer );
+static void wakeProducer( JAudioPlayer *audioPlayer );
+
+void JAudioPlayerGetDefaultConfig( JAudioPlayerConfig *config )
+{
+    config->framesPerBlock = DEFAULT_FRAMES_PER_BLOCK;
+    config->framesPerBuffer = paFramesPerBufferUnspecified;
+    config->numBlocks = DEFAULT_NUM_BLOCKS;
+    config->minBlocks = DEFAULT_MIN_BLOCKS;
+    config->maxBlocks = DEFAULT_MAX_BLOCKS;
+    config->refillBlocks = DEFAULT_REFILL_BLOCKS;
+    config->bMapPCM = TRUE;
+    config->bNativeFormat = TRUE;
+    config->bDither = TRUE;
+    config->bDeviceRate = TRUE;
+    config->resampleQuality = JRESAMPLE_MEDIUM;
+    config->cacheBytes = DEFAULT_CACHE_BYTES;
+    config->readAheadSeconds = DEFAULT_READAHEAD_SECONDS;
+    config->bSeekIndex = TRUE;
+    config->bSaveSeekIndex = FALSE;
+    config->producerPolicy = JSCHED_FIFO;
+    config->producerPriority = DEFAULT_PRODUCER_PRIORITY;
+    config->producerCpu = -1;
+    config->memoryLock = JMEMLOCK_BUFFERS;
+    JAudioOutputGetDefaultConfig( &config->output );
+    return;
+}
+
+
+JAudioPlayer* JAudioPlayerCreate( const char *filePath, const JAudioPlayerConfig *config )
+{
+    return createPlayer( filePath, NULL, config );
+}
+
+
+JAudioPlayer* JAudioPlayerCreateFromSource( const JByteSource *byteSource, const JAudioPlayerConfig *config )
+{
+    return createPlayer( NULL, byteSource, config );
+}
+
+
+/* Opens filePath, or byteSource if it is not NULL, and starts the threads of a player
+ * for it */
+static JAudioPlayer* createPlayer( const char *filePath, const JByteSource *byteSource,
+                                   const JAudioPlayerConfig *config )
 {
+    const unsigned long long createNs = JPlatformGetTimeNs();
     JAudioPlayer *audioPlayer = NULL;
-    PaError err;
-    int i;
+    JAudioPlayerConfig defaultConfig;
+    JCircularBuffer *buffer;
+    JAudioOutputParams outputParams;
+    JAudioSource *source;
+    JSampleFormat format;
+    unsigned numBlocks, spanBlocks, i;
+
+    if( config == NULL )
+    {
+        JAudioPlayerGetDefaultConfig( &defaultConfig );
+        config = &defaultConfig;
+    }
+    if( config->framesPerBlock == 0 || config->numBlocks == 0 )
+    {
+        printf( "  Error: Audio buffer needs at least one block of at least one frame\n" );
+        if( byteSource != NULL && byteSource->close != NULL )
+            byteSource->close( byteSource->userData );
+        return NULL;
+    }
 
     audioPlayer = (JAudioPlayer*)malloc( sizeof(JAudioPlayer) );
     if( audioPlayer == NULL )
+    {
+        if( byteSource != NULL && byteSource->close != NULL )
+            byteSource->close( byteSource->userData );
         return NULL;
+    }
 #ifdef WIN32
     audioPlayer->audioBuffer.producerThreadEvent = NULL;
 #endif
 
     audioPlayer->bTimeToQuit = FALSE;
+    audioPlayer->bStoppingOutput = FALSE;
+    audioPlayer->createNs = createNs;
+    JSampleConvertInit();
 
     /* Open soundfile and fill in sfInfo */
-    audioPlayer->sfInfo.format = 0;     /* sndfile API requires format be set to zero before calling sf_open */
-    audioPlayer->sfPtr = sf_open( filePath, SFM_READ, &audioPlayer->sfInfo );
-    if( audioPlayer->sfPtr == NULL )
+    if( byteSource != NULL )
+        source = JAudioSourceOpenStream( byteSource );
+    else
+        source = JAudioSourceOpen( filePath, config->bMapPCM );
+    if( source == NULL )
     {
-        printf( "  Error: Could not open soundfile: %s\n", filePath );
         free( audioPlayer );
         return NULL;
     }
-    audioPlayer->seekerInfo.bChangeSeek = FALSE;
+    /* Nothing can open a pipe a second time, so a stream gets no cache or index */
+    if( !source->bSeekable )
+        filePath = NULL;
+    audioPlayer->sfInfo = source->sfInfo;
+    audioPlayer->seekerInfo.sequence = 0;
+    audioPlayer->seekerInfo.trackId = 0;
+    audioPlayer->seekerInfo.completedGeneration = 0;
+    audioPlayer->seekerInfo.callback = NULL;
+    audioPlayer->seekerInfo.callbackUserData = NULL;
+    audioPlayer->readTrack = 0;
     audioPlayer->seekFrames = 0;
+    audioPlayer->trackFrames = audioPlayer->sfInfo.frames;
+    audioPlayer->bTrackSeekable = source->bSeekable;
+    audioPlayer->framesAfterEnd = 0;
+    audioPlayer->bQueueDrained = FALSE;
+    audioPlayer->resumeFrame = 0;
+    audioPlayer->seekerInfo.seeksRefused = 0;
+    audioPlayer->playingTrack = 0;
+    audioPlayer->positionSequence = 0;
+    memset( &audioPlayer->position, 0, sizeof(JPlayPosition) );
+    audioPlayer->position.trackFrames = audioPlayer->sfInfo.frames;
+    audioPlayer->position.bSeekable = source->bSeekable;
+    audioPlayer->position.sampleRate = audioPlayer->sfInfo.samplerate;
+    audioPlayer->cache = NULL;
+    audioPlayer->cacheRun = NULL;
+    audioPlayer->cacheRunUsed = 0;
+    audioPlayer->bCacheRunSought = FALSE;
+    audioPlayer->seekerInfo.requestTimeNs = 0;
+    memset( &audioPlayer->callbackCounters, 0, sizeof(JCallbackCounters) );
+    memset( &audioPlayer->producerCounters, 0, sizeof(JProducerCounters) );
+    memset( &audioPlayer->ioCounters, 0, sizeof(JReadAheadCounters) );
+    audioPlayer->callbackCounters.fillMin = UINT_MAX;
+
+    /* Set up output stream.  The device is asked for the sample format of the file
+     * first so integer files are not widened to float.  If it does not take that,
+     * the output falls back to the best integer format the device has, dithered by
+     * each track that has more bits, and to float only if it has none. */
+    format = config->bNativeFormat ? source->format : JSAMPLE_FLOAT32;
+    outputParams.channelCount = audioPlayer->sfInfo.channels;
+    outputParams.sampleFormat = JSampleFormatToPa( format );
+    outputParams.fallbackFormats = config->bNativeFormat ? paInt32 | paInt24 | paInt16 | paFloat32 : 0;
+    outputParams.sampleRate = config->bDeviceRate ? JAudioOutputGetDefaultSampleRate( &config->output ) : 0;
+    if( outputParams.sampleRate <= 0 )
+        outputParams.sampleRate = audioPlayer->sfInfo.samplerate;
+    outputParams.framesPerBuffer = config->framesPerBuffer;
+    outputParams.callback = paCallback;
+    outputParams.ready = audioReady;
+    outputParams.userData = audioPlayer;
+
+    audioPlayer->output = JAudioOutputOpen( &config->output, &outputParams );
+    if( audioPlayer->output == NULL )
+    {
+        printf( "  Error: Could not open audio output\n" );
+        JAudioSourceClose( &source );
+        free( audioPlayer );
+        return NULL;
+    }
+    format = JSampleFormatFromPa( audioPlayer->output->params.sampleFormat );
+    audioPlayer->format = format;
 
-    /* Set up audioBuffer */
-    audioPlayer->audioBuffer.head = 0;
-    audioPlayer->audioBuffer.tail = 0;
-    audioPlayer->audioBuffer.availableBlocks = 0;
-    audioPlayer->audioBuffer.num_blocks_in_buffer = MAX_BLOCKS;
-    for( i=0; i<MAX_BLOCKS; i++ )
-        audioPlayer->audioBuffer.blockPtrs[i] = NULL;
+    /* Every track, starting with this one, is converted to the format of the stream */
+    audioPlayer->stream.channels = audioPlayer->sfInfo.channels;
+    audioPlayer->stream.sampleRate = audioPlayer->output->params.sampleRate;
+    audioPlayer->stream.format = format;
+    audioPlayer->stream.framesPerBlock = config->framesPerBlock;
+    audioPlayer->stream.bMapPCM = config->bMapPCM;
+    audioPlayer->stream.bDither = config->bDither;
+    audioPlayer->stream.resampleQuality = config->resampleQuality;
+    audioPlayer->stream.readAheadSeconds = config->readAheadSeconds;
+    audioPlayer->stream.ioCounters = &audioPlayer->ioCounters;
+    audioPlayer->stream.bCancel = &audioPlayer->bTimeToQuit;   /* Destroy must not wait on a pipe */
+    audioPlayer->track = JAudioTrackCreate( source, &audioPlayer->stream, 0 );
+    if( audioPlayer->track == NULL )
+    {
+        JAudioOutputClose( &audioPlayer->output );
+        free( audioPlayer );
+        return NULL;
+    }
+    JDitherInit( &audioPlayer->dither, (unsigned)JPlatformGetTimeNs() );
+
+    /* Set up audioBuffer.  The capacity is rounded up to a power of two so the
+     * free running head and tail counts can be mapped to a block with a mask. */
+    buffer = &audioPlayer->audioBuffer;
+    buffer->head = 0;
+    buffer->tail = 0;
+    buffer->tailOffset = 0;
+    buffer->bWakePending = FALSE;
+    buffer->framesPerBlock = config->framesPerBlock;
+    buffer->bytesPerFrame = JSampleFormatBytes( format ) * audioPlayer->sfInfo.channels;
+    buffer->channels = audioPlayer->sfInfo.channels;
+    buffer->bLocked = FALSE;
+    /* A callback spanning several blocks needs all of them queued, with as many again
+     * for the producer to work on meanwhile.  Every block the depth may grow to is
+     * allocated up front, so adapting it never touches memory the callback reads. */
+    spanBlocks = 2 * ( ( audioPlayer->output->params.framesPerBuffer + buffer->framesPerBlock - 1 ) / buffer->framesPerBlock );
+    buffer->minBlocks = config->minBlocks > spanBlocks ? config->minBlocks : spanBlocks;
+    if( buffer->minBlocks == 0 )
+        buffer->minBlocks = 1;
+    buffer->maxBlocks = config->maxBlocks > buffer->minBlocks ? config->maxBlocks : buffer->minBlocks;
+    numBlocks = config->numBlocks > spanBlocks ? config->numBlocks : spanBlocks;
+    if( numBlocks < buffer->minBlocks )
+        numBlocks = buffer->minBlocks;
+    if( numBlocks > buffer->maxBlocks )
+        numBlocks = buffer->maxBlocks;
+    buffer->num_blocks_in_buffer = numBlocks;
+    memset( &audioPlayer->depthController, 0, sizeof(JDepthController) );
+    audioPlayer->depthController.windowStartNs = JPlatformGetTimeNs();
+    audioPlayer->refillBlocks = config->refillBlocks;
+    updateLowWatermark( audioPlayer );
+    for( buffer->blockCapacity = 1; buffer->blockCapacity < buffer->maxBlocks; buffer->blockCapacity <<= 1 );
+    buffer->blockMask = buffer->blockCapacity - 1;
+
+    allocAudioBuffer( buffer );
+    /* Effects run on float, so an integer stream has its blocks decoded to float for them */
+    audioPlayer->dsp = JDSPChainCreate( audioPlayer->stream.channels, audioPlayer->stream.sampleRate );
+    audioPlayer->dspBuffer = ( format == JSAMPLE_FLOAT32 ) ? NULL :
+                             (float*)malloc( sizeof(float) * buffer->framesPerBlock * audioPlayer->sfInfo.channels );
+    if( buffer->memory == NULL || audioPlayer->dsp == NULL ||
+        ( format != JSAMPLE_FLOAT32 && audioPlayer->dspBuffer == NULL ) )
+    {
+        printf( "  Error using malloc\n" );
+        JDSPChainDestroy( &audioPlayer->dsp );
+        free( audioPlayer->dspBuffer );
+        freeAudioBuffer( buffer );
+        JAudioTrackClose( &audioPlayer->track );
+        JAudioOutputClose( &audioPlayer->output );
+        free( audioPlayer );
+        return NULL;
+    }
+    for( i=0; i<buffer->blockCapacity; i++ )
+        buffer->blockPtrs[i] = buffer->blockMemory + ( i * buffer->framesPerBlock * buffer->bytesPerFrame );
+    audioPlayer->memoryLock = lockMemory( audioPlayer, config->memoryLock );
 
-    for( i=0; i<MAX_BLOCKS; i++ )
+    /* Each cached run covers the buffer twice over.  The producer moves the track to
+     * where the run ends as soon as the ring is full, so the seek and the read-ahead
+     * behind it run while the callback plays from memory.  Playing without the cache
+     * is only slower to seek, so failing to create it is not fatal. */
+    if( config->cacheBytes > 0 )
     {
-        audioPlayer->audioBuffer.blockPtrs[i] = (float*)malloc( sizeof(float) * FRAMES_PER_BLOCK * audioPlayer->sfInfo.channels );
-        if( audioPlayer->audioBuffer.blockPtrs[i] == NULL )
+        audioPlayer->cache = JBlockCacheCreate( &audioPlayer->stream, config->cacheBytes,
+                                                2 * buffer->maxBlocks * buffer->framesPerBlock );
+        if( audioPlayer->cache == NULL )
+            printf( "  Error: Could not create block cache, seeks will be decoded from the file\n" );
+        else
         {
-            printf( "  Error using malloc\n" );
-            for( i=0; i<MAX_BLOCKS; i++ )
-                free( audioPlayer->audioBuffer.blockPtrs[i] );
-            sf_close( audioPlayer->sfPtr );
-            free( audioPlayer );
-            return NULL;
+            JBlockCacheSetTrack( audioPlayer->cache, 0, audioPlayer->track->resampler == NULL ? filePath : NULL );
+            JBlockCacheRequestFill( audioPlayer->cache, 0, 0, TRUE );
         }
     }
 
-    /* Set up signaling object */
+    /* Set up signaling objects */
 #ifdef WIN32
     audioPlayer->audioBuffer.producerThreadEvent = CreateEvent( NULL, /* bManualReset = */ FALSE, /* bInitialState = */ TRUE, NULL );
     if( audioPlayer->audioBuffer.producerThreadEvent == NULL )
@@ -99,59 +340,77 @@ JAudioPlayer* JAudioPlayerCreate( const char *filePath )
 #endif
     {
         printf( "  Error: Cannot create synchronization object\n" );
-        for( i=0; i<MAX_BLOCKS; i++ )
-            free( audioPlayer->audioBuffer.blockPtrs[i] );
-        sf_close( audioPlayer->sfPtr );
+        JBlockCacheDestroy( &audioPlayer->cache );
+        JDSPChainDestroy( &audioPlayer->dsp );
+        free( audioPlayer->dspBuffer );
+        unlockMemory( audioPlayer );
+        freeAudioBuffer( &audioPlayer->audioBuffer );
+        JAudioTrackClose( &audioPlayer->track );
+        JAudioOutputClose( &audioPlayer->output );
         free( audioPlayer );
         return NULL;
     }
-
-    /* Initialize PortAudio and set up output stream */
-    err = Pa_Initialize();
-    if( err != paNoError )
+    if( JPlatformEventInit( &audioPlayer->resumeEvent ) )
     {
-        printf( "  Error: Pa_Initialize\n" );
-        printf( "  Error number: %d\n", err );
-        printf( "  Error message: %s\n", Pa_GetErrorText( err ) );
+        printf( "  Error: Cannot create synchronization object\n" );
         CLOSE_SYNCHRONIZATION_OBJECT
-        for( i=0; i<MAX_BLOCKS; i++ )
-            free( audioPlayer->audioBuffer.blockPtrs[i] );
-        sf_close( audioPlayer->sfPtr );
+        JBlockCacheDestroy( &audioPlayer->cache );
+        JDSPChainDestroy( &audioPlayer->dsp );
+        free( audioPlayer->dspBuffer );
+        unlockMemory( audioPlayer );
+        freeAudioBuffer( &audioPlayer->audioBuffer );
+        JAudioTrackClose( &audioPlayer->track );
+        JAudioOutputClose( &audioPlayer->output );
         free( audioPlayer );
         return NULL;
     }
-
-    audioPlayer->outputParameters.device = Pa_GetDefaultOutputDevice();
-    audioPlayer->outputParameters.channelCount = audioPlayer->sfInfo.channels;
-    audioPlayer->outputParameters.sampleFormat = paFloat32;          /* 32 bit floating point output */
-    audioPlayer->outputParameters.suggestedLatency = Pa_GetDeviceInfo( audioPlayer->outputParameters.device )->defaultLowOutputLatency;
-    audioPlayer->outputParameters.hostApiSpecificStreamInfo = NULL;
-
-    err = Pa_OpenStream(
-              &audioPlayer->stream,
-              NULL, /* no input */
-              &audioPlayer->outputParameters,
-              audioPlayer->sfInfo.samplerate,
-              FRAMES_PER_BLOCK,
-              paNoFlag,
-              paCallback,
-              audioPlayer );
-    if( err != paNoError )
-    {
-        printf( "  Error: Pa_OpenStream\n" );
-        printf( "  Error number: %d\n", err );
-        printf( "  Error message: %s\n", Pa_GetErrorText( err ) );
-        Pa_Terminate();
+    if( initTrackQueue( &audioPlayer->queue ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        JPlatformEventDestroy( &audioPlayer->resumeEvent );
         CLOSE_SYNCHRONIZATION_OBJECT
-        for( i=0; i<MAX_BLOCKS; i++ )
-            free( audioPlayer->audioBuffer.blockPtrs[i] );
-        sf_close( audioPlayer->sfPtr );
+        JBlockCacheDestroy( &audioPlayer->cache );
+        JDSPChainDestroy( &audioPlayer->dsp );
+        free( audioPlayer->dspBuffer );
+        unlockMemory( audioPlayer );
+        freeAudioBuffer( &audioPlayer->audioBuffer );
+        JAudioTrackClose( &audioPlayer->track );
+        JAudioOutputClose( &audioPlayer->output );
         free( audioPlayer );
         return NULL;
     }
     audioPlayer->state = JPLAYER_STOPPED;
 
-    /* Start producer thread */
+    /* Start indexer thread, which makes seeking compressed tracks quicker.  The player
+     * works without it, so failing to start it is not fatal.  The loader hands it the
+     * tracks to index, so it is started first. */
+    initTrackIndexer( audioPlayer, config );
+    setIndexedTrack( audioPlayer, audioPlayer->track, filePath );
+
+    /* Start loader thread, which opens queued tracks ahead of the producer */
+    if( JPlatformThreadCreate( &audioPlayer->queue.loaderThread, trackLoader, audioPlayer ) )
+    {
+        printf( "  Error creating loader thread\n" );
+        freeTrackIndexer( audioPlayer );
+        JPlatformEventDestroy( &audioPlayer->queue.loaderEvent );
+        JPlatformMutexDestroy( &audioPlayer->queue.lock );
+        JPlatformEventDestroy( &audioPlayer->resumeEvent );
+        CLOSE_SYNCHRONIZATION_OBJECT
+        JBlockCacheDestroy( &audioPlayer->cache );
+        JDSPChainDestroy( &audioPlayer->dsp );
+        free( audioPlayer->dspBuffer );
+        unlockMemory( audioPlayer );
+        freeAudioBuffer( &audioPlayer->audioBuffer );
+        JAudioTrackClose( &audioPlayer->track );
+        JAudioOutputClose( &audioPlayer->output );
+        free( audioPlayer );
+        return NULL;
+    }
+
+    /* Start producer thread, which sets up its own scheduling */
+    audioPlayer->producerPolicy = config->producerPolicy;
+    audioPlayer->producerPriority = config->producerPriority;
+    audioPlayer->producerCpu = config->producerCpu;
 #ifdef WIN32
     audioPlayer->handle_Producer = (HANDLE)_beginthreadex( NULL,
                                                            0,
@@ -165,45 +424,107 @@ JAudioPlayer* JAudioPlayerCreate( const char *filePath )
 #endif
     {
         printf( "  Error creating producer thread\n" );
-        Pa_CloseStream( audioPlayer->stream );
-        Pa_Terminate();
+        JAudioOutputClose( &audioPlayer->output );
+        stopTrackIndexer( audioPlayer );
+        freeTrackQueue( audioPlayer );
+        freeTrackIndexer( audioPlayer );
+        JPlatformEventDestroy( &audioPlayer->resumeEvent );
         CLOSE_SYNCHRONIZATION_OBJECT
-        for( i=0; i<MAX_BLOCKS; i++ )
-            free( audioPlayer->audioBuffer.blockPtrs[i] );
-        sf_close( audioPlayer->sfPtr );
+        JBlockCacheDestroy( &audioPlayer->cache );
+        JDSPChainDestroy( &audioPlayer->dsp );
+        free( audioPlayer->dspBuffer );
+        unlockMemory( audioPlayer );
+        freeAudioBuffer( &audioPlayer->audioBuffer );
+        JAudioTrackClose( &audioPlayer->track );
         free( audioPlayer );
         return NULL;
     }
-#ifdef WIN32
-    SetThreadPriority( audioPlayer->handle_Producer, THREAD_PRIORITY_TIME_CRITICAL );
-#endif
 
+    audioPlayer->openNs = JPlatformGetTimeNs() - createNs;
     return audioPlayer;
 }
 
 
-void JAudioPlayerPlay( JAudioPlayer *audioPlayer )
+int JAudioPlayerEnqueue( JAudioPlayer *audioPlayer, const char *filePath )
 {
-    PaError err;
+    JTrackQueue *queue = &audioPlayer->queue;
+    char        *path;
+    unsigned    slot, trackId;
+
+    path = (char*)malloc( strlen( filePath ) + 1 );
+    if( path == NULL )
+        return -1;
+    strcpy( path, filePath );
+
+    JPlatformMutexLock( &queue->lock );
+    if( queue->pathCount == JPLAYER_QUEUE_SIZE )
+    {
+        JPlatformMutexUnlock( &queue->lock );
+        printf( "  Error: Play queue is full\n" );
+        free( path );
+        return -1;
+    }
+    slot = ( queue->pathHead + queue->pathCount ) % JPLAYER_QUEUE_SIZE;
+    trackId = ++queue->lastTrackId;
+    queue->paths[slot] = path;
+    queue->pathIds[slot] = trackId;
+    queue->pathCount++;
+    JPlatformMutexUnlock( &queue->lock );
+
+    JPlatformEventSignal( &queue->loaderEvent );
+    return (int)trackId;
+}
+
+
+void JAudioPlayerClearQueue( JAudioPlayer *audioPlayer )
+{
+    JPlatformMutexLock( &audioPlayer->queue.lock );
+    clearTrackQueue( &audioPlayer->queue );
+    JPlatformMutexUnlock( &audioPlayer->queue.lock );
+    return;
+}
+
+
+unsigned JAudioPlayerGetQueueLength( JAudioPlayer *audioPlayer )
+{
+    JTrackQueue *queue = &audioPlayer->queue;
+    unsigned    length;
+
+    JPlatformMutexLock( &queue->lock );
+    length = queue->pathCount + queue->loading + ( queue->next != NULL );
+    JPlatformMutexUnlock( &queue->lock );
+    return length;
+}
+
+
+unsigned JAudioPlayerGetPlayingTrack( JAudioPlayer *audioPlayer )
+{
+    return JATOMIC_LOAD_RELAXED( &audioPlayer->playingTrack );
+}
+
 
+void JAudioPlayerAddCuePoint( JAudioPlayer *audioPlayer, unsigned trackId, sf_count_t frames )
+{
+    if( audioPlayer->cache != NULL )
+        JBlockCacheRequestFill( audioPlayer->cache, trackId, frames, TRUE );
+    return;
+}
+
+
+void JAudioPlayerPlay( JAudioPlayer *audioPlayer )
+{
     if( audioPlayer == NULL )
         return;
 
     switch( audioPlayer->state )
     {
         case JPLAYER_STOPPED:
-            err = Pa_StartStream( audioPlayer->stream );
-            if( err != paNoError )
-            {
-                printf( "  Error: Pa_StartStream\n" );
-                printf( "  Error number: %d\n", err );
-                printf( "  Error message: %s\n", Pa_GetErrorText( err ) );
-            }
-            else
+            if( JAudioOutputStart( audioPlayer->output ) == paNoError )
                 audioPlayer->state = JPLAYER_PLAYING;
             break;
         case JPLAYER_PAUSED:
             audioPlayer->state = JPLAYER_PLAYING;
+            JPlatformEventSignal( &audioPlayer->resumeEvent );
             break;
         case JPLAYER_PLAYING:
             break;
@@ -232,8 +553,6 @@ void JAudioPlayerPause( JAudioPlayer *audioPlayer )
 
 void JAudioPlayerStop( JAudioPlayer *audioPlayer )
 {
-    PaError err;
-
     if( audioPlayer == NULL )
         return;
 
@@ -243,14 +562,8 @@ void JAudioPlayerStop( JAudioPlayer *audioPlayer )
             break;
         case JPLAYER_PAUSED:
         case JPLAYER_PLAYING:
-            err = Pa_StopStream( audioPlayer->stream );
-            if( err != paNoError )
-            {
-                printf( "  Error: Pa_StopStream\n" );
-                printf( "  Error number: %d\n", err );
-                printf( "  Error message: %s\n", Pa_GetErrorText( err ) );
+            if( stopOutput( audioPlayer ) != paNoError )
                 return;
-            }
             else
                 audioPlayer->state = JPLAYER_STOPPED;
 
@@ -261,18 +574,300 @@ void JAudioPlayerStop( JAudioPlayer *audioPlayer )
 }
 
 
-inline void JAudioPlayerSeek( JAudioPlayer *audioPlayer, sf_count_t frames, int whence )
+unsigned JAudioPlayerSeekAsync( JAudioPlayer *audioPlayer, sf_count_t frames, int whence )
 {
-    audioPlayer->seekerInfo.frames = frames;
-    audioPlayer->seekerInfo.whence = whence;
+    JChangeSeekInfo *seekerInfo = &audioPlayer->seekerInfo;
+    JPlayPosition   played;
+    unsigned sequence;
+
+    /* Take the write side of the sequence lock by making the sequence odd.  This
+     * only contends with other control threads issuing seeks at the same moment. */
+    do
+    {
+        sequence = JATOMIC_LOAD_RELAXED( &seekerInfo->sequence ) & ~1u;
+    }
+    while( !__atomic_compare_exchange_n( &seekerInfo->sequence, &sequence, sequence + 1,
+                                         /* weak = */ TRUE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) );
+
+    /* Requests are made absolute, within the track being heard, while the lock is
+     * held.  The producer's cursor and track are ahead by the blocks queued, so a
+     * relative request is taken from the block being heard, or from the target of the
+     * latest request if that has not been heard yet, as it would otherwise be lost
+     * when this one supersedes it.  The position stays on the track heard until then. */
+    getPlayedPosition( audioPlayer, &played );
+    if( whence == SEEK_CUR )
+    {
+        frames += ( played.generation != sequence >> 1 ) ? seekerInfo->frames : played.frame;
+        whence = SEEK_SET;
+    }
+    else if( whence == SEEK_END && played.bSeekable )
+    {
+        frames += played.trackFrames;
+        whence = SEEK_SET;
+    }
+
+    /* A target past either end of the track would only fail once the callback had
+     * dropped the blocks queued, so it is clamped to the track */
+    if( whence == SEEK_SET && played.bSeekable )
+    {
+        if( played.trackFrames != SF_COUNT_MAX && frames > played.trackFrames )
+            frames = played.trackFrames;
+        if( frames < 0 )
+            frames = 0;
+    }
+
+    /* Refused here, a request that could never be followed does not make the callback
+     * drop the blocks already queued.  Once the producer has moved on to the next
+     * track the one heard is closed, and a stream cannot go back. */
+    if( played.track != JATOMIC_LOAD_RELAXED( &audioPlayer->readTrack ) ||
+        ( !played.bSeekable && ( whence == SEEK_END || frames < JATOMIC_LOAD_RELAXED( &audioPlayer->seekFrames ) ) ) )
+    {
+        JATOMIC_STORE_RELEASE( &seekerInfo->sequence, sequence );
+        JATOMIC_ADD_RELAXED( &seekerInfo->seeksRefused, 1 );
+        return sequence >> 1;
+    }
+
+    JATOMIC_STORE_RELAXED( &seekerInfo->requestTimeNs, JPlatformGetTimeNs() );
+    JATOMIC_STORE_RELAXED( &seekerInfo->trackId, played.track );
+    JATOMIC_STORE_RELAXED( &seekerInfo->frames, frames );
+    JATOMIC_STORE_RELAXED( &seekerInfo->whence, whence );
+    JATOMIC_STORE_RELEASE( &seekerInfo->sequence, sequence + 2 );
 
-    audioPlayer->seekerInfo.bChangeSeek = TRUE;
     SIGNAL_SYNCHRONIZATION_OBJECT
 
-    /* Wait for producer thread to signal seek cursor has been changed in audio
-     * file by setting changeSeek back to FALSE */
-    while( audioPlayer->seekerInfo.bChangeSeek );
+    return ( sequence + 2 ) >> 1;
+}
+
+
+int JAudioPlayerSeekIsComplete( JAudioPlayer *audioPlayer, unsigned seekId )
+{
+    unsigned completed = JATOMIC_LOAD_ACQUIRE( &audioPlayer->seekerInfo.completedGeneration );
+
+    return (int)( completed - seekId ) >= 0;
+}
+
+
+void JAudioPlayerSetSeekCallback( JAudioPlayer *audioPlayer, JSeekCompleteCallback callback, void *userData )
+{
+    audioPlayer->seekerInfo.callbackUserData = userData;
+    JATOMIC_STORE_RELEASE( &audioPlayer->seekerInfo.callback, callback );
+    return;
+}
+
+
+void JAudioPlayerGetPosition( JAudioPlayer *audioPlayer, JPlayPosition *position )
+{
+    JChangeSeekInfo *seekerInfo = &audioPlayer->seekerInfo;
+    sf_count_t  frames;
+    unsigned    sequence;
+
+    getPlayedPosition( audioPlayer, position );
+
+    /* Blocks from before the latest request are about to be dropped, so report where
+     * it goes instead */
+    do
+    {
+        while( ( sequence = JATOMIC_LOAD_ACQUIRE( &seekerInfo->sequence ) ) & 1u )
+            JPlatformYield();
+        frames = JATOMIC_LOAD_RELAXED( &seekerInfo->frames );
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    }
+    while( JATOMIC_LOAD_RELAXED( &seekerInfo->sequence ) != sequence );
+    if( position->generation != sequence >> 1 )
+    {
+        position->frame = frames;
+        position->generation = sequence >> 1;
+        position->bEnded = FALSE;
+    }
+    return;
+}
+
+
+void JAudioPlayerSeek( JAudioPlayer *audioPlayer, sf_count_t frames, int whence )
+{
+    JAudioPlayerSeekAsync( audioPlayer, frames, whence );
+    return;
+}
+
+
+void JAudioPlayerGetStats( JAudioPlayer *audioPlayer, JAudioPlayerStats *stats )
+{
+    const JCallbackCounters *callbackCounters = &audioPlayer->callbackCounters;
+    const JProducerCounters *producerCounters = &audioPlayer->producerCounters;
+    unsigned long long total, startNs, elapsedNs;
+    unsigned long count;
+    int i;
+
+    stats->callbacks = count = JATOMIC_LOAD_RELAXED( &callbackCounters->callbacks );
+    stats->underruns = JATOMIC_LOAD_RELAXED( &callbackCounters->underruns );
+    stats->outputUnderflows = JATOMIC_LOAD_RELAXED( &callbackCounters->outputUnderflows );
+    stats->outputOverflows = JATOMIC_LOAD_RELAXED( &callbackCounters->outputOverflows );
+    for( i=0; i<JSTATS_HISTOGRAM_BUCKETS; i++ )
+        stats->callbackHistogram[i] = JATOMIC_LOAD_RELAXED( &callbackCounters->histogram[i] );
+    total = JATOMIC_LOAD_RELAXED( &callbackCounters->callbackNsTotal );
+    stats->callbackUsAverage = count ? total / 1e3 / count : 0.0;
+    stats->callbackUsMax = JATOMIC_LOAD_RELAXED( &callbackCounters->callbackNsMax ) / 1e3;
+    stats->fillMin = count ? JATOMIC_LOAD_RELAXED( &callbackCounters->fillMin ) : 0;
+    total = JATOMIC_LOAD_RELAXED( &callbackCounters->fillTotal );
+    stats->fillAverage = count ? (double)total / count : 0.0;
+    stats->nearEmpty = JATOMIC_LOAD_RELAXED( &callbackCounters->nearEmpty );
+    stats->bufferBlocks = JATOMIC_LOAD_RELAXED( &audioPlayer->audioBuffer.num_blocks_in_buffer );
+    stats->minBlocks = audioPlayer->audioBuffer.minBlocks;
+    stats->maxBlocks = audioPlayer->audioBuffer.maxBlocks;
+
+    stats->seeks = count = JATOMIC_LOAD_RELAXED( &callbackCounters->seeks );
+    stats->seekMsLast = JATOMIC_LOAD_RELAXED( &callbackCounters->seekNsLast ) / 1e6;
+    total = JATOMIC_LOAD_RELAXED( &callbackCounters->seekNsTotal );
+    stats->seekMsAverage = count ? total / 1e6 / count : 0.0;
+    stats->seekMsMax = JATOMIC_LOAD_RELAXED( &callbackCounters->seekNsMax ) / 1e6;
+    stats->seeksRefused = JATOMIC_LOAD_RELAXED( &audioPlayer->seekerInfo.seeksRefused );
+
+    stats->openMs = audioPlayer->openNs / 1e6;
+    total = JATOMIC_LOAD_RELAXED( &callbackCounters->firstAudioNs );
+    stats->firstAudioMs = total != 0 ? ( total - audioPlayer->createNs ) / 1e6 : 0.0;
+
+    stats->producerWakeups = JATOMIC_LOAD_RELAXED( &producerCounters->wakeups );
+    stats->producerSignals = JATOMIC_LOAD_RELAXED( &callbackCounters->producerSignals );
+    stats->producerTimeouts = JATOMIC_LOAD_RELAXED( &producerCounters->timeouts );
+    stats->overruns = JATOMIC_LOAD_RELAXED( &producerCounters->overruns );
+    startNs = JATOMIC_LOAD_RELAXED( &producerCounters->startNs );
+    elapsedNs = startNs != 0 ? JPlatformGetTimeNs() - startNs : 0;
+    stats->wakeupsPerSecond = elapsedNs ? stats->producerWakeups / ( elapsedNs / 1e9 ) : 0.0;
+    stats->producerIdlePercent = elapsedNs ? 100.0 * JATOMIC_LOAD_RELAXED( &producerCounters->sleepNsTotal ) / elapsedNs : 0.0;
+    stats->producerCpuPercent = elapsedNs ? 100.0 * JATOMIC_LOAD_RELAXED( &producerCounters->cpuNs ) / elapsedNs : 0.0;
+    stats->lowWatermark = JATOMIC_LOAD_RELAXED( &audioPlayer->audioBuffer.lowWatermark );
+    stats->framesDecoded = JATOMIC_LOAD_RELAXED( &producerCounters->framesDecoded );
+    stats->blocksDecoded = count = JATOMIC_LOAD_RELAXED( &producerCounters->blocksDecoded );
+    total = JATOMIC_LOAD_RELAXED( &producerCounters->readNsTotal );
+    stats->readUsAverage = count ? total / 1e3 / count : 0.0;
+    stats->readUsMax = JATOMIC_LOAD_RELAXED( &producerCounters->readNsMax ) / 1e3;
+    total -= JATOMIC_LOAD_RELAXED( &producerCounters->stallNsTotal );
+    stats->decodeUsAverage = count ? total / 1e3 / count : 0.0;
+    count = JATOMIC_LOAD_RELAXED( &producerCounters->refills );
+    stats->blocksPerRefill = count ? (double)stats->blocksDecoded / count : 0.0;
+    total = JATOMIC_LOAD_RELAXED( &producerCounters->wakeToReadyNsTotal );
+    stats->wakeToReadyUsAverage = count ? total / 1e3 / count : 0.0;
+    stats->wakeToReadyUsMax = JATOMIC_LOAD_RELAXED( &producerCounters->wakeToReadyNsMax ) / 1e3;
+    stats->trackSwitches = JATOMIC_LOAD_RELAXED( &producerCounters->trackSwitches );
+    stats->trackGapBlocks = JATOMIC_LOAD_RELAXED( &producerCounters->trackGapBlocks );
+    stats->depthGrows = JATOMIC_LOAD_RELAXED( &producerCounters->depthGrows );
+    stats->depthShrinks = JATOMIC_LOAD_RELAXED( &producerCounters->depthShrinks );
+
+    if( audioPlayer->cache != NULL )
+    {
+        JBlockCacheStats cacheStats;
+
+        JBlockCacheGetStats( audioPlayer->cache, &cacheStats );
+        stats->cacheHits = cacheStats.hits;
+        stats->cacheMisses = cacheStats.misses;
+        stats->cacheEntries = cacheStats.entries;
+        stats->cacheBytes = cacheStats.bytes;
+    }
+    else
+    {
+        stats->cacheHits = 0;
+        stats->cacheMisses = 0;
+        stats->cacheEntries = 0;
+        stats->cacheBytes = 0;
+    }
+
+    stats->ioBytesRead = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.bytesRead );
+    stats->ioReads = count = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.reads );
+    total = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.readNsTotal );
+    stats->ioReadUsAverage = count ? total / 1e3 / count : 0.0;
+    stats->ioReadUsMax = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.readNsMax ) / 1e3;
+    stats->ioStalls = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.stalls );
+    stats->ioStallMsTotal = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.stallNsTotal ) / 1e6;
+    stats->ioStallMsMax = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.stallNsMax ) / 1e6;
+    stats->ioRefetches = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.refetches );
+
+    stats->dspStageCount = JDSPChainGetStats( audioPlayer->dsp, stats->dspStages );
+    stats->dspUsAverage = 0.0;
+    stats->dspCorePercent = 0.0;
+    for( i=0; i<(int)stats->dspStageCount; i++ )
+    {
+        /* Bypassed stages count for the blocks they did process */
+        stats->dspUsAverage += stats->blocksDecoded ?
+                               stats->dspStages[i].usAverage * stats->dspStages[i].blocks / stats->blocksDecoded : 0.0;
+        stats->dspCorePercent += stats->dspStages[i].corePercent;
+    }
+
+    stats->producerPolicy = JATOMIC_LOAD_ACQUIRE( &audioPlayer->producerPolicy );
+    stats->producerPriority = audioPlayer->producerPriority;
+    stats->producerCpu = audioPlayer->producerCpu;
+    stats->memoryLock = audioPlayer->memoryLock;
+
+    return;
+}
+
+
+void JAudioPlayerPrintStats( const JAudioPlayerStats *stats, FILE *stream )
+{
+    int i;
+
+    fprintf( stream, "  Callback: %lu calls, %.1f us avg, %.1f us max, %lu underruns, "
+                     "%lu output underflows, %lu output overflows\n",
+             stats->callbacks, stats->callbackUsAverage, stats->callbackUsMax, stats->underruns,
+             stats->outputUnderflows, stats->outputOverflows );
+    fprintf( stream, "  Callback duration histogram (us):" );
+    for( i=0; i<JSTATS_HISTOGRAM_BUCKETS; i++ )
+    {
+        if( stats->callbackHistogram[i] == 0 )
+            continue;
+        if( i == 0 )
+            fprintf( stream, " <1:%lu", stats->callbackHistogram[i] );
+        else if( i == JSTATS_HISTOGRAM_BUCKETS - 1 )
+            fprintf( stream, " >=%u:%lu", 1u << ( i - 1 ), stats->callbackHistogram[i] );
+        else
+            fprintf( stream, " %u-%u:%lu", 1u << ( i - 1 ), 1u << i, stats->callbackHistogram[i] );
+    }
+    fprintf( stream, "\n  Buffer fill: %u blocks min, %.2f blocks avg, %lu near empty\n",
+             stats->fillMin, stats->fillAverage, stats->nearEmpty );
+    fprintf( stream, "  Buffer depth: %u blocks, between %u and %u, %lu grows, %lu shrinks\n",
+             stats->bufferBlocks, stats->minBlocks, stats->maxBlocks, stats->depthGrows, stats->depthShrinks );
+    fprintf( stream, "  Producer: %lu wakeups, %lu overruns, %llu frames in %lu blocks, "
+                     "read %.1f us avg %.1f us max, decode %.1f us avg, wake to ready %.1f us avg %.1f us max\n",
+             stats->producerWakeups, stats->overruns, stats->framesDecoded, stats->blocksDecoded,
+             stats->readUsAverage, stats->readUsMax, stats->decodeUsAverage,
+             stats->wakeToReadyUsAverage, stats->wakeToReadyUsMax );
+    fprintf( stream, "  Wakeups: %.1f per second, %lu signalled by the callback at %u blocks, %lu timed out, "
+                     "%.2f blocks per refill, %.1f%% idle, %.2f%% CPU\n",
+             stats->wakeupsPerSecond, stats->producerSignals, stats->lowWatermark, stats->producerTimeouts,
+             stats->blocksPerRefill, stats->producerIdlePercent, stats->producerCpuPercent );
+    fprintf( stream, "  Seek: %lu seeks, %.2f ms last, %.2f ms avg, %.2f ms max, %lu refused\n",
+             stats->seeks, stats->seekMsLast, stats->seekMsAverage, stats->seekMsMax, stats->seeksRefused );
+    fprintf( stream, "  Startup: opened in %.2f ms, first audio after %.2f ms\n",
+             stats->openMs, stats->firstAudioMs );
+    fprintf( stream, "  Tracks: %lu switches, %lu gap blocks\n", stats->trackSwitches, stats->trackGapBlocks );
+    fprintf( stream, "  Cache: %lu hits, %lu misses, %u runs in %.1f MB\n",
+             stats->cacheHits, stats->cacheMisses, stats->cacheEntries, stats->cacheBytes / 1048576.0 );
+    fprintf( stream, "  Read-ahead: %.1f MB in %lu reads, %.1f us avg %.1f us max, "
+                     "%lu stalls, %.2f ms stalled, %.2f ms max, %lu refetches\n",
+             stats->ioBytesRead / 1048576.0, stats->ioReads, stats->ioReadUsAverage, stats->ioReadUsMax,
+             stats->ioStalls, stats->ioStallMsTotal, stats->ioStallMsMax, stats->ioRefetches );
+    if( stats->dspStageCount > 0 )
+    {
+        fprintf( stream, "  Effects: %u stages, %.1f us per block, %.3f%% of a core\n",
+                 stats->dspStageCount, stats->dspUsAverage, stats->dspCorePercent );
+        for( i=0; i<(int)stats->dspStageCount; i++ )
+        {
+            const JDSPStageStats *stage = &stats->dspStages[i];
 
+            fprintf( stream, "    %u %s%s: %lu blocks, %.2f us avg %.2f us max, %.3f%% of a core\n",
+                     (unsigned)i, JDSPStageTypeName( stage->type ), stage->bBypass ? " (bypassed)" : "",
+                     stage->blocks, stage->usAverage, stage->usMax, stage->corePercent );
+        }
+    }
+    fprintf( stream, "  Scheduling: producer %s",
+             stats->producerPolicy == JSCHED_FIFO ? "SCHED_FIFO" :
+             stats->producerPolicy == JSCHED_RR ? "SCHED_RR" : "normal" );
+    if( stats->producerPolicy != JSCHED_NORMAL )
+        fprintf( stream, " priority %d", stats->producerPriority );
+    if( stats->producerCpu >= 0 )
+        fprintf( stream, " on CPU %d", stats->producerCpu );
+    fprintf( stream, ", memory locked: %s\n",
+             stats->memoryLock == JMEMLOCK_ALL ? "all" :
+             stats->memoryLock == JMEMLOCK_BUFFERS ? "buffers" : "none" );
     return;
 }
 
@@ -280,7 +875,6 @@ inline void JAudioPlayerSeek( JAudioPlayer *audioPlayer, sf_count_t frames, int
 void JAudioPlayerDestroy( JAudioPlayer **audioPlayerPtr )
 {
     JAudioPlayer *audioPlayer = *audioPlayerPtr;
-    int i;
 
     if( audioPlayer == NULL )
         return;
@@ -289,21 +883,29 @@ void JAudioPlayerDestroy( JAudioPlayer **audioPlayerPtr )
     {
         case JPLAYER_PLAYING:   /* Fall through all cases */
         case JPLAYER_PAUSED:
-            Pa_StopStream( audioPlayer->stream );
+            stopOutput( audioPlayer );
         case JPLAYER_STOPPED:
-            Pa_CloseStream( audioPlayer->stream );
+            JAudioOutputClose( &audioPlayer->output );
             audioPlayer->bTimeToQuit = TRUE;
+            SIGNAL_SYNCHRONIZATION_OBJECT
 #ifdef WIN32
             WaitForSingleObject( audioPlayer->handle_Producer, 10000 );
-            CloseHandle( audioPlayer->handle_Produer );
+            CloseHandle( audioPlayer->handle_Producer );
 #else
             pthread_join( audioPlayer->threadID_Producer, NULL );
 #endif
-            Pa_Terminate();
+            stopTrackIndexer( audioPlayer );
+            freeTrackQueue( audioPlayer );
+            releaseCacheRun( audioPlayer );
+            JBlockCacheDestroy( &audioPlayer->cache );
+            freeTrackIndexer( audioPlayer );
+            JPlatformEventDestroy( &audioPlayer->resumeEvent );
             CLOSE_SYNCHRONIZATION_OBJECT
-            for( i=0; i<MAX_BLOCKS; i++ )
-                free( audioPlayer->audioBuffer.blockPtrs[i] );
-            sf_close( audioPlayer->sfPtr );
+            JDSPChainDestroy( &audioPlayer->dsp );
+            free( audioPlayer->dspBuffer );
+            unlockMemory( audioPlayer );
+            freeAudioBuffer( &audioPlayer->audioBuffer );
+            JAudioTrackClose( &audioPlayer->track );
             free( audioPlayer );
             *audioPlayerPtr = NULL;
     }
@@ -319,39 +921,118 @@ int paCallback( const void                      *input,
                 void                            *userData )
 {
     (void)input;        /* Prevent unused variable warning */
-    float *out = (float*)output;
+    (void)timeInfo;
+    unsigned char *out = (unsigned char*)output;
     JAudioPlayer *audioPlayer = (JAudioPlayer*)userData;
 
     JCircularBuffer *buffer = &audioPlayer->audioBuffer;
 
     const int   channels = audioPlayer->sfInfo.channels;
-    unsigned    i, j;
+    unsigned long framesLeft = frameCount;
+
+    JCallbackCounters *counters = &audioPlayer->callbackCounters;
+    const unsigned long long startNs = JPlatformGetTimeNs();
+    const unsigned generation = JATOMIC_LOAD_ACQUIRE( &audioPlayer->seekerInfo.sequence ) >> 1;
+    const unsigned head = JATOMIC_LOAD_ACQUIRE( &buffer->head );
+    unsigned    tail = buffer->tail;
+    int         bSettled;
+
+    if( statusFlags & paOutputUnderflow )
+        JATOMIC_ADD_SINGLE_WRITER( &counters->outputUnderflows, 1 );
+    if( statusFlags & paOutputOverflow )
+        JATOMIC_ADD_SINGLE_WRITER( &counters->outputOverflows, 1 );
+
+    /* Drop blocks decoded before the latest seek request */
+    if( head != tail && buffer->blockGeneration[tail & buffer->blockMask] != generation )
+    {
+        while( tail != head && buffer->blockGeneration[tail & buffer->blockMask] != generation )
+            tail++;
+        buffer->tailOffset = 0;
+        JATOMIC_STORE_RELEASE( &buffer->tail, tail );
+    }
+
+    if( head - tail < counters->fillMin )
+        JATOMIC_STORE_RELAXED( &counters->fillMin, head - tail );
+    JATOMIC_ADD_SINGLE_WRITER( &counters->fillTotal, head - tail );
+    if( frameCount > counters->framesPerCallbackMax )
+        JATOMIC_STORE_RELAXED( &counters->framesPerCallbackMax, frameCount );
+
+    /* Until the first block of the latest seek has been played the buffer is still
+     * refilling, so running short is expected and is not counted.  Taken before the
+     * copy, which moves playedGeneration on. */
+    bSettled = ( generation == counters->playedGeneration );
+
+    /* Enough for this call but not a block more means the producer only just kept
+     * up */
+    if( audioPlayer->state != JPLAYER_PAUSED && bSettled &&
+        (unsigned long)( head - tail ) * buffer->framesPerBlock - buffer->tailOffset >= frameCount &&
+        (unsigned long)( head - tail ) * buffer->framesPerBlock - buffer->tailOffset < frameCount + buffer->framesPerBlock )
+        JATOMIC_ADD_SINGLE_WRITER( &counters->nearEmpty, 1 );
 
     if( audioPlayer->state == JPLAYER_PAUSED )
     {
-        for( i=0; i<FRAMES_PER_BLOCK; i++ )
-        {
-            for( j=0; j<channels; j++ )
-                *out++ = 0;
-        }
+        memset( out, 0, frameCount * buffer->bytesPerFrame );
+        framesLeft = 0;
     }
-    else
+
+    /* frameCount is whatever the host asks for, so copy from as many blocks as it
+     * spans, starting part way into the block at tail if the last call ended there */
+    while( framesLeft > 0 && tail != head )
     {
-        while( buffer->availableBlocks < 1 );
+        const unsigned char *block = buffer->blockPtrs[tail & buffer->blockMask] +
+                                     (size_t)buffer->tailOffset * buffer->bytesPerFrame;
+        unsigned long frames = buffer->framesPerBlock - buffer->tailOffset;
 
-        for( i=0; i<FRAMES_PER_BLOCK; i++ )
+        if( frames > framesLeft )
+            frames = framesLeft;
+
+        if( buffer->tailOffset == 0 )
+            publishPosition( audioPlayer, &buffer->blockPosition[tail & buffer->blockMask] );
+        if( counters->firstAudioNs == 0 )
+            JATOMIC_STORE_RELAXED( &counters->firstAudioNs, startNs );
+        if( buffer->tailOffset == 0 && generation != counters->playedGeneration )  /* First block after a seek */
         {
-            for( j=0; j<channels; j++ )
-            {
-                *out++ = *( buffer->blockPtrs[buffer->tail] + (i * channels) + j );
-            }
+            const unsigned long long seekNs = startNs - JATOMIC_LOAD_RELAXED( &audioPlayer->seekerInfo.requestTimeNs );
+
+            counters->playedGeneration = generation;
+            JATOMIC_ADD_SINGLE_WRITER( &counters->seeks, 1 );
+            JATOMIC_STORE_RELAXED( &counters->seekNsLast, seekNs );
+            JATOMIC_ADD_SINGLE_WRITER( &counters->seekNsTotal, seekNs );
+            updateMax( &counters->seekNsMax, seekNs );
+        }
+
+        /* Blocks are laid out exactly as the stream expects, one copy hands them over */
+        memcpy( out, block, frames * buffer->bytesPerFrame );
+        out += frames * buffer->bytesPerFrame;
+        framesLeft -= frames;
+        buffer->tailOffset += frames;
+        if( buffer->tailOffset == buffer->framesPerBlock )
+        {
+            buffer->tailOffset = 0;
+            JATOMIC_STORE_RELEASE( &buffer->tail, ++tail );     /* Hand the block back to the producer */
         }
-        __sync_fetch_and_sub( &buffer->availableBlocks, 1 );
-        if( ++(buffer->tail) >= buffer->num_blocks_in_buffer )
-            buffer->tail = 0;
-        SIGNAL_SYNCHRONIZATION_OBJECT
+        if( framesLeft == 0 )
+            JConvertToFloat( out - buffer->bytesPerFrame, audioPlayer->format, buffer->lastFrame, channels );
+    }
+
+    if( framesLeft > 0 )
+    {
+        /* Producer has fallen behind.  Never wait for it here, instead ramp the
+         * last frame that was output down to silence so the dropout does not click */
+        if( out != (unsigned char*)output )
+            JConvertToFloat( out - buffer->bytesPerFrame, audioPlayer->format, buffer->lastFrame, channels );
+        renderFadeOut( audioPlayer, out, framesLeft );
+        if( bSettled )
+            JATOMIC_ADD_SINGLE_WRITER( &counters->underruns, 1 );
     }
 
+    /* Blocks handed back are only refilled once the queue has drained to the low
+     * watermark, so the producer wakes once for a batch rather than for each block */
+    if( head - tail <= JATOMIC_LOAD_RELAXED( &buffer->lowWatermark ) )
+        wakeProducer( audioPlayer );
+
+    recordCallbackDuration( counters, JPlatformGetTimeNs() - startNs );
+
     return paContinue;      /* return 0 */
 }
 
@@ -361,57 +1042,1165 @@ THREAD_ROUTINE_SIGNATURE audioBufferProducer( void *threadArg )
     JAudioPlayer    *audioPlayer = (JAudioPlayer*)threadArg;
     JCircularBuffer *buffer = &audioPlayer->audioBuffer;
     JChangeSeekInfo *seekerInfo = &audioPlayer->seekerInfo;
-    const int       channels = audioPlayer->sfInfo.channels;
 
+    JProducerCounters *counters = &audioPlayer->producerCounters;
     sf_count_t      framesReadFromFile;
-    int             blocksNeeded, n;
+    JPlayPosition   *position;
+    float           *floatBlock;
+    int             blocksNeeded, n, bSignalled;
+    unsigned        generation = 0, wokenGeneration;
+    unsigned long long sleepNs, wakeNs, readNs, stallNs, startCpuNs;
+
+    setProducerScheduling( audioPlayer );
+    startCpuNs = JPlatformThreadGetCpuTimeNs();
+    JATOMIC_STORE_RELAXED( &counters->startNs, JPlatformGetTimeNs() );
 
     while( !audioPlayer->bTimeToQuit )
     {
+        sleepNs = JPlatformGetTimeNs();
 #ifdef WIN32
-        WaitForSingleObject( buffer->producerThreadEvent, 1000 );
+        bSignalled = WaitForSingleObject( buffer->producerThreadEvent, 1000 ) == WAIT_OBJECT_0;
 #else
-        static struct timespec waitTime = { 1, 0 };
-        sem_timedwait( &buffer->producerThreadSemaphore, &waitTime );
+        struct timespec waitTime;
+
+        /* sem_timedwait takes an absolute deadline.  A deadline in the past returns
+         * at once, which would spin the thread, and a real-time one would starve the
+         * rest of the system. */
+        clock_gettime( CLOCK_REALTIME, &waitTime );
+        waitTime.tv_sec += 1;
+        while( !( bSignalled = sem_timedwait( &buffer->producerThreadSemaphore, &waitTime ) == 0 ) &&
+               errno == EINTR );
 #endif
+        wakeNs = JPlatformGetTimeNs();
+        JATOMIC_ADD_SINGLE_WRITER( &counters->wakeups, 1 );
+        JATOMIC_ADD_SINGLE_WRITER( &counters->sleepNsTotal, wakeNs - sleepNs );
+        if( !bSignalled )
+            JATOMIC_ADD_SINGLE_WRITER( &counters->timeouts, 1 );
 
-        /* Reset seek cursor in audio file if needed */
-        if( seekerInfo->bChangeSeek )
-        {
-            sf_count_t frameOffset;
-            if( ( frameOffset = sf_seek( audioPlayer->sfPtr, seekerInfo->frames, seekerInfo->whence ) ) >= 0 )
-                audioPlayer->seekFrames = frameOffset;
+        /* Let the callback wake us again before looking at tail.  The fence pairs
+         * with the one in wakeProducer, so a block the callback hands back after
+         * this is either seen below or wakes us once more. */
+        JATOMIC_STORE_RELAXED( &buffer->bWakePending, FALSE );
+        JATOMIC_FENCE();
 
-            seekerInfo->bChangeSeek = FALSE;
-        }
+        /* Reset seek cursor in audio file if a new request has been published.  This
+         * is checked again before each block so a request arriving mid-fill is seen. */
+        wokenGeneration = generation;
+        if( JATOMIC_LOAD_ACQUIRE( &seekerInfo->sequence ) >> 1 != generation )
+            generation = applySeekRequest( audioPlayer, generation );
 
-        blocksNeeded = buffer->num_blocks_in_buffer - buffer->availableBlocks;
+        /* Signalled with the buffer exactly full is an overrun.  Not when woken for a
+         * seek, whose stale blocks the callback has yet to drop, nor above the depth,
+         * after adaptBufferDepth has shrunk it and the callback is draining the excess. */
+        blocksNeeded = buffer->num_blocks_in_buffer - ( buffer->head - JATOMIC_LOAD_ACQUIRE( &buffer->tail ) );
+        if( blocksNeeded == 0 && bSignalled && generation == wokenGeneration )
+            JATOMIC_ADD_SINGLE_WRITER( &counters->overruns, 1 );
         for( n=0; n<blocksNeeded; n++ )
         {
-            framesReadFromFile = sf_readf_float( audioPlayer->sfPtr,
-                                                 buffer->blockPtrs[buffer->head],
-                                                 FRAMES_PER_BLOCK );
-            audioPlayer->seekFrames += framesReadFromFile;
+            unsigned char *block = buffer->blockPtrs[buffer->head & buffer->blockMask];
 
-            if( framesReadFromFile < FRAMES_PER_BLOCK )  /* Check frames read from file, produce silence after end of file */
+            if( JATOMIC_LOAD_ACQUIRE( &seekerInfo->sequence ) >> 1 != generation )
             {
-                unsigned    silentFramesToProduce = FRAMES_PER_BLOCK - framesReadFromFile;
-                float       *ptr = buffer->blockPtrs[buffer->head] + ( framesReadFromFile * channels );
-                unsigned    i, j;
-
-                for( i=0; i<silentFramesToProduce; i++ )
-                {
-                    for( j=0; j<channels; j++ )
-                        *ptr++ = 0;
-                }
+                generation = applySeekRequest( audioPlayer, generation );
+                /* A request still being written would have the blocks filled meanwhile
+                 * dropped, so wait for the signal sent once it is published */
+                if( JATOMIC_LOAD_ACQUIRE( &seekerInfo->sequence ) >> 1 != generation )
+                    break;
             }
-            __sync_fetch_and_add( &(buffer->availableBlocks), 1 );  /* Protect against race condition with atomic operation */
-            if( ++(buffer->head) >= buffer->num_blocks_in_buffer )
-                buffer->head = 0;
+            buffer->blockGeneration[buffer->head & buffer->blockMask] = generation;
+            position = &buffer->blockPosition[buffer->head & buffer->blockMask];
+            position->track = audioPlayer->track->trackId;
+            position->frame = audioPlayer->seekFrames;
+            position->trackFrames = audioPlayer->trackFrames;
+            position->bSeekable = audioPlayer->bTrackSeekable;
+            position->sampleRate = audioPlayer->track->sfInfo.samplerate;
+            position->generation = generation;
+
+            /* An integer block going through effects is decoded as float, so it is only
+             * quantized once, after the chain */
+            floatBlock = ( audioPlayer->dspBuffer != NULL && JDSPChainGetStageCount( audioPlayer->dsp ) > 0 ) ?
+                         audioPlayer->dspBuffer : NULL;
+
+            stallNs = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.stallNsTotal );
+            readNs = JPlatformGetTimeNs();
+            framesReadFromFile = readBlock( audioPlayer, block, floatBlock );
+            readNs = JPlatformGetTimeNs() - readNs;
+            stallNs = JATOMIC_LOAD_RELAXED( &audioPlayer->ioCounters.stallNsTotal ) - stallNs;
+            JATOMIC_ADD_SINGLE_WRITER( &counters->framesDecoded, framesReadFromFile );
+            JATOMIC_ADD_SINGLE_WRITER( &counters->blocksDecoded, 1 );
+            JATOMIC_ADD_SINGLE_WRITER( &counters->readNsTotal, readNs );
+            JATOMIC_ADD_SINGLE_WRITER( &counters->stallNsTotal, stallNs < readNs ? stallNs : readNs );
+            updateMax( &counters->readNsMax, readNs );
+            processEffects( audioPlayer, block, floatBlock );
+            /* The silence is run through the chain like any block, so the end is only
+             * flagged once it has pushed out what the limiters still held */
+            position->bEnded = audioPlayer->framesAfterEnd >=
+                               (sf_count_t)buffer->framesPerBlock + JDSPChainGetLatency( audioPlayer->dsp );
+
+            JATOMIC_STORE_RELEASE( &buffer->head, buffer->head + 1 );   /* Publish the filled block to the callback */
+        }
+        /* The ring is full, so move the track past a cached run being copied while the
+         * callback plays from memory, rather than when the run is used up */
+        if( audioPlayer->cacheRun != NULL && !audioPlayer->bCacheRunSought )
+            seekPastCacheRun( audioPlayer );
+        if( blocksNeeded > 0 )
+        {
+            const unsigned long long wakeToReadyNs = JPlatformGetTimeNs() - wakeNs;
+
+            JATOMIC_ADD_SINGLE_WRITER( &counters->refills, 1 );
+            JATOMIC_ADD_SINGLE_WRITER( &counters->wakeToReadyNsTotal, wakeToReadyNs );
+            updateMax( &counters->wakeToReadyNsMax, wakeToReadyNs );
+            adaptBufferDepth( audioPlayer, (unsigned)n, wakeToReadyNs );
         }
+        else
+            adaptBufferDepth( audioPlayer, 0, 0 );
+        updateLowWatermark( audioPlayer );
+        JATOMIC_STORE_RELAXED( &counters->cpuNs, JPlatformThreadGetCpuTimeNs() - startCpuNs );
     }
 #ifdef WIN32
     _endthreadex( 0 );
 #endif
     return 0;
 }
+
+
+/* Fills block with the next framesPerBlock frames in the output format and rate and
+ * returns the number of frames taken from files.  A track ending part way through the
+ * block is followed by the next queued track from the following frame.  When there is
+ * nothing to follow it the block is completed with silence.  Given floatBlock, the
+ * frames go there as float instead, for processEffects to convert into block. */
+static sf_count_t readBlock( JAudioPlayer *audioPlayer, unsigned char *block, float *floatBlock )
+{
+    JCircularBuffer *buffer = &audioPlayer->audioBuffer;
+    JBlockCacheEntry *run = audioPlayer->cacheRun;
+    sf_count_t      framesRead = 0, trackFramesRead;
+    unsigned long   filled = 0;
+
+    /* After a seek that hit the cache, blocks are copied from the cached run.  Once it
+     * is used up decoding carries on from where the run ends, where the track has
+     * normally been moved to already. */
+    if( run != NULL )
+    {
+        filled = run->frames - audioPlayer->cacheRunUsed;
+        if( filled > buffer->framesPerBlock )
+            filled = buffer->framesPerBlock;
+        if( floatBlock != NULL )
+            JConvertToFloat( run->data + (size_t)audioPlayer->cacheRunUsed * buffer->bytesPerFrame,
+                             audioPlayer->format, floatBlock, (size_t)filled * buffer->channels );
+        else
+            memcpy( block, run->data + (size_t)audioPlayer->cacheRunUsed * buffer->bytesPerFrame,
+                    filled * buffer->bytesPerFrame );
+        audioPlayer->cacheRunUsed += filled;
+        JATOMIC_ADD_SINGLE_WRITER( &audioPlayer->seekFrames, filled );
+        if( audioPlayer->cacheRunUsed == run->frames )
+        {
+            if( !audioPlayer->bCacheRunSought )
+                seekPastCacheRun( audioPlayer );
+            releaseCacheRun( audioPlayer );
+        }
+        if( filled == buffer->framesPerBlock )
+        {
+            audioPlayer->framesAfterEnd = 0;
+            return 0;
+        }
+    }
+
+    do
+    {
+        trackFramesRead = 0;
+        if( floatBlock != NULL )
+            filled += JAudioTrackReadFloat( audioPlayer->track, floatBlock + (size_t)filled * buffer->channels,
+                                            buffer->framesPerBlock - filled, &trackFramesRead );
+        else
+            filled += JAudioTrackRead( audioPlayer->track, block + (size_t)filled * buffer->bytesPerFrame,
+                                       buffer->framesPerBlock - filled, &audioPlayer->dither, &trackFramesRead );
+        JATOMIC_ADD_SINGLE_WRITER( &audioPlayer->seekFrames, trackFramesRead );
+        framesRead += trackFramesRead;
+    }
+    while( filled < buffer->framesPerBlock && switchTrack( audioPlayer, &framesRead ) );
+
+    if( filled < buffer->framesPerBlock && floatBlock != NULL )
+    {
+        memset( floatBlock + (size_t)filled * buffer->channels, 0,
+                sizeof(float) * ( buffer->framesPerBlock - filled ) * buffer->channels );
+    }
+    else if( filled < buffer->framesPerBlock )
+    {
+        memset( block + ( filled * buffer->bytesPerFrame ), 0,
+                ( buffer->framesPerBlock - filled ) * buffer->bytesPerFrame );
+    }
+
+    /* Silence after the last track counts towards the end of the stream, a gap before
+     * a track still being opened does not */
+    if( filled > 0 )
+        audioPlayer->framesAfterEnd = 0;
+    if( filled < buffer->framesPerBlock && audioPlayer->bQueueDrained )
+        audioPlayer->framesAfterEnd += buffer->framesPerBlock - filled;
+    return framesRead;
+}
+
+
+/* Runs the effects chain over a block.  An integer block was read into floatBlock by
+ * readBlock, and is converted into block only after the chain, so it is quantized and
+ * dithered once.  Only the producer runs the chain, so its cost is never paid by the
+ * callback. */
+static void processEffects( JAudioPlayer *audioPlayer, unsigned char *block, float *floatBlock )
+{
+    JCircularBuffer *buffer = &audioPlayer->audioBuffer;
+
+    if( floatBlock != NULL )
+    {
+        JDSPChainProcess( audioPlayer->dsp, floatBlock, buffer->framesPerBlock );
+        JConvertFromFloat( floatBlock, block, audioPlayer->format, (size_t)buffer->framesPerBlock * buffer->channels,
+                           audioPlayer->stream.bDither ? &audioPlayer->dither : NULL );
+    }
+    else if( audioPlayer->format == JSAMPLE_FLOAT32 && JDSPChainGetStageCount( audioPlayer->dsp ) > 0 )
+        JDSPChainProcess( audioPlayer->dsp, (float*)block, buffer->framesPerBlock );
+    return;
+}
+
+
+/* Replaces the track that has ended with the one the loader thread has opened.
+ * Returns FALSE if there is none, because the queue is empty or the loader has not
+ * finished opening it yet.  Called by the producer. */
+static int switchTrack( JAudioPlayer *audioPlayer, sf_count_t *framesRead )
+{
+    JTrackQueue *queue = &audioPlayer->queue;
+    JAudioTrack *next;
+    int         bPending;
+
+    /* Closing the track that ended and pointing the cache and indexer at the next one
+     * block, so they are left to the loader.  It takes retired before it opens another
+     * track, so there is always room for this one. */
+    JPlatformMutexLock( &queue->lock );
+    next = queue->next;
+    queue->next = NULL;
+    if( next != NULL )
+    {
+        queue->retired = audioPlayer->track;
+        queue->started = next;
+    }
+    bPending = queue->pathCount + queue->loading > 0;
+    JPlatformMutexUnlock( &queue->lock );
+
+    audioPlayer->bQueueDrained = next == NULL && !bPending;
+    if( next == NULL )
+    {
+        if( bPending )
+            JATOMIC_ADD_SINGLE_WRITER( &audioPlayer->producerCounters.trackGapBlocks, 1 );
+        return FALSE;
+    }
+    JPlatformEventSignal( &queue->loaderEvent );
+
+    audioPlayer->track = next;
+    audioPlayer->resumeFrame = 0;
+    JATOMIC_STORE_RELAXED( &audioPlayer->readTrack, next->trackId );
+    JATOMIC_STORE_RELAXED( &audioPlayer->seekFrames, next->prerollFileFrames );
+    audioPlayer->trackFrames = next->sfInfo.frames;
+    audioPlayer->bTrackSeekable = next->source->bSeekable;
+    *framesRead += next->prerollFileFrames;
+    JATOMIC_ADD_SINGLE_WRITER( &audioPlayer->producerCounters.trackSwitches, 1 );
+    return TRUE;
+}
+
+
+/* Keeps the next queued track open, with its start decoded, until the producer takes
+ * it, and closes the track before once it has.  Also readies and closes the indexed
+ * sources the producer swaps.  Opening and closing files can block for a long time,
+ * so it is kept off the producer. */
+static THREAD_ROUTINE_SIGNATURE trackLoader( void *threadArg )
+{
+    JAudioPlayer    *audioPlayer = (JAudioPlayer*)threadArg;
+    JTrackQueue     *queue = &audioPlayer->queue;
+    const unsigned long prerollFrames = 2 * audioPlayer->audioBuffer.maxBlocks *
+                                        audioPlayer->audioBuffer.framesPerBlock;
+    JAudioTrack     *track, *started;
+    char            *path;
+    unsigned        trackId = 0, clears = 0;
+
+    while( !queue->bLoaderQuit )
+    {
+        JPlatformEventWait( &queue->loaderEvent, 1000 );
+
+        for( ;; )
+        {
+            /* The producer has switched tracks.  Until the cache is pointed at the
+             * new one it finds nothing there, and the indexer offers it nothing. */
+            JPlatformMutexLock( &queue->lock );
+            started = queue->started;
+            track = queue->retired;
+            queue->started = NULL;
+            queue->retired = NULL;
+            JPlatformMutexUnlock( &queue->lock );
+            if( started != NULL )
+            {
+                if( audioPlayer->cache != NULL )
+                    JBlockCacheSetTrack( audioPlayer->cache, started->trackId,
+                                         started->resampler == NULL ? started->filePath : NULL );
+                setIndexedTrack( audioPlayer, started, started->filePath );
+            }
+            JAudioTrackClose( &track );
+            prepareIndexedSource( audioPlayer );
+
+            path = NULL;
+            JPlatformMutexLock( &queue->lock );
+            if( queue->next == NULL && queue->pathCount > 0 && !queue->bLoaderQuit )
+            {
+                path = queue->paths[queue->pathHead];
+                trackId = queue->pathIds[queue->pathHead];
+                queue->paths[queue->pathHead] = NULL;
+                queue->pathHead = ( queue->pathHead + 1 ) % JPLAYER_QUEUE_SIZE;
+                queue->pathCount--;
+                queue->loading = 1;
+                clears = queue->clears;
+            }
+            JPlatformMutexUnlock( &queue->lock );
+            if( path == NULL )
+                break;
+
+            track = JAudioTrackOpen( path, &audioPlayer->stream, trackId );
+            if( track == NULL )
+                printf( "  Error: Could not open %s, skipping it\n", path );
+            else
+                JAudioTrackPreroll( track, prerollFrames );
+            free( path );
+
+            /* The queue may have been cleared while the file was opened */
+            JPlatformMutexLock( &queue->lock );
+            if( queue->clears == clears )
+            {
+                queue->next = track;
+                track = NULL;
+            }
+            queue->loading = 0;
+            JPlatformMutexUnlock( &queue->lock );
+            JAudioTrackClose( &track );
+        }
+    }
+    return 0;
+}
+
+
+/* Indexes the track being read, from the lowest priority thread of the player */
+static THREAD_ROUTINE_SIGNATURE trackIndexer( void *threadArg )
+{
+    JAudioPlayer    *audioPlayer = (JAudioPlayer*)threadArg;
+    JTrackIndexer   *indexer = &audioPlayer->indexer;
+    JSeekIndex      *index;
+    JAudioSource    *source;
+    char            *path;
+    unsigned        trackId = 0;
+
+    JPlatformThreadSetBackground();
+
+    while( !indexer->bQuit )
+    {
+        JPlatformEventWait( &indexer->event, 1000 );
+
+        path = NULL;
+        JPlatformMutexLock( &indexer->lock );
+        if( indexer->path != NULL && !indexer->bQuit )
+        {
+            path = indexer->path;
+            indexer->path = NULL;
+            trackId = indexer->trackId;
+            indexer->bCancel = FALSE;
+        }
+        JPlatformMutexUnlock( &indexer->lock );
+        if( path == NULL )
+            continue;
+
+        /* Building the index reads the whole file, and is abandoned if the track
+         * changes meanwhile */
+        index = JSeekIndexBuild( path, &indexer->bCancel );
+        if( index != NULL && indexer->bSave )
+            JSeekIndexSave( index, path );
+        source = ( index != NULL ) ? JAudioSourceOpenIndexed( path, index ) : NULL;
+        free( path );
+
+        /* The loader starts its read-ahead, as a thread started here would run at the
+         * background priority of this one */
+        JPlatformMutexLock( &indexer->lock );
+        if( source != NULL && indexer->trackId == trackId && !indexer->bCancel )
+        {
+            JAudioSourceClose( &indexer->opened );
+            indexer->opened = source;
+            source = NULL;
+        }
+        JPlatformMutexUnlock( &indexer->lock );
+        if( source == NULL )
+            JPlatformEventSignal( &audioPlayer->queue.loaderEvent );
+        JAudioSourceClose( &source );
+    }
+    return 0;
+}
+
+
+static void initTrackIndexer( JAudioPlayer *audioPlayer, const JAudioPlayerConfig *config )
+{
+    JTrackIndexer *indexer = &audioPlayer->indexer;
+
+    indexer->trackId = 0;
+    indexer->path = NULL;
+    indexer->opened = NULL;
+    indexer->source = NULL;
+    indexer->retired = NULL;
+    indexer->bSave = config->bSaveSeekIndex;
+    indexer->bRunning = FALSE;
+    indexer->bCancel = FALSE;
+    indexer->bQuit = FALSE;
+    if( !config->bSeekIndex )
+        return;
+
+    if( JPlatformMutexInit( &indexer->lock ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        return;
+    }
+    if( JPlatformEventInit( &indexer->event ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        JPlatformMutexDestroy( &indexer->lock );
+        return;
+    }
+    if( JPlatformThreadCreate( &indexer->thread, trackIndexer, audioPlayer ) )
+    {
+        printf( "  Error creating indexer thread\n" );
+        JPlatformEventDestroy( &indexer->event );
+        JPlatformMutexDestroy( &indexer->lock );
+        return;
+    }
+    indexer->bRunning = TRUE;
+    return;
+}
+
+
+/* Stops the indexer thread.  Its lock and sources are kept for the loader, which may
+ * still be running, until freeTrackIndexer. */
+static void stopTrackIndexer( JAudioPlayer *audioPlayer )
+{
+    JTrackIndexer *indexer = &audioPlayer->indexer;
+
+    if( !indexer->bRunning || indexer->bQuit )
+        return;
+
+    indexer->bQuit = TRUE;
+    indexer->bCancel = TRUE;
+    JPlatformEventSignal( &indexer->event );
+    JPlatformThreadJoin( &indexer->thread );
+    return;
+}
+
+
+/* Stops the indexer thread and frees the sources not handed over or not closed yet.
+ * Called once the loader has stopped. */
+static void freeTrackIndexer( JAudioPlayer *audioPlayer )
+{
+    JTrackIndexer *indexer = &audioPlayer->indexer;
+
+    if( !indexer->bRunning )
+        return;
+
+    stopTrackIndexer( audioPlayer );
+    free( indexer->path );
+    JAudioSourceClose( &indexer->opened );
+    JAudioSourceClose( &indexer->source );
+    JAudioSourceClose( &indexer->retired );
+    JPlatformEventDestroy( &indexer->event );
+    JPlatformMutexDestroy( &indexer->lock );
+    indexer->bRunning = FALSE;
+    return;
+}
+
+
+/* Points the indexer at the track now being read.  Tracks that cannot be indexed, or
+ * were opened through a saved index already, cancel any index being built. */
+static void setIndexedTrack( JAudioPlayer *audioPlayer, const JAudioTrack *track, const char *filePath )
+{
+    JTrackIndexer   *indexer = &audioPlayer->indexer;
+    JAudioSource    *stale, *staleOpened;
+    char            *path = NULL;
+
+    if( !indexer->bRunning )
+        return;
+
+    if( filePath != NULL && track->source->index == NULL && JSeekIndexIsSupported( &track->sfInfo ) )
+    {
+        path = (char*)malloc( strlen( filePath ) + 1 );
+        if( path != NULL )
+            strcpy( path, filePath );
+    }
+
+    JPlatformMutexLock( &indexer->lock );
+    free( indexer->path );
+    indexer->path = path;
+    indexer->trackId = track->trackId;
+    stale = indexer->source;
+    staleOpened = indexer->opened;
+    indexer->source = NULL;
+    indexer->opened = NULL;
+    indexer->bCancel = TRUE;
+    JPlatformMutexUnlock( &indexer->lock );
+
+    JAudioSourceClose( &stale );
+    JAudioSourceClose( &staleOpened );
+    JPlatformEventSignal( &indexer->event );
+    return;
+}
+
+
+/* Moves the track being read onto its indexed source, if the indexer has one ready.
+ * Called by the producer before a seek, which the new source then makes quickly.
+ * Only pointers are swapped here: the source replaced is closed by the loader, as
+ * closing it joins its read-ahead thread. */
+static void swapIndexedSource( JAudioPlayer *audioPlayer )
+{
+    JTrackIndexer   *indexer = &audioPlayer->indexer;
+    int             bSwapped = FALSE;
+
+    if( !indexer->bRunning )
+        return;
+
+    JPlatformMutexLock( &indexer->lock );
+    if( indexer->source != NULL && indexer->retired == NULL && indexer->trackId == audioPlayer->track->trackId )
+    {
+        indexer->retired = JAudioTrackReplaceSource( audioPlayer->track, indexer->source );
+        indexer->source = NULL;
+        bSwapped = TRUE;
+    }
+    JPlatformMutexUnlock( &indexer->lock );
+
+    if( bSwapped )
+        JPlatformEventSignal( &audioPlayer->queue.loaderEvent );
+    return;
+}
+
+
+/* Starts the read-ahead of a source the indexer has opened and offers it to the
+ * producer, and closes the source the producer replaced.  Called by the loader, so
+ * the read-ahead thread takes neither the real-time policy of the producer nor the
+ * background priority of the indexer. */
+static void prepareIndexedSource( JAudioPlayer *audioPlayer )
+{
+    JTrackIndexer   *indexer = &audioPlayer->indexer;
+    JAudioSource    *opened, *retired;
+    unsigned        trackId;
+
+    if( !indexer->bRunning )
+        return;
+
+    JPlatformMutexLock( &indexer->lock );
+    opened = indexer->opened;
+    retired = indexer->retired;
+    indexer->opened = NULL;
+    indexer->retired = NULL;
+    trackId = indexer->trackId;
+    JPlatformMutexUnlock( &indexer->lock );
+
+    JAudioSourceClose( &retired );
+    if( opened == NULL )
+        return;
+    JAudioSourceStartReadAhead( opened, audioPlayer->stream.readAheadSeconds, audioPlayer->stream.ioCounters,
+                                audioPlayer->stream.bCancel );
+
+    JPlatformMutexLock( &indexer->lock );
+    if( indexer->trackId == trackId && indexer->source == NULL )
+    {
+        indexer->source = opened;
+        opened = NULL;
+    }
+    JPlatformMutexUnlock( &indexer->lock );
+    JAudioSourceClose( &opened );
+    return;
+}
+
+
+static int initTrackQueue( JTrackQueue *queue )
+{
+    memset( queue->paths, 0, sizeof(queue->paths) );
+    queue->pathHead = 0;
+    queue->pathCount = 0;
+    queue->next = NULL;
+    queue->started = NULL;
+    queue->retired = NULL;
+    queue->loading = 0;
+    queue->clears = 0;
+    queue->lastTrackId = 0;
+    queue->bLoaderQuit = FALSE;
+
+    if( JPlatformMutexInit( &queue->lock ) )
+        return -1;
+    if( JPlatformEventInit( &queue->loaderEvent ) )
+    {
+        JPlatformMutexDestroy( &queue->lock );
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Stops the loader thread and frees everything left in the queue, including a track
+ * the producer handed back that the loader had not closed yet.  Called once the
+ * producer has stopped, and before the cache and indexer the loader uses are freed. */
+static void freeTrackQueue( JAudioPlayer *audioPlayer )
+{
+    JTrackQueue *queue = &audioPlayer->queue;
+
+    queue->bLoaderQuit = TRUE;
+    JPlatformEventSignal( &queue->loaderEvent );
+    JPlatformThreadJoin( &queue->loaderThread );
+
+    JAudioTrackClose( &queue->retired );
+    queue->started = NULL;
+    clearTrackQueue( queue );
+    JPlatformEventDestroy( &queue->loaderEvent );
+    JPlatformMutexDestroy( &queue->lock );
+    return;
+}
+
+
+/* Frees queued paths and the opened next track.  Called with lock taken. */
+static void clearTrackQueue( JTrackQueue *queue )
+{
+    for( ; queue->pathCount > 0; queue->pathCount-- )
+    {
+        free( queue->paths[queue->pathHead] );
+        queue->paths[queue->pathHead] = NULL;
+        queue->pathHead = ( queue->pathHead + 1 ) % JPLAYER_QUEUE_SIZE;
+    }
+    JAudioTrackClose( &queue->next );
+    queue->clears++;
+    return;
+}
+
+
+/* Carves every array of the audio buffer out of one run of whole pages, each on cache
+ * lines of its own, so locking them locks no other allocation.  The pages start out
+ * zeroed.  Leaves memory NULL on failure. */
+static void allocAudioBuffer( JCircularBuffer *buffer )
+{
+    size_t          bytes[6], offsets[6];
+    unsigned char   *memory;
+    unsigned        i;
+
+    bytes[0] = sizeof(unsigned char*) * buffer->blockCapacity;
+    bytes[1] = (size_t)buffer->framesPerBlock * buffer->bytesPerFrame * buffer->blockCapacity;
+    bytes[2] = sizeof(unsigned) * buffer->blockCapacity;
+    bytes[3] = sizeof(JPlayPosition) * buffer->blockCapacity;
+    bytes[4] = sizeof(float) * buffer->channels;
+    bytes[5] = sizeof(float) * buffer->framesPerBlock * buffer->channels;
+    buffer->memoryBytes = 0;
+    for( i=0; i<6; i++ )
+    {
+        offsets[i] = buffer->memoryBytes;
+        buffer->memoryBytes += ( bytes[i] + JCACHE_LINE_SIZE - 1 ) & ~(size_t)( JCACHE_LINE_SIZE - 1 );
+    }
+
+    buffer->memory = JPlatformAllocPages( buffer->memoryBytes );
+    if( buffer->memory == NULL )
+        return;
+    memory = (unsigned char*)buffer->memory;
+    buffer->blockPtrs = (unsigned char**)( memory + offsets[0] );
+    buffer->blockMemory = memory + offsets[1];
+    buffer->blockGeneration = (unsigned*)( memory + offsets[2] );
+    buffer->blockPosition = (JPlayPosition*)( memory + offsets[3] );
+    buffer->lastFrame = (float*)( memory + offsets[4] );
+    buffer->fadeFrames = (float*)( memory + offsets[5] );
+    return;
+}
+
+
+static void freeAudioBuffer( JCircularBuffer *buffer )
+{
+    if( buffer->bLocked )
+        lockAudioBuffer( buffer, FALSE );
+    JPlatformFreePages( buffer->memory, buffer->memoryBytes );
+    buffer->memory = NULL;
+    buffer->blockPtrs = NULL;
+    buffer->blockMemory = NULL;
+    buffer->blockGeneration = NULL;
+    buffer->blockPosition = NULL;
+    buffer->lastFrame = NULL;
+    buffer->fadeFrames = NULL;
+    return;
+}
+
+
+/* Locks or unlocks the pages of the audio buffer.  They hold nothing else, so this
+ * never unlocks memory another player locked.  Returns non-zero if they could not be
+ * locked. */
+static int lockAudioBuffer( JCircularBuffer *buffer, int bLock )
+{
+    if( !bLock )
+    {
+        JPlatformUnlockMemory( buffer->memory, buffer->memoryBytes );
+        buffer->bLocked = FALSE;
+        return 0;
+    }
+    if( JPlatformLockMemory( buffer->memory, buffer->memoryBytes ) )
+        return -1;
+    buffer->bLocked = TRUE;
+    return 0;
+}
+
+
+/* Locks as much of memoryLock as the process is allowed to and returns what was
+ * locked.  Called from JAudioPlayerCreate once the audio buffer is allocated. */
+static JMemoryLock lockMemory( JAudioPlayer *audioPlayer, JMemoryLock memoryLock )
+{
+    static int bWarnedAll = FALSE, bWarnedBuffers = FALSE;
+
+    if( memoryLock == JMEMLOCK_ALL )
+    {
+        if( JPlatformLockAllMemory() == 0 )
+            return JMEMLOCK_ALL;
+        warnOnce( &bWarnedAll, "  Warning: Cannot lock all memory, locking the audio buffer only\n" );
+        memoryLock = JMEMLOCK_BUFFERS;
+    }
+    if( memoryLock == JMEMLOCK_BUFFERS )
+    {
+        if( lockAudioBuffer( &audioPlayer->audioBuffer, TRUE ) == 0 )
+            return JMEMLOCK_BUFFERS;
+        warnOnce( &bWarnedBuffers, "  Warning: Cannot lock the audio buffer into memory, "
+                                   "the memory lock limit may be too low\n" );
+    }
+    return JMEMLOCK_NONE;
+}
+
+
+/* Undoes lockMemory.  Called when the player is destroyed or fails to be created. */
+static void unlockMemory( JAudioPlayer *audioPlayer )
+{
+    switch( audioPlayer->memoryLock )
+    {
+        case JMEMLOCK_ALL:
+            JPlatformUnlockAllMemory();
+            break;
+        case JMEMLOCK_BUFFERS:
+            lockAudioBuffer( &audioPlayer->audioBuffer, FALSE );
+            break;
+        case JMEMLOCK_NONE:
+            break;
+    }
+    audioPlayer->memoryLock = JMEMLOCK_NONE;
+    return;
+}
+
+
+/* Gives the producer thread the policy, priority and processor asked for, or as much
+ * of them as the process is allowed.  Called by the producer before it starts. */
+static void setProducerScheduling( JAudioPlayer *audioPlayer )
+{
+    static int bWarnedPolicy = FALSE, bWarnedCpu = FALSE;
+    JSchedPolicy policy = audioPlayer->producerPolicy;
+
+    if( policy != JSCHED_NORMAL &&
+        JPlatformThreadSetRealtime( policy, audioPlayer->producerPriority ) != policy )
+    {
+        warnOnce( &bWarnedPolicy, "  Warning: No permission for real-time scheduling, "
+                                  "the producer thread runs as a normal thread\n" );
+        policy = JSCHED_NORMAL;
+    }
+    if( audioPlayer->producerCpu >= 0 && JPlatformThreadSetAffinity( (unsigned)audioPlayer->producerCpu ) )
+    {
+        warnOnce( &bWarnedCpu, "  Warning: Cannot pin the producer thread to a processor\n" );
+        audioPlayer->producerCpu = -1;
+    }
+    JATOMIC_STORE_RELEASE( &audioPlayer->producerPolicy, policy );
+    return;
+}
+
+
+/* Prints a warning the first time it is given in the process, as every player would
+ * otherwise repeat it */
+static void warnOnce( int *bWarned, const char *message )
+{
+    if( !__atomic_exchange_n( bWarned, TRUE, __ATOMIC_RELAXED ) )
+        printf( "%s", message );
+    return;
+}
+
+
+/* Used by the null output backend to check that a block is ready for paCallback */
+static int audioReady( void *userData )
+{
+    JAudioPlayer *audioPlayer = (JAudioPlayer*)userData;
+    const JCircularBuffer *buffer = &audioPlayer->audioBuffer;
+    unsigned blocks;
+
+    /* Paused, every call would only output silence, so the null output is held here
+     * until playback resumes or the output is stopped instead of calling back to back */
+    if( audioPlayer->state == JPLAYER_PAUSED )
+    {
+        if( !audioPlayer->bStoppingOutput )
+            JPlatformEventWait( &audioPlayer->resumeEvent, RESUME_WAIT_MS );
+        return FALSE;
+    }
+
+    /* A callback may span several blocks, wait for all of them unless the buffer is
+     * already as full as the producer keeps it */
+    blocks = JATOMIC_LOAD_ACQUIRE( &buffer->head ) - buffer->tail;
+    return blocks >= JATOMIC_LOAD_RELAXED( &buffer->num_blocks_in_buffer ) ||
+           (unsigned long)blocks * buffer->framesPerBlock - buffer->tailOffset >= audioPlayer->output->params.framesPerBuffer;
+}
+
+
+/* Stops the output stream, first letting the null output out of audioReady if it is
+ * waiting there for a pause to end */
+static PaError stopOutput( JAudioPlayer *audioPlayer )
+{
+    PaError err;
+
+    audioPlayer->bStoppingOutput = TRUE;
+    JPlatformEventSignal( &audioPlayer->resumeEvent );
+    err = JAudioOutputStop( audioPlayer->output );
+    audioPlayer->bStoppingOutput = FALSE;
+    return err;
+}
+
+
+/* Grows the depth of the audio buffer when the callback ran dry, came close to it, or
+ * a refill took more than half the time the blocks not needed by the next callback
+ * last.  Shrinks it by a block once playback has been smooth for DEPTH_WINDOW_NS with
+ * refills short enough to keep that margin at one block less.  Growing only lets the
+ * producer fill further and shrinking only holds back refills until the callback has
+ * used up the extra blocks, so neither is heard.  Called by the producer after every
+ * wakeup, with the blocks it refilled and how long that took. */
+static void adaptBufferDepth( JAudioPlayer *audioPlayer, unsigned blocksRefilled, unsigned long long wakeToReadyNs )
+{
+    JCircularBuffer     *buffer = &audioPlayer->audioBuffer;
+    JDepthController    *controller = &audioPlayer->depthController;
+    JCallbackCounters   *callbackCounters = &audioPlayer->callbackCounters;
+    const unsigned      depth = buffer->num_blocks_in_buffer;
+    const unsigned long underruns = JATOMIC_LOAD_RELAXED( &callbackCounters->underruns );
+    const unsigned long nearEmpty = JATOMIC_LOAD_RELAXED( &callbackCounters->nearEmpty );
+    const unsigned long long nowNs = JPlatformGetTimeNs();
+    const double        blockNs = 1e9 * buffer->framesPerBlock / audioPlayer->stream.sampleRate;
+    unsigned            callbackBlocks, floorBlocks, spare, newDepth = depth;
+    int                 bSmooth = TRUE;
+
+    if( buffer->minBlocks == buffer->maxBlocks )
+        return;
+    if( audioPlayer->state != JPLAYER_PLAYING )
+    {
+        /* Time spent paused says nothing about how smoothly playback runs */
+        controller->underruns = underruns;
+        controller->nearEmpty = nearEmpty;
+        controller->windowStartNs = nowNs;
+        controller->windowWakeNsMax = 0;
+        return;
+    }
+
+    /* Each callback must find every block it spans queued, and as many to spare */
+    callbackBlocks = getCallbackBlocks( audioPlayer );
+    floorBlocks = 2 * callbackBlocks > buffer->minBlocks ? 2 * callbackBlocks : buffer->minBlocks;
+    if( floorBlocks > buffer->maxBlocks )
+        floorBlocks = buffer->maxBlocks;
+    /* The producer is woken with at most lowWatermark blocks queued, and must have
+     * refilled the batch before they are played */
+    spare = buffer->lowWatermark;
+
+    /* Refilling a buffer emptied by a seek takes longer than refilling one batch, so
+     * only batches are timed */
+    if( blocksRefilled > depth - buffer->lowWatermark + callbackBlocks )
+        wakeToReadyNs = 0;
+    if( wakeToReadyNs > controller->windowWakeNsMax )
+        controller->windowWakeNsMax = wakeToReadyNs;
+
+    if( underruns != controller->underruns )
+    {
+        newDepth = depth + ( depth + 1 ) / 2;
+        bSmooth = FALSE;
+    }
+    else if( nearEmpty != controller->nearEmpty || depth < floorBlocks ||
+             DEPTH_JITTER_MARGIN * (double)wakeToReadyNs > spare * blockNs )
+    {
+        newDepth = depth + 1;
+        bSmooth = FALSE;
+    }
+    else if( nowNs - controller->windowStartNs >= DEPTH_WINDOW_NS )
+    {
+        if( depth > floorBlocks &&
+            2 * DEPTH_JITTER_MARGIN * (double)controller->windowWakeNsMax < ( spare - 1.0 ) * blockNs )
+            newDepth = depth - 1;
+        bSmooth = FALSE;    /* Start the next window */
+    }
+    controller->underruns = underruns;
+    controller->nearEmpty = nearEmpty;
+
+    if( newDepth > buffer->maxBlocks )
+        newDepth = buffer->maxBlocks;
+    if( newDepth != depth )
+    {
+        JATOMIC_STORE_RELAXED( &buffer->num_blocks_in_buffer, newDepth );
+        if( newDepth > depth )
+            JATOMIC_ADD_SINGLE_WRITER( &audioPlayer->producerCounters.depthGrows, 1 );
+        else
+            JATOMIC_ADD_SINGLE_WRITER( &audioPlayer->producerCounters.depthShrinks, 1 );
+    }
+    if( !bSmooth )
+    {
+        controller->windowStartNs = nowNs;
+        controller->windowWakeNsMax = 0;
+    }
+    return;
+}
+
+
+/* Returns the most blocks one callback has spanned.  Until the first callback it is
+ * guessed from the frames per buffer the stream was opened with. */
+static unsigned getCallbackBlocks( JAudioPlayer *audioPlayer )
+{
+    const JCircularBuffer *buffer = &audioPlayer->audioBuffer;
+    const unsigned long frames = JATOMIC_LOAD_RELAXED( &audioPlayer->callbackCounters.framesPerCallbackMax );
+    unsigned            blocks;
+
+    if( frames > 0 )
+        blocks = (unsigned)( ( frames + buffer->framesPerBlock - 1 ) / buffer->framesPerBlock );
+    else
+        blocks = buffer->minBlocks / 2;
+    return blocks > 0 ? blocks : 1;
+}
+
+
+/* Sets the blocks left queued when the callback wakes the producer: the depth less
+ * refillBlocks, or half the depth by default, but never less than one callback takes.
+ * Called by the producer whenever it may have changed the depth. */
+static void updateLowWatermark( JAudioPlayer *audioPlayer )
+{
+    JCircularBuffer *buffer = &audioPlayer->audioBuffer;
+    const unsigned  depth = buffer->num_blocks_in_buffer;
+    const unsigned  callbackBlocks = getCallbackBlocks( audioPlayer );
+    const unsigned  maxRefill = depth > callbackBlocks ? depth - callbackBlocks : 1;
+    unsigned        refill = audioPlayer->refillBlocks ? audioPlayer->refillBlocks : depth / 2;
+
+    if( refill > maxRefill )
+        refill = maxRefill;
+    if( refill == 0 )
+        refill = 1;
+    if( buffer->lowWatermark != depth - refill )
+        JATOMIC_STORE_RELAXED( &buffer->lowWatermark, depth - refill );
+    return;
+}
+
+
+/* Called by the audio callback to have the producer refill the buffer.  Only the
+ * first call after the producer has woken signals it, so a callback that finds the
+ * buffer still below the low watermark does not make a system call. */
+static void wakeProducer( JAudioPlayer *audioPlayer )
+{
+    JCircularBuffer *buffer = &audioPlayer->audioBuffer;
+
+    JATOMIC_FENCE();        /* Order the store to tail before the load of the flag */
+    if( JATOMIC_LOAD_RELAXED( &buffer->bWakePending ) )
+        return;
+    JATOMIC_STORE_RELAXED( &buffer->bWakePending, TRUE );
+    JATOMIC_ADD_SINGLE_WRITER( &audioPlayer->callbackCounters.producerSignals, 1 );
+    SIGNAL_SYNCHRONIZATION_OBJECT
+    return;
+}
+
+
+/* Ramps the last frame that was output down to silence over frames frames */
+static void renderFadeOut( JAudioPlayer *audioPlayer, unsigned char *out, unsigned long frames )
+{
+    JCircularBuffer *buffer = &audioPlayer->audioBuffer;
+    const int       channels = audioPlayer->sfInfo.channels;
+    unsigned long   done, count, i;
+    int             j;
+
+    for( done=0; done<frames; done+=count )
+    {
+        float *fade = buffer->fadeFrames;
+
+        count = frames - done < buffer->framesPerBlock ? frames - done : buffer->framesPerBlock;
+        for( i=0; i<count; i++ )
+        {
+            const float gain = 1.0f - (float)( done + i + 1 ) / (float)frames;
+            for( j=0; j<channels; j++ )
+                *fade++ = buffer->lastFrame[j] * gain;
+        }
+        JConvertFromFloat( buffer->fadeFrames, out + done * buffer->bytesPerFrame, audioPlayer->format,
+                           count * channels, NULL );
+    }
+    for( j=0; j<channels; j++ )
+        buffer->lastFrame[j] = 0;
+    return;
+}
+
+
+/* Reads the latest seek request under the sequence lock, moves the cursor in the
+ * current track and returns the generation that was applied.  A request caught being
+ * written is left for the next block, as JDSPChain leaves settings, and generation,
+ * the one applied before, returned: the producer may have preempted the writer on
+ * its core, so waiting for it could spin forever.  Called by the producer. */
+static unsigned applySeekRequest( JAudioPlayer *audioPlayer, unsigned generation )
+{
+    JChangeSeekInfo *seekerInfo = &audioPlayer->seekerInfo;
+    JSeekCompleteCallback callback;
+    JPlayPosition played;
+    unsigned    sequence, trackId;
+    sf_count_t  frames, frameOffset = -1, resumeOffset = -1;
+    int         whence;
+
+    sequence = JATOMIC_LOAD_ACQUIRE( &seekerInfo->sequence );
+    if( sequence & 1u )
+        return generation;
+    trackId = JATOMIC_LOAD_RELAXED( &seekerInfo->trackId );
+    frames = JATOMIC_LOAD_RELAXED( &seekerInfo->frames );
+    whence = JATOMIC_LOAD_RELAXED( &seekerInfo->whence );
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if( JATOMIC_LOAD_RELAXED( &seekerInfo->sequence ) != sequence )
+        return generation;
+
+    /* JAudioPlayerSeekAsync has made the request absolute.  A request for the track
+     * before, made as the producer moved on from it, can no longer be followed. */
+    if( trackId == audioPlayer->track->trackId )
+        frameOffset = seekTrack( audioPlayer, frames, whence );
+    if( frameOffset >= 0 )
+        audioPlayer->resumeFrame = frameOffset;
+    else
+    {
+        /* The callback drops the blocks queued before the request all the same, so
+         * rather than carry on from the cursor, a ring's worth ahead, go back to the
+         * first of them: the block being heard, or where the blocks of the request
+         * before start if it has not been heard yet */
+        JATOMIC_ADD_RELAXED( &seekerInfo->seeksRefused, 1 );
+        getPlayedPosition( audioPlayer, &played );
+        if( played.generation == generation && played.track == audioPlayer->track->trackId )
+            audioPlayer->resumeFrame = played.frame;
+        resumeOffset = seekTrack( audioPlayer, audioPlayer->resumeFrame, SEEK_SET );
+    }
+
+    /* Filter tails and the limiter's delay belong to the audio before the seek, as
+     * does any silence after the end */
+    if( frameOffset >= 0 || resumeOffset >= 0 )
+    {
+        JDSPChainReset( audioPlayer->dsp );
+        audioPlayer->framesAfterEnd = 0;
+    }
+
+    JATOMIC_STORE_RELEASE( &seekerInfo->completedGeneration, sequence >> 1 );
+
+    callback = JATOMIC_LOAD_ACQUIRE( &seekerInfo->callback );
+    if( callback != NULL )
+        callback( sequence >> 1, frameOffset, seekerInfo->callbackUserData );
+
+    return sequence >> 1;
+}
+
+
+/* Moves the cursor in the track being read, from a cached run if one starts there.
+ * Returns the new position in file frames, or -1 on failure.  Called by the producer. */
+static sf_count_t seekTrack( JAudioPlayer *audioPlayer, sf_count_t frames, int whence )
+{
+    sf_count_t frameOffset;
+
+    swapIndexedSource( audioPlayer );
+    releaseCacheRun( audioPlayer );
+
+    if( whence == SEEK_SET && audioPlayer->cache != NULL && audioPlayer->track->resampler == NULL &&
+        ( audioPlayer->cacheRun = JBlockCacheLookup( audioPlayer->cache, audioPlayer->track->trackId, frames,
+                                                     &audioPlayer->cacheRunUsed ) ) != NULL )
+    {
+        /* Served from memory, the file is sought once the run is used up */
+        frameOffset = frames;
+        JATOMIC_STORE_RELAXED( &audioPlayer->seekFrames, frameOffset );
+    }
+    else if( ( frameOffset = JAudioTrackSeek( audioPlayer->track, frames, whence ) ) >= 0 )
+    {
+        JATOMIC_STORE_RELAXED( &audioPlayer->seekFrames, frameOffset );
+        /* Decode the run behind this target, in case it is sought to again */
+        if( audioPlayer->cache != NULL )
+            JBlockCacheRequestFill( audioPlayer->cache, audioPlayer->track->trackId, frameOffset, FALSE );
+    }
+    return frameOffset;
+}
+
+
+/* Publishes where the block the callback is starting begins as the position being
+ * heard.  The callback is the only writer, so it never waits; readers try again if
+ * they catch it writing. */
+static void publishPosition( JAudioPlayer *audioPlayer, const JPlayPosition *position )
+{
+    const unsigned sequence = audioPlayer->positionSequence;
+
+    JATOMIC_STORE_RELAXED( &audioPlayer->positionSequence, sequence + 1 );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    audioPlayer->position = *position;
+    JATOMIC_STORE_RELEASE( &audioPlayer->positionSequence, sequence + 2 );
+    JATOMIC_STORE_RELAXED( &audioPlayer->playingTrack, position->track );
+    return;
+}
+
+
+/* Reads the position last published by the callback */
+static void getPlayedPosition( JAudioPlayer *audioPlayer, JPlayPosition *position )
+{
+    unsigned sequence;
+
+    do
+    {
+        while( ( sequence = JATOMIC_LOAD_ACQUIRE( &audioPlayer->positionSequence ) ) & 1u )
+            JPlatformYield();
+        *position = audioPlayer->position;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    }
+    while( JATOMIC_LOAD_RELAXED( &audioPlayer->positionSequence ) != sequence );
+    return;
+}
+
+
+/* Hands the cached run being copied back to the cache.  Called by the producer, or
+ * once it has stopped. */
+static void releaseCacheRun( JAudioPlayer *audioPlayer )
+{
+    if( audioPlayer->cacheRun == NULL )
+        return;
+    JBlockCacheRelease( audioPlayer->cache, audioPlayer->cacheRun );
+    audioPlayer->cacheRun = NULL;
+    audioPlayer->cacheRunUsed = 0;
+    audioPlayer->bCacheRunSought = FALSE;
+    return;
+}
+
+
+/* Moves the track to the frame after the cached run being copied, so decoding carries
+ * on from there once the run is used up.  Called by the producer. */
+static void seekPastCacheRun( JAudioPlayer *audioPlayer )
+{
+    const JBlockCacheEntry *run = audioPlayer->cacheRun;
+
+    JAudioTrackSeek( audioPlayer->track, run->frame + run->fileFrames, SEEK_SET );
+    audioPlayer->bCacheRunSought = TRUE;
+    return;
+}
+
+
+/* Raises a maximum kept in a statistics counter.  Each counter has a single writer,
+ * so no read-modify-write is needed. */
+static void updateMax( unsigned long long *max, unsigned long long value )
+{
+    if( value > JATOMIC_LOAD_RELAXED( max ) )
+        JATOMIC_STORE_RELAXED( max, value );
+    return;
+}
+
+
+static void recordCallbackDuration( JCallbackCounters *counters, unsigned long long durationNs )
+{
+    const unsigned long long durationUs = durationNs / 1000;
+    int bucket = 0;
+
+    if( durationUs > 0 )
+    {
+        bucket = 64 - __builtin_clzll( durationUs );     /* floor( log2( durationUs ) ) + 1 */
+        if( bucket > JSTATS_HISTOGRAM_BUCKETS - 1 )
+            bucket = JSTATS_HISTOGRAM_BUCKETS - 1;
+    }
+    JATOMIC_ADD_SINGLE_WRITER( &counters->histogram[bucket], 1 );
+    JATOMIC_ADD_SINGLE_WRITER( &counters->callbacks, 1 );
+    JATOMIC_ADD_SINGLE_WRITER( &counters->callbackNsTotal, durationNs );
+    updateMax( &counters->callbackNsMax, durationNs );
+    return;
+}
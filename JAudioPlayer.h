@@ -28,22 +28,45 @@
 #include <semaphore.h>
 #endif
 
+#include <stdio.h>
+
 #include "portaudio.h"
 #include "sndfile.h"
 
+#include "JPlatform.h"
+#include "JAudioOutput.h"
+#include "JAudioSource.h"
+#include "JSampleConvert.h"
+#include "JResampler.h"
+#include "JDSPChain.h"
+#include "JAudioTrack.h"
+#include "JBlockCache.h"
+
 #ifndef TRUE
 #define TRUE 1
 #define FALSE 0
 #endif
 
-#define FRAMES_PER_BLOCK 256
-#define MAX_BLOCKS 4
+#define DEFAULT_FRAMES_PER_BLOCK 256
+#define DEFAULT_NUM_BLOCKS 4
+#define DEFAULT_MIN_BLOCKS 2
+#define DEFAULT_MAX_BLOCKS 32
+#define DEFAULT_REFILL_BLOCKS 0     /* Half the depth of the buffer */
+#define JPLAYER_QUEUE_SIZE 64       /* Most tracks waiting to be played */
+#define DEFAULT_CACHE_BYTES ( 16 << 20 )
+#define DEFAULT_READAHEAD_SECONDS 4.0
+#define DEFAULT_PRODUCER_PRIORITY 10    /* Above every normal thread, below the device's */
 
-#ifdef WIN32
-#define THREAD_ROUTINE_SIGNATURE unsigned int __stdcall
-#else
-#define THREAD_ROUTINE_SIGNATURE void*
-#endif
+/** Memory locked into RAM so the audio callback never waits for a page fault */
+typedef enum
+{
+    JMEMLOCK_NONE,
+    JMEMLOCK_BUFFERS,   /* The audio buffer and everything else the callback touches */
+    JMEMLOCK_ALL        /* Every page of the process, including the decode buffers of
+                         * tracks opened later, until the last player that locked
+                         * them is destroyed */
+}
+JMemoryLock;
 
 /** State of the audio player - specifically what the state of the PaStream is */
 typedef enum
@@ -54,14 +77,68 @@ typedef enum
 }
 JPlayerState;
 
-/** Buffer used to transfer audio from file to output stream */
+/** Where playback is in a track.  The producer tags each block of the audio buffer
+  * with where it starts, and the callback publishes the tag of a block as it starts
+  * playing it.
+  * @see JAudioPlayerGetPosition
+  */
+typedef struct
+{
+    unsigned    track;          /* Identifier of the track */
+    sf_count_t  frame;          /* In frames of the track's file */
+    sf_count_t  trackFrames;    /* Length of the track, SF_COUNT_MAX for a stream
+                                 * that does not give it */
+    int         bSeekable;      /* FALSE for a stream, which only seeks forward */
+    int         sampleRate;     /* Sample rate of the track's file */
+    unsigned    generation;     /* Seek request the block was decoded for */
+    int         bEnded;         /* Only silence follows the last track from here, so
+                                 * all of it has been heard */
+}
+JPlayPosition;
+
+/** Single producer/single consumer ring used to transfer audio from file to output
+  * stream.  head and tail are free running block counts; the producer thread is the
+  * only writer of head and the audio callback the only writer of tail, so each side
+  * publishes its progress with a release store and observes the other side with an
+  * acquire load.  The two indices are kept on separate cache lines.
+  * The callback wakes the producer once the blocks queued fall to lowWatermark, and
+  * not again until the producer has woken, so each wakeup refills a batch of blocks.
+  */
 typedef struct
 {
-    float       *blockPtrs[MAX_BLOCKS];
-    unsigned    head;       /* Track position of head and tail in blocks */
-    unsigned    tail;
-    unsigned    num_blocks_in_buffer;
-    volatile unsigned availableBlocks;  /* Blocks available for output */
+    /* Set up in JAudioPlayerCreate and read-only afterwards */
+    unsigned char **blockPtrs;          /* blockCapacity pointers into blockMemory */
+    unsigned char *blockMemory;         /* Backs every block */
+    unsigned    framesPerBlock;
+    unsigned    bytesPerFrame;          /* Frames are stored in the output sample format */
+    unsigned    blockCapacity;          /* Number of allocated blocks, a power of two */
+    unsigned    blockMask;              /* blockCapacity - 1, maps a count to a block */
+    unsigned    num_blocks_in_buffer;   /* Blocks the producer keeps queued, the one
+                                         * field here the producer changes as it adapts
+                                         * the depth of the buffer */
+    unsigned    minBlocks;              /* Bounds of num_blocks_in_buffer */
+    unsigned    maxBlocks;
+    unsigned    *blockGeneration;       /* Seek generation each block was decoded for */
+    JPlayPosition *blockPosition;       /* Where in its track each block starts */
+    float       *lastFrame;             /* Last frame output by the callback, faded
+                                         * out when the buffer runs empty */
+    float       *fadeFrames;            /* Block the fade out is rendered into */
+    unsigned    channels;
+    void        *memory;                /* Whole pages holding every array above and */
+    size_t      memoryBytes;            /* nothing else, so they can be locked alone */
+    int         bLocked;                /* memory is locked into RAM */
+    JCACHE_LINE_PAD( pad0, 0 );
+
+    unsigned    head;                   /* Blocks written, only written by the producer */
+    unsigned    lowWatermark;           /* Blocks queued at which the callback wakes the
+                                         * producer, set by the producer */
+    JCACHE_LINE_PAD( pad1, 2 * sizeof(unsigned) );
+    unsigned    tail;                   /* Blocks read, only written by the callback */
+    unsigned    tailOffset;             /* Frames of the block at tail already output,
+                                         * only used by the callback */
+    int         bWakePending;           /* Set by the callback when it wakes the
+                                         * producer, cleared by the producer on waking */
+    JCACHE_LINE_PAD( pad2, 3 * sizeof(unsigned) );
 
 #ifdef WIN32
     HANDLE      producerThreadEvent;    /* Event to signal that there is something
@@ -72,18 +149,303 @@ typedef struct
 }
 JCircularBuffer;
 
+/** Settings chosen when the audio player is created
+  * @see JAudioPlayerGetDefaultConfig
+  * @see JAudioPlayerCreate
+  */
+typedef struct
+{
+    unsigned    framesPerBlock;     /* Frames in each block of the audio buffer */
+    unsigned long framesPerBuffer;  /* Frames per call of paCallback, by default
+                                     * paFramesPerBufferUnspecified to let the host
+                                     * API use its native period */
+    unsigned    numBlocks;          /* Blocks queued between producer and callback at
+                                     * first, raised to twice the blocks one callback
+                                     * spans */
+    unsigned    minBlocks;          /* Bounds the producer adapts the number of blocks
+                                     * within, growing it when the callback comes */
+    unsigned    maxBlocks;          /* close to running dry and shrinking it while
+                                     * playback is smooth.  Equal bounds fix it. */
+    unsigned    refillBlocks;       /* Blocks the callback lets drain before waking the
+                                     * producer to refill them all at once, 0 for half
+                                     * the depth.  At least one callback's worth is
+                                     * always left queued. */
+    int         bMapPCM;            /* Read uncompressed WAV and AIFF files through a
+                                     * memory mapping instead of libsndfile */
+    int         bNativeFormat;      /* Open the device in the sample format of the file
+                                     * if it supports it, otherwise in its best integer
+                                     * format, and in float if it has none */
+    int         bDither;            /* Dither when the device has fewer bits than the file */
+    int         bDeviceRate;        /* Run the stream at the device's default sample
+                                     * rate, resampling the file if it differs */
+    JResampleQuality resampleQuality;
+    size_t      cacheBytes;         /* Memory for blocks decoded at seek targets and cue
+                                     * points, 0 to decode every seek from the file */
+    double      readAheadSeconds;   /* Audio read from files decoded by libsndfile ahead
+                                     * of the decoder by an I/O thread per track, 0 to
+                                     * read them on the producer thread */
+    int         bSeekIndex;         /* Index FLAC files without a seek table in the
+                                     * background, so seeking does not bisect them */
+    int         bSaveSeekIndex;     /* Save indexes next to the files, so they are
+                                     * quick to seek as soon as they are opened again */
+    JSchedPolicy producerPolicy;    /* Scheduling of the producer thread.  Without the
+                                     * privileges for it the producer runs as a normal
+                                     * thread, with a warning. */
+    int         producerPriority;   /* Real-time priority of the producer, 1 to 99 */
+    int         producerCpu;        /* Processor to pin the producer to, -1 for any */
+    JMemoryLock memoryLock;         /* Falls back to less, with a warning, if the
+                                     * memory lock limit is too low */
+
+    JAudioOutputConfig  output;     /* Output backend, PortAudio unless changed */
+}
+JAudioPlayerConfig;
+
+/** Number of buckets in the callback duration histogram.  Bucket 0 counts callbacks
+  * shorter than 1 microsecond, bucket i callbacks of at least 2^(i-1) and less than
+  * 2^i microseconds, and the last bucket everything longer.
+  */
+#define JSTATS_HISTOGRAM_BUCKETS 16
+
+/** Counters updated by paCallback.  Only the callback writes them, using relaxed
+  * atomic stores so they can be read at any time from another thread.
+  * @see JATOMIC_ADD_SINGLE_WRITER
+  */
+typedef struct
+{
+    unsigned long       callbacks;
+    unsigned long       underruns;
+    unsigned long       outputUnderflows;
+    unsigned long       outputOverflows;
+    unsigned long       histogram[JSTATS_HISTOGRAM_BUCKETS];
+    unsigned long long  callbackNsTotal;
+    unsigned long long  callbackNsMax;
+    unsigned            fillMin;
+    unsigned long long  fillTotal;
+    unsigned long       seeks;
+    unsigned long long  seekNsLast;
+    unsigned long long  seekNsTotal;
+    unsigned long long  seekNsMax;
+    unsigned            playedGeneration;   /* Seek generation of the last block played */
+    unsigned long       nearEmpty;          /* Calls that left less than a block queued */
+    unsigned long       framesPerCallbackMax;
+    unsigned long       producerSignals;    /* Times the callback woke the producer */
+    unsigned long long  firstAudioNs;       /* When the first block was played, 0 until
+                                             * then */
+}
+JCallbackCounters;
+
+/** Counters updated by the producer thread, in the same way as JCallbackCounters */
+typedef struct
+{
+    unsigned long       wakeups;
+    unsigned long       timeouts;           /* Wakeups with no signal */
+    unsigned long       overruns;
+    unsigned long long  startNs;            /* When the producer started */
+    unsigned long long  sleepNsTotal;       /* Time spent waiting to be woken */
+    unsigned long long  cpuNs;              /* Processor time used since then */
+    unsigned long long  framesDecoded;
+    unsigned long       blocksDecoded;
+    unsigned long long  readNsTotal;
+    unsigned long long  readNsMax;
+    unsigned long long  stallNsTotal;       /* Part of readNsTotal spent waiting for
+                                             * read-ahead */
+    unsigned long       refills;
+    unsigned long long  wakeToReadyNsTotal;
+    unsigned long long  wakeToReadyNsMax;
+    unsigned long       trackSwitches;
+    unsigned long       trackGapBlocks;
+    unsigned long       depthGrows;
+    unsigned long       depthShrinks;
+}
+JProducerCounters;
+
+/** State of the adaptive buffer depth, only used by the producer thread */
+typedef struct
+{
+    unsigned long       underruns;          /* Callback counters when last checked */
+    unsigned long       nearEmpty;
+    unsigned long long  windowStartNs;      /* Start of the current stretch of smooth */
+    unsigned long long  windowWakeNsMax;    /* playback, and its longest refill */
+}
+JDepthController;
+
+/** Snapshot of the playback statistics
+  * @see JAudioPlayerGetStats
+  */
+typedef struct
+{
+    /* Audio callback */
+    unsigned long   callbacks;
+    unsigned long   underruns;          /* Callbacks that found the audio buffer empty
+                                         * and output silence instead of waiting, not
+                                         * counting the refill after a seek */
+    unsigned long   outputUnderflows;   /* Callbacks PortAudio flagged with
+                                         * paOutputUnderflow */
+    unsigned long   outputOverflows;    /* Callbacks PortAudio flagged with
+                                         * paOutputOverflow */
+    unsigned long   callbackHistogram[JSTATS_HISTOGRAM_BUCKETS];   /* Callback durations */
+    double          callbackUsAverage;
+    double          callbackUsMax;
+    unsigned        fillMin;            /* Fewest blocks queued when the callback ran */
+    double          fillAverage;        /* Average blocks queued when the callback ran */
+    unsigned long   nearEmpty;          /* Callbacks that left less than a block queued */
+    unsigned        bufferBlocks;       /* Blocks the producer keeps queued now */
+    unsigned        minBlocks;
+    unsigned        maxBlocks;
+    unsigned long   seeks;              /* Seeks that have reached the output */
+    double          seekMsLast;         /* From the seek request to its first block */
+    double          seekMsAverage;      /* being played */
+    double          seekMsMax;
+    unsigned long   seeksRefused;       /* Requests the track could not follow, such as
+                                         * going back in a pipe */
+
+    /* Startup */
+    double          openMs;             /* Time JAudioPlayerCreate took */
+    double          firstAudioMs;       /* From JAudioPlayerCreate to the first block
+                                         * played, 0 until then */
+
+    /* Producer thread */
+    unsigned long   producerWakeups;    /* Times the producer thread woke up */
+    unsigned long   producerSignals;    /* Wakeups asked for by the callback */
+    unsigned long   producerTimeouts;   /* Wakeups after waiting a second for nothing */
+    unsigned long   overruns;           /* Signalled wakeups that found the buffer
+                                         * already full, other than for a seek */
+    double          wakeupsPerSecond;   /* Since the producer started */
+    double          blocksPerRefill;    /* Blocks decoded per wakeup that found room */
+    double          producerIdlePercent;    /* Time the producer spent waiting */
+    double          producerCpuPercent;     /* Processor time of one core it used */
+    unsigned        lowWatermark;       /* Blocks queued when the producer is woken */
+    unsigned long long framesDecoded;   /* Frames read from the audio file */
+    unsigned long   blocksDecoded;
+    double          readUsAverage;      /* Time spent reading the file per block */
+    double          readUsMax;
+    double          decodeUsAverage;    /* The same without waiting for read-ahead */
+    double          wakeToReadyUsAverage;   /* From a wakeup to the buffer being full */
+    double          wakeToReadyUsMax;
+    unsigned long   trackSwitches;      /* Changes to the next queued track */
+    unsigned long   trackGapBlocks;     /* Blocks of silence output while a queued track
+                                         * was still being opened */
+    unsigned long   depthGrows;         /* Changes to bufferBlocks */
+    unsigned long   depthShrinks;
+
+    /* Block cache */
+    unsigned long   cacheHits;          /* Seeks served from decoded blocks in memory */
+    unsigned long   cacheMisses;        /* Seeks decoded from the file */
+    unsigned        cacheEntries;
+    size_t          cacheBytes;
+
+    /* Read-ahead I/O threads */
+    unsigned long long ioBytesRead;
+    unsigned long   ioReads;
+    double          ioReadUsAverage;    /* Time each read of the file took */
+    double          ioReadUsMax;
+    unsigned long   ioStalls;           /* Reads by a decoder that waited for the disk */
+    double          ioStallMsTotal;
+    double          ioStallMsMax;
+    unsigned long   ioRefetches;        /* Seeks outside the bytes read ahead */
+
+    /* Effects chain */
+    unsigned        dspStageCount;
+    JDSPStageStats  dspStages[JDSP_MAX_STAGES];
+    double          dspUsAverage;       /* Time all the stages took per block */
+    double          dspCorePercent;     /* Share of one core they need at real time */
+
+    /* Scheduling */
+    JSchedPolicy    producerPolicy;     /* What the producer thread was given, which */
+    int             producerPriority;   /* may be less than was asked for */
+    int             producerCpu;        /* -1 when not pinned */
+    JMemoryLock     memoryLock;
+}
+JAudioPlayerStats;
+
+/** Routine called from the producer thread once a seek request has been applied
+  * @param seekId Value returned by JAudioPlayerSeekAsync for the applied request
+  * @param frameOffset New position of the cursor in frames, or -1 if the seek failed,
+  * in which case playback carries on from the block that was being heard
+  * @param userData Pointer passed to JAudioPlayerSetSeekCallback
+  * @see JAudioPlayerSetSeekCallback
+  */
+typedef void (*JSeekCompleteCallback)( unsigned seekId, sf_count_t frameOffset, void *userData );
+
 /** Contains information needed to synchronize the seek cursor position
-  * across threads
-  * @see JAudioPlayerSeek
+  * across threads.  Requests are published with a sequence lock: sequence is odd
+  * while a control thread writes frames and whence, and sequence / 2 is the
+  * generation of the latest request.  Blocks queued in the audio buffer are tagged
+  * with the generation they were decoded for, so the callback can drop blocks
+  * decoded before the latest seek.
+  * @see JAudioPlayerSeekAsync
   */
 typedef struct
 {
-    volatile int        bChangeSeek;
-    volatile sf_count_t frames;
-    volatile int        whence;
+    unsigned            sequence;
+    unsigned            trackId;                /* Track heard when the request was made */
+    sf_count_t          frames;
+    int                 whence;
+    unsigned            completedGeneration;    /* Latest generation applied by the producer */
+    unsigned long long  requestTimeNs;          /* When the latest request was made */
+    unsigned long       seeksRefused;           /* Requests the track could not follow,
+                                                 * added to by any thread */
+
+    JSeekCompleteCallback   callback;
+    void                    *callbackUserData;
 }
 JChangeSeekInfo;
 
+/** Tracks waiting to be played.  Paths are opened in order by the loader thread,
+  * which keeps the next track open and its start decoded so the producer can switch
+  * to it without touching the disk.  Everything here is protected by lock.
+  * @see JAudioPlayerEnqueue
+  */
+typedef struct
+{
+    JMutex      lock;
+    char        *paths[JPLAYER_QUEUE_SIZE];     /* Waiting to be opened, first at pathHead */
+    unsigned    pathIds[JPLAYER_QUEUE_SIZE];
+    unsigned    pathHead;
+    unsigned    pathCount;
+    JAudioTrack *next;                          /* Opened, waiting for the producer */
+    JAudioTrack *started;                       /* Taken by the producer, for the loader to
+                                                 * point the cache and indexer at */
+    JAudioTrack *retired;                       /* Finished with by the producer, for the
+                                                 * loader to close */
+    unsigned    loading;                        /* 1 while the loader opens a path */
+    unsigned    clears;                         /* Times the queue has been cleared */
+    unsigned    lastTrackId;
+
+    JThread     loaderThread;
+    JEvent      loaderEvent;                    /* Something was queued or taken */
+    volatile int bLoaderQuit;
+}
+JTrackQueue;
+
+/** Builds seek indexes in the background for the track being read.  Once the track is
+  * indexed it is opened again through the index, its read-ahead started by the loader
+  * thread, and handed to the producer, which swaps it in at the next seek.  The loader
+  * closes the source it replaced.  Everything but bCancel and bQuit is protected by
+  * lock.
+  * @see JSeekIndexBuild
+  */
+typedef struct
+{
+    JMutex      lock;
+    unsigned    trackId;                        /* Track being read */
+    char        *path;                          /* NULL when it needs no index */
+    JAudioSource *opened;                       /* Indexed source of trackId, waiting for
+                                                 * the loader to start its read-ahead */
+    JAudioSource *source;                       /* Indexed source of trackId, waiting for
+                                                 * the producer */
+    JAudioSource *retired;                      /* Replaced by the producer, for the
+                                                 * loader to close */
+    int         bSave;                          /* Write a sidecar for each index built */
+    int         bRunning;                       /* Indexer thread was started */
+
+    JThread     thread;
+    JEvent      event;                          /* The track changed */
+    volatile int bCancel;                       /* Abandon the index being built */
+    volatile int bQuit;
+}
+JTrackIndexer;
+
 /** Contains information used by PortAudio API and information used by the producer thread
   * @see JAudioPlayerCreate
   * @see JAudioPlayerStart
@@ -92,16 +454,55 @@ JChangeSeekInfo;
   */
 typedef struct
 {
-    /* PortAudio variables */
-    PaStreamParameters  outputParameters;
-    PaStream            *stream;
+    /* Output stream, the PortAudio callback is paCallback */
+    JAudioOutput        *output;
 
-    /* sndfile API variables */
+    /* sfInfo describes the file the player was created with, which decided the
+     * channel count of the stream */
     SF_INFO          sfInfo;
-    SNDFILE         *sfPtr;
 
-    volatile sf_count_t seekFrames;
+    /* Track being read by the producer.  seekFrames is the cursor within it and
+     * trackFrames its length, both in frames of the file.  bTrackSeekable is FALSE
+     * while it is a stream.  Control threads only read readTrack and seekFrames, which
+     * the producer stores atomically; the rest is only used by the producer. */
+    JAudioTrack         *track;
+    unsigned            readTrack;      /* Same as track->trackId */
+    sf_count_t          seekFrames;
+    sf_count_t          trackFrames;
+    int                 bTrackSeekable;
+    sf_count_t          framesAfterEnd; /* Silence written since the last track ended
+                                         * with nothing to follow it, and whether it */
+    int                 bQueueDrained;  /* had, only used by the producer */
+    sf_count_t          resumeFrame;    /* First frame of track queued for the latest
+                                         * request applied, where a seek that fails
+                                         * carries on from.  Only used by the producer. */
     JChangeSeekInfo     seekerInfo;
+    JTrackQueue         queue;
+    JTrackIndexer       indexer;
+    unsigned            playingTrack;   /* Track of the block the callback last started */
+    unsigned            positionSequence;   /* Sequence lock on position, odd while */
+    JPlayPosition       position;           /* the callback writes it */
+    unsigned long long  createNs;       /* When JAudioPlayerCreate was called, and how */
+    unsigned long long  openNs;         /* long it took */
+
+    /* Runs decoded around seek targets and cue points.  While cacheRun is set the
+     * producer copies blocks from it, and moves the track's own cursor to where the
+     * run ends once the ring is full.  NULL cache when disabled. */
+    JBlockCache         *cache;
+    JBlockCacheEntry    *cacheRun;
+    unsigned long       cacheRunUsed;   /* Stream frames of cacheRun already copied */
+    int                 bCacheRunSought;    /* The track has been moved past cacheRun */
+
+    /* Format of the audio buffer and the output stream */
+    JStreamFormat   stream;
+    JSampleFormat   format;             /* Same as stream.format */
+    JDither         dither;             /* Only used by the producer thread */
+
+    /* Effects run by the producer on each block on its way into the audio buffer, after
+     * the block cache.  Stages are added and changed through the JDSPChain routines.
+     * dspBuffer holds a block decoded as float for them when the stream is not float. */
+    JDSPChain       *dsp;
+    float           *dspBuffer;
 
     /* Buffer producer thread variables */
 #ifdef WIN32
@@ -110,19 +511,85 @@ typedef struct
 #else
     pthread_t       threadID_Producer;
 #endif
+    JSchedPolicy    producerPolicy;     /* As asked for in the config until the producer */
+    int             producerPriority;   /* has started, then what it was given */
+    int             producerCpu;
+    JMemoryLock     memoryLock;         /* Memory that was locked */
 
     volatile int    bTimeToQuit;        /* Flag signal time for thread shutdown */
 
     JCircularBuffer audioBuffer;
+    JDepthController depthController;
+    unsigned        refillBlocks;       /* As in the config */
     JPlayerState    state;
+    JEvent          resumeEvent;        /* Signalled when a pause ends, for the null
+                                         * output waiting in audioReady */
+    volatile int    bStoppingOutput;    /* Set while the output is being stopped */
+
+    /* Statistics, each set of counters on its own cache lines */
+    JCACHE_LINE_PAD( padCallbackCounters, 0 );
+    JCallbackCounters   callbackCounters;
+    JCACHE_LINE_PAD( padProducerCounters, 0 );
+    JProducerCounters   producerCounters;
+    JCACHE_LINE_PAD( padIOCounters, 0 );
+    JReadAheadCounters  ioCounters;     /* Shared by the read-ahead of every track */
 }
 JAudioPlayer;
 
+/** @brief Fills in a JAudioPlayerConfig with the default settings
+  * @param config Pointer to the configuration to fill in
+  */
+void JAudioPlayerGetDefaultConfig( JAudioPlayerConfig *config );
+
 /** @brief Initializes JAudioPlayer.  JAudioPlayerDestroy must be called to free
   * resources allocated by JAudioPlayerCreate.
+  * @param filePath Path of the audio file to be played
+  * @param config Buffering settings, or NULL to use the defaults
+  * @return Pointer to an initialized JAudioPlayer object, returns NULL on failure
+  */
+JAudioPlayer* JAudioPlayerCreate( const char *filePath, const JAudioPlayerConfig *config );
+
+/** @brief Same as JAudioPlayerCreate for audio streamed by the application, such as a
+  * decoder or generator running upstream.  Playback starts as soon as the header and
+  * the first block have arrived.  The stream is read once, front to back: seeking
+  * forward decodes up to the target and drops it, while seeking back or from the end
+  * is refused without touching what is queued to play.  Pipes and standard input,
+  * as "-", can be passed to JAudioPlayerCreate instead.
+  * @param byteSource Routines to read the stream with, copied.  byteSource->close is
+  * called when the player is destroyed, or before returning if creation fails.
+  * @param config Buffering settings, or NULL to use the defaults
   * @return Pointer to an initialized JAudioPlayer object, returns NULL on failure
   */
-JAudioPlayer* JAudioPlayerCreate( const char *filePath );
+JAudioPlayer* JAudioPlayerCreateFromSource( const JByteSource *byteSource, const JAudioPlayerConfig *config );
+
+/** @brief Adds an audio file to the end of the play queue.  It is opened and its start
+  * decoded in the background, then played straight after the track before it without
+  * a gap.  Files with a different sample rate, channel count or sample format are
+  * converted to those of the stream.
+  * @param filePath Path of the audio file, copied
+  * @return Identifier the track is reported with by JAudioPlayerGetPlayingTrack, or
+  * -1 if the queue is full.  The file given to JAudioPlayerCreate is track 0.
+  */
+int JAudioPlayerEnqueue( JAudioPlayer *audioPlayer, const char *filePath );
+
+/** @brief Removes every track from the play queue.  The track playing is not affected. */
+void JAudioPlayerClearQueue( JAudioPlayer *audioPlayer );
+
+/** @brief Returns the number of tracks queued after the one being read */
+unsigned JAudioPlayerGetQueueLength( JAudioPlayer *audioPlayer );
+
+/** @brief Returns the identifier of the track being heard */
+unsigned JAudioPlayerGetPlayingTrack( JAudioPlayer *audioPlayer );
+
+/** @brief Registers a point of a track that is likely to be sought to, such as the
+  * start of a chorus.  Blocks from it are decoded into the block cache in the
+  * background so a later seek there plays straight from memory.  Cue points of a
+  * queued track are decoded once it starts, and forgotten when the track after it
+  * does.  The start of the first track always is one.
+  * @param trackId The track being read, or one returned by JAudioPlayerEnqueue
+  * @param frames Position of the cue point in frames
+  */
+void JAudioPlayerAddCuePoint( JAudioPlayer *audioPlayer, unsigned trackId, sf_count_t frames );
 
 /** @brief Starts the playing the audio stream */
 void JAudioPlayerPlay( JAudioPlayer *audioPlayer );
@@ -133,14 +600,62 @@ void JAudioPlayerPause( JAudioPlayer *audioPlayer );
 /** @brief Stops the audio stream */
 void JAudioPlayerStop( JAudioPlayer *audioPlayer );
 
+/** @brief Requests the cursor within the track being heard be moved and returns
+  * immediately.  Blocks already queued from the old position are dropped by the
+  * callback.  A newer request supersedes one the producer has not applied yet.
+  * Safe to call from any number of control threads.  A request that could never be
+  * followed is refused straight away and the identifier of the request before it
+  * returned: one made once the producer has moved on to reading the next track, or
+  * one a stream could not follow, back from where it has been decoded to or from its
+  * end.  A target past either end of the track is moved to that end.
+  * @param frames Offset of frames the cursor will be set to from the whence parameter
+  * @param whence One of the values SEEK_SET (from beginning of data) SEEK_CUR (from
+  * current location SEEK_END (fromt end of data).  SEEK_CUR is taken from the
+  * position being heard, or from the target of a request that has not been heard
+  * yet, so requests made in a row add up.
+  * @return Identifier of the request, to be passed to JAudioPlayerSeekIsComplete
+  */
+unsigned JAudioPlayerSeekAsync( JAudioPlayer *audioPlayer, sf_count_t frames, int whence );
+
+/** @brief Checks whether the producer thread has applied a seek request
+  * @param seekId Value returned by JAudioPlayerSeekAsync
+  * @return TRUE once the request, or a request issued after it, has been applied
+  */
+int JAudioPlayerSeekIsComplete( JAudioPlayer *audioPlayer, unsigned seekId );
+
+/** @brief Sets a routine to be called from the producer thread each time a seek
+  * request is applied.  Should be set before seek requests are issued.
+  * @param callback Routine to call, or NULL to disable notification
+  * @param userData Pointer passed through to the callback
+  */
+void JAudioPlayerSetSeekCallback( JAudioPlayer *audioPlayer, JSeekCompleteCallback callback, void *userData );
+
+/** @brief Reports the position being heard, to within a block.  While a seek has not
+  * been heard yet, frame is its target.  bEnded tells when the end of the last track
+  * has been heard.  Safe to call from any thread.
+  * @param position Pointer to the structure to fill in
+  */
+void JAudioPlayerGetPosition( JAudioPlayer *audioPlayer, JPlayPosition *position );
+
 /** @brief Signals to set the cursor within the data section of the opened audio file.
-  * Only returns when the producer thread has seen the request to change the seek cursor
-  * position and changes it.
+  * Same as JAudioPlayerSeekAsync without returning the request identifier.
   * @param frames Offset of frames the cursor will be set to from the whence parameter
   * @param whence One of the values SEEK_SET (from beginning of data) SEEK_CUR (from
   * current location SEEK_END (fromt end of data)
   */
-inline void JAudioPlayerSeek( JAudioPlayer *audioPlayer, sf_count_t frames, int whence );
+void JAudioPlayerSeek( JAudioPlayer *audioPlayer, sf_count_t frames, int whence );
+
+/** @brief Takes a snapshot of the playback statistics.  Safe to call from any thread
+  * while the stream is running.
+  * @param stats Pointer to the structure to fill in
+  */
+void JAudioPlayerGetStats( JAudioPlayer *audioPlayer, JAudioPlayerStats *stats );
+
+/** @brief Prints a statistics snapshot as a few lines of text
+  * @param stats Snapshot filled in by JAudioPlayerGetStats
+  * @param stream Where to print, e.g. stdout
+  */
+void JAudioPlayerPrintStats( const JAudioPlayerStats *stats, FILE *stream );
 
 /** @brief Used to destroy JAudioPlayer initialized with JAudioPlayerCreate
   * @param audioPlayer Pointer to a pointer to a JAudioPlayer structure. Pointer to
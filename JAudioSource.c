@@ -0,0 +1,682 @@
+/* JAudioSource.c Contains routines for reading audio files, including the memory
+ * mapped fast path for uncompressed PCM
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "JAudioSource.h"
+
+/* Bytes of the mapping the kernel is asked to read ahead of the cursor at a time */
+#define PCM_READAHEAD_BYTES ( 1 << 20 )
+
+static int mapFile( JPCMMapping *map, const char *filePath );
+static void unmapFile( JPCMMapping *map );
+static int findDataChunk( JPCMMapping *map, const SF_INFO *sfInfo );
+static void adviseReadAhead( JPCMMapping *map, size_t offset );
+static JAudioSource* openReader( JReadAhead *reader, const char *name );
+static sf_count_t skipForward( JAudioSource *source, sf_count_t target );
+static void setSampleFormat( JAudioSource *source );
+static sf_count_t plainLength( void *userData );
+static sf_count_t plainSeek( sf_count_t offset, int whence, void *userData );
+static sf_count_t plainRead( void *ptr, sf_count_t count, void *userData );
+static sf_count_t plainTell( void *userData );
+static sf_count_t indexedLength( void *userData );
+static sf_count_t indexedSeek( sf_count_t offset, int whence, void *userData );
+static sf_count_t indexedRead( void *ptr, sf_count_t count, void *userData );
+static sf_count_t indexedWrite( const void *ptr, sf_count_t count, void *userData );
+static sf_count_t indexedTell( void *userData );
+
+JAudioSource* JAudioSourceOpen( const char *filePath, int bAllowMapping )
+{
+    JAudioSource *source = NULL;
+    JReadAhead *reader;
+    JSeekIndex *index;
+
+    /* A file indexed before is opened through its index straight away */
+    if( ( index = JSeekIndexLoad( filePath ) ) != NULL &&
+        ( source = JAudioSourceOpenIndexed( filePath, index ) ) != NULL )
+        return source;
+
+    reader = JReadAheadOpen( filePath );
+    if( reader == NULL )
+    {
+        printf( "  Error: Could not open soundfile: %s\n", filePath );
+        return NULL;
+    }
+    source = openReader( reader, filePath );
+    if( source == NULL )
+        return NULL;
+
+    /* Uncompressed files are read straight from a mapping of the file.  Anything
+     * the header parser does not fully understand stays with libsndfile, and so
+     * does anything read from a pipe. */
+    if( bAllowMapping && source->bSeekable && mapFile( &source->map, filePath ) == 0 )
+    {
+        if( findDataChunk( &source->map, &source->sfInfo ) == 0 )
+        {
+            source->bMapped = TRUE;
+            adviseReadAhead( &source->map, 0 );
+        }
+        else
+            unmapFile( &source->map );
+    }
+
+    return source;
+}
+
+
+JAudioSource* JAudioSourceOpenStream( const JByteSource *byteSource )
+{
+    JReadAhead *reader;
+
+    reader = JReadAheadOpenSource( byteSource );
+    if( reader == NULL )
+    {
+        printf( "  Error: Could not open stream\n" );
+        return NULL;
+    }
+    return openReader( reader, "stream" );
+}
+
+
+JAudioSource* JAudioSourceOpenIndexed( const char *filePath, JSeekIndex *index )
+{
+    static SF_VIRTUAL_IO indexedIO = { indexedLength, indexedSeek, indexedRead, indexedWrite, indexedTell };
+    JAudioSource *source = NULL;
+
+    source = (JAudioSource*)calloc( 1, sizeof(JAudioSource) );
+    if( source == NULL )
+    {
+        JSeekIndexDestroy( &index );
+        return NULL;
+    }
+    source->index = index;
+    source->reader = JReadAheadOpen( filePath );
+    if( source->reader == NULL )
+    {
+        printf( "  Error: Could not open soundfile: %s\n", filePath );
+        JSeekIndexDestroy( &source->index );
+        free( source );
+        return NULL;
+    }
+    source->virtualPosition = 0;
+
+    source->sfInfo.format = 0;
+    source->sfPtr = sf_open_virtual( &indexedIO, SFM_READ, &source->sfInfo, source );
+    if( source->sfPtr == NULL )
+    {
+        printf( "  Error: Could not open soundfile: %s\n", filePath );
+        JReadAheadClose( &source->reader );
+        JSeekIndexDestroy( &source->index );
+        free( source );
+        return NULL;
+    }
+    source->bMapped = FALSE;
+    source->position = 0;
+    source->bSeekable = TRUE;
+    setSampleFormat( source );
+    return source;
+}
+
+
+void JAudioSourceStartReadAhead( JAudioSource *source, double seconds, JReadAheadCounters *counters,
+                                 const volatile int *bCancel )
+{
+    const double duration = source->sfInfo.samplerate > 0 ? (double)source->sfInfo.frames / source->sfInfo.samplerate : 0.0;
+    double bytesPerSecond;
+
+    if( source->bMapped )
+        return;
+    JReadAheadSetCancelFlag( source->reader, bCancel );
+    if( seconds <= 0 )
+        return;
+
+    /* Compressed files are sized by their average bit rate, which is close enough
+     * with a ring rounded up to a power of two.  A stream has no length to go by, so
+     * its ring is bounded by what the audio would take as float. */
+    if( duration > 0 && source->bSeekable )
+        bytesPerSecond = JReadAheadLength( source->reader ) / duration;
+    else
+        bytesPerSecond = (double)source->sfInfo.samplerate * source->sfInfo.channels * sizeof(float);
+    JReadAheadStart( source->reader, (size_t)( seconds * bytesPerSecond ), counters );
+    return;
+}
+
+
+sf_count_t JAudioSourceReadFloat( JAudioSource *source, float *dest, sf_count_t frames )
+{
+    const JPCMMapping *map = &source->map;
+    const unsigned char *src;
+    sf_count_t  samples, i;
+
+    if( !source->bMapped )
+    {
+        frames = sf_readf_float( source->sfPtr, dest, frames );
+        source->position += frames;
+        return frames;
+    }
+
+    if( frames > source->sfInfo.frames - source->position )
+        frames = source->sfInfo.frames - source->position;
+    if( frames <= 0 )
+        return 0;
+
+    src = map->data + source->position * map->bytesPerFrame;
+    samples = frames * source->sfInfo.channels;
+    adviseReadAhead( &source->map, (size_t)( src - map->base ) + (size_t)( frames * map->bytesPerFrame ) );
+
+    if( map->bBigEndian == JHOST_BIG_ENDIAN )
+    {
+        JConvertToFloat( src, map->encoding, dest, (size_t)samples );
+        source->position += frames;
+        return frames;
+    }
+
+    /* Samples in the other byte order, convert with the same scaling libsndfile
+     * uses for normalized float reads */
+    switch( map->encoding )
+    {
+        case JSAMPLE_INT16:
+            for( i=0; i<samples; i++, src+=2 )
+            {
+                short value = map->bBigEndian ? (short)( src[0] << 8 | src[1] )
+                                              : (short)( src[1] << 8 | src[0] );
+                dest[i] = value * ( 1.0f / 0x8000 );
+            }
+            break;
+        case JSAMPLE_INT24:
+            for( i=0; i<samples; i++, src+=3 )
+            {
+                int value = map->bBigEndian ? (int)( (unsigned)src[0] << 24 | src[1] << 16 | src[2] << 8 )
+                                            : (int)( (unsigned)src[2] << 24 | src[1] << 16 | src[0] << 8 );
+                dest[i] = ( value >> 8 ) * ( 1.0f / 0x800000 );
+            }
+            break;
+        case JSAMPLE_INT32:
+            for( i=0; i<samples; i++, src+=4 )
+            {
+                int value = map->bBigEndian ? (int)( (unsigned)src[0] << 24 | src[1] << 16 | src[2] << 8 | src[3] )
+                                            : (int)( (unsigned)src[3] << 24 | src[2] << 16 | src[1] << 8 | src[0] );
+                dest[i] = value * ( 1.0f / 0x80000000u );
+            }
+            break;
+        case JSAMPLE_FLOAT32:
+            for( i=0; i<samples; i++, src+=4 )
+            {
+                unsigned bits = map->bBigEndian ? (unsigned)src[0] << 24 | src[1] << 16 | src[2] << 8 | src[3]
+                                                : (unsigned)src[3] << 24 | src[2] << 16 | src[1] << 8 | src[0];
+                memcpy( &dest[i], &bits, sizeof(float) );
+            }
+            break;
+    }
+
+    source->position += frames;
+    return frames;
+}
+
+
+int JAudioSourceCanRead( const JAudioSource *source, JSampleFormat format )
+{
+    if( source->bMapped )
+        return format == source->map.encoding && source->map.bBigEndian == JHOST_BIG_ENDIAN;
+
+    /* libsndfile reads 16 and 32 bit integers without going through float */
+    return format == source->format && format != JSAMPLE_INT24;
+}
+
+
+sf_count_t JAudioSourceRead( JAudioSource *source, void *dest, JSampleFormat format, sf_count_t frames )
+{
+    if( !source->bMapped )
+    {
+        switch( format )
+        {
+            case JSAMPLE_INT16:     frames = sf_readf_short( source->sfPtr, (short*)dest, frames ); break;
+            case JSAMPLE_INT32:     frames = sf_readf_int( source->sfPtr, (int*)dest, frames ); break;
+            default:                frames = sf_readf_float( source->sfPtr, (float*)dest, frames ); break;
+        }
+        source->position += frames;
+        return frames;
+    }
+
+    if( frames > source->sfInfo.frames - source->position )
+        frames = source->sfInfo.frames - source->position;
+    if( frames <= 0 )
+        return 0;
+
+    adviseReadAhead( &source->map, (size_t)( source->map.data - source->map.base ) +
+                                   (size_t)( ( source->position + frames ) * source->map.bytesPerFrame ) );
+    memcpy( dest, source->map.data + source->position * source->map.bytesPerFrame,
+            (size_t)( frames * source->map.bytesPerFrame ) );
+    source->position += frames;
+    return frames;
+}
+
+
+sf_count_t JAudioSourceSeek( JAudioSource *source, sf_count_t frames, int whence )
+{
+    sf_count_t target;
+
+    if( !source->bMapped && source->bSeekable )
+    {
+        if( ( target = sf_seek( source->sfPtr, frames, whence ) ) >= 0 )
+            source->position = target;
+        return target;
+    }
+
+    /* Seeking in a mapping is only pointer arithmetic */
+    switch( whence )
+    {
+        case SEEK_SET:  target = frames; break;
+        case SEEK_CUR:  target = source->position + frames; break;
+        case SEEK_END:  target = source->bSeekable ? source->sfInfo.frames + frames : -1; break;
+        default:        return -1;
+    }
+    if( !source->bSeekable )
+        return target < source->position ? -1 : skipForward( source, target );
+    if( target < 0 || target > source->sfInfo.frames )
+        return -1;
+
+    source->position = target;
+    source->map.advisedEnd = 0;
+    adviseReadAhead( &source->map, (size_t)( source->map.data - source->map.base ) +
+                                   (size_t)( target * source->map.bytesPerFrame ) );
+    return target;
+}
+
+
+void JAudioSourceClose( JAudioSource **sourcePtr )
+{
+    JAudioSource *source = *sourcePtr;
+
+    if( source == NULL )
+        return;
+
+    if( source->bMapped )
+        unmapFile( &source->map );
+    sf_close( source->sfPtr );
+    JReadAheadClose( &source->reader );
+    JSeekIndexDestroy( &source->index );
+    free( source );
+    *sourcePtr = NULL;
+
+    return;
+}
+
+
+/* Opens reader with libsndfile.  On failure reader is closed. */
+static JAudioSource* openReader( JReadAhead *reader, const char *name )
+{
+    static SF_VIRTUAL_IO plainIO = { plainLength, plainSeek, plainRead, indexedWrite, plainTell };
+    JAudioSource *source = NULL;
+
+    source = (JAudioSource*)malloc( sizeof(JAudioSource) );
+    if( source == NULL )
+    {
+        JReadAheadClose( &reader );
+        return NULL;
+    }
+    source->index = NULL;
+    source->reader = reader;
+
+    /* Open soundfile and fill in sfInfo */
+    source->sfInfo.format = 0;      /* sndfile API requires format be set to zero before calling sf_open */
+    source->sfPtr = sf_open_virtual( &plainIO, SFM_READ, &source->sfInfo, source );
+    if( source->sfPtr == NULL )
+    {
+        printf( "  Error: Could not open soundfile: %s\n", name );
+        JReadAheadClose( &source->reader );
+        free( source );
+        return NULL;
+    }
+
+    source->bMapped = FALSE;
+    source->position = 0;
+    source->bSeekable = JReadAheadIsSeekable( reader );
+    if( !source->bSeekable )
+    {
+        /* libsndfile takes every virtual file to be seekable */
+        source->sfInfo.seekable = FALSE;
+        if( source->sfInfo.frames <= 0 )
+            source->sfInfo.frames = SF_COUNT_MAX;
+    }
+    setSampleFormat( source );
+    return source;
+}
+
+
+/* Decodes a stream up to target and drops what was decoded.  Returns target, or -1
+ * if the stream ended first. */
+static sf_count_t skipForward( JAudioSource *source, sf_count_t target )
+{
+    float       discard[4096];
+    sf_count_t  frames, n;
+
+    while( source->position < target )
+    {
+        frames = (sf_count_t)( sizeof(discard) / sizeof(float) ) / source->sfInfo.channels;
+        if( frames > target - source->position )
+            frames = target - source->position;
+        if( ( n = sf_readf_float( source->sfPtr, discard, frames ) ) <= 0 )
+            return -1;
+        source->position += n;
+    }
+    return target;
+}
+
+
+static int mapFile( JPCMMapping *map, const char *filePath )
+{
+#ifdef WIN32
+    LARGE_INTEGER size;
+
+    map->fileHandle = CreateFileA( filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                   FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( map->fileHandle == INVALID_HANDLE_VALUE )
+        return -1;
+    if( !GetFileSizeEx( map->fileHandle, &size ) || size.QuadPart == 0 ||
+        (unsigned long long)size.QuadPart > (size_t)-1 )
+    {
+        CloseHandle( map->fileHandle );
+        return -1;
+    }
+    map->mappingHandle = CreateFileMappingA( map->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( map->mappingHandle == NULL )
+    {
+        CloseHandle( map->fileHandle );
+        return -1;
+    }
+    map->base = (const unsigned char*)MapViewOfFile( map->mappingHandle, FILE_MAP_READ, 0, 0, 0 );
+    if( map->base == NULL )
+    {
+        CloseHandle( map->mappingHandle );
+        CloseHandle( map->fileHandle );
+        return -1;
+    }
+    map->length = (size_t)size.QuadPart;
+#else
+    struct stat fileStat;
+    void *base;
+    int fd;
+
+    fd = open( filePath, O_RDONLY );
+    if( fd < 0 )
+        return -1;
+    if( fstat( fd, &fileStat ) < 0 || fileStat.st_size == 0 ||
+        (unsigned long long)fileStat.st_size > (size_t)-1 )
+    {
+        close( fd );
+        return -1;
+    }
+    base = mmap( NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );    /* The mapping keeps the file referenced */
+    if( base == MAP_FAILED )
+        return -1;
+    madvise( base, (size_t)fileStat.st_size, MADV_SEQUENTIAL );
+
+    map->base = (const unsigned char*)base;
+    map->length = (size_t)fileStat.st_size;
+#endif
+    map->advisedEnd = 0;
+    return 0;
+}
+
+
+static void unmapFile( JPCMMapping *map )
+{
+#ifdef WIN32
+    UnmapViewOfFile( map->base );
+    CloseHandle( map->mappingHandle );
+    CloseHandle( map->fileHandle );
+#else
+    munmap( (void*)map->base, map->length );
+#endif
+    map->base = NULL;
+    return;
+}
+
+
+static unsigned readLE32( const unsigned char *p )
+{
+    return (unsigned)p[0] | (unsigned)p[1] << 8 | (unsigned)p[2] << 16 | (unsigned)p[3] << 24;
+}
+
+
+static unsigned readBE32( const unsigned char *p )
+{
+    return (unsigned)p[3] | (unsigned)p[2] << 8 | (unsigned)p[1] << 16 | (unsigned)p[0] << 24;
+}
+
+
+/* Walks the chunks of a WAV or AIFF file to find where the sample data starts.  The
+ * format libsndfile detected decides whether the mapping can be used at all.
+ * Returns 0 if the data chunk was found and holds every frame sfInfo reports. */
+static int findDataChunk( JPCMMapping *map, const SF_INFO *sfInfo )
+{
+    const int   type = sfInfo->format & SF_FORMAT_TYPEMASK;
+    const unsigned char *chunk, *end = map->base + map->length;
+
+    switch( sfInfo->format & SF_FORMAT_SUBMASK )
+    {
+        case SF_FORMAT_PCM_16:  map->encoding = JSAMPLE_INT16;     break;
+        case SF_FORMAT_PCM_24:  map->encoding = JSAMPLE_INT24;     break;
+        case SF_FORMAT_PCM_32:  map->encoding = JSAMPLE_INT32;     break;
+        case SF_FORMAT_FLOAT:   map->encoding = JSAMPLE_FLOAT32;   break;
+        default:                return -1;
+    }
+    map->bytesPerFrame = JSampleFormatBytes( map->encoding ) * sfInfo->channels;
+    map->data = NULL;
+
+    if( ( type == SF_FORMAT_WAV || type == SF_FORMAT_WAVEX ) && map->length >= 12 &&
+        memcmp( map->base, "RIFF", 4 ) == 0 && memcmp( map->base + 8, "WAVE", 4 ) == 0 )
+    {
+        map->bBigEndian = FALSE;
+        for( chunk = map->base + 12; end - chunk >= 8; )
+        {
+            const size_t size = readLE32( chunk + 4 );
+
+            if( memcmp( chunk, "data", 4 ) == 0 )
+            {
+                map->data = chunk + 8;
+                break;
+            }
+            if( (size_t)( end - chunk - 8 ) < size )
+                break;
+            chunk += 8 + size + ( size & 1 );
+        }
+    }
+    else if( type == SF_FORMAT_AIFF && map->length >= 12 &&
+             memcmp( map->base, "FORM", 4 ) == 0 && memcmp( map->base + 8, "AIFF", 4 ) == 0 )
+    {
+        map->bBigEndian = TRUE;
+        for( chunk = map->base + 12; end - chunk >= 16; )
+        {
+            const size_t size = readBE32( chunk + 4 );
+
+            if( memcmp( chunk, "SSND", 4 ) == 0 )
+            {
+                const size_t offset = readBE32( chunk + 8 );
+
+                if( (size_t)( end - chunk - 16 ) >= offset )
+                    map->data = chunk + 16 + offset;
+                break;
+            }
+            if( (size_t)( end - chunk - 8 ) < size )
+                break;
+            chunk += 8 + size + ( size & 1 );
+        }
+    }
+
+    if( map->data == NULL ||
+        (unsigned long long)( end - map->data ) / map->bytesPerFrame < (unsigned long long)sfInfo->frames )
+        return -1;
+
+    return 0;
+}
+
+
+/* Asks the kernel to start reading the part of the mapping the cursor will reach
+ * next, so the producer thread does not stall on page faults */
+static void adviseReadAhead( JPCMMapping *map, size_t offset )
+{
+#ifndef WIN32
+    static long pageSize = 0;
+    size_t start, length;
+
+    if( offset + PCM_READAHEAD_BYTES / 2 < map->advisedEnd )
+        return;
+    if( pageSize == 0 )
+        pageSize = sysconf( _SC_PAGESIZE );
+
+    start = ( offset > map->advisedEnd ? offset : map->advisedEnd ) & ~(size_t)( pageSize - 1 );
+    if( start >= map->length )
+        return;
+    length = map->length - start < PCM_READAHEAD_BYTES ? map->length - start : PCM_READAHEAD_BYTES;
+    madvise( (void*)( map->base + start ), length, MADV_WILLNEED );
+    map->advisedEnd = start + length;
+#else
+    (void)map;
+    (void)offset;
+#endif
+    return;
+}
+
+
+static void setSampleFormat( JAudioSource *source )
+{
+    switch( source->sfInfo.format & SF_FORMAT_SUBMASK )
+    {
+        case SF_FORMAT_PCM_S8:
+        case SF_FORMAT_PCM_U8:
+        case SF_FORMAT_PCM_16:  source->format = JSAMPLE_INT16; break;
+        case SF_FORMAT_PCM_24:  source->format = JSAMPLE_INT24; break;
+        case SF_FORMAT_PCM_32:  source->format = JSAMPLE_INT32; break;
+        default:                source->format = JSAMPLE_FLOAT32; break;
+    }
+    return;
+}
+
+
+/* Virtual file handed to libsndfile for a source without an index: the file itself */
+static sf_count_t plainLength( void *userData )
+{
+    return JReadAheadLength( ( (const JAudioSource*)userData )->reader );
+}
+
+
+static sf_count_t plainSeek( sf_count_t offset, int whence, void *userData )
+{
+    return JReadAheadSeek( ( (JAudioSource*)userData )->reader, offset, whence );
+}
+
+
+static sf_count_t plainRead( void *ptr, sf_count_t count, void *userData )
+{
+    return JReadAheadRead( ( (JAudioSource*)userData )->reader, ptr, count );
+}
+
+
+static sf_count_t plainTell( void *userData )
+{
+    return JReadAheadTell( ( (const JAudioSource*)userData )->reader );
+}
+
+
+/* Virtual file handed to libsndfile for an indexed source: the rewritten metadata of
+ * index->header, followed by the file from its first frame on.  Seek table offsets
+ * count from the first frame, so they hold in both. */
+static sf_count_t indexedLength( void *userData )
+{
+    const JAudioSource *source = (const JAudioSource*)userData;
+
+    return (sf_count_t)source->index->headerBytes + source->index->fileSize - source->index->audioOffset;
+}
+
+
+static sf_count_t indexedSeek( sf_count_t offset, int whence, void *userData )
+{
+    JAudioSource *source = (JAudioSource*)userData;
+
+    switch( whence )
+    {
+        case SEEK_SET:  break;
+        case SEEK_CUR:  offset += source->virtualPosition; break;
+        case SEEK_END:  offset += indexedLength( userData ); break;
+        default:        return -1;
+    }
+    if( offset < 0 )
+        return -1;
+    source->virtualPosition = offset;
+    return offset;
+}
+
+
+static sf_count_t indexedRead( void *ptr, sf_count_t count, void *userData )
+{
+    JAudioSource        *source = (JAudioSource*)userData;
+    const JSeekIndex    *index = source->index;
+    unsigned char       *out = (unsigned char*)ptr;
+    sf_count_t          done = 0, n, fileOffset;
+
+    if( source->virtualPosition < (sf_count_t)index->headerBytes )
+    {
+        n = (sf_count_t)index->headerBytes - source->virtualPosition;
+        if( n > count )
+            n = count;
+        memcpy( out, index->header + source->virtualPosition, (size_t)n );
+        source->virtualPosition += n;
+        done = n;
+    }
+    if( done == count )
+        return done;
+
+    fileOffset = index->audioOffset + source->virtualPosition - (sf_count_t)index->headerBytes;
+    if( JReadAheadSeek( source->reader, fileOffset, SEEK_SET ) < 0 )
+        return done;
+    n = JReadAheadRead( source->reader, out + done, count - done );
+    source->virtualPosition += n;
+    return done + n;
+}
+
+
+static sf_count_t indexedWrite( const void *ptr, sf_count_t count, void *userData )
+{
+    (void)ptr;
+    (void)count;
+    (void)userData;
+    return 0;
+}
+
+
+static sf_count_t indexedTell( void *userData )
+{
+    return ( (const JAudioSource*)userData )->virtualPosition;
+}
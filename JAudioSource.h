@@ -0,0 +1,142 @@
+/* JAudioSource.h Header file for audio file sources
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JAUDIOSOURCE_H_INCLUDED
+#define JAUDIOSOURCE_H_INCLUDED
+
+#ifdef WIN32
+#include <Windows.h>
+#endif
+
+#include <stdio.h>
+
+#include "sndfile.h"
+
+#include "JPlatform.h"
+#include "JSampleConvert.h"
+#include "JSeekIndex.h"
+#include "JReadAhead.h"
+
+/** Memory mapping of an uncompressed audio file */
+typedef struct
+{
+    const unsigned char *base;          /* Start of the mapped file */
+    size_t              length;         /* Length of the mapped file in bytes */
+    const unsigned char *data;          /* First frame of the data chunk */
+    JSampleFormat       encoding;
+    int                 bBigEndian;     /* Byte order of the samples */
+    int                 bytesPerFrame;
+    size_t              advisedEnd;     /* Offset up to which read-ahead was requested */
+#ifdef WIN32
+    HANDLE              fileHandle;
+    HANDLE              mappingHandle;
+#endif
+}
+JPCMMapping;
+
+/** An open audio file.  Uncompressed WAV and AIFF files are read straight from a
+  * memory mapping of the file, everything else is decoded by libsndfile, which reads
+  * the file through reader.  A source read from a pipe or a JByteSource is decoded
+  * by libsndfile as it arrives and only ever moves forward.
+  */
+typedef struct
+{
+    SF_INFO     sfInfo;
+    SNDFILE     *sfPtr;
+    JSampleFormat format;       /* Closest format to how the file stores samples,
+                                 * JSAMPLE_FLOAT32 for float and compressed files */
+
+    int         bMapped;        /* TRUE if reads come from map rather than sfPtr */
+    JPCMMapping map;
+    sf_count_t  position;       /* Cursor in frames */
+    int         bSeekable;      /* FALSE for a stream, same as sfInfo.seekable */
+
+    JReadAhead  *reader;
+
+    /* Seek index the file is decoded through, NULL if none.  libsndfile then reads
+     * index->header followed by the frames of the file. */
+    JSeekIndex  *index;
+    sf_count_t  virtualPosition;    /* Byte offset in what libsndfile reads */
+}
+JAudioSource;
+
+/** @brief Opens an audio file for reading.  JAudioSourceClose must be called to free
+  * resources allocated by JAudioSourceOpen.
+  * @param filePath Path of the audio file
+  * @param bAllowMapping FALSE to always decode through libsndfile
+  * @return Pointer to an open JAudioSource, returns NULL on failure
+  */
+JAudioSource* JAudioSourceOpen( const char *filePath, int bAllowMapping );
+
+/** @brief Opens audio handed over by the application, in any format libsndfile can
+  * read without seeking.  A stream whose header gives no length is read until it
+  * ends, with sfInfo.frames set to SF_COUNT_MAX.
+  * @param byteSource Routines to read the stream with, copied.  byteSource->close is
+  * called when the source is closed, or before returning if opening fails.
+  * @return Pointer to an open JAudioSource, returns NULL on failure
+  */
+JAudioSource* JAudioSourceOpenStream( const JByteSource *byteSource );
+
+/** @brief Opens a FLAC file so that libsndfile seeks it through an index instead of
+  * bisecting it.  JAudioSourceOpen does this by itself when a saved index is found.
+  * @param index Index built for the file, owned by the source afterwards, also when
+  * opening fails
+  * @return Pointer to an open JAudioSource, returns NULL on failure
+  */
+JAudioSource* JAudioSourceOpenIndexed( const char *filePath, JSeekIndex *index );
+
+/** @brief Starts reading the file ahead of libsndfile on a thread of its own, so a
+  * slow disk only holds up decoding when the thread falls behind.  Does nothing for
+  * mapped sources, which the kernel reads ahead instead.
+  * @param seconds Audio to read ahead, converted to bytes at the average bit rate of
+  * the file.  0 leaves the source reading the file on the calling thread.
+  * @param counters Counters the reads are added to, or NULL
+  * @param bCancel Flag that stops reads waiting for a stream once set, or NULL.  It
+  * is watched whether or not seconds starts the thread.
+  */
+void JAudioSourceStartReadAhead( JAudioSource *source, double seconds, JReadAheadCounters *counters,
+                                 const volatile int *bCancel );
+
+/** @brief Reads interleaved frames as floats in the range [-1, 1), advancing the cursor
+  * @return Number of frames read, less than frames at the end of the file
+  */
+sf_count_t JAudioSourceReadFloat( JAudioSource *source, float *dest, sf_count_t frames );
+
+/** @brief Checks if JAudioSourceRead can deliver format without going through float */
+int JAudioSourceCanRead( const JAudioSource *source, JSampleFormat format );
+
+/** @brief Reads interleaved frames in format, which JAudioSourceCanRead must accept.
+  * Samples are copied as stored in the file, without conversion.
+  * @return Number of frames read, less than frames at the end of the file
+  */
+sf_count_t JAudioSourceRead( JAudioSource *source, void *dest, JSampleFormat format, sf_count_t frames );
+
+/** @brief Moves the cursor, with the same arguments and return value as sf_seek.  A
+  * source that is not seekable only moves forward, by decoding up to the target and
+  * dropping what was decoded.  It fails to seek backwards or from the end, and stops
+  * at the end of the stream if the target is past it. */
+sf_count_t JAudioSourceSeek( JAudioSource *source, sf_count_t frames, int whence );
+
+/** @brief Closes an audio file opened with JAudioSourceOpen
+  * @param sourcePtr Pointer to a pointer to a JAudioSource, set to NULL after closing
+  */
+void JAudioSourceClose( JAudioSource **sourcePtr );
+
+#endif // JAUDIOSOURCE_H_INCLUDED
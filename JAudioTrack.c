@@ -0,0 +1,398 @@
+/* JAudioTrack.c Contains routines converting audio files to the stream format
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "JAudioTrack.h"
+#include "JPlatform.h"
+
+#define FOLD_GAIN 0.70710678f   /* -3 dB for channels folded onto another */
+
+static unsigned long decodeFloat( JAudioTrack *track, float *out, unsigned long frames, sf_count_t *fileFrames );
+static unsigned long endStream( JAudioTrack *track, unsigned long frames, unsigned long done );
+static sf_count_t readMapped( JAudioTrack *track, float *out, sf_count_t frames );
+static void mapChannels( const float *in, int inChannels, float *out, int outChannels, sf_count_t frames );
+
+
+JAudioTrack* JAudioTrackOpen( const char *filePath, const JStreamFormat *stream, unsigned trackId )
+{
+    JAudioSource *source = JAudioSourceOpen( filePath, stream->bMapPCM );
+    JAudioTrack *track;
+
+    if( source == NULL )
+        return NULL;
+    track = JAudioTrackCreate( source, stream, trackId );
+    if( track == NULL )
+        return NULL;
+
+    /* A pipe cannot be opened again by the cache or the indexer */
+    if( !track->source->bSeekable )
+        return track;
+
+    track->filePath = (char*)malloc( strlen( filePath ) + 1 );
+    if( track->filePath == NULL )
+    {
+        printf( "  Error using malloc\n" );
+        JAudioTrackClose( &track );
+        return NULL;
+    }
+    strcpy( track->filePath, filePath );
+    return track;
+}
+
+
+JAudioTrack* JAudioTrackCreate( JAudioSource *source, const JStreamFormat *stream, unsigned trackId )
+{
+    JAudioTrack *track = NULL;
+    const size_t blockSamples = (size_t)stream->framesPerBlock * stream->channels;
+
+    track = (JAudioTrack*)calloc( 1, sizeof(JAudioTrack) );
+    if( track == NULL )
+    {
+        JAudioSourceClose( &source );
+        return NULL;
+    }
+    track->trackId = trackId;
+    track->source = source;
+    track->sfInfo = source->sfInfo;
+    track->stream = *stream;
+    track->outputFrames = track->sfInfo.frames;
+
+    if( track->sfInfo.channels != stream->channels )
+    {
+        track->mapBuffer = (float*)malloc( sizeof(float) * stream->framesPerBlock * track->sfInfo.channels );
+        if( track->mapBuffer == NULL )
+        {
+            printf( "  Error using malloc\n" );
+            JAudioTrackClose( &track );
+            return NULL;
+        }
+    }
+
+    /* Convert to the rate the stream runs at, so the driver does not have to */
+    if( (int)( stream->sampleRate + 0.5 ) != track->sfInfo.samplerate )
+    {
+        track->resampler = JResamplerCreate( stream->channels, track->sfInfo.samplerate,
+                                             stream->sampleRate, stream->resampleQuality );
+        track->resampleInput = (float*)malloc( sizeof(float) * blockSamples );
+        if( track->resampler == NULL || track->resampleInput == NULL )
+        {
+            printf( "  Error: Could not create resampler\n" );
+            JAudioTrackClose( &track );
+            return NULL;
+        }
+        if( track->sfInfo.frames != SF_COUNT_MAX )
+            track->outputFrames = (sf_count_t)( (double)track->sfInfo.frames * stream->sampleRate /
+                                                track->sfInfo.samplerate + 0.5 );
+    }
+
+    track->bDirectRead = track->resampler == NULL && track->mapBuffer == NULL &&
+                         JAudioSourceCanRead( source, stream->format );
+    track->bDither = stream->bDither && stream->format != JSAMPLE_FLOAT32 &&
+                     ( JSampleFormatBits( stream->format ) < JSampleFormatBits( source->format ) ||
+                       track->resampler != NULL );
+    if( !track->bDirectRead && stream->format != JSAMPLE_FLOAT32 )
+    {
+        track->floatBuffer = (float*)malloc( sizeof(float) * blockSamples );
+        if( track->floatBuffer == NULL )
+        {
+            printf( "  Error using malloc\n" );
+            JAudioTrackClose( &track );
+            return NULL;
+        }
+    }
+
+    JAudioSourceStartReadAhead( source, stream->readAheadSeconds, stream->ioCounters, stream->bCancel );
+    return track;
+}
+
+
+unsigned long JAudioTrackPreroll( JAudioTrack *track, unsigned long frames )
+{
+    sf_count_t fileFrames = 0;
+
+    track->preroll = (float*)malloc( sizeof(float) * frames * track->stream.channels );
+    if( track->preroll == NULL )
+        return 0;
+    track->prerollFrames = decodeFloat( track, track->preroll, frames, &fileFrames );
+    track->prerollUsed = 0;
+    track->prerollFileFrames = fileFrames;
+    return track->prerollFrames;
+}
+
+
+unsigned long JAudioTrackRead( JAudioTrack *track, void *dest, unsigned long frames, JDither *dither,
+                               sf_count_t *fileFrames )
+{
+    const int       channels = track->stream.channels;
+    const size_t    bytesPerFrame = (size_t)JSampleFormatBytes( track->stream.format ) * channels;
+    unsigned char   *out = (unsigned char*)dest;
+    unsigned long   done = 0, count, n;
+
+    if( track->bDither == FALSE )
+        dither = NULL;
+
+    /* Frames decoded ahead by JAudioTrackPreroll go first */
+    if( track->prerollUsed < track->prerollFrames )
+    {
+        const float *preroll = track->preroll + (size_t)track->prerollUsed * channels;
+
+        count = track->prerollFrames - track->prerollUsed;
+        if( count > frames )
+            count = frames;
+        if( track->stream.format == JSAMPLE_FLOAT32 )
+            memcpy( out, preroll, sizeof(float) * count * channels );
+        else
+            JConvertFromFloat( preroll, out, track->stream.format, count * channels, dither );
+        track->prerollUsed += count;
+        out += count * bytesPerFrame;
+        done += count;
+    }
+
+    if( track->bDirectRead )
+    {
+        n = (unsigned long)JAudioSourceRead( track->source, out, track->stream.format, frames - done );
+        track->outputPosition += n;
+        *fileFrames += n;
+        return done + n;
+    }
+
+    while( done < frames )
+    {
+        float *floatOut = ( track->stream.format == JSAMPLE_FLOAT32 ) ? (float*)out : track->floatBuffer;
+
+        count = frames - done;
+        if( count > track->stream.framesPerBlock )
+            count = track->stream.framesPerBlock;
+        n = decodeFloat( track, floatOut, count, fileFrames );
+        if( floatOut != (float*)out )
+            JConvertFromFloat( floatOut, out, track->stream.format, n * channels, dither );
+        out += n * bytesPerFrame;
+        done += n;
+        if( n < count )
+            break;
+    }
+    return done;
+}
+
+
+unsigned long JAudioTrackReadFloat( JAudioTrack *track, float *dest, unsigned long frames, sf_count_t *fileFrames )
+{
+    const int       channels = track->stream.channels;
+    unsigned long   done = 0, count, n;
+
+    if( track->prerollUsed < track->prerollFrames )
+    {
+        count = track->prerollFrames - track->prerollUsed;
+        if( count > frames )
+            count = frames;
+        memcpy( dest, track->preroll + (size_t)track->prerollUsed * channels, sizeof(float) * count * channels );
+        track->prerollUsed += count;
+        done += count;
+    }
+
+    while( done < frames )
+    {
+        count = frames - done;
+        if( count > track->stream.framesPerBlock )
+            count = track->stream.framesPerBlock;
+        n = decodeFloat( track, dest + (size_t)done * channels, count, fileFrames );
+        done += n;
+        if( n < count )
+            break;
+    }
+    return done;
+}
+
+
+sf_count_t JAudioTrackSeek( JAudioTrack *track, sf_count_t frames, int whence )
+{
+    const double ratio = track->stream.sampleRate / track->sfInfo.samplerate;
+    sf_count_t target;
+
+    /* The source cursor is ahead of what has been read by any unplayed preroll */
+    if( whence == SEEK_CUR && track->prerollUsed < track->prerollFrames )
+    {
+        frames += JAudioSourceSeek( track->source, 0, SEEK_CUR ) -
+                  (sf_count_t)( ( track->prerollFrames - track->prerollUsed ) / ratio + 0.5 );
+        whence = SEEK_SET;
+    }
+    target = JAudioSourceSeek( track->source, frames, whence );
+    if( target < 0 )
+        return target;
+
+    track->prerollUsed = track->prerollFrames;
+    track->outputPosition = ( track->resampler == NULL ) ? target : (sf_count_t)( target * ratio + 0.5 );
+    if( track->resampler != NULL )
+    {
+        JResamplerReset( track->resampler );
+        track->resampleInputFrames = 0;
+        track->resampleInputUsed = 0;
+    }
+    return target;
+}
+
+
+JAudioSource* JAudioTrackReplaceSource( JAudioTrack *track, JAudioSource *source )
+{
+    JAudioSource *replaced = track->source;
+
+    if( source->sfInfo.frames != track->sfInfo.frames || source->sfInfo.channels != track->sfInfo.channels ||
+        source->format != track->source->format || source->bMapped != track->source->bMapped )
+        return source;
+    track->source = source;
+    return replaced;
+}
+
+
+void JAudioTrackClose( JAudioTrack **trackPtr )
+{
+    JAudioTrack *track = *trackPtr;
+
+    if( track == NULL )
+        return;
+
+    free( track->filePath );
+    JAudioSourceClose( &track->source );
+    JResamplerDestroy( &track->resampler );
+    free( track->resampleInput );
+    free( track->mapBuffer );
+    free( track->floatBuffer );
+    free( track->preroll );
+    free( track );
+    *trackPtr = NULL;
+
+    return;
+}
+
+
+/* Decodes up to frames stream frames, at most framesPerBlock, as float.  Stops at
+ * outputFrames so a resampled track ends at the same frame however it is read. */
+static unsigned long decodeFloat( JAudioTrack *track, float *out, unsigned long frames, sf_count_t *fileFrames )
+{
+    const int       channels = track->stream.channels;
+    unsigned long   done = 0, used;
+    sf_count_t      n;
+
+    if( (sf_count_t)frames > track->outputFrames - track->outputPosition )
+        frames = track->outputPosition < track->outputFrames ? (unsigned long)( track->outputFrames - track->outputPosition ) : 0;
+
+    if( track->resampler == NULL )
+    {
+        while( done < frames )
+        {
+            n = readMapped( track, out + (size_t)done * channels, frames - done );
+            if( n <= 0 )
+                break;
+            *fileFrames += n;
+            done += (unsigned long)n;
+        }
+    }
+    else
+    {
+        while( done < frames )
+        {
+            if( track->resampleInputUsed == track->resampleInputFrames )
+            {
+                n = readMapped( track, track->resampleInput, track->stream.framesPerBlock );
+                if( n < (sf_count_t)track->stream.framesPerBlock && !track->source->bSeekable )
+                    frames = endStream( track, frames, done );
+
+                /* Silence past the end of the file flushes the filter */
+                memset( track->resampleInput + n * channels, 0,
+                        sizeof(float) * ( track->stream.framesPerBlock - n ) * channels );
+                track->resampleInputFrames = track->stream.framesPerBlock;
+                track->resampleInputUsed = 0;
+                *fileFrames += n;
+            }
+            done += JResamplerProcess( track->resampler,
+                                       track->resampleInput + (size_t)track->resampleInputUsed * channels,
+                                       track->resampleInputFrames - track->resampleInputUsed, &used,
+                                       out + (size_t)done * channels, frames - done );
+            track->resampleInputUsed += used;
+        }
+    }
+    track->outputPosition += done;
+    return done;
+}
+
+
+/* Ends a resampled stream where its source ran dry, rather than where its header
+ * said it would, so the filter is not flushed with silence for the rest of that
+ * length.  Returns how many of the frames being decoded are still to be output. */
+static unsigned long endStream( JAudioTrack *track, unsigned long frames, unsigned long done )
+{
+    const sf_count_t end = (sf_count_t)( (double)track->source->position * track->stream.sampleRate /
+                                         track->sfInfo.samplerate + 0.5 );
+    sf_count_t left;
+
+    if( end < track->outputFrames )
+        track->outputFrames = end;
+    left = track->outputFrames - track->outputPosition;
+    if( (sf_count_t)frames > left )
+        frames = left > (sf_count_t)done ? (unsigned long)left : done;
+    return frames;
+}
+
+
+/* Reads file frames as float with the stream's channel count */
+static sf_count_t readMapped( JAudioTrack *track, float *out, sf_count_t frames )
+{
+    sf_count_t n;
+
+    if( track->mapBuffer == NULL )
+        return JAudioSourceReadFloat( track->source, out, frames );
+
+    if( frames > track->stream.framesPerBlock )
+        frames = track->stream.framesPerBlock;
+    n = JAudioSourceReadFloat( track->source, track->mapBuffer, frames );
+    mapChannels( track->mapBuffer, track->sfInfo.channels, out, track->stream.channels, n );
+    return n;
+}
+
+
+/* Mono is copied to every output channel.  Otherwise input channel c goes to output
+ * channel c, with channels past the last output folded back onto the first ones. */
+static void mapChannels( const float *in, int inChannels, float *out, int outChannels, sf_count_t frames )
+{
+    sf_count_t  i;
+    int         c;
+
+    for( i=0; i<frames; i++ )
+    {
+        if( inChannels == 1 )
+        {
+            for( c=0; c<outChannels; c++ )
+                out[c] = in[0];
+        }
+        else
+        {
+            for( c=0; c<outChannels; c++ )
+                out[c] = c < inChannels ? in[c] : 0.0f;
+            for( c=outChannels; c<inChannels; c++ )
+                out[c % outChannels] += in[c] * FOLD_GAIN;
+        }
+        in += inChannels;
+        out += outChannels;
+    }
+    return;
+}
@@ -0,0 +1,143 @@
+/* JAudioTrack.h Header file for tracks played by the audio player
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JAUDIOTRACK_H_INCLUDED
+#define JAUDIOTRACK_H_INCLUDED
+
+#include "sndfile.h"
+
+#include "JAudioSource.h"
+#include "JSampleConvert.h"
+#include "JResampler.h"
+
+/** Layout of the frames in a running stream.  Every track is converted to it, so
+  * tracks with different rates, channel counts and sample formats can follow each
+  * other without reopening the stream.
+  */
+typedef struct
+{
+    int             channels;
+    double          sampleRate;
+    JSampleFormat   format;
+    unsigned        framesPerBlock;     /* Most frames converted in one go */
+    int             bMapPCM;            /* Passed to JAudioSourceOpen */
+    int             bDither;            /* Dither when the stream has fewer bits than a file */
+    JResampleQuality resampleQuality;
+    double          readAheadSeconds;   /* Passed to JAudioSourceStartReadAhead */
+    JReadAheadCounters *ioCounters;     /* Read-ahead of every track adds to these,
+                                         * NULL for none */
+    const volatile int *bCancel;        /* Passed to JAudioSourceStartReadAhead */
+}
+JStreamFormat;
+
+/** An audio file converted to a JStreamFormat on the fly.  The start of a track can
+  * be decoded ahead of time with JAudioTrackPreroll, so that the first read after
+  * switching to it costs no more than a memcpy.
+  */
+typedef struct
+{
+    unsigned        trackId;
+    char            *filePath;          /* Copy of the path, NULL if not opened from one
+                                         * or if it is a pipe */
+    JAudioSource    *source;
+    SF_INFO         sfInfo;             /* Copy of source->sfInfo */
+    JStreamFormat   stream;
+
+    int             bDirectRead;        /* File is read in the stream format, without float */
+    int             bDither;
+    float           *floatBuffer;       /* framesPerBlock stream frames before conversion */
+
+    /* Channel mapping, NULL mapBuffer when the file has the stream's channel count */
+    float           *mapBuffer;         /* framesPerBlock file frames */
+
+    /* Sample rate conversion, NULL resampler when the file is at the stream rate */
+    JResampler      *resampler;
+    float           *resampleInput;     /* Block of file frames being fed to resampler */
+    unsigned long   resampleInputFrames;
+    unsigned long   resampleInputUsed;
+
+    sf_count_t      outputFrames;       /* Length of the track in stream frames */
+    sf_count_t      outputPosition;     /* Stream frames decoded so far */
+
+    float           *preroll;           /* Stream frames decoded by JAudioTrackPreroll */
+    unsigned long   prerollFrames;
+    unsigned long   prerollUsed;
+    sf_count_t      prerollFileFrames;  /* File frames the preroll was decoded from */
+}
+JAudioTrack;
+
+/** @brief Opens an audio file as a track.  JAudioTrackClose must be called to free
+  * resources allocated by JAudioTrackOpen.
+  * @param filePath Path of the audio file
+  * @param stream Format the track is converted to
+  * @param trackId Identifier reported while the track plays
+  * @return Pointer to a JAudioTrack, returns NULL on failure
+  */
+JAudioTrack* JAudioTrackOpen( const char *filePath, const JStreamFormat *stream, unsigned trackId );
+
+/** @brief Same as JAudioTrackOpen for a source that is already open.  The track
+  * takes ownership of source, also when it fails.
+  */
+JAudioTrack* JAudioTrackCreate( JAudioSource *source, const JStreamFormat *stream, unsigned trackId );
+
+/** @brief Decodes the start of the track into memory, so reading it later does not
+  * touch the file.  Called once, before the first read.
+  * @return Number of frames decoded
+  */
+unsigned long JAudioTrackPreroll( JAudioTrack *track, unsigned long frames );
+
+/** @brief Reads frames in the stream format, advancing the cursor
+  * @param dest Interleaved frames in stream->format
+  * @param dither Generator used when the track needs dither
+  * @param fileFrames Incremented by the number of frames taken from the file
+  * @return Number of frames written, less than frames only at the end of the track
+  */
+unsigned long JAudioTrackRead( JAudioTrack *track, void *dest, unsigned long frames, JDither *dither,
+                               sf_count_t *fileFrames );
+
+/** @brief Reads frames as float whatever the stream format, advancing the cursor as
+  * JAudioTrackRead does.  Used when the frames are processed further before being
+  * converted to the stream format, so they are only quantized once.
+  * @param dest Interleaved float frames with stream->channels channels
+  * @param fileFrames Incremented by the number of frames taken from the file
+  * @return Number of frames written, less than frames only at the end of the track
+  */
+unsigned long JAudioTrackReadFloat( JAudioTrack *track, float *dest, unsigned long frames, sf_count_t *fileFrames );
+
+/** @brief Moves the cursor, as JAudioSourceSeek.  Frames decoded ahead are dropped.
+  * @return New position of the cursor in file frames, or -1 on failure
+  */
+sf_count_t JAudioTrackSeek( JAudioTrack *track, sf_count_t frames, int whence );
+
+/** @brief Swaps the source for another opening of the same file, such as one opened
+  * through a seek index, with its read-ahead started.  Nothing is sought, closed or
+  * started, so it can be called from a real-time thread, and the track must be sought
+  * before it is read again.
+  * @return The source replaced, or source itself if it is not the same file, for the
+  * caller to close
+  */
+JAudioSource* JAudioTrackReplaceSource( JAudioTrack *track, JAudioSource *source );
+
+/** @brief Closes a track opened with JAudioTrackOpen or JAudioTrackCreate
+  * @param trackPtr Pointer to a pointer to a JAudioTrack, set to NULL after closing
+  */
+void JAudioTrackClose( JAudioTrack **trackPtr );
+
+#endif // JAUDIOTRACK_H_INCLUDED
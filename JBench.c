@@ -0,0 +1,540 @@
+/* JBench.c Benchmark harness for the J Audio Player playback pipeline
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Generates synthetic audio files, plays each one through JAudioPlayer on the null
+ * output backend and drives paCallback from a simulated device clock.  Results are
+ * printed to stdout as one JSON object per line so runs can be compared between
+ * releases.
+ *
+ * Usage: JBench [-s seconds] [-b frames] [-r rate] [-j jitter] [-x clock_speed] [-w blocks] [-v voices] [-p 0|1] [-e 0|1] [-d directory]
+ *   -s  Length of each generated file in seconds (default 20)
+ *   -b  Frames per callback, need not be a multiple of the block size (default 256)
+ *   -r  Sample rate of the simulated device.  Files at other rates are resampled and
+ *       played once per resampler quality tier (default 0, play at the file's rate)
+ *   -j  Jitter of the simulated clock as a fraction of the buffer period (default 0.25)
+ *   -x  How much faster than real time the simulated clock runs (default 4)
+ *   -w  Blocks the callback lets drain before waking the producer (default 0, half
+ *       the depth of the buffer)
+ *   -v  Most voices mixed at once by JMixer.  The mixer is run with 1, 2, 4... up to
+ *       this many looping voices and reports how many voices one core can mix and
+ *       decode in real time (default 32, 0 to skip)
+ *   -p  1 to hand each file to the player as a stream it cannot seek, through
+ *       JAudioPlayerCreateFromSource, rather than by path (default 0)
+ *   -e  1 to run each file through a mastering chain of gain, a three band EQ, a
+ *       compressor and a limiter (default 0)
+ *   -d  Directory the generated files are written to (default obj)
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "JAudioPlayer.h"
+#include "JMixer.h"
+
+/** A synthetic file to generate and play */
+typedef struct
+{
+    const char  *name;
+    int         format;
+    int         sampleRate;
+    int         channels;
+}
+JBenchCase;
+
+/** Settings shared by every run */
+typedef struct
+{
+    unsigned long   framesPerCallback;
+    double          deviceRate;
+    double          jitter;
+    double          clockSpeed;
+    unsigned        refillBlocks;
+    unsigned        maxVoices;
+    int             bStream;
+    int             bEffects;
+}
+JBenchOptions;
+
+/** How the harness calls paCallback */
+typedef enum
+{
+    JBENCH_CLOCK_FREERUN,       /* Back to back whenever a block is ready */
+    JBENCH_CLOCK_JITTERED       /* On a simulated device clock with jitter */
+}
+JBenchClock;
+
+static const JBenchCase benchCases[] =
+{
+    { "wav_pcm16_44100_2ch",  SF_FORMAT_WAV | SF_FORMAT_PCM_16,  44100, 2 },
+    { "wav_pcm24_96000_2ch",  SF_FORMAT_WAV | SF_FORMAT_PCM_24,  96000, 2 },
+    { "wav_float_48000_6ch",  SF_FORMAT_WAV | SF_FORMAT_FLOAT,   48000, 6 },
+    { "flac_pcm16_44100_2ch", SF_FORMAT_FLAC | SF_FORMAT_PCM_16, 44100, 2 },
+    { "flac_pcm24_48000_1ch", SF_FORMAT_FLAC | SF_FORMAT_PCM_24, 48000, 1 },
+    { "flac_pcm16_48000_8ch", SF_FORMAT_FLAC | SF_FORMAT_PCM_16, 48000, 8 }
+};
+
+static const char *formatNames[] = { "int16", "int24", "int32", "float32" };
+
+static unsigned long long randomState = 0x9E3779B97F4A7C15ULL;
+
+/* xorshift64*, returns a uniformly distributed value in [-1, 1) */
+static double randomSigned( void )
+{
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (double)( ( randomState * 2685821657736338717ULL ) >> 11 ) / 4503599627370496.0 - 1.0;
+}
+
+
+static int compareLatency( const void *a, const void *b )
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+
+    return ( x > y ) - ( x < y );
+}
+
+
+static unsigned long long percentile( const unsigned long long *sorted, unsigned long count, double p )
+{
+    unsigned long index = (unsigned long)( p * (double)( count - 1 ) + 0.5 );
+
+    return count ? sorted[index] : 0;
+}
+
+
+/* Reads a generated file for JAudioPlayerCreateFromSource, as a decoder running
+ * upstream in the same process would hand its output over */
+static long long readStreamed( void *userData, void *dest, size_t bytes )
+{
+    FILE *file = (FILE*)userData;
+    size_t n = fread( dest, 1, bytes, file );
+
+    return ( n > 0 || !ferror( file ) ) ? (long long)n : -1;
+}
+
+
+static void closeStreamed( void *userData )
+{
+    fclose( (FILE*)userData );
+    return;
+}
+
+
+/* Adds the stages a mastering chain would have, each with work to do on the sweep */
+static int addEffects( JDSPChain *chain )
+{
+    JDSPParams params;
+    int failures = 0;
+
+    JDSPChainGetDefaultParams( JDSP_GAIN, &params );
+    params.gainDb = 3.0f;
+    failures += JDSPChainAddStage( chain, JDSP_GAIN, &params ) < 0;
+
+    JDSPChainGetDefaultParams( JDSP_BIQUAD, &params );
+    params.filterType = JBIQUAD_LOW_SHELF;
+    params.frequency = 120.0f;
+    params.gainDb = 2.0f;
+    failures += JDSPChainAddStage( chain, JDSP_BIQUAD, &params ) < 0;
+    params.filterType = JBIQUAD_PEAK;
+    params.frequency = 2500.0f;
+    params.gainDb = -3.0f;
+    params.q = 1.4f;
+    failures += JDSPChainAddStage( chain, JDSP_BIQUAD, &params ) < 0;
+    params.filterType = JBIQUAD_HIGH_SHELF;
+    params.frequency = 9000.0f;
+    params.gainDb = 1.5f;
+    params.q = 0.707f;
+    failures += JDSPChainAddStage( chain, JDSP_BIQUAD, &params ) < 0;
+
+    failures += JDSPChainAddStage( chain, JDSP_COMPRESSOR, NULL ) < 0;
+    failures += JDSPChainAddStage( chain, JDSP_LIMITER, NULL ) < 0;
+    return failures ? -1 : 0;
+}
+
+
+/* Writes seconds of a tone sweep with a little noise to path */
+static int generateFile( const char *path, const JBenchCase *benchCase, double seconds )
+{
+    const sf_count_t framesPerWrite = 4096;
+    SF_INFO     sfInfo;
+    SNDFILE     *sfPtr;
+    float       *frames;
+    sf_count_t  totalFrames = (sf_count_t)( seconds * benchCase->sampleRate );
+    sf_count_t  n, i;
+    int         j;
+    double      phase = 0.0;
+
+    sfInfo.samplerate = benchCase->sampleRate;
+    sfInfo.channels = benchCase->channels;
+    sfInfo.format = benchCase->format;
+    sfPtr = sf_open( path, SFM_WRITE, &sfInfo );
+    if( sfPtr == NULL )
+    {
+        printf( "  Error: Could not create soundfile: %s\n", path );
+        return -1;
+    }
+
+    frames = (float*)malloc( sizeof(float) * framesPerWrite * benchCase->channels );
+    if( frames == NULL )
+    {
+        sf_close( sfPtr );
+        return -1;
+    }
+
+    for( n=0; n<totalFrames; n+=framesPerWrite )
+    {
+        sf_count_t count = ( totalFrames - n < framesPerWrite ) ? totalFrames - n : framesPerWrite;
+
+        for( i=0; i<count; i++ )
+        {
+            const double frequency = 110.0 + 1650.0 * (double)( n + i ) / (double)totalFrames;
+
+            phase += 2.0 * M_PI * frequency / benchCase->sampleRate;
+            for( j=0; j<benchCase->channels; j++ )
+                frames[i * benchCase->channels + j] = (float)( 0.5 * sin( phase + j ) + 0.01 * randomSigned() );
+        }
+        sf_writef_float( sfPtr, frames, count );
+    }
+
+    free( frames );
+    sf_close( sfPtr );
+    return 0;
+}
+
+
+/* Plays path to the end, calling paCallback directly, and prints one result line */
+static int runCase( const char *path, const JBenchCase *benchCase, JBenchClock clock,
+                    JResampleQuality quality, const JBenchOptions *options )
+{
+    JAudioPlayer        *audioPlayer;
+    JAudioPlayerConfig  config;
+    JAudioPlayerStats   stats;
+    PaStreamCallbackTimeInfo timeInfo;
+    unsigned long long  *latencies;
+    unsigned long       callbacks, maxCallbacks;
+    unsigned long long  periodNs, deadline, start, elapsed;
+    sf_count_t          framesPlayed = 0;
+    float               *output;
+    JCircularBuffer     *buffer;
+    const unsigned long framesPerCallback = options->framesPerCallback;
+    double              outputRate;
+
+    JAudioPlayerGetDefaultConfig( &config );
+    config.output.backend = JOUTPUT_NULL;
+    config.framesPerBuffer = framesPerCallback;
+    config.output.nullSampleRate = options->deviceRate;
+    config.resampleQuality = quality;
+    config.refillBlocks = options->refillBlocks;
+
+    if( options->bStream )
+    {
+        JByteSource byteSource;
+
+        byteSource.read = readStreamed;
+        byteSource.close = closeStreamed;
+        if( ( byteSource.userData = fopen( path, "rb" ) ) == NULL )
+            return -1;
+        audioPlayer = JAudioPlayerCreateFromSource( &byteSource, &config );
+    }
+    else
+        audioPlayer = JAudioPlayerCreate( path, &config );
+    if( audioPlayer == NULL )
+        return -1;
+    if( options->bEffects && addEffects( audioPlayer->dsp ) < 0 )
+    {
+        JAudioPlayerDestroy( &audioPlayer );
+        return -1;
+    }
+
+    buffer = &audioPlayer->audioBuffer;
+    outputRate = audioPlayer->output->params.sampleRate;
+    maxCallbacks = (unsigned long)( audioPlayer->sfInfo.frames * outputRate / audioPlayer->sfInfo.samplerate / framesPerCallback ) + 1;
+    latencies = (unsigned long long*)malloc( sizeof(unsigned long long) * maxCallbacks );
+    output = (float*)malloc( sizeof(float) * framesPerCallback * audioPlayer->sfInfo.channels );
+    if( latencies == NULL || output == NULL )
+    {
+        free( latencies );
+        free( output );
+        JAudioPlayerDestroy( &audioPlayer );
+        return -1;
+    }
+
+    periodNs = (unsigned long long)( 1e9 * framesPerCallback / outputRate / options->clockSpeed );
+    timeInfo.inputBufferAdcTime = 0;
+    start = deadline = JPlatformGetTimeNs();
+
+    for( callbacks=0; callbacks<maxCallbacks; callbacks++ )
+    {
+        unsigned long long before;
+
+        if( clock == JBENCH_CLOCK_JITTERED )
+        {
+            deadline += periodNs;
+            JPlatformSleepUntilNs( deadline + (long long)( options->jitter * periodNs * randomSigned() ) );
+        }
+        else
+        {
+            /* Wait for every block the call spans, or for a full buffer */
+            for( ;; )
+            {
+                const unsigned blocks = JATOMIC_LOAD_ACQUIRE( &buffer->head ) - buffer->tail;
+
+                if( blocks >= JATOMIC_LOAD_RELAXED( &buffer->num_blocks_in_buffer ) ||
+                    (unsigned long)blocks * buffer->framesPerBlock - buffer->tailOffset >= framesPerCallback )
+                    break;
+                JPlatformYield();
+            }
+        }
+
+        timeInfo.currentTime = (double)framesPlayed / outputRate;
+        timeInfo.outputBufferDacTime = timeInfo.currentTime;
+
+        before = JPlatformGetTimeNs();
+        paCallback( NULL, output, framesPerCallback, &timeInfo, 0, audioPlayer );
+        latencies[callbacks] = JPlatformGetTimeNs() - before;
+
+        framesPlayed += framesPerCallback;
+    }
+    elapsed = JPlatformGetTimeNs() - start;
+
+    JAudioPlayerGetStats( audioPlayer, &stats );
+    qsort( latencies, callbacks, sizeof(unsigned long long), compareLatency );
+
+    printf( "{\"case\":\"%s\",\"input\":\"%s\",\"clock\":\"%s\",\"channels\":%d,\"sample_rate\":%d,\"frames_per_callback\":%lu,"
+            "\"output_format\":\"%s\",\"convert_kernel\":\"%s\",\"device_rate\":%.0f,"
+            "\"resample_quality\":\"%s\",\"resample_kernel\":\"%s\","
+            "\"frames\":%lld,\"seconds\":%.6f,\"decode_frames_per_sec\":%.0f,\"realtime_factor\":%.2f,"
+            "\"callbacks\":%lu,\"callback_ns_p50\":%llu,\"callback_ns_p90\":%llu,"
+            "\"callback_ns_p99\":%llu,\"callback_ns_p999\":%llu,\"callback_ns_max\":%llu,"
+            "\"producer_wakeups\":%lu,\"underruns\":%lu,\"overruns\":%lu,\"fill_min\":%u,"
+            "\"fill_avg\":%.2f,\"near_empty\":%lu,\"buffer_blocks\":%u,\"depth_grows\":%lu,\"depth_shrinks\":%lu,"
+            "\"read_us_avg\":%.2f,\"read_us_max\":%.2f,\"wake_to_ready_us_avg\":%.2f,"
+            "\"low_watermark\":%u,\"producer_signals\":%lu,\"producer_timeouts\":%lu,"
+            "\"wakeups_per_audio_sec\":%.1f,\"blocks_per_refill\":%.2f,"
+            "\"producer_idle_pct\":%.1f,\"producer_cpu_pct\":%.2f,\"decode_us_avg\":%.2f,"
+            "\"io_reads\":%lu,\"io_read_us_avg\":%.2f,\"io_stalls\":%lu,\"io_stall_ms\":%.3f,"
+            "\"open_ms\":%.3f,\"first_audio_ms\":%.3f,"
+            "\"dsp_stages\":%u,\"dsp_kernel\":\"%s\",\"dsp_us_avg\":%.2f,\"dsp_core_pct\":%.3f}\n",
+            benchCase->name, options->bStream ? "stream" : "file",
+            clock == JBENCH_CLOCK_FREERUN ? "freerun" : "jittered",
+            benchCase->channels, benchCase->sampleRate, framesPerCallback,
+            formatNames[audioPlayer->format], JSampleConvertGetKernelName(), outputRate,
+            audioPlayer->track->resampler ? JResampleQualityName( quality ) : "none",
+            audioPlayer->track->resampler ? JResamplerGetKernelName() : "none",
+            (long long)audioPlayer->sfInfo.frames, elapsed / 1e9,
+            stats.framesDecoded / ( elapsed / 1e9 ),
+            (double)audioPlayer->sfInfo.frames / audioPlayer->sfInfo.samplerate / ( elapsed / 1e9 ),
+            callbacks,
+            percentile( latencies, callbacks, 0.50 ), percentile( latencies, callbacks, 0.90 ),
+            percentile( latencies, callbacks, 0.99 ), percentile( latencies, callbacks, 0.999 ),
+            callbacks ? latencies[callbacks - 1] : 0,
+            stats.producerWakeups, stats.underruns, stats.overruns, stats.fillMin,
+            stats.fillAverage, stats.nearEmpty, stats.bufferBlocks, stats.depthGrows, stats.depthShrinks,
+            stats.readUsAverage, stats.readUsMax, stats.wakeToReadyUsAverage,
+            stats.lowWatermark, stats.producerSignals, stats.producerTimeouts,
+            framesPlayed > 0 ? stats.producerWakeups / ( framesPlayed / outputRate ) : 0.0, stats.blocksPerRefill,
+            stats.producerIdlePercent, stats.producerCpuPercent, stats.decodeUsAverage,
+            stats.ioReads, stats.ioReadUsAverage, stats.ioStalls, stats.ioStallMsTotal,
+            stats.openMs, stats.firstAudioMs,
+            stats.dspStageCount, stats.dspStageCount ? JDSPChainGetKernelName() : "none",
+            stats.dspUsAverage, stats.dspCorePercent );
+    fflush( stdout );
+
+    free( latencies );
+    free( output );
+    JAudioPlayerDestroy( &audioPlayer );
+    return 0;
+}
+
+
+/* Doubles the voice count up to maxVoices, ending on maxVoices itself.  Returns 0
+ * after maxVoices. */
+static unsigned nextVoiceCount( unsigned voices, unsigned maxVoices )
+{
+    if( voices >= maxVoices )
+        return 0;
+    return voices * 2 < maxVoices ? voices * 2 : maxVoices;
+}
+
+
+/* Mixes voices copies of path for seconds of audio, calling JMixerCallback directly
+ * as fast as the voices are ready, and prints one result line */
+static int runMixer( const char *path, unsigned voices, double seconds, const JBenchOptions *options )
+{
+    JMixer          *mixer;
+    JMixerConfig    config;
+    JMixerStats     stats;
+    PaStreamCallbackTimeInfo timeInfo;
+    const unsigned long framesPerCallback = options->framesPerCallback;
+    unsigned long   callbacks, maxCallbacks;
+    unsigned long long start, elapsed;
+    double          outputRate, audioSeconds;
+    float           *output;
+    unsigned        v;
+
+    JMixerGetDefaultConfig( &config );
+    config.output.backend = JOUTPUT_NULL;
+    config.framesPerBuffer = framesPerCallback;
+    config.sampleRate = options->deviceRate > 0 ? options->deviceRate : benchCases[0].sampleRate;
+
+    mixer = JMixerCreate( &config );
+    if( mixer == NULL )
+        return -1;
+    for( v=0; v<voices; v++ )
+    {
+        /* Spread the voices across the stereo field */
+        const float pan = voices > 1 ? -1.0f + 2.0f * v / ( voices - 1 ) : 0.0f;
+
+        if( JMixerAddVoice( mixer, path, 1.0f / voices, pan, TRUE ) < 0 )
+        {
+            JMixerDestroy( &mixer );
+            return -1;
+        }
+    }
+
+    outputRate = mixer->output->params.sampleRate;
+    maxCallbacks = (unsigned long)( seconds * outputRate / framesPerCallback ) + 1;
+    output = (float*)malloc( sizeof(float) * framesPerCallback * mixer->stream.channels );
+    if( output == NULL )
+    {
+        JMixerDestroy( &mixer );
+        return -1;
+    }
+
+    memset( &timeInfo, 0, sizeof(timeInfo) );
+    start = JPlatformGetTimeNs();
+    for( callbacks=0; callbacks<maxCallbacks; callbacks++ )
+    {
+        while( !JMixerIsReady( mixer, framesPerCallback ) )
+            JPlatformYield();
+        JMixerCallback( NULL, output, framesPerCallback, &timeInfo, 0, mixer );
+    }
+    elapsed = JPlatformGetTimeNs() - start;
+
+    JMixerGetStats( mixer, &stats );
+    audioSeconds = (double)callbacks * framesPerCallback / outputRate;
+
+    printf( "{\"case\":\"mixer\",\"voices\":%u,\"channels\":%d,\"sample_rate\":%.0f,\"frames_per_callback\":%lu,"
+            "\"mix_kernel\":\"%s\",\"seconds\":%.6f,\"callbacks\":%lu,\"callback_us_avg\":%.2f,"
+            "\"callback_us_max\":%.2f,\"voice_underruns\":%lu,\"read_us_avg\":%.2f,"
+            "\"mix_load\":%.4f,\"decode_load\":%.4f,\"mix_voices_per_core\":%.0f,\"voices_per_core\":%.0f}\n",
+            voices, mixer->stream.channels, outputRate, framesPerCallback, JMixerGetKernelName(),
+            elapsed / 1e9, stats.callbacks, stats.callbackUsAverage, stats.callbackUsMax,
+            stats.voiceUnderruns, stats.readUsAverage,
+            stats.mixSeconds / audioSeconds, stats.decodeSeconds / audioSeconds,
+            stats.mixSeconds > 0 ? voices * audioSeconds / stats.mixSeconds : 0.0,
+            stats.mixSeconds + stats.decodeSeconds > 0 ? voices * audioSeconds / ( stats.mixSeconds + stats.decodeSeconds ) : 0.0 );
+    fflush( stdout );
+
+    free( output );
+    JMixerDestroy( &mixer );
+    return 0;
+}
+
+
+int main( int argc, char* argv[] )
+{
+    const char      *directory = "obj";
+    double          seconds = 20.0;
+    JBenchOptions   options;
+    char            path[1024];
+    unsigned        c, v;
+    int             i, q, tiers, failures = 0;
+
+    options.framesPerCallback = DEFAULT_FRAMES_PER_BLOCK;
+    options.deviceRate = 0;
+    options.jitter = 0.25;
+    options.clockSpeed = 4.0;
+    options.refillBlocks = 0;
+    options.maxVoices = 32;
+    options.bStream = FALSE;
+    options.bEffects = FALSE;
+
+    for( i=1; i+1<argc; i+=2 )
+    {
+        if( strcmp( argv[i], "-s" ) == 0 )
+            seconds = atof( argv[i + 1] );
+        else if( strcmp( argv[i], "-b" ) == 0 )
+            options.framesPerCallback = strtoul( argv[i + 1], NULL, 10 );
+        else if( strcmp( argv[i], "-r" ) == 0 )
+            options.deviceRate = atof( argv[i + 1] );
+        else if( strcmp( argv[i], "-j" ) == 0 )
+            options.jitter = atof( argv[i + 1] );
+        else if( strcmp( argv[i], "-x" ) == 0 )
+            options.clockSpeed = atof( argv[i + 1] );
+        else if( strcmp( argv[i], "-w" ) == 0 )
+            options.refillBlocks = (unsigned)strtoul( argv[i + 1], NULL, 10 );
+        else if( strcmp( argv[i], "-v" ) == 0 )
+            options.maxVoices = (unsigned)strtoul( argv[i + 1], NULL, 10 );
+        else if( strcmp( argv[i], "-p" ) == 0 )
+            options.bStream = atoi( argv[i + 1] ) != 0;
+        else if( strcmp( argv[i], "-e" ) == 0 )
+            options.bEffects = atoi( argv[i + 1] ) != 0;
+        else if( strcmp( argv[i], "-d" ) == 0 )
+            directory = argv[i + 1];
+        else
+            break;
+    }
+    if( i != argc || seconds <= 0 || options.clockSpeed <= 0 || options.framesPerCallback == 0 ||
+        options.deviceRate < 0 )
+    {
+        printf( "Usage: %s [-s seconds] [-b frames] [-r rate] [-j jitter] [-x clock_speed] [-w blocks] [-v voices] [-p 0|1] [-e 0|1] [-d directory]\n", argv[0] );
+        return 1;
+    }
+
+    for( c=0; c<sizeof(benchCases)/sizeof(benchCases[0]); c++ )
+    {
+        const int bMixerCase = ( c == 0 && options.maxVoices > 0 );
+
+        snprintf( path, sizeof(path), "%s/bench_%s.%s", directory, benchCases[c].name,
+                  ( benchCases[c].format & SF_FORMAT_TYPEMASK ) == SF_FORMAT_FLAC ? "flac" : "wav" );
+        if( generateFile( path, &benchCases[c], seconds ) < 0 )
+        {
+            failures++;
+            continue;
+        }
+
+        /* Every quality tier is measured when the file has to be resampled */
+        tiers = ( options.deviceRate > 0 && (int)options.deviceRate != benchCases[c].sampleRate ) ? JRESAMPLE_BEST + 1 : 1;
+        for( q=0; q<tiers; q++ )
+        {
+            const JResampleQuality quality = ( tiers == 1 ) ? JRESAMPLE_MEDIUM : (JResampleQuality)q;
+
+            if( runCase( path, &benchCases[c], JBENCH_CLOCK_FREERUN, quality, &options ) < 0 )
+                failures++;
+            if( runCase( path, &benchCases[c], JBENCH_CLOCK_JITTERED, quality, &options ) < 0 )
+                failures++;
+        }
+
+        /* The first case doubles as the voice for the mixer */
+        for( v=1; bMixerCase && v>0; v=nextVoiceCount( v, options.maxVoices ) )
+        {
+            if( runMixer( path, v, seconds, &options ) < 0 )
+                failures++;
+        }
+        remove( path );
+    }
+
+    return failures != 0;
+}
@@ -0,0 +1,439 @@
+/* JBlockCache.c Contains routines caching decoded blocks around seek targets
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "JBlockCache.h"
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+static THREAD_ROUTINE_SIGNATURE fillThread( void *threadArg );
+static JBlockCacheEntry* decodeRun( JBlockCache *cache, JAudioTrack *decoder, const JBlockCacheRequest *request,
+                                    JDither *dither );
+static JBlockCacheEntry* findEntry( JBlockCache *cache, sf_count_t frame );
+static void insertEntry( JBlockCache *cache, JBlockCacheEntry *entry );
+static int evictEntry( JBlockCache *cache );
+static void unlinkEntry( JBlockCache *cache, JBlockCacheEntry *entry );
+static void freeEntry( JBlockCacheEntry *entry );
+
+
+JBlockCache* JBlockCacheCreate( const JStreamFormat *stream, size_t budgetBytes, unsigned long runFrames )
+{
+    JBlockCache *cache = NULL;
+
+    cache = (JBlockCache*)calloc( 1, sizeof(JBlockCache) );
+    if( cache == NULL )
+        return NULL;
+    cache->stream = *stream;
+    cache->stream.readAheadSeconds = 0;     /* Runs are short and start anywhere */
+    cache->stream.ioCounters = NULL;
+    cache->bytesPerFrame = (size_t)JSampleFormatBytes( stream->format ) * stream->channels;
+    cache->budgetBytes = budgetBytes;
+    cache->runFrames = runFrames;
+    cache->bTimeToQuit = FALSE;
+
+    if( JPlatformMutexInit( &cache->lock ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        free( cache );
+        return NULL;
+    }
+    if( JPlatformEventInit( &cache->fillEvent ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        JPlatformMutexDestroy( &cache->lock );
+        free( cache );
+        return NULL;
+    }
+    if( JPlatformThreadCreate( &cache->fillThread, fillThread, cache ) )
+    {
+        printf( "  Error creating cache fill thread\n" );
+        JPlatformEventDestroy( &cache->fillEvent );
+        JPlatformMutexDestroy( &cache->lock );
+        free( cache );
+        return NULL;
+    }
+    return cache;
+}
+
+
+void JBlockCacheSetTrack( JBlockCache *cache, unsigned trackId, const char *filePath )
+{
+    JBlockCacheEntry *entry, *next;
+    char *path = NULL;
+    unsigned i, kept = 0;
+
+    if( filePath != NULL )
+    {
+        path = (char*)malloc( strlen( filePath ) + 1 );
+        if( path != NULL )
+            strcpy( path, filePath );
+    }
+
+    JPlatformMutexLock( &cache->lock );
+    /* Runs of other tracks can never be looked up again.  One still in use is left to
+     * be evicted once it has been released. */
+    for( entry = cache->first; entry != NULL; entry = next )
+    {
+        next = entry->next;
+        if( entry->trackId != trackId && entry->users == 0 )
+        {
+            unlinkEntry( cache, entry );
+            freeEntry( entry );
+        }
+    }
+    /* Requests for earlier tracks can never be served.  Those for tracks still queued,
+     * such as their cue points, wait for their track. */
+    for( i=0; i<cache->requestCount; i++ )
+    {
+        if( cache->requests[i].trackId > trackId || ( cache->requests[i].trackId == trackId && path != NULL ) )
+            cache->requests[kept++] = cache->requests[i];
+    }
+    cache->requestCount = kept;
+    free( cache->trackPath );
+    cache->trackPath = path;
+    cache->trackId = trackId;
+    JPlatformMutexUnlock( &cache->lock );
+
+    if( kept > 0 )
+        JPlatformEventSignal( &cache->fillEvent );
+    return;
+}
+
+
+void JBlockCacheRequestFill( JBlockCache *cache, unsigned trackId, sf_count_t frame, int bCuePoint )
+{
+    JBlockCacheEntry *entry;
+    unsigned i;
+
+    JPlatformMutexLock( &cache->lock );
+    if( trackId < cache->trackId || ( trackId == cache->trackId && cache->trackPath == NULL ) )
+    {
+        JPlatformMutexUnlock( &cache->lock );
+        return;
+    }
+    if( trackId == cache->trackId && ( entry = findEntry( cache, frame ) ) != NULL )
+    {
+        entry->bCuePoint |= bCuePoint;
+        JPlatformMutexUnlock( &cache->lock );
+        return;
+    }
+    for( i=0; i<cache->requestCount; i++ )
+    {
+        if( cache->requests[i].trackId == trackId && cache->requests[i].frame == frame )
+        {
+            cache->requests[i].bCuePoint |= bCuePoint;
+            JPlatformMutexUnlock( &cache->lock );
+            return;
+        }
+    }
+    /* The oldest request is the least likely to be wanted again */
+    if( cache->requestCount == JBLOCKCACHE_MAX_REQUESTS )
+    {
+        memmove( cache->requests, cache->requests + 1, sizeof(JBlockCacheRequest) * ( JBLOCKCACHE_MAX_REQUESTS - 1 ) );
+        cache->requestCount--;
+    }
+    cache->requests[cache->requestCount].trackId = trackId;
+    cache->requests[cache->requestCount].frame = frame;
+    cache->requests[cache->requestCount].bCuePoint = bCuePoint;
+    cache->requestCount++;
+    JPlatformMutexUnlock( &cache->lock );
+
+    JPlatformEventSignal( &cache->fillEvent );
+    return;
+}
+
+
+JBlockCacheEntry* JBlockCacheLookup( JBlockCache *cache, unsigned trackId, sf_count_t frame, unsigned long *offset )
+{
+    JBlockCacheEntry *entry;
+
+    JPlatformMutexLock( &cache->lock );
+    entry = ( trackId == cache->trackId ) ? findEntry( cache, frame ) : NULL;
+    if( entry != NULL )
+    {
+        entry->users++;
+        unlinkEntry( cache, entry );
+        entry->next = cache->first;
+        if( cache->first != NULL )
+            cache->first->prev = entry;
+        else
+            cache->last = entry;
+        cache->first = entry;
+        cache->counters.entries++;
+        cache->counters.bytes += entry->bytes;
+        cache->counters.hits++;
+        *offset = (unsigned long)( frame - entry->frame );
+    }
+    else
+        cache->counters.misses++;
+    JPlatformMutexUnlock( &cache->lock );
+    return entry;
+}
+
+
+void JBlockCacheRelease( JBlockCache *cache, JBlockCacheEntry *entry )
+{
+    JPlatformMutexLock( &cache->lock );
+    entry->users--;
+    JPlatformMutexUnlock( &cache->lock );
+    return;
+}
+
+
+void JBlockCacheGetStats( JBlockCache *cache, JBlockCacheStats *stats )
+{
+    JPlatformMutexLock( &cache->lock );
+    *stats = cache->counters;
+    JPlatformMutexUnlock( &cache->lock );
+    return;
+}
+
+
+void JBlockCacheDestroy( JBlockCache **cachePtr )
+{
+    JBlockCache *cache = *cachePtr;
+    JBlockCacheEntry *entry;
+
+    if( cache == NULL )
+        return;
+
+    cache->bTimeToQuit = TRUE;
+    JPlatformEventSignal( &cache->fillEvent );
+    JPlatformThreadJoin( &cache->fillThread );
+
+    while( ( entry = cache->first ) != NULL )
+    {
+        unlinkEntry( cache, entry );
+        freeEntry( entry );
+    }
+    free( cache->trackPath );
+    JPlatformEventDestroy( &cache->fillEvent );
+    JPlatformMutexDestroy( &cache->lock );
+    free( cache );
+    *cachePtr = NULL;
+
+    return;
+}
+
+
+/* Decodes requested runs with a decoder of its own, reopened when the track changes.
+ * The lock is not held while decoding, so lookups never wait for the disk. */
+static THREAD_ROUTINE_SIGNATURE fillThread( void *threadArg )
+{
+    JBlockCache         *cache = (JBlockCache*)threadArg;
+    JAudioTrack         *decoder = NULL;
+    JBlockCacheEntry    *entry;
+    JBlockCacheRequest  request;
+    JDither             dither;
+    char                *path;
+    unsigned            trackId, i;
+
+    JDitherInit( &dither, (unsigned)JPlatformGetTimeNs() );
+
+    while( !cache->bTimeToQuit )
+    {
+        JPlatformEventWait( &cache->fillEvent, 1000 );
+
+        while( !cache->bTimeToQuit )
+        {
+            path = NULL;
+            JPlatformMutexLock( &cache->lock );
+            trackId = cache->trackId;
+            for( i=0; i<cache->requestCount && cache->requests[i].trackId != trackId; i++ );
+            if( i == cache->requestCount || cache->trackPath == NULL )
+            {
+                JPlatformMutexUnlock( &cache->lock );
+                break;
+            }
+            request = cache->requests[i];
+            cache->requestCount--;
+            memmove( cache->requests + i, cache->requests + i + 1, sizeof(JBlockCacheRequest) * ( cache->requestCount - i ) );
+            if( decoder == NULL || decoder->trackId != trackId )
+            {
+                path = (char*)malloc( strlen( cache->trackPath ) + 1 );
+                if( path != NULL )
+                    strcpy( path, cache->trackPath );
+            }
+            JPlatformMutexUnlock( &cache->lock );
+
+            if( path != NULL )
+            {
+                JAudioTrackClose( &decoder );
+                decoder = JAudioTrackOpen( path, &cache->stream, trackId );
+                free( path );
+            }
+            if( decoder == NULL || decoder->trackId != trackId )
+                continue;
+
+            entry = decodeRun( cache, decoder, &request, &dither );
+            if( entry == NULL )
+                continue;
+
+            /* The track may have changed, or the run been filled, while decoding */
+            JPlatformMutexLock( &cache->lock );
+            if( cache->trackId == trackId && cache->trackPath != NULL && findEntry( cache, request.frame ) == NULL )
+            {
+                insertEntry( cache, entry );
+                entry = NULL;
+            }
+            JPlatformMutexUnlock( &cache->lock );
+            freeEntry( entry );
+        }
+    }
+    JAudioTrackClose( &decoder );
+    return 0;
+}
+
+
+/* Decodes runFrames frames from request->frame into a new entry */
+static JBlockCacheEntry* decodeRun( JBlockCache *cache, JAudioTrack *decoder, const JBlockCacheRequest *request,
+                                    JDither *dither )
+{
+    JBlockCacheEntry *entry;
+    unsigned char *data;
+
+    entry = (JBlockCacheEntry*)calloc( 1, sizeof(JBlockCacheEntry) );
+    if( entry == NULL )
+        return NULL;
+    entry->data = (unsigned char*)malloc( cache->runFrames * cache->bytesPerFrame );
+    if( entry->data == NULL || JAudioTrackSeek( decoder, request->frame, SEEK_SET ) != request->frame )
+    {
+        freeEntry( entry );
+        return NULL;
+    }
+    entry->trackId = decoder->trackId;
+    entry->frame = request->frame;
+    entry->bCuePoint = request->bCuePoint;
+    entry->frames = JAudioTrackRead( decoder, entry->data, cache->runFrames, dither, &entry->fileFrames );
+    if( entry->frames == 0 )
+    {
+        freeEntry( entry );
+        return NULL;
+    }
+    entry->bytes = entry->frames * cache->bytesPerFrame;
+
+    /* A run cut short by the end of the track only keeps what it needs */
+    if( entry->frames < cache->runFrames && ( data = (unsigned char*)realloc( entry->data, entry->bytes ) ) != NULL )
+        entry->data = data;
+    return entry;
+}
+
+
+/* Returns the run of the current track covering frame.  Called with lock taken. */
+static JBlockCacheEntry* findEntry( JBlockCache *cache, sf_count_t frame )
+{
+    JBlockCacheEntry *entry;
+
+    for( entry = cache->first; entry != NULL; entry = entry->next )
+    {
+        if( entry->trackId == cache->trackId && frame >= entry->frame && frame < entry->frame + entry->fileFrames )
+            return entry;
+    }
+    return NULL;
+}
+
+
+/* Makes room under the budget and adds entry as the most recently used, or frees it if
+ * there is no room.  Called with lock taken. */
+static void insertEntry( JBlockCache *cache, JBlockCacheEntry *entry )
+{
+    while( cache->counters.bytes + entry->bytes > cache->budgetBytes )
+    {
+        if( !evictEntry( cache ) )
+        {
+            freeEntry( entry );
+            return;
+        }
+    }
+    entry->prev = NULL;
+    entry->next = cache->first;
+    if( cache->first != NULL )
+        cache->first->prev = entry;
+    else
+        cache->last = entry;
+    cache->first = entry;
+    cache->counters.entries++;
+    cache->counters.bytes += entry->bytes;
+    cache->counters.fills++;
+    return;
+}
+
+
+/* Frees the least recently used run not in use, preferring seek targets over cue
+ * points.  Returns FALSE if every run is in use.  Called with lock taken. */
+static int evictEntry( JBlockCache *cache )
+{
+    JBlockCacheEntry *entry, *victim = NULL;
+
+    for( entry = cache->last; entry != NULL; entry = entry->prev )
+    {
+        if( entry->users > 0 )
+            continue;
+        if( !entry->bCuePoint )
+        {
+            victim = entry;
+            break;
+        }
+        if( victim == NULL )
+            victim = entry;
+    }
+    if( victim == NULL )
+        return FALSE;
+
+    unlinkEntry( cache, victim );
+    freeEntry( victim );
+    cache->counters.evictions++;
+    return TRUE;
+}
+
+
+/* Takes entry out of the list.  Called with lock taken. */
+static void unlinkEntry( JBlockCache *cache, JBlockCacheEntry *entry )
+{
+    if( entry->prev != NULL )
+        entry->prev->next = entry->next;
+    else
+        cache->first = entry->next;
+    if( entry->next != NULL )
+        entry->next->prev = entry->prev;
+    else
+        cache->last = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+    cache->counters.entries--;
+    cache->counters.bytes -= entry->bytes;
+    return;
+}
+
+
+static void freeEntry( JBlockCacheEntry *entry )
+{
+    if( entry == NULL )
+        return;
+    free( entry->data );
+    free( entry );
+    return;
+}
@@ -0,0 +1,149 @@
+/* JBlockCache.h Header file for the cache of decoded blocks around seek targets
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JBLOCKCACHE_H_INCLUDED
+#define JBLOCKCACHE_H_INCLUDED
+
+#include <stdio.h>
+
+#include "sndfile.h"
+
+#include "JPlatform.h"
+#include "JAudioTrack.h"
+
+#define JBLOCKCACHE_MAX_REQUESTS 16     /* Fills waiting for the fill thread */
+
+/** A run of frames decoded in the stream format, starting at a frame of a track.
+  * The frames are never changed once the entry is in the cache.
+  */
+typedef struct JBlockCacheEntry
+{
+    unsigned        trackId;
+    sf_count_t      frame;              /* File frame the run starts at */
+    unsigned long   frames;             /* Stream frames in data, fewer than runFrames
+                                         * when the run reaches the end of the track */
+    sf_count_t      fileFrames;         /* File frames the run was decoded from */
+    unsigned char   *data;
+    size_t          bytes;
+    int             bCuePoint;          /* Only evicted when nothing else can be */
+    unsigned        users;              /* Lookups not yet released, never evicted
+                                         * while non zero */
+    struct JBlockCacheEntry *prev;      /* Least recently used list, most recent first */
+    struct JBlockCacheEntry *next;
+}
+JBlockCacheEntry;
+
+/** A run waiting to be decoded by the fill thread, once its track is the current one */
+typedef struct
+{
+    unsigned    trackId;
+    sf_count_t  frame;
+    int         bCuePoint;
+}
+JBlockCacheRequest;
+
+/** Snapshot of the cache statistics
+  * @see JBlockCacheGetStats
+  */
+typedef struct
+{
+    unsigned long   hits;               /* Lookups served from memory */
+    unsigned long   misses;
+    unsigned long   fills;              /* Runs decoded by the fill thread */
+    unsigned long   evictions;
+    unsigned        entries;
+    size_t          bytes;              /* Memory held by entries */
+}
+JBlockCacheStats;
+
+/** Least recently used cache of decoded runs of the track being played, kept under a
+  * memory budget.  Runs are decoded by a fill thread with its own decoder, so filling
+  * never moves the cursor of the track being played.  Everything below lock is
+  * protected by it; entry data is read without it while the entry is in use.
+  */
+typedef struct
+{
+    /* Set up in JBlockCacheCreate and read-only afterwards */
+    JStreamFormat   stream;
+    size_t          bytesPerFrame;
+    size_t          budgetBytes;
+    unsigned long   runFrames;          /* Stream frames decoded per entry */
+
+    JMutex          lock;
+    JBlockCacheEntry *first;            /* Most recently used */
+    JBlockCacheEntry *last;             /* Least recently used */
+    JBlockCacheStats counters;
+    unsigned        trackId;            /* Track the cache is filled for */
+    char            *trackPath;         /* NULL when the track cannot be cached */
+    JBlockCacheRequest requests[JBLOCKCACHE_MAX_REQUESTS];
+    unsigned        requestCount;
+
+    JThread         fillThread;
+    JEvent          fillEvent;          /* A request was made or the track changed */
+    volatile int    bTimeToQuit;
+}
+JBlockCache;
+
+/** @brief Creates a cache and starts its fill thread.  JBlockCacheDestroy must be
+  * called to free resources allocated by JBlockCacheCreate.
+  * @param stream Format the runs are decoded to, the same as the stream played
+  * @param budgetBytes Most memory held by decoded frames
+  * @param runFrames Frames decoded at each seek target or cue point
+  * @return Pointer to a JBlockCache, returns NULL on failure
+  */
+JBlockCache* JBlockCacheCreate( const JStreamFormat *stream, size_t budgetBytes, unsigned long runFrames );
+
+/** @brief Changes the track the cache is filled for.  Entries and requests for other
+  * tracks are dropped, except requests for tracks queued to play after it.
+  * @param filePath Path the fill thread opens the track from, copied.  NULL if the
+  * track cannot be cached, e.g. because it is resampled.
+  */
+void JBlockCacheSetTrack( JBlockCache *cache, unsigned trackId, const char *filePath );
+
+/** @brief Asks the fill thread to decode a run starting at frame of a track and
+  * returns immediately.  Does nothing if a cached run already covers frame.
+  * @param trackId The current track, or a later one to decode the run for once the
+  * cache is switched to it.  Track identifiers are assumed to increase in the order
+  * the tracks are played.
+  * @param bCuePoint TRUE to keep the run in preference to ones for seek targets
+  */
+void JBlockCacheRequestFill( JBlockCache *cache, unsigned trackId, sf_count_t frame, int bCuePoint );
+
+/** @brief Finds a run of the current track covering frame and marks it most recently
+  * used.  The run stays in the cache until it is released.
+  * @param trackId Track frame is in.  Nothing is found until the cache has been
+  * switched to it.
+  * @param offset Set to the position of frame within the run, in stream frames
+  * @return The run, or NULL if frame is not cached
+  */
+JBlockCacheEntry* JBlockCacheLookup( JBlockCache *cache, unsigned trackId, sf_count_t frame, unsigned long *offset );
+
+/** @brief Lets go of a run returned by JBlockCacheLookup */
+void JBlockCacheRelease( JBlockCache *cache, JBlockCacheEntry *entry );
+
+/** @brief Takes a snapshot of the cache statistics */
+void JBlockCacheGetStats( JBlockCache *cache, JBlockCacheStats *stats );
+
+/** @brief Stops the fill thread and frees every entry.  No run may still be in use.
+  * @param cachePtr Pointer to a pointer to a JBlockCache, set to NULL after freeing
+  */
+void JBlockCacheDestroy( JBlockCache **cachePtr );
+
+#endif // JBLOCKCACHE_H_INCLUDED
@@ -0,0 +1,719 @@
+/* JControlServer.c Source file for the control server of the headless player
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "JControlServer.h"
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define REPLY_BYTES 512
+
+#ifndef WIN32
+
+static THREAD_ROUTINE_SIGNATURE workerThread( void *threadArg );
+static void acceptClient( JControlServer *server );
+static int readClient( JControlServer *server, JControlClient *client );
+static int handleLines( JControlServer *server, JControlClient *client );
+static void closeClient( JControlServer *server, unsigned index );
+static int handleCommand( JControlServer *server, JControlClient *client, char *line );
+static int startJob( JControlServer *server, JControlJob job, const char *filePath, unsigned long clientId );
+static void finishJob( JControlServer *server );
+static int sendReply( JControlClient *client, const char *reply, size_t length );
+static int flushClient( JControlClient *client );
+static int sendStats( JControlServer *server, JControlClient *client );
+static void stopAtEnd( JControlServer *server );
+static const char* stateName( JPlayerState state );
+static int setNonBlocking( int fd );
+
+
+JControlServer* JControlServerCreate( const char *socketPath, const JAudioPlayerConfig *config )
+{
+    JControlServer      *server = NULL;
+    struct sockaddr_un  address;
+
+    if( strlen( socketPath ) >= sizeof(address.sun_path) )
+    {
+        printf( "  Error: Socket path is too long: %s\n", socketPath );
+        return NULL;
+    }
+
+    server = (JControlServer*)calloc( 1, sizeof(JControlServer) );
+    if( server == NULL )
+        return NULL;
+    if( JPlatformEventInit( &server->workerEvent ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        free( server );
+        return NULL;
+    }
+    if( config != NULL )
+        server->config = *config;
+    else
+        JAudioPlayerGetDefaultConfig( &server->config );
+    server->listenFd = -1;
+    server->wakeFds[0] = server->wakeFds[1] = -1;
+
+    server->socketPath = (char*)malloc( strlen( socketPath ) + 1 );
+    if( server->socketPath == NULL )
+    {
+        JPlatformEventDestroy( &server->workerEvent );
+        free( server );
+        return NULL;
+    }
+    strcpy( server->socketPath, socketPath );
+
+    if( pipe( server->wakeFds ) != 0 || setNonBlocking( server->wakeFds[0] ) || setNonBlocking( server->wakeFds[1] ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        JControlServerDestroy( &server );
+        return NULL;
+    }
+
+    memset( &address, 0, sizeof(address) );
+    address.sun_family = AF_UNIX;
+    strcpy( address.sun_path, socketPath );
+    unlink( socketPath );      /* Left behind by a server that did not exit cleanly */
+
+    server->listenFd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( server->listenFd < 0 ||
+        bind( server->listenFd, (struct sockaddr*)&address, sizeof(address) ) != 0 ||
+        listen( server->listenFd, JCONTROL_MAX_CLIENTS ) != 0 ||
+        setNonBlocking( server->listenFd ) )
+    {
+        printf( "  Error: Cannot listen on %s: %s\n", socketPath, strerror( errno ) );
+        JControlServerDestroy( &server );
+        return NULL;
+    }
+
+    if( JPlatformThreadCreate( &server->workerThread, workerThread, server ) )
+    {
+        printf( "  Error creating control worker thread\n" );
+        JControlServerDestroy( &server );
+        return NULL;
+    }
+    server->bWorkerRunning = TRUE;
+    return server;
+}
+
+
+int JControlServerLoad( JControlServer *server, const char *filePath )
+{
+    /* Only one output stream is open at a time */
+    JAudioPlayerDestroy( &server->player );
+    server->player = JAudioPlayerCreate( filePath, &server->config );
+    return server->player == NULL ? -1 : 0;
+}
+
+
+void JControlServerRun( JControlServer *server )
+{
+    struct pollfd   fds[JCONTROL_MAX_CLIENTS + 2];
+    unsigned        i, count;
+    char            drain[64];
+    int             bClose;
+
+    server->bQuit = FALSE;
+    while( !server->bQuit )
+    {
+        fds[0].fd = server->wakeFds[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = server->listenFd;
+        fds[1].events = POLLIN;
+        for( i=0; i<server->clientCount; i++ )
+        {
+            /* Commands are left unread while a job runs, so they are handled in order,
+             * and while a reply is waiting to be sent, so replies cannot pile up */
+            fds[i+2].fd = server->clients[i].fd;
+            fds[i+2].events = server->clients[i].pendingLength > 0 ? POLLOUT :
+                              server->job == JCONTROL_JOB_NONE ? POLLIN : 0;
+        }
+        count = server->clientCount + 2;
+
+        /* Only a playing track needs watching, otherwise sleep until a command or the
+         * end of a job */
+        if( poll( fds, count, server->job == JCONTROL_JOB_NONE && server->player != NULL &&
+                              server->player->state != JPLAYER_STOPPED ? JCONTROL_POLL_MS : -1 ) < 0 &&
+            errno != EINTR )
+        {
+            printf( "  Error: Control server poll failed: %s\n", strerror( errno ) );
+            break;
+        }
+        stopAtEnd( server );
+
+        if( fds[0].revents & POLLIN )
+        {
+            while( read( server->wakeFds[0], drain, sizeof(drain) ) > 0 );
+        }
+
+        /* Clients from the back, so closing one does not move those not yet seen */
+        for( i=count; i-- > 2; )
+        {
+            bClose = FALSE;
+            if( fds[i].revents & POLLOUT )
+            {
+                bClose = flushClient( &server->clients[i-2] );
+                if( !bClose && server->clients[i-2].pendingLength == 0 )
+                    bClose = handleLines( server, &server->clients[i-2] );
+            }
+            if( !bClose && ( fds[i].revents & ( POLLIN | POLLHUP | POLLERR ) ) )
+                bClose = readClient( server, &server->clients[i-2] );
+            if( bClose )
+                closeClient( server, i - 2 );
+        }
+
+        /* Reply to the job that has finished, then carry on with the commands held */
+        if( server->job != JCONTROL_JOB_NONE && JATOMIC_LOAD_ACQUIRE( &server->bJobDone ) )
+        {
+            finishJob( server );
+            for( i=server->clientCount; i-- > 0 && !server->bQuit; )
+            {
+                if( handleLines( server, &server->clients[i] ) )
+                    closeClient( server, i );
+            }
+        }
+        if( fds[1].revents & POLLIN )
+            acceptClient( server );
+    }
+    return;
+}
+
+
+void JControlServerStop( JControlServer *server )
+{
+    char wake = 0;
+
+    server->bQuit = TRUE;
+    if( write( server->wakeFds[1], &wake, 1 ) < 0 )
+        return;     /* The pipe is full, so poll will wake anyway */
+    return;
+}
+
+
+void JControlServerDestroy( JControlServer **serverPtr )
+{
+    JControlServer *server = *serverPtr;
+
+    if( server == NULL )
+        return;
+
+    /* A job still running is let finish, as it may be replacing the player */
+    if( server->bWorkerRunning )
+    {
+        server->bWorkerQuit = TRUE;
+        JPlatformEventSignal( &server->workerEvent );
+        JPlatformThreadJoin( &server->workerThread );
+    }
+    free( server->jobPath );
+    JPlatformEventDestroy( &server->workerEvent );
+
+    while( server->clientCount > 0 )
+        closeClient( server, server->clientCount - 1 );
+    if( server->listenFd >= 0 )
+    {
+        close( server->listenFd );
+        unlink( server->socketPath );
+    }
+    if( server->wakeFds[0] >= 0 )
+        close( server->wakeFds[0] );
+    if( server->wakeFds[1] >= 0 )
+        close( server->wakeFds[1] );
+    JAudioPlayerDestroy( &server->player );
+
+    free( server->socketPath );
+    free( server );
+    *serverPtr = NULL;
+
+    return;
+}
+
+
+static void acceptClient( JControlServer *server )
+{
+    JControlClient *client;
+    int fd;
+
+    while( ( fd = accept( server->listenFd, NULL, NULL ) ) >= 0 )
+    {
+        if( server->clientCount == JCONTROL_MAX_CLIENTS || setNonBlocking( fd ) )
+        {
+            close( fd );
+            continue;
+        }
+        client = &server->clients[server->clientCount++];
+        client->fd = fd;
+        client->id = ++server->counters.clientsAccepted;
+        client->length = 0;
+        client->pending = NULL;
+        client->pendingLength = 0;
+    }
+    return;
+}
+
+
+/* Reads what the client has sent and handles every complete line, until a job is
+ * started.  Returns non-zero when the client should be closed. */
+static int readClient( JControlServer *server, JControlClient *client )
+{
+    ssize_t received;
+
+    for( ;; )
+    {
+        /* Lines held back stay in the socket once the buffer is full */
+        if( client->length == sizeof(client->line) - 1 &&
+            ( server->job != JCONTROL_JOB_NONE || client->pendingLength > 0 ) )
+            return 0;
+        received = recv( client->fd, client->line + client->length, sizeof(client->line) - 1 - client->length, 0 );
+        if( received == 0 )
+            return -1;
+        if( received < 0 )
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        client->length += (size_t)received;
+        client->line[client->length] = '\0';
+
+        if( handleLines( server, client ) )
+            return -1;
+        if( server->bQuit || server->job != JCONTROL_JOB_NONE || client->pendingLength > 0 )
+            return 0;
+        if( client->length == sizeof(client->line) - 1 )
+        {
+            sendReply( client, "ERR line too long\n", 18 );
+            return -1;
+        }
+    }
+}
+
+
+/* Handles the complete lines received from the client, stopping at one that starts a
+ * job or whose reply the socket has not taken.  Returns non-zero when the client
+ * should be closed. */
+static int handleLines( JControlServer *server, JControlClient *client )
+{
+    char    *end;
+    size_t  lineBytes;
+
+    while( server->job == JCONTROL_JOB_NONE && !server->bQuit && client->pendingLength == 0 &&
+           ( end = strchr( client->line, '\n' ) ) != NULL )
+    {
+        *end = '\0';
+        lineBytes = (size_t)( end - client->line ) + 1;
+        if( handleCommand( server, client, client->line ) )
+            return -1;
+        client->length -= lineBytes;
+        memmove( client->line, client->line + lineBytes, client->length + 1 );
+    }
+    return 0;
+}
+
+
+static void closeClient( JControlServer *server, unsigned index )
+{
+    close( server->clients[index].fd );
+    free( server->clients[index].pending );
+    server->clientCount--;
+    if( index != server->clientCount )
+        memcpy( &server->clients[index], &server->clients[server->clientCount], sizeof(JControlClient) );
+    return;
+}
+
+
+/* Carries out one command and sends its reply, or starts a job that replies once it
+ * has finished.  Returns non-zero when the reply could not be sent. */
+static int handleCommand( JControlServer *server, JControlClient *client, char *line )
+{
+    JAudioPlayer        *player = server->player;
+    JPlayPosition       position;
+    unsigned long long  startNs = JPlatformGetTimeNs(), elapsedNs;
+    char                reply[REPLY_BYTES];
+    char                *command, *argument, *end;
+    double              seconds, rate;
+    int                 whence, trackId, result;
+
+    /* The command is the first word, its argument the rest of the line */
+    end = line + strlen( line );
+    while( end > line && ( end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t' ) )
+        *--end = '\0';
+    command = line + strspn( line, " \t" );
+    argument = command + strcspn( command, " \t" );
+    if( *argument != '\0' )
+    {
+        *argument++ = '\0';
+        argument += strspn( argument, " \t" );
+    }
+    /* Seconds are in the track being heard, which may not be at the rate of the first */
+    if( player != NULL )
+        JAudioPlayerGetPosition( player, &position );
+    rate = player != NULL && position.sampleRate > 0 ? (double)position.sampleRate : 1.0;
+
+    if( *command == '\0' )
+        return 0;
+    else if( strcmp( command, "load" ) == 0 || strcmp( command, "queue" ) == 0 )
+    {
+        if( *argument == '\0' )
+            snprintf( reply, sizeof(reply), "ERR %s needs a file\n", command );
+        else if( command[0] == 'l' )
+        {
+            if( startJob( server, JCONTROL_JOB_LOAD, argument, client->id ) )
+                snprintf( reply, sizeof(reply), "ERR cannot play %s\n", argument );
+            else
+                return 0;
+        }
+        else if( player == NULL )
+            snprintf( reply, sizeof(reply), "ERR no file loaded\n" );
+        else if( ( trackId = JAudioPlayerEnqueue( player, argument ) ) < 0 )
+            snprintf( reply, sizeof(reply), "ERR queue is full\n" );
+        else
+            snprintf( reply, sizeof(reply), "OK %d\n", trackId );
+    }
+    else if( strcmp( command, "quit" ) == 0 )
+    {
+        server->bQuit = TRUE;
+        snprintf( reply, sizeof(reply), "OK\n" );
+    }
+    else if( strcmp( command, "help" ) == 0 )
+    {
+        snprintf( reply, sizeof(reply), "OK load <file>, queue <file>, clear, play, pause, stop, "
+                                        "seek <seconds> [cur|end], status, stats, quit\n" );
+    }
+    else if( player == NULL )
+        snprintf( reply, sizeof(reply), "ERR no file loaded\n" );
+    else if( strcmp( command, "play" ) == 0 )
+    {
+        JAudioPlayerPlay( player );
+        snprintf( reply, sizeof(reply), "OK\n" );
+    }
+    else if( strcmp( command, "pause" ) == 0 )
+    {
+        JAudioPlayerPause( player );
+        snprintf( reply, sizeof(reply), "OK\n" );
+    }
+    else if( strcmp( command, "stop" ) == 0 )
+    {
+        startJob( server, JCONTROL_JOB_STOP, NULL, client->id );
+        return 0;
+    }
+    else if( strcmp( command, "clear" ) == 0 )
+    {
+        JAudioPlayerClearQueue( player );
+        snprintf( reply, sizeof(reply), "OK\n" );
+    }
+    else if( strcmp( command, "seek" ) == 0 )
+    {
+        seconds = strtod( argument, &end );
+        end += strspn( end, " \t" );
+        whence = strcmp( end, "cur" ) == 0 ? SEEK_CUR : strcmp( end, "end" ) == 0 ? SEEK_END : SEEK_SET;
+        if( end == argument || ( *end != '\0' && whence == SEEK_SET ) )
+            snprintf( reply, sizeof(reply), "ERR seek needs seconds\n" );
+        else
+        {
+            /* Seeks are applied by the producer, the reply does not wait for it */
+            JAudioPlayerSeekAsync( player, (sf_count_t)( seconds * rate ), whence );
+            snprintf( reply, sizeof(reply), "OK\n" );
+        }
+    }
+    else if( strcmp( command, "status" ) == 0 )
+    {
+        snprintf( reply, sizeof(reply), "OK state=%s track=%u position=%.3f length=%.3f queue=%u\n",
+                  stateName( player->state ), position.track,
+                  (double)position.frame / rate, (double)position.trackFrames / rate,
+                  JAudioPlayerGetQueueLength( player ) );
+    }
+    else if( strcmp( command, "stats" ) == 0 )
+    {
+        result = sendStats( server, client );
+        if( result == 0 )
+            snprintf( reply, sizeof(reply), "OK\n" );
+        else
+            snprintf( reply, sizeof(reply), "ERR cannot format statistics\n" );
+    }
+    else
+        snprintf( reply, sizeof(reply), "ERR unknown command %s\n", command );
+
+    if( strncmp( reply, "ERR", 3 ) == 0 )
+        server->counters.errors++;
+    result = sendReply( client, reply, strlen( reply ) );
+
+    elapsedNs = JPlatformGetTimeNs() - startNs;
+    server->counters.commands++;
+    server->counters.commandNsTotal += elapsedNs;
+    if( elapsedNs > server->counters.commandNsMax )
+        server->counters.commandNsMax = elapsedNs;
+    return result;
+}
+
+
+/* Hands a job to the worker thread.  Returns non-zero if it could not be started. */
+static int startJob( JControlServer *server, JControlJob job, const char *filePath, unsigned long clientId )
+{
+    if( filePath != NULL )
+    {
+        server->jobPath = (char*)malloc( strlen( filePath ) + 1 );
+        if( server->jobPath == NULL )
+            return -1;
+        strcpy( server->jobPath, filePath );
+    }
+    server->job = job;
+    server->jobClientId = clientId;
+    server->jobStartNs = JPlatformGetTimeNs();
+    JATOMIC_STORE_RELEASE( &server->bJobQueued, TRUE );
+    JPlatformEventSignal( &server->workerEvent );
+    return 0;
+}
+
+
+/* Sends the reply to the job the worker has finished, if its client is still there */
+static void finishJob( JControlServer *server )
+{
+    char                reply[REPLY_BYTES];
+    unsigned long long  elapsedNs;
+    unsigned            i;
+
+    JATOMIC_STORE_RELAXED( &server->bJobDone, FALSE );
+    if( server->job == JCONTROL_JOB_LOAD && server->jobResult != 0 )
+        snprintf( reply, sizeof(reply), "ERR cannot play %s\n", server->jobPath );
+    else
+        snprintf( reply, sizeof(reply), "OK\n" );
+    free( server->jobPath );
+    server->jobPath = NULL;
+    server->job = JCONTROL_JOB_NONE;
+
+    if( server->jobClientId == 0 )
+        return;     /* Stopped at the end of the last track */
+    for( i=0; i<server->clientCount && server->clients[i].id != server->jobClientId; i++ );
+    if( i < server->clientCount && sendReply( &server->clients[i], reply, strlen( reply ) ) )
+        closeClient( server, i );
+
+    if( strncmp( reply, "ERR", 3 ) == 0 )
+        server->counters.errors++;
+    elapsedNs = JPlatformGetTimeNs() - server->jobStartNs;
+    server->counters.commands++;
+    server->counters.commandNsTotal += elapsedNs;
+    if( elapsedNs > server->counters.commandNsMax )
+        server->counters.commandNsMax = elapsedNs;
+    return;
+}
+
+
+/* Makes the player calls that wait for the device, one job at a time */
+static THREAD_ROUTINE_SIGNATURE workerThread( void *threadArg )
+{
+    JControlServer  *server = (JControlServer*)threadArg;
+    char            wake = 0;
+
+    while( !server->bWorkerQuit )
+    {
+        JPlatformEventWait( &server->workerEvent, 1000 );
+        if( !JATOMIC_LOAD_ACQUIRE( &server->bJobQueued ) )
+            continue;
+        JATOMIC_STORE_RELAXED( &server->bJobQueued, FALSE );
+
+        switch( server->job )
+        {
+            case JCONTROL_JOB_LOAD:
+                server->jobResult = JControlServerLoad( server, server->jobPath );
+                break;
+            case JCONTROL_JOB_STOP:
+                JAudioPlayerStop( server->player );
+                server->jobResult = 0;
+                break;
+            case JCONTROL_JOB_NONE:
+                break;
+        }
+        JATOMIC_STORE_RELEASE( &server->bJobDone, TRUE );
+        if( write( server->wakeFds[1], &wake, 1 ) < 0 )
+            continue;   /* The pipe is full, so poll will wake anyway */
+    }
+    return 0;
+}
+
+
+/* Sends what the socket takes now and queues the rest until poll reports it writable.
+ * Returns non-zero when the client should be closed. */
+static int sendReply( JControlClient *client, const char *reply, size_t length )
+{
+    ssize_t sent;
+    char    *pending;
+
+    while( client->pendingLength == 0 && length > 0 )
+    {
+        sent = send( client->fd, reply, length, MSG_NOSIGNAL );
+        if( sent < 0 && errno == EINTR )
+            continue;
+        if( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            break;
+        if( sent <= 0 )
+            return -1;
+        reply += sent;
+        length -= (size_t)sent;
+    }
+    if( length == 0 )
+        return 0;
+
+    pending = (char*)realloc( client->pending, client->pendingLength + length );
+    if( pending == NULL )
+        return -1;
+    memcpy( pending + client->pendingLength, reply, length );
+    client->pending = pending;
+    client->pendingLength += length;
+    return 0;
+}
+
+
+/* Sends as much of the queued replies as the socket takes.  Returns non-zero when the
+ * client should be closed. */
+static int flushClient( JControlClient *client )
+{
+    ssize_t sent;
+
+    while( client->pendingLength > 0 )
+    {
+        sent = send( client->fd, client->pending, client->pendingLength, MSG_NOSIGNAL );
+        if( sent < 0 && errno == EINTR )
+            continue;
+        if( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            return 0;
+        if( sent <= 0 )
+            return -1;
+        client->pendingLength -= (size_t)sent;
+        memmove( client->pending, client->pending + sent, client->pendingLength );
+    }
+    return 0;
+}
+
+
+/* Sends the player statistics and the server's own, as printed on the console */
+static int sendStats( JControlServer *server, JControlClient *client )
+{
+    JAudioPlayerStats   stats;
+    JControlCounters    *counters = &server->counters;
+    char                *text = NULL;
+    size_t              length = 0;
+    FILE                *stream;
+    int                 result;
+
+    stream = open_memstream( &text, &length );
+    if( stream == NULL )
+        return -1;
+    JAudioPlayerGetStats( server->player, &stats );
+    JAudioPlayerPrintStats( &stats, stream );
+    fprintf( stream, "  Control: %lu clients, %lu commands, %lu errors, %.1f us avg, %.1f us max\n",
+             counters->clientsAccepted, counters->commands, counters->errors,
+             counters->commands > 0 ? counters->commandNsTotal / 1e3 / counters->commands : 0.0,
+             counters->commandNsMax / 1e3 );
+    if( fclose( stream ) != 0 )
+    {
+        free( text );
+        return -1;
+    }
+    result = sendReply( client, text, length );
+    free( text );
+    return result;
+}
+
+
+/* Stops the player once the end of the last track has been heard, as the player
+ * window does */
+static void stopAtEnd( JControlServer *server )
+{
+    JAudioPlayer    *player = server->player;
+    JPlayPosition   position;
+
+    if( server->job != JCONTROL_JOB_NONE || player == NULL || player->state == JPLAYER_STOPPED )
+        return;
+    JAudioPlayerGetPosition( player, &position );
+    if( position.bEnded && JAudioPlayerGetQueueLength( player ) == 0 )
+        startJob( server, JCONTROL_JOB_STOP, NULL, 0 );
+    return;
+}
+
+
+static const char* stateName( JPlayerState state )
+{
+    switch( state )
+    {
+        case JPLAYER_STOPPED:
+            return "stopped";
+        case JPLAYER_PAUSED:
+            return "paused";
+        case JPLAYER_PLAYING:
+            return "playing";
+    }
+    return "unknown";
+}
+
+
+static int setNonBlocking( int fd )
+{
+    int flags = fcntl( fd, F_GETFL, 0 );
+
+    if( flags < 0 || fcntl( fd, F_SETFL, flags | O_NONBLOCK ) < 0 )
+        return -1;
+    return 0;
+}
+
+#else
+
+/* Windows has no Unix domain sockets before Windows 10, so the server is not built */
+
+JControlServer* JControlServerCreate( const char *socketPath, const JAudioPlayerConfig *config )
+{
+    printf( "  Error: The control server is not supported on Windows\n" );
+    return NULL;
+}
+
+
+int JControlServerLoad( JControlServer *server, const char *filePath )
+{
+    return -1;
+}
+
+
+void JControlServerRun( JControlServer *server )
+{
+    return;
+}
+
+
+void JControlServerStop( JControlServer *server )
+{
+    return;
+}
+
+
+void JControlServerDestroy( JControlServer **serverPtr )
+{
+    return;
+}
+
+#endif
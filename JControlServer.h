@@ -0,0 +1,134 @@
+/* JControlServer.h Header file for the control server of the headless player
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JCONTROLSERVER_H_INCLUDED
+#define JCONTROLSERVER_H_INCLUDED
+
+#include <stdio.h>
+
+#include "JAudioPlayer.h"
+
+#define JCONTROL_MAX_CLIENTS 16
+#define JCONTROL_LINE_BYTES 4096        /* Longest command, including the newline */
+#define JCONTROL_POLL_MS 100            /* Longest sleep while a track plays, to notice
+                                         * the end of the last one */
+
+/** A connection to the server, the command it is part way through sending and the
+  * replies its socket has not taken yet */
+typedef struct
+{
+    int         fd;
+    unsigned long id;                   /* Tells clients apart once fd is reused */
+    char        line[JCONTROL_LINE_BYTES];
+    size_t      length;                 /* Bytes of line received so far */
+    char        *pending;               /* Sent when poll reports the socket writable.  No */
+    size_t      pendingLength;          /* more commands are read until it has been. */
+}
+JControlClient;
+
+/** Player calls that wait for the device, made on the worker thread */
+typedef enum
+{
+    JCONTROL_JOB_NONE,
+    JCONTROL_JOB_LOAD,
+    JCONTROL_JOB_STOP
+}
+JControlJob;
+
+/** Counters of the commands handled, only written by the thread running the server */
+typedef struct
+{
+    unsigned long       clientsAccepted;
+    unsigned long       commands;
+    unsigned long       errors;         /* Commands answered with ERR */
+    unsigned long long  commandNsTotal; /* From the command being read to its reply */
+    unsigned long long  commandNsMax;   /* being sent */
+}
+JControlCounters;
+
+/** Drives a JAudioPlayer from commands sent over a Unix domain socket, for players
+  * without a display.  Each command is one line of text, answered with a line starting
+  * with OK or ERR.  The server runs a poll loop on the calling thread that never
+  * blocks: loading a file and stopping, which wait for the device, are handed to a
+  * worker thread, and commands arriving meanwhile are held until it has finished.
+  * A reply a client is slow to take is queued until its socket is writable, and the
+  * client's next command waits for it.
+  * @see JControlServerRun
+  */
+typedef struct
+{
+    char            *socketPath;
+    int             listenFd;
+    int             wakeFds[2];         /* Self-pipe written by JControlServerStop */
+    JControlClient  clients[JCONTROL_MAX_CLIENTS];
+    unsigned        clientCount;
+
+    JAudioPlayerConfig config;          /* Used to create the player on each load */
+    JAudioPlayer    *player;            /* NULL until a file is loaded */
+    volatile int    bQuit;
+
+    /* The poll loop leaves the player alone while job is set.  It hands a job over with
+     * bJobQueued and the worker hands it back with bJobDone and the self-pipe. */
+    JThread         workerThread;
+    JEvent          workerEvent;
+    int             bWorkerRunning;
+    volatile int    bWorkerQuit;
+    JControlJob     job;                /* Only written by the poll loop */
+    char            *jobPath;           /* File of a load */
+    unsigned long   jobClientId;        /* Client waiting for the reply, 0 for none */
+    unsigned long long jobStartNs;
+    int             jobResult;
+    int             bJobQueued;
+    int             bJobDone;
+
+    JControlCounters counters;
+}
+JControlServer;
+
+/** @brief Creates the socket and starts listening on it.  Nothing is played until a
+  * file is loaded.  JControlServerDestroy must be called to free resources allocated
+  * by JControlServerCreate.
+  * @param socketPath Path of the socket, an existing socket there is replaced
+  * @param config Settings for the player, or NULL to use the defaults
+  * @return Pointer to a JControlServer, returns NULL on failure
+  */
+JControlServer* JControlServerCreate( const char *socketPath, const JAudioPlayerConfig *config );
+
+/** @brief Replaces the player with one playing filePath, stopped at its start.  The
+  * same as the load command, but made on the calling thread, so only to be called
+  * before JControlServerRun.
+  * @return 0 on success, non-zero on failure
+  */
+int JControlServerLoad( JControlServer *server, const char *filePath );
+
+/** @brief Handles connections and commands until the quit command is received or
+  * JControlServerStop is called
+  */
+void JControlServerRun( JControlServer *server );
+
+/** @brief Makes JControlServerRun return.  Safe to call from a signal handler. */
+void JControlServerStop( JControlServer *server );
+
+/** @brief Closes every connection, removes the socket and destroys the player
+  * @param serverPtr Pointer to a pointer to a JControlServer, set to NULL after freeing
+  */
+void JControlServerDestroy( JControlServer **serverPtr );
+
+#endif // JCONTROLSERVER_H_INCLUDED
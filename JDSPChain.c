@@ -0,0 +1,815 @@
+/* JDSPChain.c Contains the effects applied to the stream by the producer
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "JDSPChain.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JDSP_X86
+#include <immintrin.h>
+#define TARGET_SSE __attribute__(( target( "sse" ) ))
+#endif
+
+#define JDSP_LANES 4            /* Channels filtered per vector */
+#define JDSP_SILENCE 1e-9f      /* Peaks below this are treated as silence */
+
+/** Runs frames through one biquad section, each channel with its own state */
+typedef void (*JBiquadKernel)( float *samples, unsigned long frames, int channels,
+                               const float *coefficients, float *z1, float *z2 );
+
+static void biquadScalar( float *samples, unsigned long frames, int channels,
+                          const float *coefficients, float *z1, float *z2 );
+
+static JBiquadKernel biquadKernel = biquadScalar;
+static const char *biquadKernelName = "scalar";
+
+#ifdef JDSP_X86
+static void biquadSSE( float *samples, unsigned long frames, int channels,
+                       const float *coefficients, float *z1, float *z2 );
+static unsigned enterFlushToZero( void );
+static void leaveFlushToZero( unsigned csr );
+#endif
+
+static void selectKernel( void );
+static int allocateStage( JDSPStage *stage, const JDSPChain *chain );
+static void freeStage( JDSPStage *stage );
+static void applyParams( JDSPStage *stage, const JDSPChain *chain );
+static void setupStage( JDSPStage *stage, const JDSPChain *chain );
+static void resetStage( JDSPStage *stage, const JDSPChain *chain );
+static void setBiquadCoefficients( JDSPStage *stage, double sampleRate );
+static void processGain( JDSPStage *stage, float *samples, unsigned long frames, int channels );
+static void processCompressor( JDSPStage *stage, float *samples, unsigned long frames, int channels );
+static void processLimiter( JDSPStage *stage, float *samples, unsigned long frames, int channels );
+static float framePeak( const float *frame, int channels );
+static float smoothingCoefficient( float ms, double sampleRate );
+static float dbToGain( float db );
+
+
+JDSPChain* JDSPChainCreate( int channels, double sampleRate )
+{
+    JDSPChain *chain = NULL;
+
+    if( channels <= 0 || sampleRate <= 0 )
+    {
+        printf( "  Error: Invalid effects chain format\n" );
+        return NULL;
+    }
+
+    chain = (JDSPChain*)calloc( 1, sizeof(JDSPChain) );
+    if( chain == NULL )
+        return NULL;
+    selectKernel();
+
+    chain->channels = channels;
+    chain->sampleRate = sampleRate;
+    chain->paddedChannels = ( channels + JDSP_LANES - 1 ) / JDSP_LANES * JDSP_LANES;
+    return chain;
+}
+
+
+void JDSPChainGetDefaultParams( JDSPStageType type, JDSPParams *params )
+{
+    memset( params, 0, sizeof(JDSPParams) );
+    params->bBypass = FALSE;
+    params->gainDb = 0.0f;
+    params->filterType = JBIQUAD_PEAK;
+    params->frequency = 1000.0f;
+    params->q = 0.707f;
+    params->thresholdDb = ( type == JDSP_LIMITER ) ? -1.0f : -18.0f;
+    params->ratio = 4.0f;
+    params->kneeDb = 6.0f;
+    params->attackMs = 10.0f;
+    params->releaseMs = ( type == JDSP_LIMITER ) ? 50.0f : 100.0f;
+    params->lookAheadMs = 5.0f;
+    return;
+}
+
+
+int JDSPChainAddStage( JDSPChain *chain, JDSPStageType type, const JDSPParams *params )
+{
+    JDSPStage *stage;
+    const unsigned index = chain->stageCount;
+
+    if( index >= JDSP_MAX_STAGES )
+    {
+        printf( "  Error: Effects chain is full\n" );
+        return -1;
+    }
+
+    stage = (JDSPStage*)calloc( 1, sizeof(JDSPStage) );
+    if( stage == NULL )
+        return -1;
+    stage->type = type;
+    if( params != NULL )
+        stage->params = *params;
+    else
+        JDSPChainGetDefaultParams( type, &stage->params );
+    if( allocateStage( stage, chain ) )
+    {
+        printf( "  Error using malloc\n" );
+        freeStage( stage );
+        return -1;
+    }
+
+    /* The producer does not see the stage before the count is published, so it is
+     * set up here as the producer would */
+    stage->applied = stage->params;
+    setupStage( stage, chain );
+    resetStage( stage, chain );
+
+    chain->stages[index] = stage;
+    JATOMIC_STORE_RELEASE( &chain->stageCount, index + 1 );
+    return (int)index;
+}
+
+
+int JDSPChainSetParams( JDSPChain *chain, unsigned stage, const JDSPParams *params )
+{
+    JDSPStage *target;
+    unsigned sequence;
+
+    if( stage >= JATOMIC_LOAD_ACQUIRE( &chain->stageCount ) )
+        return -1;
+    target = chain->stages[stage];
+
+    /* Take the write side of the sequence lock, as JAudioPlayerSeekAsync does */
+    do
+    {
+        sequence = JATOMIC_LOAD_RELAXED( &target->sequence ) & ~1u;
+    }
+    while( !__atomic_compare_exchange_n( &target->sequence, &sequence, sequence + 1,
+                                         /* weak = */ TRUE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) );
+    target->params = *params;
+    JATOMIC_STORE_RELEASE( &target->sequence, sequence + 2 );
+    return 0;
+}
+
+
+int JDSPChainGetParams( JDSPChain *chain, unsigned stage, JDSPParams *params )
+{
+    JDSPStage *target;
+    unsigned sequence;
+
+    if( stage >= JATOMIC_LOAD_ACQUIRE( &chain->stageCount ) )
+        return -1;
+    target = chain->stages[stage];
+
+    do
+    {
+        while( ( sequence = JATOMIC_LOAD_ACQUIRE( &target->sequence ) ) & 1u )
+            JPlatformYield();
+        *params = target->params;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    }
+    while( JATOMIC_LOAD_RELAXED( &target->sequence ) != sequence );
+    return 0;
+}
+
+
+unsigned JDSPChainGetStageCount( JDSPChain *chain )
+{
+    return JATOMIC_LOAD_ACQUIRE( &chain->stageCount );
+}
+
+
+unsigned JDSPChainGetLatency( JDSPChain *chain )
+{
+    const unsigned  count = JATOMIC_LOAD_ACQUIRE( &chain->stageCount );
+    unsigned        i, latency = 0;
+
+    for( i=0; i<count; i++ )
+    {
+        if( chain->stages[i]->type == JDSP_LIMITER && !chain->stages[i]->applied.bBypass )
+            latency += chain->stages[i]->lookAhead;
+    }
+    return latency;
+}
+
+
+void JDSPChainProcess( JDSPChain *chain, float *samples, unsigned long frames )
+{
+    const unsigned  count = JATOMIC_LOAD_ACQUIRE( &chain->stageCount );
+    JDSPStage       *stage;
+    unsigned long long startNs, ns;
+    unsigned        i;
+#ifdef JDSP_X86
+    unsigned        csr = 0;
+#endif
+
+    if( count == 0 || frames == 0 )
+        return;
+
+#ifdef JDSP_X86
+    /* Filter and envelope state decaying into denormals would cost far more than the
+     * audio they carry */
+    if( biquadKernel != biquadScalar )
+        csr = enterFlushToZero();
+#endif
+
+    for( i=0; i<count; i++ )
+    {
+        stage = chain->stages[i];
+        applyParams( stage, chain );
+        if( stage->applied.bBypass )
+            continue;
+        if( stage->bReset )
+            resetStage( stage, chain );
+
+        startNs = JPlatformGetTimeNs();
+        switch( stage->type )
+        {
+            case JDSP_GAIN:
+                processGain( stage, samples, frames, chain->channels );
+                break;
+            case JDSP_BIQUAD:
+                biquadKernel( samples, frames, chain->channels, stage->coefficients, stage->z1, stage->z2 );
+                break;
+            case JDSP_COMPRESSOR:
+                processCompressor( stage, samples, frames, chain->channels );
+                break;
+            case JDSP_LIMITER:
+                processLimiter( stage, samples, frames, chain->channels );
+                break;
+        }
+        ns = JPlatformGetTimeNs() - startNs;
+
+        JATOMIC_ADD_SINGLE_WRITER( &stage->blocks, 1 );
+        JATOMIC_ADD_SINGLE_WRITER( &stage->frames, frames );
+        JATOMIC_ADD_SINGLE_WRITER( &stage->nsTotal, ns );
+        if( ns > JATOMIC_LOAD_RELAXED( &stage->nsMax ) )
+            JATOMIC_STORE_RELAXED( &stage->nsMax, ns );
+    }
+
+#ifdef JDSP_X86
+    if( biquadKernel != biquadScalar )
+        leaveFlushToZero( csr );
+#endif
+    return;
+}
+
+
+void JDSPChainReset( JDSPChain *chain )
+{
+    const unsigned count = JATOMIC_LOAD_ACQUIRE( &chain->stageCount );
+    unsigned i;
+
+    for( i=0; i<count; i++ )
+        chain->stages[i]->bReset = TRUE;
+    return;
+}
+
+
+unsigned JDSPChainGetStats( JDSPChain *chain, JDSPStageStats *stats )
+{
+    const unsigned count = JATOMIC_LOAD_ACQUIRE( &chain->stageCount );
+    const JDSPStage *stage;
+    unsigned long long frames, nsTotal;
+    unsigned i;
+
+    for( i=0; i<count; i++ )
+    {
+        stage = chain->stages[i];
+        frames = JATOMIC_LOAD_RELAXED( &stage->frames );
+        nsTotal = JATOMIC_LOAD_RELAXED( &stage->nsTotal );
+
+        stats[i].type = stage->type;
+        stats[i].bBypass = JATOMIC_LOAD_RELAXED( &stage->params.bBypass );
+        stats[i].blocks = JATOMIC_LOAD_RELAXED( &stage->blocks );
+        stats[i].usAverage = stats[i].blocks ? nsTotal / 1e3 / stats[i].blocks : 0.0;
+        stats[i].usMax = JATOMIC_LOAD_RELAXED( &stage->nsMax ) / 1e3;
+        stats[i].corePercent = frames ? 100.0 * nsTotal / ( 1e9 * frames / chain->sampleRate ) : 0.0;
+    }
+    return count;
+}
+
+
+const char* JDSPStageTypeName( JDSPStageType type )
+{
+    switch( type )
+    {
+        case JDSP_GAIN:         return "gain";
+        case JDSP_BIQUAD:       return "biquad";
+        case JDSP_COMPRESSOR:   return "compressor";
+        default:                return "limiter";
+    }
+}
+
+
+const char* JDSPChainGetKernelName( void )
+{
+    selectKernel();
+    return biquadKernelName;
+}
+
+
+void JDSPChainDestroy( JDSPChain **chainPtr )
+{
+    JDSPChain *chain = *chainPtr;
+    unsigned i;
+
+    if( chain == NULL )
+        return;
+
+    for( i=0; i<chain->stageCount; i++ )
+        freeStage( chain->stages[i] );
+    free( chain );
+    *chainPtr = NULL;
+
+    return;
+}
+
+
+static void selectKernel( void )
+{
+#ifdef JDSP_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "sse" ) )
+    {
+        biquadKernelName = "sse";
+        JATOMIC_STORE_RELEASE( &biquadKernel, biquadSSE );
+    }
+#endif
+    return;
+}
+
+
+/* Allocates the state of stages that keep some per channel.  A limiter gets room for
+ * the longest look-ahead, so changing it never allocates on the producer. */
+static int allocateStage( JDSPStage *stage, const JDSPChain *chain )
+{
+    const size_t lanes = (size_t)chain->paddedChannels;
+
+    if( stage->type == JDSP_BIQUAD )
+    {
+        stage->z1 = (float*)calloc( lanes, sizeof(float) );
+        stage->z2 = (float*)calloc( lanes, sizeof(float) );
+        return stage->z1 == NULL || stage->z2 == NULL;
+    }
+    if( stage->type == JDSP_LIMITER )
+    {
+        stage->maxLookAhead = (unsigned)ceil( JDSP_MAX_LOOKAHEAD_MS * chain->sampleRate / 1000.0 );
+        stage->delay = (float*)calloc( (size_t)stage->maxLookAhead * chain->channels, sizeof(float) );
+        stage->minValues = (float*)malloc( sizeof(float) * ( stage->maxLookAhead + 1 ) );
+        stage->minFrames = (unsigned long*)malloc( sizeof(unsigned long) * ( stage->maxLookAhead + 1 ) );
+        stage->boxValues = (float*)malloc( sizeof(float) * stage->maxLookAhead );
+        return stage->delay == NULL || stage->minValues == NULL || stage->minFrames == NULL ||
+               stage->boxValues == NULL;
+    }
+    return 0;
+}
+
+
+static void freeStage( JDSPStage *stage )
+{
+    free( stage->z1 );
+    free( stage->z2 );
+    free( stage->delay );
+    free( stage->minValues );
+    free( stage->minFrames );
+    free( stage->boxValues );
+    free( stage );
+    return;
+}
+
+
+/* Takes settings published since the last block.  A write still in progress, or one
+ * that overlapped the copy, is left for the next block rather than waited for. */
+static void applyParams( JDSPStage *stage, const JDSPChain *chain )
+{
+    const unsigned sequence = JATOMIC_LOAD_ACQUIRE( &stage->sequence );
+    const JDSPParams previous = stage->applied;
+    JDSPParams params;
+
+    if( sequence == stage->appliedSequence || ( sequence & 1u ) )
+        return;
+    params = stage->params;
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if( JATOMIC_LOAD_RELAXED( &stage->sequence ) != sequence )
+        return;
+
+    stage->applied = params;
+    stage->appliedSequence = sequence;
+    setupStage( stage, chain );
+    if( previous.bBypass && !params.bBypass )
+        stage->bReset = TRUE;
+    if( stage->type == JDSP_LIMITER && stage->applied.lookAheadMs != previous.lookAheadMs )
+        stage->bReset = TRUE;
+    return;
+}
+
+
+/* Works out the coefficients of a stage from its applied settings */
+static void setupStage( JDSPStage *stage, const JDSPChain *chain )
+{
+    const JDSPParams *params = &stage->applied;
+    float knee;
+
+    switch( stage->type )
+    {
+        case JDSP_GAIN:
+            stage->targetGain = dbToGain( params->gainDb );
+            break;
+
+        case JDSP_BIQUAD:
+            setBiquadCoefficients( stage, chain->sampleRate );
+            break;
+
+        case JDSP_COMPRESSOR:
+            knee = params->kneeDb > 0 ? params->kneeDb : 0.0f;
+            stage->thresholdDb = params->thresholdDb;
+            stage->kneeStart = dbToGain( params->thresholdDb - knee / 2 );
+            stage->slope = 1.0f / ( params->ratio >= 1.0f ? params->ratio : 1.0f ) - 1.0f;
+            stage->makeup = dbToGain( params->gainDb );
+            stage->attackCoefficient = smoothingCoefficient( params->attackMs, chain->sampleRate );
+            stage->releaseCoefficient = smoothingCoefficient( params->releaseMs, chain->sampleRate );
+            break;
+
+        case JDSP_LIMITER:
+            stage->ceiling = dbToGain( params->thresholdDb < 0 ? params->thresholdDb : 0.0f );
+            stage->lookAhead = params->lookAheadMs > 0 ? (unsigned)( params->lookAheadMs * chain->sampleRate / 1000.0 + 0.5 ) : 0;
+            if( stage->lookAhead > stage->maxLookAhead )
+                stage->lookAhead = stage->maxLookAhead;
+            stage->releaseCoefficient = smoothingCoefficient( params->releaseMs, chain->sampleRate );
+            break;
+    }
+    return;
+}
+
+
+static void resetStage( JDSPStage *stage, const JDSPChain *chain )
+{
+    unsigned i;
+
+    stage->bReset = FALSE;
+    stage->gain = stage->targetGain;
+    stage->reductionDb = 0.0f;
+    if( stage->z1 != NULL )
+    {
+        memset( stage->z1, 0, sizeof(float) * chain->paddedChannels );
+        memset( stage->z2, 0, sizeof(float) * chain->paddedChannels );
+    }
+    if( stage->delay != NULL )
+    {
+        memset( stage->delay, 0, sizeof(float) * stage->maxLookAhead * chain->channels );
+        for( i=0; i<stage->lookAhead; i++ )
+            stage->boxValues[i] = 1.0f;
+        stage->boxSum = stage->lookAhead;
+        stage->boxPosition = 0;
+        stage->delayPosition = 0;
+        stage->minHead = 0;
+        stage->minCount = 0;
+        stage->frameIndex = 0;
+        stage->limiterGain = 1.0f;
+    }
+    return;
+}
+
+
+/* Coefficients from Robert Bristow-Johnson's Audio EQ Cookbook */
+static void setBiquadCoefficients( JDSPStage *stage, double sampleRate )
+{
+    const JDSPParams *params = &stage->applied;
+    double frequency = params->frequency, q = params->q > 0.1f ? params->q : 0.1;
+    double a, w0, cosW0, alpha, root, b0, b1, b2, a0, a1, a2;
+
+    if( frequency < 1.0 )
+        frequency = 1.0;
+    if( frequency > 0.49 * sampleRate )
+        frequency = 0.49 * sampleRate;
+    a = pow( 10.0, params->gainDb / 40.0 );
+    w0 = 2.0 * M_PI * frequency / sampleRate;
+    cosW0 = cos( w0 );
+    alpha = sin( w0 ) / ( 2.0 * q );
+    root = 2.0 * sqrt( a ) * alpha;
+
+    switch( params->filterType )
+    {
+        case JBIQUAD_LOW_SHELF:
+            b0 = a * ( ( a + 1 ) - ( a - 1 ) * cosW0 + root );
+            b1 = 2 * a * ( ( a - 1 ) - ( a + 1 ) * cosW0 );
+            b2 = a * ( ( a + 1 ) - ( a - 1 ) * cosW0 - root );
+            a0 = ( a + 1 ) + ( a - 1 ) * cosW0 + root;
+            a1 = -2 * ( ( a - 1 ) + ( a + 1 ) * cosW0 );
+            a2 = ( a + 1 ) + ( a - 1 ) * cosW0 - root;
+            break;
+        case JBIQUAD_HIGH_SHELF:
+            b0 = a * ( ( a + 1 ) + ( a - 1 ) * cosW0 + root );
+            b1 = -2 * a * ( ( a - 1 ) + ( a + 1 ) * cosW0 );
+            b2 = a * ( ( a + 1 ) + ( a - 1 ) * cosW0 - root );
+            a0 = ( a + 1 ) - ( a - 1 ) * cosW0 + root;
+            a1 = 2 * ( ( a - 1 ) - ( a + 1 ) * cosW0 );
+            a2 = ( a + 1 ) - ( a - 1 ) * cosW0 - root;
+            break;
+        case JBIQUAD_LOW_PASS:
+            b0 = b2 = ( 1 - cosW0 ) / 2;
+            b1 = 1 - cosW0;
+            a0 = 1 + alpha;
+            a1 = -2 * cosW0;
+            a2 = 1 - alpha;
+            break;
+        case JBIQUAD_HIGH_PASS:
+            b0 = b2 = ( 1 + cosW0 ) / 2;
+            b1 = -( 1 + cosW0 );
+            a0 = 1 + alpha;
+            a1 = -2 * cosW0;
+            a2 = 1 - alpha;
+            break;
+        default:    /* JBIQUAD_PEAK */
+            b0 = 1 + alpha * a;
+            b1 = -2 * cosW0;
+            b2 = 1 - alpha * a;
+            a0 = 1 + alpha / a;
+            a1 = -2 * cosW0;
+            a2 = 1 - alpha / a;
+            break;
+    }
+
+    stage->coefficients[0] = (float)( b0 / a0 );
+    stage->coefficients[1] = (float)( b1 / a0 );
+    stage->coefficients[2] = (float)( b2 / a0 );
+    stage->coefficients[3] = (float)( a1 / a0 );
+    stage->coefficients[4] = (float)( a2 / a0 );
+    return;
+}
+
+
+/* A change of gain is ramped over the block so it does not click */
+static void processGain( JDSPStage *stage, float *samples, unsigned long frames, int channels )
+{
+    const size_t samplesInBlock = (size_t)frames * channels;
+    float       gain = stage->gain, step;
+    unsigned long i;
+    size_t      j;
+    int         c;
+
+    if( gain == stage->targetGain )
+    {
+        if( gain == 1.0f )
+            return;
+        for( j=0; j<samplesInBlock; j++ )
+            samples[j] *= gain;
+        return;
+    }
+
+    step = ( stage->targetGain - gain ) / frames;
+    for( i=0; i<frames; i++ )
+    {
+        gain += step;
+        for( c=0; c<channels; c++ )
+            samples[c] *= gain;
+        samples += channels;
+    }
+    stage->gain = stage->targetGain;
+    return;
+}
+
+
+/* Gain reduction is worked out in dB from the loudest channel of each frame and
+ * applied to every channel, so the stereo image does not move */
+static void processCompressor( JDSPStage *stage, float *samples, unsigned long frames, int channels )
+{
+    const float knee = stage->applied.kneeDb > 0 ? stage->applied.kneeDb : 0.0f;
+    float       reduction = stage->reductionDb, target, overDb, gain, coefficient;
+    unsigned long i;
+    int         c;
+
+    for( i=0; i<frames; i++ )
+    {
+        const float peak = framePeak( samples, channels );
+
+        target = 0.0f;
+        if( peak > stage->kneeStart && peak > JDSP_SILENCE )
+        {
+            overDb = 20.0f * log10f( peak ) - stage->thresholdDb;
+            if( knee > 0 && 2.0f * fabsf( overDb ) <= knee )
+                target = -stage->slope * ( overDb + knee / 2 ) * ( overDb + knee / 2 ) / ( 2.0f * knee );
+            else if( overDb > 0 )
+                target = -stage->slope * overDb;
+        }
+
+        coefficient = ( target > reduction ) ? stage->attackCoefficient : stage->releaseCoefficient;
+        reduction = target + coefficient * ( reduction - target );
+
+        gain = ( reduction > 1e-6f ) ? stage->makeup * dbToGain( -reduction ) : stage->makeup;
+        for( c=0; c<channels; c++ )
+            samples[c] *= gain;
+        samples += channels;
+    }
+    stage->reductionDb = reduction;
+    return;
+}
+
+
+/* The gain for each frame is the lowest any frame still in the delay needs to stay
+ * under the ceiling, averaged over the look-ahead.  Every minimum averaged covers the
+ * frame leaving the delay, so the ramp reaches the gain a peak needs by the time the
+ * peak comes out.  Recovery after it is smoothed by the release. */
+static void processLimiter( JDSPStage *stage, float *samples, unsigned long frames, int channels )
+{
+    const unsigned  lookAhead = stage->lookAhead, capacity = stage->maxLookAhead + 1;
+    const float     ceiling = stage->ceiling, release = stage->releaseCoefficient;
+    float           gain = stage->limiterGain, needed, target, sample, *delayed;
+    unsigned        back;
+    unsigned long   i;
+    int             c;
+
+    for( i=0; i<frames; i++ )
+    {
+        const float peak = framePeak( samples, channels );
+
+        needed = ( peak > ceiling ) ? ceiling / peak : 1.0f;
+        if( lookAhead == 0 )
+            target = needed;
+        else
+        {
+            /* Sliding minimum over the frames in the delay and this one */
+            while( stage->minCount > 0 )
+            {
+                back = ( stage->minHead + stage->minCount - 1 ) % capacity;
+                if( stage->minValues[back] < needed )
+                    break;
+                stage->minCount--;
+            }
+            back = ( stage->minHead + stage->minCount ) % capacity;
+            stage->minValues[back] = needed;
+            stage->minFrames[back] = stage->frameIndex;
+            stage->minCount++;
+            while( stage->minFrames[stage->minHead] + lookAhead < stage->frameIndex )
+            {
+                stage->minHead = ( stage->minHead + 1 ) % capacity;
+                stage->minCount--;
+            }
+
+            stage->boxSum += stage->minValues[stage->minHead] - stage->boxValues[stage->boxPosition];
+            stage->boxValues[stage->boxPosition] = stage->minValues[stage->minHead];
+            if( ++stage->boxPosition == lookAhead )
+                stage->boxPosition = 0;
+            target = (float)( stage->boxSum / lookAhead );
+            stage->frameIndex++;
+        }
+
+        gain = ( target < gain ) ? target : target + release * ( gain - target );
+
+        delayed = ( lookAhead > 0 ) ? stage->delay + (size_t)stage->delayPosition * channels : NULL;
+        for( c=0; c<channels; c++ )
+        {
+            if( delayed != NULL )
+            {
+                sample = delayed[c];
+                delayed[c] = samples[c];
+            }
+            else
+                sample = samples[c];
+
+            /* Rounding in the running average may leave a peak a hair over */
+            sample *= gain;
+            samples[c] = sample > ceiling ? ceiling : ( sample < -ceiling ? -ceiling : sample );
+        }
+        if( lookAhead > 0 && ++stage->delayPosition == lookAhead )
+            stage->delayPosition = 0;
+        samples += channels;
+    }
+    stage->limiterGain = gain;
+    return;
+}
+
+
+static float framePeak( const float *frame, int channels )
+{
+    float peak = 0.0f;
+    int c;
+
+    for( c=0; c<channels; c++ )
+    {
+        if( fabsf( frame[c] ) > peak )
+            peak = fabsf( frame[c] );
+    }
+    return peak;
+}
+
+
+/* Coefficient of a one pole smoother reaching 1 - 1/e of a step in ms */
+static float smoothingCoefficient( float ms, double sampleRate )
+{
+    if( ms <= 0 )
+        return 0.0f;
+    return (float)exp( -1000.0 / ( ms * sampleRate ) );
+}
+
+
+static float dbToGain( float db )
+{
+    return expf( db * 0.11512925f );    /* ln( 10 ) / 20 */
+}
+
+
+static void biquadScalar( float *samples, unsigned long frames, int channels,
+                          const float *coefficients, float *z1, float *z2 )
+{
+    const float b0 = coefficients[0], b1 = coefficients[1], b2 = coefficients[2];
+    const float a1 = coefficients[3], a2 = coefficients[4];
+    unsigned long i;
+    float       x, y;
+    int         c;
+
+    for( i=0; i<frames; i++ )
+    {
+        for( c=0; c<channels; c++ )
+        {
+            x = samples[c];
+            y = b0 * x + z1[c];
+            z1[c] = b1 * x - a1 * y + z2[c];
+            z2[c] = b2 * x - a2 * y;
+            samples[c] = y;
+        }
+        samples += channels;
+    }
+    return;
+}
+
+
+#ifdef JDSP_X86
+
+/* Filters JDSP_LANES channels of a frame per vector.  The channels left over after
+ * the whole vectors are copied through a padded frame, whose spare lanes stay
+ * silent. */
+TARGET_SSE static void biquadSSE( float *samples, unsigned long frames, int channels,
+                                  const float *coefficients, float *z1, float *z2 )
+{
+    const __m128 b0 = _mm_set1_ps( coefficients[0] ), b1 = _mm_set1_ps( coefficients[1] );
+    const __m128 b2 = _mm_set1_ps( coefficients[2] ), a1 = _mm_set1_ps( coefficients[3] );
+    const __m128 a2 = _mm_set1_ps( coefficients[4] );
+    const int   whole = channels - channels % JDSP_LANES, left = channels - whole;
+    float       padded[JDSP_LANES] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    unsigned long i;
+    __m128      x, y;
+    int         c;
+
+    for( i=0; i<frames; i++ )
+    {
+        for( c=0; c<channels; c+=JDSP_LANES )
+        {
+            if( c < whole )
+                x = _mm_loadu_ps( samples + c );
+            else
+            {
+                memcpy( padded, samples + c, sizeof(float) * left );
+                x = _mm_loadu_ps( padded );
+            }
+
+            y = _mm_add_ps( _mm_mul_ps( b0, x ), _mm_loadu_ps( z1 + c ) );
+            _mm_storeu_ps( z1 + c, _mm_add_ps( _mm_sub_ps( _mm_mul_ps( b1, x ), _mm_mul_ps( a1, y ) ),
+                                               _mm_loadu_ps( z2 + c ) ) );
+            _mm_storeu_ps( z2 + c, _mm_sub_ps( _mm_mul_ps( b2, x ), _mm_mul_ps( a2, y ) ) );
+
+            if( c < whole )
+                _mm_storeu_ps( samples + c, y );
+            else
+            {
+                _mm_storeu_ps( padded, y );
+                memcpy( samples + c, padded, sizeof(float) * left );
+            }
+        }
+        samples += channels;
+    }
+    return;
+}
+
+
+TARGET_SSE static unsigned enterFlushToZero( void )
+{
+    const unsigned csr = _mm_getcsr();
+
+    _mm_setcsr( csr | _MM_FLUSH_ZERO_ON );
+    return csr;
+}
+
+
+TARGET_SSE static void leaveFlushToZero( unsigned csr )
+{
+    _mm_setcsr( csr );
+    return;
+}
+
+#endif  // JDSP_X86
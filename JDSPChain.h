@@ -0,0 +1,224 @@
+/* JDSPChain.h Header file for the effects applied to the stream by the producer
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JDSPCHAIN_H_INCLUDED
+#define JDSPCHAIN_H_INCLUDED
+
+#include "JPlatform.h"
+
+#define JDSP_MAX_STAGES 16
+#define JDSP_MAX_LOOKAHEAD_MS 20.0      /* Longest look-ahead of a limiter */
+
+/** Kinds of stage */
+typedef enum
+{
+    JDSP_GAIN,          /* Fixed gain, ramped over a block when it changes */
+    JDSP_BIQUAD,        /* One section of a parametric EQ.  Bands are cascaded by
+                         * adding a stage for each. */
+    JDSP_COMPRESSOR,    /* Feed-forward, soft knee, with the channels linked */
+    JDSP_LIMITER        /* Look-ahead peak limiter, delays the stream by its
+                         * look-ahead */
+}
+JDSPStageType;
+
+/** Responses of a biquad section, from the Audio EQ Cookbook */
+typedef enum
+{
+    JBIQUAD_PEAK,
+    JBIQUAD_LOW_SHELF,
+    JBIQUAD_HIGH_SHELF,
+    JBIQUAD_LOW_PASS,
+    JBIQUAD_HIGH_PASS
+}
+JBiquadType;
+
+/** Settings of one stage.  Each kind of stage only reads the fields marked for it.
+  * @see JDSPChainGetDefaultParams
+  */
+typedef struct
+{
+    int         bBypass;            /* All: pass the audio through untouched */
+    float       gainDb;             /* Gain: the gain.  Biquad: boost or cut of peaks
+                                     * and shelves.  Compressor: make-up gain. */
+    JBiquadType filterType;         /* Biquad */
+    float       frequency;          /* Biquad: centre or corner frequency in Hz */
+    float       q;                  /* Biquad: 0.707 for a Butterworth pass filter */
+    float       thresholdDb;        /* Compressor: where gain reduction starts.
+                                     * Limiter: the ceiling. */
+    float       ratio;              /* Compressor */
+    float       kneeDb;             /* Compressor: width of the soft knee */
+    float       attackMs;           /* Compressor */
+    float       releaseMs;          /* Compressor and limiter */
+    float       lookAheadMs;        /* Limiter, up to JDSP_MAX_LOOKAHEAD_MS */
+}
+JDSPParams;
+
+/** One stage of a chain.  Control threads publish new settings with a sequence lock
+  * on sequence, as seek requests are.  The producer picks them up at the start of a
+  * block, or at a later one if a write was in progress, and works out its own copy
+  * of the coefficients from them, so it never waits for a control thread.
+  */
+typedef struct
+{
+    JDSPStageType   type;
+    unsigned        sequence;           /* Odd while params is being written */
+    JDSPParams      params;
+
+    /* Only used by the producer */
+    unsigned        appliedSequence;
+    JDSPParams      applied;            /* Settings the state below was set up for */
+    int             bReset;             /* Clear the state before the next block */
+
+    float           gain;               /* Gain: linear gain reached by the ramp */
+    float           targetGain;
+
+    float           coefficients[5];    /* Biquad: b0 b1 b2 a1 a2, normalized by a0 */
+    float           *z1;                /* Biquad: transposed direct form II state,  */
+    float           *z2;                /* one per channel padded to a whole vector */
+
+    float           thresholdDb;        /* Compressor */
+    float           kneeStart;          /* Linear peak below which no gain is reduced */
+    float           slope;              /* 1 / ratio - 1 */
+    float           makeup;             /* Linear make-up gain */
+    float           attackCoefficient;  /* Also the limiter's release */
+    float           releaseCoefficient;
+    float           reductionDb;        /* Smoothed gain reduction */
+
+    float           ceiling;            /* Limiter: linear ceiling */
+    unsigned        lookAhead;          /* Frames of look-ahead */
+    unsigned        maxLookAhead;
+    float           *delay;             /* maxLookAhead frames in, lookAhead used */
+    unsigned        delayPosition;
+    float           *minValues;         /* Monotonic queue of the gains needed by the */
+    unsigned long   *minFrames;         /* frames still in the delay, maxLookAhead + 1 */
+    unsigned        minHead;
+    unsigned        minCount;
+    float           *boxValues;         /* Last lookAhead minimums, averaged to ramp */
+    double          boxSum;             /* the gain down before each peak arrives */
+    unsigned        boxPosition;
+    unsigned long   frameIndex;
+    float           limiterGain;
+
+    /* Timing, only written by the producer */
+    unsigned long       blocks;
+    unsigned long long  frames;
+    unsigned long long  nsTotal;
+    unsigned long long  nsMax;
+}
+JDSPStage;
+
+/** Timing of one stage
+  * @see JDSPChainGetStats
+  */
+typedef struct
+{
+    JDSPStageType   type;
+    int             bBypass;
+    unsigned long   blocks;             /* Blocks processed while not bypassed */
+    double          usAverage;          /* Time per block */
+    double          usMax;
+    double          corePercent;        /* Time spent as a share of the audio processed,
+                                         * i.e. of one core at real time */
+}
+JDSPStageStats;
+
+/** Effects applied in order to blocks of interleaved float frames.  Blocks are
+  * processed in place by a single thread, the producer of the player owning the
+  * chain, so the audio callback never pays for them.  Stages are added while the
+  * chain runs by one control thread at a time, and their settings can be changed by
+  * any thread without locks.
+  */
+typedef struct
+{
+    int             channels;
+    double          sampleRate;
+    int             paddedChannels;     /* channels rounded up to a whole vector */
+    JDSPStage       *stages[JDSP_MAX_STAGES];
+    unsigned        stageCount;         /* Published with a release store */
+}
+JDSPChain;
+
+/** @brief Creates an empty chain.  JDSPChainDestroy must be called to free resources
+  * allocated by JDSPChainCreate.
+  * @return Pointer to a JDSPChain, returns NULL on failure
+  */
+JDSPChain* JDSPChainCreate( int channels, double sampleRate );
+
+/** @brief Fills in the settings a stage starts with: unity gain, a flat peak at 1 kHz,
+  * 4:1 compression above -18 dB and a -1 dB ceiling with 5 ms of look-ahead
+  */
+void JDSPChainGetDefaultParams( JDSPStageType type, JDSPParams *params );
+
+/** @brief Appends a stage to the chain, taking effect from the next block
+  * @param params Settings of the stage, or NULL for the defaults
+  * @return Index of the stage, or -1 if the chain is full or on failure
+  */
+int JDSPChainAddStage( JDSPChain *chain, JDSPStageType type, const JDSPParams *params );
+
+/** @brief Changes the settings of a stage.  Safe to call from any thread; the
+  * producer picks them up at the start of a block.  Changing the look-ahead of a
+  * limiter or taking a stage out of bypass starts it from silence.
+  * @return 0 on success, non-zero if there is no such stage
+  */
+int JDSPChainSetParams( JDSPChain *chain, unsigned stage, const JDSPParams *params );
+
+/** @brief Reads back the settings of a stage, as last set
+  * @return 0 on success, non-zero if there is no such stage
+  */
+int JDSPChainGetParams( JDSPChain *chain, unsigned stage, JDSPParams *params );
+
+/** @brief Returns the number of stages added so far */
+unsigned JDSPChainGetStageCount( JDSPChain *chain );
+
+/** @brief Returns the frames by which the chain delays the stream, the look-ahead of
+  * the limiters not bypassed, as of the last block processed.  Only called by the
+  * thread that owns the chain.
+  */
+unsigned JDSPChainGetLatency( JDSPChain *chain );
+
+/** @brief Runs a block through every stage that is not bypassed.  Only called by
+  * the thread that owns the chain.
+  * @param samples Interleaved frames, processed in place
+  */
+void JDSPChainProcess( JDSPChain *chain, float *samples, unsigned long frames );
+
+/** @brief Clears the filter, envelope and delay state of every stage, e.g. after
+  * seeking.  Only called by the thread that owns the chain.
+  */
+void JDSPChainReset( JDSPChain *chain );
+
+/** @brief Reports the timing of each stage.  Safe to call from any thread.
+  * @param stats Array of at least JDSP_MAX_STAGES entries
+  * @return Number of stages filled in
+  */
+unsigned JDSPChainGetStats( JDSPChain *chain, JDSPStageStats *stats );
+
+/** @brief Returns the name of a kind of stage, e.g. "biquad" */
+const char* JDSPStageTypeName( JDSPStageType type );
+
+/** @brief Returns the instruction set of the biquad kernel, e.g. "sse" */
+const char* JDSPChainGetKernelName( void );
+
+/** @brief Frees a chain and its stages
+  * @param chainPtr Pointer to a pointer to a JDSPChain, set to NULL after freeing
+  */
+void JDSPChainDestroy( JDSPChain **chainPtr );
+
+#endif // JDSPCHAIN_H_INCLUDED
@@ -0,0 +1,747 @@
+/* JMixer.c Contains routines mixing several audio files into one stream
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "JMixer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JMIXER_X86
+#include <immintrin.h>
+#define TARGET_SSE __attribute__(( target( "sse" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2,fma" ) ))
+#endif
+
+#define GAIN_PATTERN 8      /* Gains are repeated per channel across one vector */
+
+/** Adds in * gains to out.  gains holds GAIN_PATTERN values repeating the per channel
+  * gains, so samples are matched to their gain by index modulo GAIN_PATTERN. */
+typedef void (*JMixKernel)( float *out, const float *in, const float *gains, size_t samples );
+
+static void mixScalar( float *out, const float *in, const float *gains, size_t samples );
+
+static JMixKernel mixKernel = mixScalar;
+static const char *mixKernelName = "scalar";
+
+#ifdef JMIXER_X86
+static void mixSSE( float *out, const float *in, const float *gains, size_t samples );
+static void mixAVX2( float *out, const float *in, const float *gains, size_t samples );
+#endif
+
+static void selectKernel( void );
+static THREAD_ROUTINE_SIGNATURE mixerProducer( void *threadArg );
+static void fillVoice( JMixer *mixer, JMixerVoice *voice, JMixerProducerCounters *counters );
+static int mixVoice( JMixer *mixer, JMixerVoice *voice, float *out, unsigned long frames );
+static void wakeProducer( JMixer *mixer );
+static void voiceGains( const JMixer *mixer, const JMixerVoice *voice, float *gains );
+static void reclaimVoice( JMixer *mixer, int slot );
+static void freeVoice( JMixerVoice *voice );
+static JMixerVoice* findVoice( JMixer *mixer, int voiceId );
+static void updateMax( unsigned long long *max, unsigned long long value );
+
+
+void JMixerGetDefaultConfig( JMixerConfig *config )
+{
+    config->channels = 2;
+    config->sampleRate = 0;
+    config->framesPerBlock = JMIXER_DEFAULT_FRAMES_PER_BLOCK;
+    config->numBlocks = JMIXER_DEFAULT_NUM_BLOCKS;
+    config->framesPerBuffer = paFramesPerBufferUnspecified;
+    config->bMapPCM = TRUE;
+    config->resampleQuality = JRESAMPLE_MEDIUM;
+    JAudioOutputGetDefaultConfig( &config->output );
+    return;
+}
+
+
+JMixer* JMixerCreate( const JMixerConfig *config )
+{
+    JMixer              *mixer = NULL;
+    JMixerConfig        defaultConfig;
+    JAudioOutputParams  outputParams;
+
+    if( config == NULL )
+    {
+        JMixerGetDefaultConfig( &defaultConfig );
+        config = &defaultConfig;
+    }
+    if( config->channels <= 0 || config->channels > JMIXER_MAX_CHANNELS ||
+        config->framesPerBlock == 0 || config->numBlocks == 0 )
+    {
+        printf( "  Error: Invalid mixer configuration\n" );
+        return NULL;
+    }
+
+    mixer = (JMixer*)calloc( 1, sizeof(JMixer) );
+    if( mixer == NULL )
+        return NULL;
+    selectKernel();
+    JSampleConvertInit();
+
+    /* Voices are summed in float, so the stream is float whatever the files are */
+    outputParams.channelCount = config->channels;
+    outputParams.sampleFormat = paFloat32;
+    outputParams.fallbackFormats = 0;
+    outputParams.sampleRate = config->sampleRate > 0 ? config->sampleRate : JAudioOutputGetDefaultSampleRate( &config->output );
+    if( outputParams.sampleRate <= 0 )
+        outputParams.sampleRate = JMIXER_DEFAULT_SAMPLE_RATE;
+    outputParams.framesPerBuffer = config->framesPerBuffer;
+    outputParams.callback = JMixerCallback;
+    outputParams.ready = NULL;
+    outputParams.userData = mixer;
+
+    mixer->output = JAudioOutputOpen( &config->output, &outputParams );
+    if( mixer->output == NULL )
+    {
+        printf( "  Error: Could not open audio output\n" );
+        free( mixer );
+        return NULL;
+    }
+
+    mixer->stream.channels = config->channels;
+    mixer->stream.sampleRate = mixer->output->params.sampleRate;
+    mixer->stream.format = JSAMPLE_FLOAT32;
+    mixer->stream.framesPerBlock = config->framesPerBlock;
+    mixer->stream.bMapPCM = config->bMapPCM;
+    mixer->stream.bDither = FALSE;
+    mixer->stream.resampleQuality = config->resampleQuality;
+    mixer->stream.readAheadSeconds = 0;     /* Not worth a thread for every voice */
+    mixer->stream.ioCounters = NULL;
+    mixer->stream.bCancel = NULL;
+    /* As in JAudioPlayerCreate, a callback spanning several blocks needs all of them */
+    mixer->numBlocks = 2 * ( ( mixer->output->params.framesPerBuffer + config->framesPerBlock - 1 ) / config->framesPerBlock );
+    if( mixer->numBlocks < config->numBlocks )
+        mixer->numBlocks = config->numBlocks;
+    /* Half the ring is refilled per wakeup, which still leaves a callback's worth */
+    mixer->lowWatermark = mixer->numBlocks - mixer->numBlocks / 2;
+
+    if( JPlatformMutexInit( &mixer->controlLock ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        JAudioOutputClose( &mixer->output );
+        free( mixer );
+        return NULL;
+    }
+    if( JPlatformEventInit( &mixer->producerEvent ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        JPlatformMutexDestroy( &mixer->controlLock );
+        JAudioOutputClose( &mixer->output );
+        free( mixer );
+        return NULL;
+    }
+    if( JPlatformThreadCreate( &mixer->producerThread, mixerProducer, mixer ) )
+    {
+        printf( "  Error creating producer thread\n" );
+        JPlatformEventDestroy( &mixer->producerEvent );
+        JPlatformMutexDestroy( &mixer->controlLock );
+        JAudioOutputClose( &mixer->output );
+        free( mixer );
+        return NULL;
+    }
+    return mixer;
+}
+
+
+void JMixerStart( JMixer *mixer )
+{
+    if( mixer != NULL && !mixer->bRunning && JAudioOutputStart( mixer->output ) == paNoError )
+        mixer->bRunning = TRUE;
+    return;
+}
+
+
+void JMixerStop( JMixer *mixer )
+{
+    if( mixer != NULL && mixer->bRunning && JAudioOutputStop( mixer->output ) == paNoError )
+        mixer->bRunning = FALSE;
+    return;
+}
+
+
+int JMixerAddVoice( JMixer *mixer, const char *filePath, float gain, float pan, int bLoop )
+{
+    JMixerVoice *voice;
+    int         slot, voiceId = -1;
+
+    voice = (JMixerVoice*)calloc( 1, sizeof(JMixerVoice) );
+    if( voice == NULL )
+        return -1;
+    voice->track = JAudioTrackOpen( filePath, &mixer->stream, 0 );
+    if( voice->track == NULL )
+    {
+        free( voice );
+        return -1;
+    }
+    voice->bLoop = bLoop;
+    voice->gain = gain;
+    voice->pan = pan;
+    voice->framesPerBlock = mixer->stream.framesPerBlock;
+    voice->numBlocks = mixer->numBlocks;
+    for( voice->blockCapacity = 1; voice->blockCapacity < voice->numBlocks; voice->blockCapacity <<= 1 );
+    voice->blockMask = voice->blockCapacity - 1;
+    voice->blockMemory = (float*)malloc( sizeof(float) * voice->framesPerBlock * mixer->stream.channels * voice->blockCapacity );
+    if( voice->blockMemory == NULL )
+    {
+        printf( "  Error using malloc\n" );
+        freeVoice( voice );
+        return -1;
+    }
+
+    /* Fill the ring before anyone can see the voice, then start it at full gain
+     * rather than ramping up from silence */
+    fillVoice( mixer, voice, NULL );
+    voiceGains( mixer, voice, voice->appliedGains );
+
+    JPlatformMutexLock( &mixer->controlLock );
+    for( slot=0; slot<JMIXER_MAX_VOICES; slot++ )
+    {
+        if( mixer->voices[slot] == NULL )
+        {
+            voiceId = voice->voiceId = ++mixer->lastVoiceId;
+            JATOMIC_STORE_RELEASE( &mixer->voices[slot], voice );
+            break;
+        }
+    }
+    JPlatformMutexUnlock( &mixer->controlLock );
+
+    if( voiceId < 0 )
+    {
+        printf( "  Error: Mixer has no free voices\n" );
+        freeVoice( voice );
+    }
+    return voiceId;
+}
+
+
+void JMixerRemoveVoice( JMixer *mixer, int voiceId )
+{
+    JMixerVoice *voice;
+    int         bRetired = FALSE;
+
+    JPlatformMutexLock( &mixer->controlLock );
+    if( ( voice = findVoice( mixer, voiceId ) ) != NULL )
+    {
+        JATOMIC_STORE_RELEASE( &voice->bRemove, TRUE );
+        /* A stopped stream never calls back to retire the voice, so do it here.  Only
+         * while the lock is held, as the producer may free the voice once it is
+         * retired and the lock is released. */
+        if( !mixer->bRunning )
+        {
+            JATOMIC_STORE_RELEASE( &voice->bRetired, TRUE );
+            bRetired = TRUE;
+        }
+    }
+    JPlatformMutexUnlock( &mixer->controlLock );
+
+    if( bRetired )
+        JPlatformEventSignal( &mixer->producerEvent );
+    return;
+}
+
+
+void JMixerSetVoiceGain( JMixer *mixer, int voiceId, float gain )
+{
+    JMixerVoice *voice;
+
+    JPlatformMutexLock( &mixer->controlLock );
+    if( ( voice = findVoice( mixer, voiceId ) ) != NULL )
+        JATOMIC_STORE_FLOAT_RELAXED( &voice->gain, gain );
+    JPlatformMutexUnlock( &mixer->controlLock );
+    return;
+}
+
+
+void JMixerSetVoicePan( JMixer *mixer, int voiceId, float pan )
+{
+    JMixerVoice *voice;
+
+    JPlatformMutexLock( &mixer->controlLock );
+    if( ( voice = findVoice( mixer, voiceId ) ) != NULL )
+        JATOMIC_STORE_FLOAT_RELAXED( &voice->pan, pan );
+    JPlatformMutexUnlock( &mixer->controlLock );
+    return;
+}
+
+
+unsigned JMixerGetVoiceCount( JMixer *mixer )
+{
+    unsigned    count = 0;
+    int         slot;
+
+    for( slot=0; slot<JMIXER_MAX_VOICES; slot++ )
+        count += JATOMIC_LOAD_RELAXED( &mixer->voices[slot] ) != NULL;
+    return count;
+}
+
+
+int JMixerIsReady( JMixer *mixer, unsigned long frames )
+{
+    int slot;
+
+    for( slot=0; slot<JMIXER_MAX_VOICES; slot++ )
+    {
+        const JMixerVoice *voice = JATOMIC_LOAD_ACQUIRE( &mixer->voices[slot] );
+        unsigned blocks;
+
+        if( voice == NULL || JATOMIC_LOAD_ACQUIRE( &voice->bEnded ) )
+            continue;
+        blocks = JATOMIC_LOAD_ACQUIRE( &voice->head ) - voice->tail;
+        if( blocks < voice->numBlocks && (unsigned long)blocks * voice->framesPerBlock - voice->tailOffset < frames )
+            return FALSE;
+    }
+    return TRUE;
+}
+
+
+const char* JMixerGetKernelName( void )
+{
+    selectKernel();
+    return mixKernelName;
+}
+
+
+void JMixerGetStats( JMixer *mixer, JMixerStats *stats )
+{
+    const JMixerCallbackCounters *callbackCounters = &mixer->callbackCounters;
+    const JMixerProducerCounters *producerCounters = &mixer->producerCounters;
+    unsigned long long total;
+    unsigned long count;
+
+    stats->voices = JMixerGetVoiceCount( mixer );
+    stats->callbacks = count = JATOMIC_LOAD_RELAXED( &callbackCounters->callbacks );
+    total = JATOMIC_LOAD_RELAXED( &callbackCounters->callbackNsTotal );
+    stats->mixSeconds = total / 1e9;
+    stats->callbackUsAverage = count ? total / 1e3 / count : 0.0;
+    stats->callbackUsMax = JATOMIC_LOAD_RELAXED( &callbackCounters->callbackNsMax ) / 1e3;
+    stats->voicesAverage = count ? (double)JATOMIC_LOAD_RELAXED( &callbackCounters->voicesMixed ) / count : 0.0;
+    stats->voiceUnderruns = JATOMIC_LOAD_RELAXED( &callbackCounters->voiceUnderruns );
+
+    stats->blocksDecoded = count = JATOMIC_LOAD_RELAXED( &producerCounters->blocksDecoded );
+    total = JATOMIC_LOAD_RELAXED( &producerCounters->readNsTotal );
+    stats->decodeSeconds = total / 1e9;
+    stats->readUsAverage = count ? total / 1e3 / count : 0.0;
+    stats->readUsMax = JATOMIC_LOAD_RELAXED( &producerCounters->readNsMax ) / 1e3;
+    return;
+}
+
+
+void JMixerPrintStats( const JMixerStats *stats, FILE *stream )
+{
+    fprintf( stream, "  Mixer: %u voices, %lu callbacks, %.1f us avg, %.1f us max, %.1f voices per callback, "
+                     "%lu voice underruns\n",
+             stats->voices, stats->callbacks, stats->callbackUsAverage, stats->callbackUsMax,
+             stats->voicesAverage, stats->voiceUnderruns );
+    fprintf( stream, "  Mixer producer: %lu blocks, read %.1f us avg %.1f us max\n",
+             stats->blocksDecoded, stats->readUsAverage, stats->readUsMax );
+    return;
+}
+
+
+void JMixerDestroy( JMixer **mixerPtr )
+{
+    JMixer  *mixer = *mixerPtr;
+    int     slot;
+
+    if( mixer == NULL )
+        return;
+
+    JMixerStop( mixer );
+    JAudioOutputClose( &mixer->output );
+    mixer->bTimeToQuit = TRUE;
+    JPlatformEventSignal( &mixer->producerEvent );
+    JPlatformThreadJoin( &mixer->producerThread );
+
+    for( slot=0; slot<JMIXER_MAX_VOICES; slot++ )
+        freeVoice( mixer->voices[slot] );
+    JPlatformEventDestroy( &mixer->producerEvent );
+    JPlatformMutexDestroy( &mixer->controlLock );
+    free( mixer );
+    *mixerPtr = NULL;
+
+    return;
+}
+
+
+int JMixerCallback( const void                      *input,
+                    void                            *output,
+                    unsigned long                   frameCount,
+                    const PaStreamCallbackTimeInfo  *timeInfo,
+                    PaStreamCallbackFlags           statusFlags,
+                    void                            *userData )
+{
+    (void)input;        /* Prevent unused variable warning */
+    (void)timeInfo;
+    (void)statusFlags;
+    JMixer      *mixer = (JMixer*)userData;
+    float       *out = (float*)output;
+    JMixerCallbackCounters *counters = &mixer->callbackCounters;
+    const unsigned long long startNs = JPlatformGetTimeNs();
+    const unsigned sequence = mixer->callbackSequence;
+    unsigned    voices = 0;
+    int         slot, bWake = FALSE;
+
+    /* Odd sequence tells reclaimVoice a callback may hold voice pointers.  The fence
+     * orders the store before the slot loads below. */
+    JATOMIC_STORE_RELAXED( &mixer->callbackSequence, sequence + 1 );
+    JATOMIC_FENCE();
+
+    memset( out, 0, sizeof(float) * frameCount * mixer->stream.channels );
+    for( slot=0; slot<JMIXER_MAX_VOICES; slot++ )
+    {
+        JMixerVoice *voice = JATOMIC_LOAD_ACQUIRE( &mixer->voices[slot] );
+
+        if( voice == NULL || JATOMIC_LOAD_RELAXED( &voice->bRetired ) )
+            continue;
+        bWake |= mixVoice( mixer, voice, out, frameCount );
+        voices++;
+    }
+    if( bWake )
+        wakeProducer( mixer );
+
+    JATOMIC_STORE_RELEASE( &mixer->callbackSequence, sequence + 2 );
+
+    {
+        const unsigned long long durationNs = JPlatformGetTimeNs() - startNs;
+
+        JATOMIC_ADD_SINGLE_WRITER( &counters->callbacks, 1 );
+        JATOMIC_ADD_SINGLE_WRITER( &counters->voicesMixed, voices );
+        JATOMIC_ADD_SINGLE_WRITER( &counters->callbackNsTotal, durationNs );
+        updateMax( &counters->callbackNsMax, durationNs );
+    }
+    return paContinue;
+}
+
+
+/* Keeps every voice's ring full and frees voices the callback has retired */
+static THREAD_ROUTINE_SIGNATURE mixerProducer( void *threadArg )
+{
+    JMixer  *mixer = (JMixer*)threadArg;
+    int     slot;
+
+    while( !mixer->bTimeToQuit )
+    {
+        JPlatformEventWait( &mixer->producerEvent, 100 );
+        JATOMIC_ADD_SINGLE_WRITER( &mixer->producerCounters.wakeups, 1 );
+
+        /* As in the player's producer, let the callback wake us again before looking
+         * at any ring, so a block handed back after this is seen or wakes us again */
+        JATOMIC_STORE_RELAXED( &mixer->bWakePending, FALSE );
+        JATOMIC_FENCE();
+
+        for( slot=0; slot<JMIXER_MAX_VOICES; slot++ )
+        {
+            JMixerVoice *voice = JATOMIC_LOAD_ACQUIRE( &mixer->voices[slot] );
+
+            if( voice == NULL )
+                continue;
+            if( JATOMIC_LOAD_ACQUIRE( &voice->bRetired ) )
+                reclaimVoice( mixer, slot );
+            else
+                fillVoice( mixer, voice, &mixer->producerCounters );
+        }
+    }
+    return 0;
+}
+
+
+/* Decodes blocks until the voice's ring holds numBlocks.  Called by the producer
+ * thread, or by JMixerAddVoice before the voice is published with NULL counters. */
+static void fillVoice( JMixer *mixer, JMixerVoice *voice, JMixerProducerCounters *counters )
+{
+    const int   channels = mixer->stream.channels;
+    sf_count_t  fileFrames = 0;
+
+    while( !voice->bEnded && voice->head - JATOMIC_LOAD_ACQUIRE( &voice->tail ) < voice->numBlocks )
+    {
+        float           *block = voice->blockMemory + (size_t)( voice->head & voice->blockMask ) * voice->framesPerBlock * channels;
+        unsigned long long readNs = JPlatformGetTimeNs();
+        unsigned long   filled, n;
+
+        filled = JAudioTrackRead( voice->track, block, voice->framesPerBlock, NULL, &fileFrames );
+        while( filled < voice->framesPerBlock && voice->bLoop )
+        {
+            if( JAudioTrackSeek( voice->track, 0, SEEK_SET ) < 0 )
+                break;
+            n = JAudioTrackRead( voice->track, block + (size_t)filled * channels, voice->framesPerBlock - filled, NULL, &fileFrames );
+            if( n == 0 )
+                break;      /* Empty file */
+            filled += n;
+        }
+        if( filled < voice->framesPerBlock )
+            memset( block + (size_t)filled * channels, 0, sizeof(float) * ( voice->framesPerBlock - filled ) * channels );
+
+        if( counters != NULL )
+        {
+            readNs = JPlatformGetTimeNs() - readNs;
+            JATOMIC_ADD_SINGLE_WRITER( &counters->blocksDecoded, 1 );
+            JATOMIC_ADD_SINGLE_WRITER( &counters->readNsTotal, readNs );
+            updateMax( &counters->readNsMax, readNs );
+        }
+
+        JATOMIC_STORE_RELEASE( &voice->head, voice->head + 1 );
+        if( filled < voice->framesPerBlock )
+            JATOMIC_STORE_RELEASE( &voice->bEnded, TRUE );
+    }
+    return;
+}
+
+
+/* Adds as much of the voice as is queued to out, ramping from the gains used last
+ * time to the current ones.  Retires the voice once it has been removed and faded
+ * out, or has played its last block.  Called by the callback.
+ * Returns TRUE if the producer needs waking, to reclaim the voice or because its
+ * ring has drained to the low watermark. */
+static int mixVoice( JMixer *mixer, JMixerVoice *voice, float *out, unsigned long frames )
+{
+    const int       channels = mixer->stream.channels;
+    const JMixKernel mix = JATOMIC_LOAD_RELAXED( &mixKernel );
+    const unsigned  head = JATOMIC_LOAD_ACQUIRE( &voice->head );
+    const int       bRemove = JATOMIC_LOAD_ACQUIRE( &voice->bRemove );
+    float           gains[JMIXER_MAX_CHANNELS], pattern[GAIN_PATTERN];
+    unsigned long   done = 0, count, i;
+    int             bRamp = FALSE, c;
+
+    if( bRemove )
+        memset( gains, 0, sizeof(gains) );
+    else
+        voiceGains( mixer, voice, gains );
+    for( c=0; c<channels; c++ )
+        bRamp |= gains[c] != voice->appliedGains[c];
+    for( i=0; i<GAIN_PATTERN; i++ )
+        pattern[i] = gains[i % channels];
+
+    while( done < frames && voice->tail != head )
+    {
+        const float *block = voice->blockMemory +
+                             ( (size_t)( voice->tail & voice->blockMask ) * voice->framesPerBlock + voice->tailOffset ) * channels;
+
+        count = voice->framesPerBlock - voice->tailOffset;
+        if( count > frames - done )
+            count = frames - done;
+
+        if( bRamp )
+        {
+            /* Linear ramp across the whole callback so gain changes do not click */
+            for( i=0; i<count; i++ )
+            {
+                const float t = (float)( done + i + 1 ) / (float)frames;
+                for( c=0; c<channels; c++ )
+                    out[( done + i ) * channels + c] += block[i * channels + c] *
+                        ( voice->appliedGains[c] + ( gains[c] - voice->appliedGains[c] ) * t );
+            }
+        }
+        else if( GAIN_PATTERN % channels == 0 )
+            mix( out + done * channels, block, pattern, count * channels );
+        else
+        {
+            for( i=0; i<count; i++ )
+                for( c=0; c<channels; c++ )
+                    out[( done + i ) * channels + c] += block[i * channels + c] * gains[c];
+        }
+
+        done += count;
+        voice->tailOffset += count;
+        if( voice->tailOffset == voice->framesPerBlock )
+        {
+            voice->tailOffset = 0;
+            JATOMIC_STORE_RELEASE( &voice->tail, voice->tail + 1 );
+        }
+    }
+    memcpy( voice->appliedGains, gains, sizeof(gains) );
+
+    if( bRemove ||
+        ( JATOMIC_LOAD_ACQUIRE( &voice->bEnded ) && JATOMIC_LOAD_ACQUIRE( &voice->head ) == voice->tail ) )
+    {
+        JATOMIC_STORE_RELEASE( &voice->bRetired, TRUE );
+        return TRUE;
+    }
+    if( done < frames )
+    {
+        JATOMIC_ADD_SINGLE_WRITER( &voice->underruns, 1 );
+        JATOMIC_ADD_SINGLE_WRITER( &mixer->callbackCounters.voiceUnderruns, 1 );
+        return TRUE;
+    }
+    return head - voice->tail <= mixer->lowWatermark && !JATOMIC_LOAD_RELAXED( &voice->bEnded );
+}
+
+
+/* Called by the callback to have the producer refill the rings.  Only the first call
+ * after the producer has woken signals it, as in JAudioPlayer. */
+static void wakeProducer( JMixer *mixer )
+{
+    JATOMIC_FENCE();        /* Order the stores to tail before the load of the flag */
+    if( JATOMIC_LOAD_RELAXED( &mixer->bWakePending ) )
+        return;
+    JATOMIC_STORE_RELAXED( &mixer->bWakePending, TRUE );
+    JPlatformEventSignal( &mixer->producerEvent );
+    return;
+}
+
+
+/* Per channel gains for the voice's gain and pan.  Stereo uses a constant power pan
+ * law, other channel counts only apply the gain. */
+static void voiceGains( const JMixer *mixer, const JMixerVoice *voice, float *gains )
+{
+    const float gain = JATOMIC_LOAD_FLOAT_RELAXED( &voice->gain );
+    float       pan = JATOMIC_LOAD_FLOAT_RELAXED( &voice->pan );
+    int         c;
+
+    for( c=0; c<JMIXER_MAX_CHANNELS; c++ )
+        gains[c] = c < mixer->stream.channels ? gain : 0.0f;
+    if( mixer->stream.channels == 2 )
+    {
+        pan = pan < -1.0f ? -1.0f : ( pan > 1.0f ? 1.0f : pan );
+        gains[0] = gain * cosf( ( pan + 1.0f ) * (float)M_PI / 4.0f );
+        gains[1] = gain * sinf( ( pan + 1.0f ) * (float)M_PI / 4.0f );
+    }
+    return;
+}
+
+
+/* Empties a slot holding a retired voice and frees the voice once no callback can
+ * still be using it.  Called by the producer thread. */
+static void reclaimVoice( JMixer *mixer, int slot )
+{
+    JMixerVoice *voice;
+    unsigned    sequence;
+
+    JPlatformMutexLock( &mixer->controlLock );
+    voice = mixer->voices[slot];
+    JATOMIC_STORE_RELAXED( &mixer->voices[slot], NULL );
+    JPlatformMutexUnlock( &mixer->controlLock );
+
+    /* A callback that started before the slot was emptied may still hold the voice,
+     * wait for it to finish.  Later callbacks cannot see it. */
+    JATOMIC_FENCE();
+    sequence = JATOMIC_LOAD_ACQUIRE( &mixer->callbackSequence );
+    if( sequence & 1u )
+    {
+        while( JATOMIC_LOAD_ACQUIRE( &mixer->callbackSequence ) == sequence )
+            JPlatformYield();
+    }
+
+    freeVoice( voice );
+    JATOMIC_ADD_SINGLE_WRITER( &mixer->producerCounters.voicesRetired, 1 );
+    return;
+}
+
+
+static void freeVoice( JMixerVoice *voice )
+{
+    if( voice == NULL )
+        return;
+    JAudioTrackClose( &voice->track );
+    free( voice->blockMemory );
+    free( voice );
+    return;
+}
+
+
+/* Called with controlLock taken */
+static JMixerVoice* findVoice( JMixer *mixer, int voiceId )
+{
+    int slot;
+
+    for( slot=0; slot<JMIXER_MAX_VOICES; slot++ )
+    {
+        if( mixer->voices[slot] != NULL && mixer->voices[slot]->voiceId == voiceId )
+            return mixer->voices[slot];
+    }
+    return NULL;
+}
+
+
+static void updateMax( unsigned long long *max, unsigned long long value )
+{
+    if( value > JATOMIC_LOAD_RELAXED( max ) )
+        JATOMIC_STORE_RELAXED( max, value );
+    return;
+}
+
+
+static void selectKernel( void )
+{
+#ifdef JMIXER_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+    {
+        mixKernelName = "avx2";
+        JATOMIC_STORE_RELEASE( &mixKernel, mixAVX2 );
+    }
+    else if( __builtin_cpu_supports( "sse" ) )
+    {
+        mixKernelName = "sse";
+        JATOMIC_STORE_RELEASE( &mixKernel, mixSSE );
+    }
+#endif
+    return;
+}
+
+
+static void mixScalar( float *out, const float *in, const float *gains, size_t samples )
+{
+    size_t i;
+
+    for( i=0; i<samples; i++ )
+        out[i] += in[i] * gains[i % GAIN_PATTERN];
+    return;
+}
+
+
+#ifdef JMIXER_X86
+
+TARGET_SSE static void mixSSE( float *out, const float *in, const float *gains, size_t samples )
+{
+    const __m128 gain0 = _mm_loadu_ps( gains ), gain1 = _mm_loadu_ps( gains + 4 );
+    size_t i;
+
+    for( i=0; i+8<=samples; i+=8 )
+    {
+        _mm_storeu_ps( out + i, _mm_add_ps( _mm_loadu_ps( out + i ), _mm_mul_ps( _mm_loadu_ps( in + i ), gain0 ) ) );
+        _mm_storeu_ps( out + i + 4, _mm_add_ps( _mm_loadu_ps( out + i + 4 ), _mm_mul_ps( _mm_loadu_ps( in + i + 4 ), gain1 ) ) );
+    }
+    for( ; i<samples; i++ )
+        out[i] += in[i] * gains[i % GAIN_PATTERN];
+    return;
+}
+
+
+TARGET_AVX2 static void mixAVX2( float *out, const float *in, const float *gains, size_t samples )
+{
+    const __m256 gain = _mm256_loadu_ps( gains );
+    size_t i;
+
+    for( i=0; i+16<=samples; i+=16 )
+    {
+        _mm256_storeu_ps( out + i, _mm256_fmadd_ps( _mm256_loadu_ps( in + i ), gain, _mm256_loadu_ps( out + i ) ) );
+        _mm256_storeu_ps( out + i + 8, _mm256_fmadd_ps( _mm256_loadu_ps( in + i + 8 ), gain, _mm256_loadu_ps( out + i + 8 ) ) );
+    }
+    for( ; i+8<=samples; i+=8 )
+        _mm256_storeu_ps( out + i, _mm256_fmadd_ps( _mm256_loadu_ps( in + i ), gain, _mm256_loadu_ps( out + i ) ) );
+    for( ; i<samples; i++ )
+        out[i] += in[i] * gains[i % GAIN_PATTERN];
+    return;
+}
+
+#endif  // JMIXER_X86
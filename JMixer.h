@@ -0,0 +1,228 @@
+/* JMixer.h Header file for the multi-voice mixer
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JMIXER_H_INCLUDED
+#define JMIXER_H_INCLUDED
+
+#include <stdio.h>
+
+#include "portaudio.h"
+
+#include "JPlatform.h"
+#include "JAudioOutput.h"
+#include "JAudioTrack.h"
+
+#define JMIXER_MAX_VOICES 64
+#define JMIXER_MAX_CHANNELS 8
+#define JMIXER_DEFAULT_FRAMES_PER_BLOCK 256
+#define JMIXER_DEFAULT_NUM_BLOCKS 4
+#define JMIXER_DEFAULT_SAMPLE_RATE 48000
+
+/** Settings chosen when the mixer is created
+  * @see JMixerGetDefaultConfig
+  */
+typedef struct
+{
+    int         channels;           /* Output channels, default 2 */
+    double      sampleRate;         /* Rate of the stream, 0 for the device's default */
+    unsigned    framesPerBlock;     /* Frames in each block of a voice's ring */
+    unsigned    numBlocks;          /* Blocks queued per voice */
+    unsigned long framesPerBuffer;  /* Frames per call of JMixerCallback */
+    int         bMapPCM;            /* Passed to JAudioSourceOpen */
+    JResampleQuality resampleQuality;
+
+    JAudioOutputConfig  output;
+}
+JMixerConfig;
+
+/** One file being mixed.  Its ring is a single producer/single consumer queue of float
+  * blocks like JCircularBuffer, filled by the mixer's producer thread and emptied by
+  * JMixerCallback.  Control threads only write gain, pan and bRemove, gain and pan
+  * with relaxed atomic stores as the callback reads them whenever it runs.
+  */
+typedef struct
+{
+    int         voiceId;
+    JAudioTrack *track;
+    int         bLoop;              /* Start again from the beginning at the end */
+
+    float       gain;               /* Written by control threads */
+    float       pan;                /* -1 left to 1 right, stereo streams only */
+    float       appliedGains[JMIXER_MAX_CHANNELS];  /* Gains used at the end of the last
+                                                     * callback, only used by the callback */
+    int         bRemove;            /* Control thread asked for the voice to go */
+    int         bEnded;             /* Producer has queued the last block */
+    int         bRetired;           /* Callback will not touch the voice again */
+
+    float       *blockMemory;       /* blockCapacity blocks of framesPerBlock frames */
+    unsigned    framesPerBlock;
+    unsigned    blockCapacity;      /* A power of two */
+    unsigned    blockMask;
+    unsigned    numBlocks;          /* Blocks the producer keeps queued */
+    JCACHE_LINE_PAD( pad0, 0 );
+
+    unsigned    head;               /* Only written by the producer */
+    JCACHE_LINE_PAD( pad1, sizeof(unsigned) );
+    unsigned    tail;               /* Only written by the callback */
+    unsigned    tailOffset;
+    unsigned long underruns;
+    JCACHE_LINE_PAD( pad2, 2 * sizeof(unsigned) + sizeof(unsigned long) );
+}
+JMixerVoice;
+
+/** Counters updated by JMixerCallback, single writer like JCallbackCounters */
+typedef struct
+{
+    unsigned long       callbacks;
+    unsigned long long  callbackNsTotal;
+    unsigned long long  callbackNsMax;
+    unsigned long long  voicesMixed;        /* Sum over callbacks of voices mixed */
+    unsigned long       voiceUnderruns;
+}
+JMixerCallbackCounters;
+
+/** Counters updated by the producer thread */
+typedef struct
+{
+    unsigned long       wakeups;
+    unsigned long       blocksDecoded;
+    unsigned long long  readNsTotal;
+    unsigned long long  readNsMax;
+    unsigned long       voicesRetired;
+}
+JMixerProducerCounters;
+
+/** Snapshot of the mixer statistics
+  * @see JMixerGetStats
+  */
+typedef struct
+{
+    unsigned        voices;             /* Voices in the mixer now */
+    unsigned long   callbacks;
+    double          callbackUsAverage;
+    double          callbackUsMax;
+    double          voicesAverage;      /* Voices mixed per callback */
+    unsigned long   voiceUnderruns;     /* Voices that ran out of frames mid-callback */
+    unsigned long   blocksDecoded;
+    double          readUsAverage;      /* Time spent decoding per block */
+    double          readUsMax;
+    double          decodeSeconds;      /* Total time spent decoding */
+    double          mixSeconds;         /* Total time spent in the callback */
+}
+JMixerStats;
+
+/** Plays any number of files at once through one output stream.  Voices are added and
+  * removed without locking the audio callback: slots are published with release
+  * stores, and a removed voice is only freed by the producer thread once the callback
+  * has let go of it.  Control threads serialize among themselves on controlLock.
+  */
+typedef struct
+{
+    JAudioOutput    *output;
+    JStreamFormat   stream;             /* Float at the output's rate and channel count */
+    unsigned        numBlocks;
+    unsigned        lowWatermark;       /* Blocks left in a voice's ring at which the
+                                         * callback wakes the producer */
+
+    JMixerVoice     *voices[JMIXER_MAX_VOICES];
+    JMutex          controlLock;        /* Taken to fill or empty a slot, never by the callback */
+    int             lastVoiceId;
+
+    JThread         producerThread;
+    JEvent          producerEvent;
+    volatile int    bTimeToQuit;
+    int             bRunning;
+
+    JCACHE_LINE_PAD( padSequence, 0 );
+    unsigned        callbackSequence;   /* Odd while JMixerCallback runs */
+    int             bWakePending;       /* Set by the callback when it wakes the
+                                         * producer, cleared by the producer on waking */
+    JCACHE_LINE_PAD( padCallbackCounters, sizeof(unsigned) + sizeof(int) );
+    JMixerCallbackCounters  callbackCounters;
+    JCACHE_LINE_PAD( padProducerCounters, 0 );
+    JMixerProducerCounters  producerCounters;
+}
+JMixer;
+
+/** @brief Fills in a JMixerConfig with the default settings */
+void JMixerGetDefaultConfig( JMixerConfig *config );
+
+/** @brief Opens the output stream and starts the producer thread.  JMixerDestroy must
+  * be called to free resources allocated by JMixerCreate.
+  * @param config Settings, or NULL to use the defaults
+  * @return Pointer to a JMixer, returns NULL on failure
+  */
+JMixer* JMixerCreate( const JMixerConfig *config );
+
+/** @brief Starts the output stream */
+void JMixerStart( JMixer *mixer );
+
+/** @brief Stops the output stream.  Voices keep their place. */
+void JMixerStop( JMixer *mixer );
+
+/** @brief Opens an audio file and starts mixing it in.  The file is opened and its
+  * first blocks decoded on the calling thread, so the voice starts without a gap.
+  * @param gain Linear gain, 1 for unity
+  * @param pan -1 for left, 0 for centre, 1 for right
+  * @param bLoop TRUE to repeat the file until the voice is removed
+  * @return Identifier of the voice, or -1 on failure
+  */
+int JMixerAddVoice( JMixer *mixer, const char *filePath, float gain, float pan, int bLoop );
+
+/** @brief Fades a voice out over one callback and frees it.  Voices that reach the end
+  * of their file are removed in the same way without calling this.
+  */
+void JMixerRemoveVoice( JMixer *mixer, int voiceId );
+
+/** @brief Changes the gain of a voice, ramped over the next callback */
+void JMixerSetVoiceGain( JMixer *mixer, int voiceId, float gain );
+
+/** @brief Changes the pan of a voice, ramped over the next callback */
+void JMixerSetVoicePan( JMixer *mixer, int voiceId, float pan );
+
+/** @brief Returns the number of voices in the mixer, including ones fading out */
+unsigned JMixerGetVoiceCount( JMixer *mixer );
+
+/** @brief Checks that every voice has frames queued for a callback of frames frames */
+int JMixerIsReady( JMixer *mixer, unsigned long frames );
+
+/** @brief Returns the instruction set the mix routine uses, e.g. "avx2" */
+const char* JMixerGetKernelName( void );
+
+/** @brief Takes a snapshot of the mixer statistics */
+void JMixerGetStats( JMixer *mixer, JMixerStats *stats );
+
+/** @brief Prints a statistics snapshot as a few lines of text */
+void JMixerPrintStats( const JMixerStats *stats, FILE *stream );
+
+/** @brief Stops the stream and frees the mixer and every voice
+  * @param mixerPtr Pointer to a pointer to a JMixer, set to NULL after freeing
+  */
+void JMixerDestroy( JMixer **mixerPtr );
+
+/** @brief Stream callback summing every voice into the output */
+int JMixerCallback( const void *input,
+                    void *output,
+                    unsigned long frameCount,
+                    const PaStreamCallbackTimeInfo *timeInfo,
+                    PaStreamCallbackFlags statusFlags,
+                    void *userData );
+
+#endif // JMIXER_H_INCLUDED
@@ -0,0 +1,449 @@
+/* JPlatform.c Contains platform helpers shared by J Audio Player modules
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE     /* sched_setaffinity */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "JPlatform.h"
+
+int JPlatformThreadCreate( JThread *thread, THREAD_ROUTINE_SIGNATURE (*routine)( void* ), void *arg )
+{
+#ifdef WIN32
+    thread->handle = (HANDLE)_beginthreadex( NULL, 0, routine, arg, 0, &thread->threadID );
+    return thread->handle == 0;
+#else
+    return pthread_create( &thread->threadID, NULL, routine, arg );
+#endif
+}
+
+
+void JPlatformThreadJoin( JThread *thread )
+{
+#ifdef WIN32
+    WaitForSingleObject( thread->handle, INFINITE );
+    CloseHandle( thread->handle );
+#else
+    pthread_join( thread->threadID, NULL );
+#endif
+    return;
+}
+
+
+void JPlatformThreadSetBackground( void )
+{
+#ifdef WIN32
+    SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_LOWEST );
+#elif defined(__linux__)
+    /* Linux applies nice values to single threads */
+    setpriority( PRIO_PROCESS, (id_t)syscall( SYS_gettid ), 10 );
+#endif
+    return;
+}
+
+
+JSchedPolicy JPlatformThreadSetRealtime( JSchedPolicy policy, int priority )
+{
+#ifdef WIN32
+    if( policy == JSCHED_NORMAL )
+        SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_NORMAL );
+    else if( !SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL ) )
+        return JSCHED_NORMAL;
+    return policy;
+#else
+    struct sched_param param;
+    int posixPolicy;
+
+    switch( policy )
+    {
+        case JSCHED_FIFO:   posixPolicy = SCHED_FIFO; break;
+        case JSCHED_RR:     posixPolicy = SCHED_RR; break;
+        default:            posixPolicy = SCHED_OTHER; break;
+    }
+    memset( &param, 0, sizeof(param) );
+    if( posixPolicy != SCHED_OTHER )
+    {
+        if( priority < sched_get_priority_min( posixPolicy ) )
+            priority = sched_get_priority_min( posixPolicy );
+        if( priority > sched_get_priority_max( posixPolicy ) )
+            priority = sched_get_priority_max( posixPolicy );
+        param.sched_priority = priority;
+    }
+    if( pthread_setschedparam( pthread_self(), posixPolicy, &param ) != 0 )
+    {
+        /* Report what the thread was left with */
+        if( pthread_getschedparam( pthread_self(), &posixPolicy, &param ) != 0 )
+            return JSCHED_NORMAL;
+    }
+    return posixPolicy == SCHED_FIFO ? JSCHED_FIFO : posixPolicy == SCHED_RR ? JSCHED_RR : JSCHED_NORMAL;
+#endif
+}
+
+
+int JPlatformThreadSetAffinity( unsigned cpu )
+{
+#ifdef WIN32
+    if( cpu >= sizeof(DWORD_PTR) * 8 )
+        return -1;
+    return SetThreadAffinityMask( GetCurrentThread(), (DWORD_PTR)1 << cpu ) == 0;
+#elif defined(__linux__)
+    cpu_set_t cpus;
+
+    if( cpu >= CPU_SETSIZE )
+        return -1;
+    CPU_ZERO( &cpus );
+    CPU_SET( cpu, &cpus );
+    return sched_setaffinity( (pid_t)syscall( SYS_gettid ), sizeof(cpus), &cpus );
+#else
+    return -1;
+#endif
+}
+
+
+#ifndef WIN32
+/* munlockall also unlocks the regions locked with mlock, so they are kept in a list to
+ * be locked again after it */
+typedef struct JLockedRegion
+{
+    const void              *address;
+    size_t                  bytes;
+    struct JLockedRegion    *next;
+}
+JLockedRegion;
+
+static pthread_mutex_t  memoryLockMutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned         lockAllCount = 0;
+static JLockedRegion    *lockedRegions = NULL;
+#endif
+
+
+int JPlatformLockMemory( const void *address, size_t bytes )
+{
+#ifdef WIN32
+    return !VirtualLock( (LPVOID)address, bytes );
+#else
+    JLockedRegion *region;
+
+    region = (JLockedRegion*)malloc( sizeof(JLockedRegion) );
+    if( region == NULL )
+        return -1;
+    pthread_mutex_lock( &memoryLockMutex );
+    if( mlock( address, bytes ) != 0 )
+    {
+        pthread_mutex_unlock( &memoryLockMutex );
+        free( region );
+        return -1;
+    }
+    region->address = address;
+    region->bytes = bytes;
+    region->next = lockedRegions;
+    lockedRegions = region;
+    pthread_mutex_unlock( &memoryLockMutex );
+    return 0;
+#endif
+}
+
+
+void JPlatformUnlockMemory( const void *address, size_t bytes )
+{
+#ifdef WIN32
+    VirtualUnlock( (LPVOID)address, bytes );
+#else
+    JLockedRegion **link, *region;
+
+    pthread_mutex_lock( &memoryLockMutex );
+    for( link = &lockedRegions; *link != NULL; link = &(*link)->next )
+    {
+        if( (*link)->address == address && (*link)->bytes == bytes )
+        {
+            region = *link;
+            *link = region->next;
+            free( region );
+            break;
+        }
+    }
+    munlock( address, bytes );
+    pthread_mutex_unlock( &memoryLockMutex );
+#endif
+    return;
+}
+
+
+int JPlatformLockAllMemory( void )
+{
+#ifdef WIN32
+    return -1;
+#else
+    int result;
+
+    pthread_mutex_lock( &memoryLockMutex );
+    result = mlockall( MCL_CURRENT | MCL_FUTURE );
+    if( result == 0 )
+        lockAllCount++;
+    pthread_mutex_unlock( &memoryLockMutex );
+    return result;
+#endif
+}
+
+
+void JPlatformUnlockAllMemory( void )
+{
+#ifndef WIN32
+    JLockedRegion *region;
+
+    pthread_mutex_lock( &memoryLockMutex );
+    if( lockAllCount > 0 && --lockAllCount == 0 )
+    {
+        munlockall();
+        for( region = lockedRegions; region != NULL; region = region->next )
+            mlock( region->address, region->bytes );
+    }
+    pthread_mutex_unlock( &memoryLockMutex );
+#endif
+    return;
+}
+
+
+void* JPlatformAllocPages( size_t bytes )
+{
+#ifdef WIN32
+    return VirtualAlloc( NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+#else
+    void *address = mmap( NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    return address == MAP_FAILED ? NULL : address;
+#endif
+}
+
+
+void JPlatformFreePages( void *address, size_t bytes )
+{
+    if( address == NULL )
+        return;
+#ifdef WIN32
+    VirtualFree( address, 0, MEM_RELEASE );
+#else
+    munmap( address, bytes );
+#endif
+    return;
+}
+
+
+int JPlatformMutexInit( JMutex *mutex )
+{
+#ifdef WIN32
+    InitializeCriticalSection( &mutex->section );
+    return 0;
+#else
+    return pthread_mutex_init( &mutex->mutex, NULL );
+#endif
+}
+
+
+void JPlatformMutexLock( JMutex *mutex )
+{
+#ifdef WIN32
+    EnterCriticalSection( &mutex->section );
+#else
+    pthread_mutex_lock( &mutex->mutex );
+#endif
+    return;
+}
+
+
+void JPlatformMutexUnlock( JMutex *mutex )
+{
+#ifdef WIN32
+    LeaveCriticalSection( &mutex->section );
+#else
+    pthread_mutex_unlock( &mutex->mutex );
+#endif
+    return;
+}
+
+
+void JPlatformMutexDestroy( JMutex *mutex )
+{
+#ifdef WIN32
+    DeleteCriticalSection( &mutex->section );
+#else
+    pthread_mutex_destroy( &mutex->mutex );
+#endif
+    return;
+}
+
+
+int JPlatformEventInit( JEvent *event )
+{
+#ifdef WIN32
+    event->handle = CreateEvent( NULL, /* bManualReset = */ FALSE, /* bInitialState = */ FALSE, NULL );
+    return event->handle == NULL;
+#else
+    return sem_init( &event->semaphore, /* pshared = */ 0, /* value = */ 0 );
+#endif
+}
+
+
+void JPlatformEventSignal( JEvent *event )
+{
+#ifdef WIN32
+    SetEvent( event->handle );
+#else
+    sem_post( &event->semaphore );
+#endif
+    return;
+}
+
+
+void JPlatformEventWait( JEvent *event, unsigned timeoutMs )
+{
+#ifdef WIN32
+    WaitForSingleObject( event->handle, timeoutMs );
+#else
+    struct timespec deadline;
+
+    /* sem_timedwait takes an absolute CLOCK_REALTIME deadline */
+    clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)( timeoutMs % 1000 ) * 1000000L;
+    if( deadline.tv_nsec >= 1000000000L )
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while( sem_timedwait( &event->semaphore, &deadline ) != 0 && errno == EINTR );
+#endif
+    return;
+}
+
+
+void JPlatformEventDestroy( JEvent *event )
+{
+#ifdef WIN32
+    CloseHandle( event->handle );
+#else
+    sem_destroy( &event->semaphore );
+#endif
+    return;
+}
+
+
+unsigned long long JPlatformGetTimeNs( void )
+{
+#ifdef WIN32
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter( &counter );
+    QueryPerformanceFrequency( &frequency );
+    return (unsigned long long)( (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart );
+#else
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+#endif
+}
+
+
+unsigned long long JPlatformThreadGetCpuTimeNs( void )
+{
+#ifdef WIN32
+    FILETIME creation, exit, kernel, user;
+    ULARGE_INTEGER kernelTime, userTime;
+
+    if( !GetThreadTimes( GetCurrentThread(), &creation, &exit, &kernel, &user ) )
+        return 0;
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+    return ( kernelTime.QuadPart + userTime.QuadPart ) * 100;     /* 100 ns units */
+#else
+    struct timespec now;
+
+    if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now ) )
+        return 0;
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+#endif
+}
+
+
+void JPlatformSleepUntilNs( unsigned long long deadlineNs )
+{
+#ifdef WIN32
+    unsigned long long now = JPlatformGetTimeNs();
+
+    if( deadlineNs > now )
+        Sleep( (DWORD)( ( deadlineNs - now ) / 1000000ULL ) );
+#else
+    struct timespec deadline;
+
+    deadline.tv_sec = (time_t)( deadlineNs / 1000000000ULL );
+    deadline.tv_nsec = (long)( deadlineNs % 1000000000ULL );
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL ) == EINTR );
+#endif
+    return;
+}
+
+
+void JPlatformYield( void )
+{
+#ifdef WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+    return;
+}
+
+
+unsigned JPlatformGetProcessorCount( void )
+{
+#ifdef WIN32
+    SYSTEM_INFO systemInfo;
+
+    GetSystemInfo( &systemInfo );
+    return systemInfo.dwNumberOfProcessors > 0 ? (unsigned)systemInfo.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf( _SC_NPROCESSORS_ONLN );
+
+    return count > 0 ? (unsigned)count : 1;
+#endif
+}
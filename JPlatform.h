@@ -0,0 +1,236 @@
+/* JPlatform.h Header file for platform helpers shared by J Audio Player modules
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JPLATFORM_H_INCLUDED
+#define JPLATFORM_H_INCLUDED
+
+#include <stddef.h>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#ifdef WIN32
+#define THREAD_ROUTINE_SIGNATURE unsigned int __stdcall
+#else
+#define THREAD_ROUTINE_SIGNATURE void*
+#endif
+
+/** 1 on big endian hosts, 0 on little endian hosts */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define JHOST_BIG_ENDIAN 1
+#else
+#define JHOST_BIG_ENDIAN 0
+#endif
+
+/** Size used to keep data written by different threads on separate cache lines */
+#define JCACHE_LINE_SIZE 64
+
+/** Pads a structure member out to a full cache line
+  * @param name Name of the padding member
+  * @param used Bytes of the cache line already taken by the preceding member
+  */
+#define JCACHE_LINE_PAD( name, used ) char name[JCACHE_LINE_SIZE - (used)]
+
+/* Atomic accessors used to pass data between the producer thread, the audio
+ * callback and the control thread.  These map onto the gcc __atomic builtins,
+ * which are available on every compiler J Audio Player is built with. */
+#define JATOMIC_LOAD_RELAXED( ptr )         __atomic_load_n( (ptr), __ATOMIC_RELAXED )
+#define JATOMIC_LOAD_ACQUIRE( ptr )         __atomic_load_n( (ptr), __ATOMIC_ACQUIRE )
+#define JATOMIC_STORE_RELAXED( ptr, val )   __atomic_store_n( (ptr), (val), __ATOMIC_RELAXED )
+#define JATOMIC_STORE_RELEASE( ptr, val )   __atomic_store_n( (ptr), (val), __ATOMIC_RELEASE )
+#define JATOMIC_ADD_RELAXED( ptr, val )     __atomic_fetch_add( (ptr), (val), __ATOMIC_RELAXED )
+#define JATOMIC_ADD_ACQ_REL( ptr, val )     __atomic_fetch_add( (ptr), (val), __ATOMIC_ACQ_REL )
+
+/* The _n builtins above only take integers and pointers, so floats go through the
+ * generic ones */
+#define JATOMIC_LOAD_FLOAT_RELAXED( ptr ) \
+    __extension__ ({ float value_; __atomic_load( (ptr), &value_, __ATOMIC_RELAXED ); value_; })
+#define JATOMIC_STORE_FLOAT_RELAXED( ptr, val ) \
+    do { float value_ = (val); __atomic_store( (ptr), &value_, __ATOMIC_RELAXED ); } while( 0 )
+
+/* Orders a store before a later load of another variable, which acquire and release
+ * do not.  Needed where two threads each store a flag and then check the other's. */
+#define JATOMIC_FENCE()                     __atomic_thread_fence( __ATOMIC_SEQ_CST )
+
+/* Adds to a counter that only one thread ever writes.  Readers on other threads still
+ * see whole values, but the writer avoids the cost of a locked read-modify-write. */
+#define JATOMIC_ADD_SINGLE_WRITER( ptr, val ) \
+    JATOMIC_STORE_RELAXED( (ptr), JATOMIC_LOAD_RELAXED( ptr ) + (val) )
+
+/** Handle of a thread started with JPlatformThreadCreate */
+typedef struct
+{
+#ifdef WIN32
+    HANDLE      handle;
+    unsigned    threadID;
+#else
+    pthread_t   threadID;
+#endif
+}
+JThread;
+
+/** Scheduling policy of a time critical thread */
+typedef enum
+{
+    JSCHED_NORMAL,      /* Time shared with every other thread */
+    JSCHED_FIFO,        /* Real-time, runs until it blocks or a higher priority runs */
+    JSCHED_RR           /* Real-time, takes turns with threads of the same priority */
+}
+JSchedPolicy;
+
+/** Lock for data shared between control threads and the producer side.  Never taken
+  * by the audio callback. */
+typedef struct
+{
+#ifdef WIN32
+    CRITICAL_SECTION    section;
+#else
+    pthread_mutex_t     mutex;
+#endif
+}
+JMutex;
+
+/** Auto-reset event: a signal wakes one wait, or the next wait if nobody is waiting */
+typedef struct
+{
+#ifdef WIN32
+    HANDLE      handle;
+#else
+    sem_t       semaphore;
+#endif
+}
+JEvent;
+
+/** @brief Starts a thread running routine
+  * @param thread Pointer to the handle to fill in
+  * @return 0 on success, non-zero on failure
+  */
+int JPlatformThreadCreate( JThread *thread, THREAD_ROUTINE_SIGNATURE (*routine)( void* ), void *arg );
+
+/** @brief Waits for a thread started with JPlatformThreadCreate to finish */
+void JPlatformThreadJoin( JThread *thread );
+
+/** @brief Lowers the priority of the calling thread, for background work that must
+  * not take time from playback */
+void JPlatformThreadSetBackground( void );
+
+/** @brief Gives the calling thread a real-time scheduling policy.  Linux only allows
+  * it with CAP_SYS_NICE or an RLIMIT_RTPRIO of at least priority, and the thread keeps
+  * its policy otherwise.  Both real-time policies are THREAD_PRIORITY_TIME_CRITICAL on
+  * Windows.
+  * @param priority From 1, the lowest, to 99.  Ignored on Windows.
+  * @return The policy the thread has afterwards
+  */
+JSchedPolicy JPlatformThreadSetRealtime( JSchedPolicy policy, int priority );
+
+/** @brief Pins the calling thread to one processor
+  * @return 0 on success, non-zero on failure or where it is not supported
+  */
+int JPlatformThreadSetAffinity( unsigned cpu );
+
+/** @brief Locks memory into RAM, so touching it never page faults.  Linux limits the
+  * memory an unprivileged process may lock with RLIMIT_MEMLOCK.
+  * @return 0 on success, non-zero on failure
+  */
+int JPlatformLockMemory( const void *address, size_t bytes );
+
+/** @brief Unlocks memory locked with JPlatformLockMemory */
+void JPlatformUnlockMemory( const void *address, size_t bytes );
+
+/** @brief Locks every page the process has mapped and will map into RAM.  Calls are
+  * counted, and each must be matched by JPlatformUnlockAllMemory.
+  * @return 0 on success, non-zero on failure or where it is not supported
+  */
+int JPlatformLockAllMemory( void );
+
+/** @brief Undoes JPlatformLockAllMemory once every call to it has been matched.
+  * Regions locked with JPlatformLockMemory stay locked.
+  */
+void JPlatformUnlockAllMemory( void );
+
+/** @brief Allocates whole pages of zeroed memory, shared with no other allocation, so
+  * they can be locked and unlocked without touching anyone else's memory
+  * @return Page aligned memory, or NULL on failure
+  */
+void* JPlatformAllocPages( size_t bytes );
+
+/** @brief Frees memory allocated with JPlatformAllocPages
+  * @param bytes The size it was allocated with
+  */
+void JPlatformFreePages( void *address, size_t bytes );
+
+/** @brief Initializes a mutex
+  * @return 0 on success, non-zero on failure
+  */
+int JPlatformMutexInit( JMutex *mutex );
+
+/** @brief Takes a mutex, waiting for another thread to release it if needed */
+void JPlatformMutexLock( JMutex *mutex );
+
+/** @brief Releases a mutex taken with JPlatformMutexLock */
+void JPlatformMutexUnlock( JMutex *mutex );
+
+/** @brief Frees a mutex initialized with JPlatformMutexInit */
+void JPlatformMutexDestroy( JMutex *mutex );
+
+/** @brief Initializes an event, not signalled
+  * @return 0 on success, non-zero on failure
+  */
+int JPlatformEventInit( JEvent *event );
+
+/** @brief Wakes a thread waiting on event.  Signals do not accumulate beyond the
+  * count of a semaphore, so waiters must recheck their condition. */
+void JPlatformEventSignal( JEvent *event );
+
+/** @brief Waits for event to be signalled
+  * @param timeoutMs Longest time to wait in milliseconds
+  */
+void JPlatformEventWait( JEvent *event, unsigned timeoutMs );
+
+/** @brief Frees an event initialized with JPlatformEventInit */
+void JPlatformEventDestroy( JEvent *event );
+
+/** @brief Returns a monotonic time stamp in nanoseconds */
+unsigned long long JPlatformGetTimeNs( void );
+
+/** @brief Returns the processor time the calling thread has used, in nanoseconds */
+unsigned long long JPlatformThreadGetCpuTimeNs( void );
+
+/** @brief Sleeps until the monotonic clock reaches deadlineNs
+  * @param deadlineNs Absolute time as returned by JPlatformGetTimeNs
+  */
+void JPlatformSleepUntilNs( unsigned long long deadlineNs );
+
+/** @brief Gives up the rest of the calling thread's time slice */
+void JPlatformYield( void );
+
+/** @brief Returns the number of processors available to the program, at least 1 */
+unsigned JPlatformGetProcessorCount( void );
+
+#endif // JPLATFORM_H_INCLUDED
@@ -0,0 +1,122 @@
+/* JPlayerDaemon.c Contains main routine of the headless J Audio Player
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+
+#include "JAudioPlayer.h"
+#include "JControlServer.h"
+
+static JControlServer *theServer = NULL;
+
+/* Lets SIGINT and SIGTERM close the socket and the sound device */
+static void stopServer( int signalNumber )
+{
+    (void)signalNumber;
+    if( theServer != NULL )
+        JControlServerStop( theServer );
+    return;
+}
+
+int main( int argc, char* argv[] )
+{
+    JControlServer      *server;
+    JAudioEngine        *engine;
+    JAudioPlayerConfig  config;
+    const char          *socketPath = NULL;
+    int                 bPlay = FALSE;
+    int                 i;
+
+    JAudioPlayerGetDefaultConfig( &config );
+
+    for( i=1; i<argc && argv[i][0] == '-'; i++ )
+    {
+        if( strcmp( argv[i], "-i" ) == 0 )
+            config.bSaveSeekIndex = TRUE;
+        else if( strcmp( argv[i], "-p" ) == 0 )
+            bPlay = TRUE;
+        else if( strcmp( argv[i], "-a" ) == 0 && i + 1 < argc )
+            config.producerCpu = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-m" ) == 0 )
+            config.memoryLock = JMEMLOCK_ALL;
+        else
+            break;
+    }
+    if( i < argc && argv[i][0] != '-' )
+        socketPath = argv[i++];
+
+    if( socketPath == NULL )
+    {
+        printf( "ERROR: Not enough input arguments\n"
+                "Usage: %s [-i] [-p] [-a cpu] [-m] socket_path [audio_file...]\n"
+                "  -i  Save the seek index built for FLAC files next to them, as file.jseek\n"
+                "  -p  Start playing the first file straight away\n"
+                "  -a  Run the thread that reads the files on the given processor only\n"
+                "  -m  Lock all of the player's memory into RAM, not just the audio buffer\n"
+                "  The first file is loaded and the rest are queued after it.  Send help\n"
+                "  to the socket for the list of commands.\n", argv[0] );
+        return 1;
+    }
+
+    server = JControlServerCreate( socketPath, &config );
+    if( server == NULL )
+    {
+        printf( "Failed to create control server!\n" );
+        return 1;
+    }
+
+    /* Each load command replaces the player and its stream, but PortAudio stays
+     * initialized from one to the next */
+    engine = JAudioEngineAcquire();
+
+    if( i < argc )
+    {
+        if( JControlServerLoad( server, argv[i] ) )
+        {
+            printf( "Failed to create audio player!\n" );
+            JControlServerDestroy( &server );
+            JAudioEngineRelease( &engine );
+            return 1;
+        }
+        for( i++; i<argc; i++ )
+        {
+            if( JAudioPlayerEnqueue( server->player, argv[i] ) < 0 )
+                printf( "Failed to queue %s\n", argv[i] );
+        }
+        if( bPlay )
+            JAudioPlayerPlay( server->player );
+    }
+
+    theServer = server;
+    signal( SIGINT, stopServer );
+    signal( SIGTERM, stopServer );
+
+    printf( "Listening on %s\n", socketPath );
+    JControlServerRun( server );
+
+    theServer = NULL;
+    JControlServerDestroy( &server );
+    JAudioEngineRelease( &engine );
+    printf( "Control server destroyed\n" );
+
+    return 0;
+}
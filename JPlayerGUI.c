@@ -29,25 +29,29 @@ const SDL_Rect StopButtonPos = { 250, 125, 50, 50 };
 const SDL_Rect PlayButtonPos = { 100, 125, 50, 50 };
 const SDL_Rect PauseButtonPos = { 175, 125, 50, 50 };
 
+/* Places of the button and tracker images in the texture atlas.  Each button holds
+ * its unpressed image above its pressed one. */
+const SDL_Rect PlayButtonCell = { 0, 0, 50, 100 };
+const SDL_Rect PauseButtonCell = { 50, 0, 50, 100 };
+const SDL_Rect StopButtonCell = { 100, 0, 50, 100 };
+const SDL_Rect TrackerCell = { 150, 0, 13, 13 };
+#define ATLAS_WIDTH 163
+#define ATLAS_HEIGHT 100
+
+static SDL_Texture* createAtlas( SDL_Renderer *renderer );
+static void drawButton( JPlayerGUI *playerGUI, const SDL_Rect *cell, const SDL_Rect *position, int bPressed );
+static void drawWaveform( JPlayerGUI *playerGUI, float audioCompletion );
+
 JPlayerGUI* JPlayerGUICreate( void )
 {
     JPlayerGUI  *playerGUI = NULL;
 #ifdef WIN32
     const char  backgroundPath[] = "assets\\PlayerBackground.bmp";
-    const char  playButtonPath[] = "assets\\PlayButton.bmp";
-    const char  stopButtonPath[] = "assets\\StopButton.bmp";
-    const char  pauseButtonPath[] = "assets\\PauseButton.bmp";
-    const char  timeTrackerPath[] = "assets\\TimeTracker.bmp";
 #else
     const char  backgroundPath[] = "assets/PlayerBackground.bmp";
-    const char  playButtonPath[] = "assets/PlayButton.bmp";
-    const char  stopButtonPath[] = "assets/StopButton.bmp";
-    const char  pauseButtonPath[] = "assets/PauseButton.bmp";
-    const char  timeTrackerPath[] = "assets/TimeTracker.bmp";
 #endif
 
     SDL_Surface *BMPSurface = NULL;        /* Loaded BMP image */
-    SDL_Rect    trackerPos = { 44, 94, 13, 13 };
 
     playerGUI = (JPlayerGUI*)malloc( sizeof(JPlayerGUI) );
     if( playerGUI == NULL )
@@ -62,6 +66,8 @@ JPlayerGUI* JPlayerGUICreate( void )
 
     playerGUI->buttonState = NO_BUTTON_PRESSED;
     playerGUI->seekerEngaged = FALSE;
+    playerGUI->waveform = NULL;
+    playerGUI->bRedraw = TRUE;
 
     /* Create window */
     playerGUI->window = SDL_CreateWindow( "J Audio Player",
@@ -102,85 +108,14 @@ JPlayerGUI* JPlayerGUICreate( void )
         if( playerGUI->texture_background == NULL )
             printf( "  Warning: Unable to create background texture! SDL Error: %s\n", SDL_GetError() );
     }
-
-    /* Load three buttons and tracker textures */
-    /* Play Button */
-    SDL_FreeSurface( BMPSurface );
-    BMPSurface = SDL_LoadBMP( playButtonPath );
-    if( BMPSurface == NULL )
-    {
-        printf( "  Warning: Unable to load play button image!\n  SDL_LoadBMP Error: %s\n", SDL_GetError() );
-        playerGUI->texture_play = NULL;
-    }
-    else
-    {
-        playerGUI->texture_play = SDL_CreateTextureFromSurface( playerGUI->renderer, BMPSurface );
-        if( playerGUI->texture_play == NULL )
-            printf( "  Warning: Unable to create play button texture! SDL Error: %s\n", SDL_GetError() );
-    }
-
-    /* Stop Button */
     SDL_FreeSurface( BMPSurface );
-    BMPSurface = SDL_LoadBMP( stopButtonPath );
-    if( BMPSurface == NULL )
-    {
-        printf( "  Warning: Unable to load stop button image!\n  SDL_LoadBMP Error: %s\n", SDL_GetError() );
-        playerGUI->texture_stop = NULL;
-    }
-    else
-    {
-        playerGUI->texture_stop = SDL_CreateTextureFromSurface( playerGUI->renderer, BMPSurface );
-        if( playerGUI->texture_stop == NULL )
-            printf( "  Warning: Unable to create stop button texture! SDL Error: %s\n", SDL_GetError() );
-    }
-
-    /* Pause Button */
-    SDL_FreeSurface( BMPSurface );
-    BMPSurface = SDL_LoadBMP( pauseButtonPath );
-    if( BMPSurface == NULL )
-    {
-        printf( "  Warning: Unable to load pause button image!\n  SDL_LoadBMP Error: %s\n", SDL_GetError() );
-        playerGUI->texture_pause = NULL;
-    }
-    else
-    {
-        playerGUI->texture_pause = SDL_CreateTextureFromSurface( playerGUI->renderer, BMPSurface );
-        if( playerGUI->texture_pause == NULL )
-            printf( "  Warning: Unable to create pause button texture! SDL Error: %s\n", SDL_GetError() );
-    }
 
-    /* Time tracker */
-    SDL_FreeSurface( BMPSurface );
-    BMPSurface = SDL_LoadBMP( timeTrackerPath );
-    if( BMPSurface == NULL )
-    {
-        printf( "  Warning: Unable to load time tracker image!\n  SDL_LoadBMP Error: %s\n", SDL_GetError() );
-        playerGUI->texture_tracker = NULL;
-    }
-    else
-    {
-        playerGUI->texture_tracker = SDL_CreateTextureFromSurface( playerGUI->renderer, BMPSurface );
-        if( playerGUI->texture_tracker == NULL )
-            printf( "  Warning: Unable to create time tracker texture! SDL Error: %s\n", SDL_GetError() );
-    }
-    SDL_FreeSurface( BMPSurface );
+    /* Load three buttons and tracker into one texture */
+    playerGUI->texture_atlas = createAtlas( playerGUI->renderer );
 
     /* Draw audio player GUI */
     SDL_SetRenderDrawColor( playerGUI->renderer, 0xFF, 0xFF, 0xFF, 0xFF );
-    SDL_RenderClear( playerGUI->renderer );
-
-    if( SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_background, NULL, NULL ) < 0 )   /* background */
-        printf( "  ERRROR: There was an error copying background texture! SDL Error: %s\n", SDL_GetError() );
-    if( SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_play, &ButtonUnpressed, &PlayButtonPos ) < 0 )   /* play button */
-        printf( "  ERRROR: There was an error copying play button texture! SDL Error: %s\n", SDL_GetError() );
-    if( SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_stop, &ButtonUnpressed, &StopButtonPos ) < 0 )   /* stop button */
-        printf( "  ERRROR: There was an error copying stop button texture! SDL Error: %s\n", SDL_GetError() );
-    if( SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_pause, &ButtonUnpressed, &PauseButtonPos ) < 0 )   /* pause button */
-        printf( "  ERRROR: There was an error copying pause button texture! SDL Error: %s\n", SDL_GetError() );
-    if( SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_tracker, NULL, &trackerPos ) < 0 )   /* time tracker */
-        printf( "  ERRROR: There was an error copying time tracker texture! SDL Error: %s\n", SDL_GetError() );
-
-    SDL_RenderPresent( playerGUI->renderer );
+    JPlayerGUIDraw( playerGUI, 0.0 );
 
     return playerGUI;
 }
@@ -189,37 +124,40 @@ JPlayerGUI* JPlayerGUICreate( void )
 void JPlayerGUIDraw( JPlayerGUI *playerGUI, float audioCompletion )
 {
     SDL_Rect TrackerPos = { 44 + (int)(300.0 * audioCompletion), 94, 13, 13 };
+    unsigned long waveformProgress = 0;
 
-    SDL_RenderClear( playerGUI->renderer );
-    SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_background, NULL, NULL );
-    SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_tracker, NULL, &TrackerPos );
+    if( playerGUI->waveform != NULL )
+        waveformProgress = JWaveformGetProgress( playerGUI->waveform );
 
-    switch( playerGUI->buttonState )
-    {
-        case NO_BUTTON_PRESSED:
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_play, &ButtonUnpressed, &PlayButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_stop, &ButtonUnpressed, &StopButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_pause, &ButtonUnpressed, &PauseButtonPos );
-            break;
-        case PLAY_BUTTON_PRESSED:
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_play, &ButtonPressed, &PlayButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_stop, &ButtonUnpressed, &StopButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_pause, &ButtonUnpressed, &PauseButtonPos );
-            break;
-        case STOP_BUTTON_PRESSED:
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_play, &ButtonUnpressed, &PlayButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_stop, &ButtonPressed, &StopButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_pause, &ButtonUnpressed, &PauseButtonPos );
-            break;
-        case PAUSE_BUTTON_PRESSED:
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_play, &ButtonUnpressed, &PlayButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_stop, &ButtonUnpressed, &StopButtonPos );
-            SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_pause, &ButtonPressed, &PauseButtonPos );
-            break;
-    }
+    /* Skip the frame when nothing on screen would change */
+    if( !playerGUI->bRedraw &&
+        TrackerPos.x == playerGUI->drawnTrackerX &&
+        playerGUI->buttonState == playerGUI->drawnButtonState &&
+        playerGUI->waveform == playerGUI->drawnWaveform &&
+        waveformProgress == playerGUI->drawnWaveformProgress )
+        return;
+
+    /* The background covers the whole window */
+    if( playerGUI->texture_background != NULL )
+        SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_background, NULL, NULL );
+    else
+        SDL_RenderClear( playerGUI->renderer );
+    if( playerGUI->waveform != NULL )
+        drawWaveform( playerGUI, audioCompletion );
+    SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_atlas, &TrackerCell, &TrackerPos );
+
+    drawButton( playerGUI, &PlayButtonCell, &PlayButtonPos, playerGUI->buttonState == PLAY_BUTTON_PRESSED );
+    drawButton( playerGUI, &StopButtonCell, &StopButtonPos, playerGUI->buttonState == STOP_BUTTON_PRESSED );
+    drawButton( playerGUI, &PauseButtonCell, &PauseButtonPos, playerGUI->buttonState == PAUSE_BUTTON_PRESSED );
 
     SDL_RenderPresent( playerGUI->renderer );
 
+    playerGUI->bRedraw = FALSE;
+    playerGUI->drawnTrackerX = TrackerPos.x;
+    playerGUI->drawnButtonState = playerGUI->buttonState;
+    playerGUI->drawnWaveform = playerGUI->waveform;
+    playerGUI->drawnWaveformProgress = waveformProgress;
+
     return;
 }
 
@@ -250,11 +188,8 @@ void JPlayerGUIDestroy( JPlayerGUI **playerGUIPtr )
     if( playerGUI == NULL )
         return;
 
-    SDL_DestroyTexture( playerGUI->texture_tracker );
     SDL_DestroyTexture( playerGUI->texture_background );
-    SDL_DestroyTexture( playerGUI->texture_stop );
-    SDL_DestroyTexture( playerGUI->texture_play );
-    SDL_DestroyTexture( playerGUI->texture_pause );
+    SDL_DestroyTexture( playerGUI->texture_atlas );
     SDL_DestroyRenderer( playerGUI->renderer );
     SDL_DestroyWindow( playerGUI->window );
     SDL_Quit();
@@ -264,3 +199,99 @@ void JPlayerGUIDestroy( JPlayerGUI **playerGUIPtr )
 
     return;
 }
+
+
+/* Loads the button and tracker images into one texture, so that drawing the player
+ * does not switch textures for every image */
+static SDL_Texture* createAtlas( SDL_Renderer *renderer )
+{
+#ifdef WIN32
+    const char      *paths[4] = { "assets\\PlayButton.bmp", "assets\\PauseButton.bmp",
+                                  "assets\\StopButton.bmp", "assets\\TimeTracker.bmp" };
+#else
+    const char      *paths[4] = { "assets/PlayButton.bmp", "assets/PauseButton.bmp",
+                                  "assets/StopButton.bmp", "assets/TimeTracker.bmp" };
+#endif
+    const SDL_Rect  *cells[4] = { &PlayButtonCell, &PauseButtonCell, &StopButtonCell, &TrackerCell };
+    SDL_Surface     *atlasSurface, *BMPSurface;
+    SDL_Texture     *atlas;
+    SDL_Rect        cell;
+    int             i;
+
+    atlasSurface = SDL_CreateRGBSurface( 0, ATLAS_WIDTH, ATLAS_HEIGHT, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0 );
+    if( atlasSurface == NULL )
+    {
+        printf( "  Warning: Unable to create button surface! SDL Error: %s\n", SDL_GetError() );
+        return NULL;
+    }
+    SDL_FillRect( atlasSurface, NULL, 0 );
+
+    for( i=0; i<4; i++ )
+    {
+        BMPSurface = SDL_LoadBMP( paths[i] );
+        if( BMPSurface == NULL )
+        {
+            printf( "  Warning: Unable to load image %s!\n  SDL_LoadBMP Error: %s\n", paths[i], SDL_GetError() );
+            continue;
+        }
+        cell = *cells[i];
+        SDL_BlitSurface( BMPSurface, NULL, atlasSurface, &cell );
+        SDL_FreeSurface( BMPSurface );
+    }
+
+    atlas = SDL_CreateTextureFromSurface( renderer, atlasSurface );
+    if( atlas == NULL )
+        printf( "  Warning: Unable to create button texture! SDL Error: %s\n", SDL_GetError() );
+    SDL_FreeSurface( atlasSurface );
+    return atlas;
+}
+
+
+/* Copies the pressed or unpressed image of a button from the atlas */
+static void drawButton( JPlayerGUI *playerGUI, const SDL_Rect *cell, const SDL_Rect *position, int bPressed )
+{
+    SDL_Rect source = bPressed ? ButtonPressed : ButtonUnpressed;
+
+    source.x += cell->x;
+    source.y += cell->y;
+    SDL_RenderCopy( playerGUI->renderer, playerGUI->texture_atlas, &source, position );
+    return;
+}
+
+
+/* Draws the min to max range of each column of the waveform with its RMS level over
+ * it.  Only reads peaks the waveform workers have published, never the audio. */
+static void drawWaveform( JPlayerGUI *playerGUI, float audioCompletion )
+{
+    JPeak   columns[WAVEFORM_WIDTH];
+    int     x, top, bottom, halfRms, played = (int)( WAVEFORM_WIDTH * audioCompletion );
+    int     middle = WAVEFORM_Y + WAVEFORM_HEIGHT / 2, halfHeight = WAVEFORM_HEIGHT / 2;
+
+    if( JWaveformGetColumns( playerGUI->waveform, columns, WAVEFORM_WIDTH ) == 0 )
+        return;
+
+    for( x=0; x<WAVEFORM_WIDTH; x++ )
+    {
+        if( x < played )
+            SDL_SetRenderDrawColor( playerGUI->renderer, 0x60, 0x48, 0x30, 0xFF );
+        else
+            SDL_SetRenderDrawColor( playerGUI->renderer, 0x98, 0x80, 0x64, 0xFF );
+        top = middle - (int)( ( columns[x].max < 1.0f ? columns[x].max : 1.0f ) * halfHeight );
+        bottom = middle - (int)( ( columns[x].min > -1.0f ? columns[x].min : -1.0f ) * halfHeight );
+        SDL_RenderDrawLine( playerGUI->renderer, WAVEFORM_X + x, top, WAVEFORM_X + x, bottom );
+    }
+
+    SDL_SetRenderDrawColor( playerGUI->renderer, 0x40, 0x30, 0x20, 0xFF );
+    for( x=0; x<WAVEFORM_WIDTH; x++ )
+    {
+        halfRms = (int)( ( columns[x].rms < 1.0f ? columns[x].rms : 1.0f ) * halfHeight );
+        top = middle - halfRms;
+        bottom = middle + halfRms;
+        if( bottom > top )
+            SDL_RenderDrawLine( playerGUI->renderer, WAVEFORM_X + x, top, WAVEFORM_X + x, bottom );
+    }
+
+    /* SDL_RenderClear fills with the draw color */
+    SDL_SetRenderDrawColor( playerGUI->renderer, 0xFF, 0xFF, 0xFF, 0xFF );
+    return;
+}
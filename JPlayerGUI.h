@@ -27,6 +27,8 @@
 #include "SDL2/SDL.h"
 #endif
 
+#include "JWaveform.h"
+
 #ifndef TRUE
 #define TRUE 1
 #define FALSE 0
@@ -35,6 +37,13 @@
 #define WINDOW_HEIGHT 200
 #define WINDOW_WIDTH 400
 
+/* Area above the time track the waveform is drawn in, one column per position of
+ * the time tracker */
+#define WAVEFORM_X 50
+#define WAVEFORM_Y 15
+#define WAVEFORM_WIDTH 300
+#define WAVEFORM_HEIGHT 70
+
 /** An enumerated type to be used in JPlayerGUIDraw to show which button has been pressed
   * @see JPlayerGUIDraw
   */
@@ -64,19 +73,29 @@ typedef struct
     SDL_Window      *window;          /* The window to be rendered to */
     SDL_Renderer    *renderer;        /* Texture Renderer */
     SDL_Texture     *texture_background;
-    SDL_Texture     *texture_play;
-    SDL_Texture     *texture_stop;
-    SDL_Texture     *texture_pause;
-    SDL_Texture     *texture_tracker;
+    SDL_Texture     *texture_atlas;   /* Buttons and time tracker */
 
     JPlayerGUIButtonState   buttonState;    /* Which button, if any, is down */
     int                     seekerEngaged;  /* Is the user moving the seeker */
+    JWaveform               *waveform;      /* Drawn above the track when not NULL,
+                                             * owned by the caller */
+    int                     bRedraw;        /* Draw the next frame even if nothing changed,
+                                             * e.g. after the window was uncovered */
+
+    /* What the window shows, JPlayerGUIDraw only draws when one of these changes */
+    int                     drawnTrackerX;
+    JPlayerGUIButtonState   drawnButtonState;
+    JWaveform               *drawnWaveform;
+    unsigned long           drawnWaveformProgress;
 }
 JPlayerGUI;
 
 /** Constant SDL_rect types idenitfying placement of buttons */
 extern const SDL_Rect ButtonUnpressed, ButtonPressed, StopButtonPos, PlayButtonPos, PauseButtonPos;
 
+/** Constant SDL_rect types identifying the images in the texture atlas */
+extern const SDL_Rect PlayButtonCell, PauseButtonCell, StopButtonCell, TrackerCell;
+
 /** @brief Initializes the GUI using SDL.  This function initializes the SDL library,
   * allowing the use of other SDL functions after JPlayerGUICreate is called.
   * JPlayerGUIDestroy must be called to free resources and quit the SDL library.
@@ -84,12 +103,14 @@ extern const SDL_Rect ButtonUnpressed, ButtonPressed, StopButtonPos, PlayButtonP
   */
 JPlayerGUI* JPlayerGUICreate( void );
 
-/** @brief Renders the audio player GUI
+/** @brief Renders the audio player GUI.  Nothing is drawn unless the tracker moved by
+  * a pixel, a button changed, the waveform gained detail or bRedraw is set.
   * @param playerGUI Pointer to an initialized JPlayerGUI object
   * @param buttonState A value from enumerated type JPlayerGUIButtonState showing
   * which button is pressed on the player
   * @param audioCompletion A float from 0.0 to 1.0 indicating how much of an audio
   * file has been played, which will determine the placement of the time tracker
+  * and how much of the waveform is shown as played
   */
 void JPlayerGUIDraw( JPlayerGUI *playerGUI, float audioCompletion );
 
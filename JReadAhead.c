@@ -0,0 +1,602 @@
+/* JReadAhead.c Source file for the read-ahead stage between a file and its decoder
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#endif
+
+#include "JReadAhead.h"
+
+/* Ring used before the I/O thread is started, enough to buffer like stdio */
+#define UNSTARTED_BYTES ( 2 * JREADAHEAD_CHUNK_BYTES )
+
+static JReadAhead* initRing( JReadAhead *reader );
+static void closeInput( JReadAhead *reader );
+static THREAD_ROUTINE_SIGNATURE readAheadThread( void *threadArg );
+static int fillStep( JReadAhead *reader );
+static long long readAt( JReadAhead *reader, unsigned char *dest, size_t bytes, sf_count_t offset );
+static long long readStream( JReadAhead *reader, unsigned char *dest, size_t bytes );
+static void releaseHistory( JReadAhead *reader );
+static void adviseWillNeed( JReadAhead *reader, sf_count_t offset );
+static void updateMax( unsigned long long *max, unsigned long long value );
+static int isCancelled( const JReadAhead *reader );
+
+
+JReadAhead* JReadAheadOpen( const char *filePath )
+{
+    JReadAhead *reader = NULL;
+#ifdef WIN32
+    struct _stati64 fileStat;
+#else
+    struct stat fileStat;
+#endif
+
+    reader = (JReadAhead*)calloc( 1, sizeof(JReadAhead) );
+    if( reader == NULL )
+        return NULL;
+
+#ifdef WIN32
+    if( strcmp( filePath, "-" ) == 0 )
+    {
+        if( ( reader->fd = _dup( _fileno( stdin ) ) ) >= 0 )
+            _setmode( reader->fd, _O_BINARY );
+    }
+    else
+        reader->fd = _open( filePath, _O_RDONLY | _O_BINARY | _O_SEQUENTIAL );
+    if( reader->fd < 0 || _fstati64( reader->fd, &fileStat ) < 0 )
+#else
+    reader->fd = strcmp( filePath, "-" ) == 0 ? dup( STDIN_FILENO ) : open( filePath, O_RDONLY );
+    if( reader->fd < 0 || fstat( reader->fd, &fileStat ) < 0 )
+#endif
+    {
+        if( reader->fd >= 0 )
+            close( reader->fd );
+        free( reader );
+        return NULL;
+    }
+
+    /* Pipes and terminals can only be read through once */
+    if( ( fileStat.st_mode & S_IFMT ) != S_IFREG )
+    {
+        reader->bStream = TRUE;
+        reader->fileSize = JREADAHEAD_UNKNOWN_LENGTH;
+    }
+    else
+    {
+        reader->fileSize = (sf_count_t)fileStat.st_size;
+#if !defined(WIN32) && defined(POSIX_FADV_SEQUENTIAL)
+        posix_fadvise( reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+    }
+    return initRing( reader );
+}
+
+
+JReadAhead* JReadAheadOpenSource( const JByteSource *source )
+{
+    JReadAhead *reader = NULL;
+
+    reader = (JReadAhead*)calloc( 1, sizeof(JReadAhead) );
+    if( reader == NULL )
+    {
+        if( source->close != NULL )
+            source->close( source->userData );
+        return NULL;
+    }
+    reader->fd = -1;
+    reader->source = *source;
+    reader->bStream = TRUE;
+    reader->fileSize = JREADAHEAD_UNKNOWN_LENGTH;
+    return initRing( reader );
+}
+
+
+int JReadAheadStart( JReadAhead *reader, size_t bytes, JReadAheadCounters *counters )
+{
+    unsigned char *data;
+    size_t capacity, n;
+    sf_count_t offset;
+
+    if( reader->bRunning )
+        return 0;
+
+    if( bytes < JREADAHEAD_MIN_BYTES )
+        bytes = JREADAHEAD_MIN_BYTES;
+    if( bytes > JREADAHEAD_MAX_BYTES )
+        bytes = JREADAHEAD_MAX_BYTES;
+    for( capacity = 1; capacity < bytes; capacity <<= 1 );
+
+    /* Nothing else touches the ring until the thread starts, so it is replaced
+     * outright.  The bytes held are moved to where the bigger ring keeps them, as a
+     * stream could not read them again. */
+    data = (unsigned char*)malloc( capacity );
+    if( data == NULL )
+    {
+        printf( "  Error using malloc\n" );
+        return -1;
+    }
+    for( offset = reader->windowStart; offset < reader->fillEnd; offset += n )
+    {
+        const size_t from = (size_t)( offset & ( reader->capacity - 1 ) );
+        const size_t to = (size_t)( offset & ( capacity - 1 ) );
+
+        n = (size_t)( reader->fillEnd - offset );
+        if( n > reader->capacity - from )
+            n = reader->capacity - from;
+        if( n > capacity - to )
+            n = capacity - to;
+        memcpy( data + to, reader->data + from, n );
+    }
+    free( reader->data );
+    reader->data = data;
+    reader->capacity = capacity;
+    reader->historyBytes = capacity / 8;
+    if( counters != NULL )
+        reader->counters = counters;
+
+    if( JPlatformEventInit( &reader->dataEvent ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        return -1;
+    }
+    if( JPlatformEventInit( &reader->spaceEvent ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        JPlatformEventDestroy( &reader->dataEvent );
+        return -1;
+    }
+    adviseWillNeed( reader, reader->position );
+    reader->bTimeToQuit = FALSE;
+    reader->bRunning = TRUE;
+    if( JPlatformThreadCreate( &reader->thread, readAheadThread, reader ) )
+    {
+        printf( "  Error creating read-ahead thread\n" );
+        reader->bRunning = FALSE;
+        JPlatformEventDestroy( &reader->spaceEvent );
+        JPlatformEventDestroy( &reader->dataEvent );
+        return -1;
+    }
+    return 0;
+}
+
+
+sf_count_t JReadAheadRead( JReadAhead *reader, void *dest, sf_count_t bytes )
+{
+    JReadAheadCounters *counters = reader->counters;
+    unsigned char   *out = (unsigned char*)dest;
+    sf_count_t      done = 0, available;
+    unsigned long long stallStartNs = 0;
+    int             bEnd, bSignal, bUnreachable;
+
+    if( bytes > reader->fileSize - reader->position )
+        bytes = reader->fileSize - reader->position;
+
+    while( done < bytes )
+    {
+        bSignal = FALSE;
+        bUnreachable = FALSE;
+        JPlatformMutexLock( &reader->lock );
+        if( reader->bReset )
+            reader->resetOffset = reader->position;     /* Sought again before the reset */
+        else if( reader->position < reader->windowStart || reader->position > reader->fillEnd )
+        {
+            /* A stream is only skipped through up to a ring ahead, so a parser looking
+             * for a chunk past the end of the audio finds nothing instead of reading
+             * all of it */
+            if( reader->bStream && ( reader->bEnd || reader->position - reader->fillEnd > (sf_count_t)reader->capacity ) )
+                bUnreachable = TRUE;
+            else
+            {
+                /* Outside the bytes held, start the ring again from the cursor */
+                reader->bReset = TRUE;
+                reader->resetOffset = reader->position;
+                bSignal = reader->bFillerWaiting;
+                reader->bFillerWaiting = FALSE;
+                if( !reader->bStream )
+                    JATOMIC_ADD_RELAXED( &counters->refetches, 1 );
+            }
+        }
+        available = ( reader->bReset || bUnreachable ) ? 0 : reader->fillEnd - reader->position;
+        bEnd = ( reader->bEnd && !reader->bReset ) || bUnreachable;
+        if( available == 0 && !bEnd && reader->bRunning )
+            reader->bReaderWaiting = TRUE;
+        JPlatformMutexUnlock( &reader->lock );
+        if( bSignal )
+            JPlatformEventSignal( &reader->spaceEvent );
+
+        if( available > 0 )
+        {
+            const size_t ringOffset = (size_t)( reader->position & ( reader->capacity - 1 ) );
+            size_t n = (size_t)( available < bytes - done ? available : bytes - done );
+            size_t first = n < reader->capacity - ringOffset ? n : reader->capacity - ringOffset;
+
+            memcpy( out + done, reader->data + ringOffset, first );
+            memcpy( out + done + first, reader->data, n - first );
+            done += n;
+            reader->position += n;
+            releaseHistory( reader );
+            continue;
+        }
+        if( bEnd )
+            break;
+
+        if( !reader->bRunning )
+        {
+            /* Without the thread the reader fills the ring itself */
+            if( !fillStep( reader ) )
+                break;
+            continue;
+        }
+        if( isCancelled( reader ) )
+            break;
+        if( stallStartNs == 0 )
+            stallStartNs = JPlatformGetTimeNs();
+        JPlatformEventWait( &reader->dataEvent, 100 );
+    }
+
+    if( stallStartNs != 0 )
+    {
+        const unsigned long long stallNs = JPlatformGetTimeNs() - stallStartNs;
+
+        JATOMIC_ADD_RELAXED( &counters->stalls, 1 );
+        JATOMIC_ADD_RELAXED( &counters->stallNsTotal, stallNs );
+        updateMax( &counters->stallNsMax, stallNs );
+    }
+    return done;
+}
+
+
+sf_count_t JReadAheadSeek( JReadAhead *reader, sf_count_t offset, int whence )
+{
+    switch( whence )
+    {
+        case SEEK_SET:  break;
+        case SEEK_CUR:  offset += reader->position; break;
+        case SEEK_END:  offset += reader->fileSize; break;
+        default:        return -1;
+    }
+    if( offset < 0 || ( reader->bStream && whence == SEEK_END ) )
+        return -1;
+
+    if( reader->bStream )
+    {
+        /* The I/O thread may be skipping forward, in which case it is told the new
+         * target before it can drop what the cursor now points at */
+        JPlatformMutexLock( &reader->lock );
+        if( offset < reader->windowStart )
+        {
+            JPlatformMutexUnlock( &reader->lock );
+            return -1;
+        }
+        if( reader->bReset )
+            reader->resetOffset = offset;
+        JPlatformMutexUnlock( &reader->lock );
+    }
+    reader->position = offset;
+    return offset;
+}
+
+
+void JReadAheadSetCancelFlag( JReadAhead *reader, const volatile int *bCancel )
+{
+    reader->bCancel = bCancel;
+    return;
+}
+
+
+sf_count_t JReadAheadTell( const JReadAhead *reader )
+{
+    return reader->position;
+}
+
+
+sf_count_t JReadAheadLength( const JReadAhead *reader )
+{
+    return reader->fileSize;
+}
+
+
+int JReadAheadIsSeekable( const JReadAhead *reader )
+{
+    return !reader->bStream;
+}
+
+
+void JReadAheadClose( JReadAhead **readerPtr )
+{
+    JReadAhead *reader = *readerPtr;
+
+    if( reader == NULL )
+        return;
+
+    if( reader->bRunning )
+    {
+        reader->bTimeToQuit = TRUE;
+        JPlatformEventSignal( &reader->spaceEvent );
+        JPlatformThreadJoin( &reader->thread );
+        JPlatformEventDestroy( &reader->spaceEvent );
+        JPlatformEventDestroy( &reader->dataEvent );
+    }
+    JPlatformMutexDestroy( &reader->lock );
+    closeInput( reader );
+    free( reader->data );
+    free( reader );
+    *readerPtr = NULL;
+
+    return;
+}
+
+
+/* Allocates the ring used before the I/O thread is started.  On failure the input
+ * is closed and reader freed. */
+static JReadAhead* initRing( JReadAhead *reader )
+{
+    reader->counters = &reader->ownCounters;
+    reader->capacity = UNSTARTED_BYTES;
+    reader->historyBytes = reader->capacity / 4;
+    reader->data = (unsigned char*)malloc( reader->capacity );
+    if( reader->data == NULL )
+    {
+        printf( "  Error using malloc\n" );
+        closeInput( reader );
+        free( reader );
+        return NULL;
+    }
+
+    if( JPlatformMutexInit( &reader->lock ) )
+    {
+        printf( "  Error: Cannot create synchronization object\n" );
+        free( reader->data );
+        closeInput( reader );
+        free( reader );
+        return NULL;
+    }
+    return reader;
+}
+
+
+static void closeInput( JReadAhead *reader )
+{
+    if( reader->fd >= 0 )
+        close( reader->fd );
+    if( reader->source.close != NULL )
+        reader->source.close( reader->source.userData );
+    return;
+}
+
+
+/* Keeps the ring filled ahead of the reader until it is closed */
+static THREAD_ROUTINE_SIGNATURE readAheadThread( void *threadArg )
+{
+    JReadAhead *reader = (JReadAhead*)threadArg;
+
+    /* A reader started by the real-time producer would inherit its policy, which
+     * waiting on the disk has no use for */
+    JPlatformThreadSetRealtime( JSCHED_NORMAL, 0 );
+
+    while( !reader->bTimeToQuit )
+    {
+        if( !fillStep( reader ) )
+            JPlatformEventWait( &reader->spaceEvent, 1000 );
+    }
+    return 0;
+}
+
+
+/* Applies a reset the reader asked for, then reads the next chunk after fillEnd if
+ * there is room for all of it.  Returns FALSE if there was nothing to do, after
+ * marking the I/O thread as waiting for room.  Called by the I/O thread, or by the
+ * reader before the thread is started. */
+static int fillStep( JReadAhead *reader )
+{
+    JReadAheadCounters *counters = reader->counters;
+    sf_count_t      offset;
+    size_t          bytes, ringOffset;
+    long long       bytesRead;
+    unsigned long long readNs;
+    int             bReset, bSignal;
+
+    JPlatformMutexLock( &reader->lock );
+    if( ( bReset = reader->bReset ) && !reader->bStream )
+    {
+        reader->windowStart = reader->fillEnd = reader->resetOffset;
+        reader->bReset = FALSE;
+        reader->bEnd = FALSE;
+    }
+    else if( bReset && ( reader->resetOffset <= reader->fillEnd || reader->bEnd ) )
+        reader->bReset = FALSE;         /* Sought back into the ring, or nothing left to skip */
+    else if( bReset )
+        reader->windowStart = reader->fillEnd;  /* Skipping a stream, nothing held is wanted */
+    offset = reader->fillEnd;
+
+    /* Wait for room for a whole chunk, unless the file ends sooner.  A stream being
+     * skipped is read up to the target, so reading stops on it if it is a pipe. */
+    bytes = JREADAHEAD_CHUNK_BYTES;
+    if( offset >= reader->fileSize || reader->bEnd )
+        bytes = 0;
+    else if( (sf_count_t)bytes > reader->fileSize - offset )
+        bytes = (size_t)( reader->fileSize - offset );
+    if( reader->bReset && (sf_count_t)bytes > reader->resetOffset - offset )
+        bytes = (size_t)( reader->resetOffset - offset );
+    if( bytes == 0 || (sf_count_t)reader->capacity - ( offset - reader->windowStart ) < (sf_count_t)bytes )
+    {
+        reader->bFillerWaiting = reader->bRunning;
+        JPlatformMutexUnlock( &reader->lock );
+        if( bReset )
+            adviseWillNeed( reader, offset );
+        return bReset;
+    }
+    JPlatformMutexUnlock( &reader->lock );
+
+    if( bReset )
+        adviseWillNeed( reader, offset );
+    ringOffset = (size_t)( offset & ( reader->capacity - 1 ) );
+    if( bytes > reader->capacity - ringOffset )
+        bytes = reader->capacity - ringOffset;
+
+    readNs = JPlatformGetTimeNs();
+    bytesRead = readAt( reader, reader->data + ringOffset, bytes, offset );
+    readNs = JPlatformGetTimeNs() - readNs;
+    JATOMIC_ADD_RELAXED( &counters->reads, 1 );
+    JATOMIC_ADD_RELAXED( &counters->readNsTotal, readNs );
+    updateMax( &counters->readNsMax, readNs );
+    if( bytesRead > 0 )
+        JATOMIC_ADD_RELAXED( &counters->bytesRead, (unsigned long long)bytesRead );
+
+    /* A reset asked for during the read makes what was read from a file useless.
+     * Nothing moves the end of a stream but this thread. */
+    JPlatformMutexLock( &reader->lock );
+    if( ( !reader->bReset || reader->bStream ) && reader->fillEnd == offset )
+    {
+        if( bytesRead > 0 )
+            reader->fillEnd += bytesRead;
+        else
+            reader->bEnd = TRUE;
+    }
+    if( reader->bStream && reader->bReset && ( reader->bEnd || reader->fillEnd >= reader->resetOffset ) )
+        reader->bReset = FALSE;
+    bSignal = reader->bReaderWaiting;
+    reader->bReaderWaiting = FALSE;
+    JPlatformMutexUnlock( &reader->lock );
+    if( bSignal )
+        JPlatformEventSignal( &reader->dataEvent );
+    return TRUE;
+}
+
+
+/* Reads bytes at offset without moving any cursor the reader relies on.  Only ever
+ * called by one thread at a time.  Returns the bytes read, or -1 on error. */
+static long long readAt( JReadAhead *reader, unsigned char *dest, size_t bytes, sf_count_t offset )
+{
+    if( reader->bStream )
+        return readStream( reader, dest, bytes );
+#ifdef WIN32
+    if( _lseeki64( reader->fd, offset, SEEK_SET ) < 0 )
+        return -1;
+    return _read( reader->fd, dest, (unsigned)bytes );
+#else
+    ssize_t bytesRead;
+
+    while( ( bytesRead = pread( reader->fd, dest, bytes, (off_t)offset ) ) < 0 && errno == EINTR );
+    return bytesRead;
+#endif
+}
+
+
+/* Reads whatever a stream has ready, up to bytes, waiting for at least one.  A pipe
+ * is polled so that closing or cancelling the reader is not held up by a writer gone
+ * quiet.
+ * Returns the bytes read, 0 at the end of the stream, or -1 on error or when the
+ * reader is being closed. */
+static long long readStream( JReadAhead *reader, unsigned char *dest, size_t bytes )
+{
+#ifndef WIN32
+    struct pollfd pollFd;
+    ssize_t bytesRead;
+    int ready;
+#endif
+
+    if( reader->source.read != NULL )
+        return reader->source.read( reader->source.userData, dest, bytes );
+
+#ifdef WIN32
+    return _read( reader->fd, dest, (unsigned)bytes );
+#else
+    pollFd.fd = reader->fd;
+    pollFd.events = POLLIN;
+    while( !reader->bTimeToQuit && !isCancelled( reader ) )
+    {
+        /* Ready covers the writer hanging up, which read reports as the end */
+        ready = poll( &pollFd, 1, 100 );
+        if( ready == 0 || ( ready < 0 && errno == EINTR ) )
+            continue;
+        while( ( bytesRead = read( reader->fd, dest, bytes ) ) < 0 && errno == EINTR );
+        return bytesRead;
+    }
+    return -1;
+#endif
+}
+
+
+/* Lets the I/O thread reuse bytes more than historyBytes behind the cursor */
+static void releaseHistory( JReadAhead *reader )
+{
+    int bSignal = FALSE;
+
+    JPlatformMutexLock( &reader->lock );
+    if( !reader->bReset && reader->position - (sf_count_t)reader->historyBytes > reader->windowStart )
+    {
+        reader->windowStart = reader->position - (sf_count_t)reader->historyBytes;
+        if( reader->bFillerWaiting && (sf_count_t)reader->capacity - ( reader->fillEnd - reader->windowStart ) >= JREADAHEAD_CHUNK_BYTES )
+        {
+            reader->bFillerWaiting = FALSE;
+            bSignal = TRUE;
+        }
+    }
+    JPlatformMutexUnlock( &reader->lock );
+    if( bSignal )
+        JPlatformEventSignal( &reader->spaceEvent );
+    return;
+}
+
+
+/* Asks the kernel to start reading what the ring will be filled with next */
+static void adviseWillNeed( JReadAhead *reader, sf_count_t offset )
+{
+#if !defined(WIN32) && defined(POSIX_FADV_WILLNEED)
+    if( !reader->bStream )
+        posix_fadvise( reader->fd, (off_t)offset, (off_t)reader->capacity, POSIX_FADV_WILLNEED );
+#else
+    (void)reader;
+    (void)offset;
+#endif
+    return;
+}
+
+
+/* Raises a maximum that more than one thread may update */
+static void updateMax( unsigned long long *max, unsigned long long value )
+{
+    unsigned long long current = JATOMIC_LOAD_RELAXED( max );
+
+    while( value > current &&
+           !__atomic_compare_exchange_n( max, &current, value, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+    return;
+}
+
+
+/* TRUE once the owner of the reader has given up on waiting for the stream */
+static int isCancelled( const JReadAhead *reader )
+{
+    return reader->bCancel != NULL && *reader->bCancel;
+}
@@ -0,0 +1,175 @@
+/* JReadAhead.h Header file for the read-ahead stage between a file and its decoder
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JREADAHEAD_H_INCLUDED
+#define JREADAHEAD_H_INCLUDED
+
+#include <stdio.h>
+
+#include "sndfile.h"
+
+#include "JPlatform.h"
+
+#define JREADAHEAD_CHUNK_BYTES ( 64 << 10 )     /* Most bytes read from the file at once */
+#define JREADAHEAD_MIN_BYTES ( 4 * JREADAHEAD_CHUNK_BYTES )
+#define JREADAHEAD_MAX_BYTES ( 64 << 20 )
+#define JREADAHEAD_UNKNOWN_LENGTH SF_COUNT_MAX    /* Length of a stream */
+
+/** Counters of the reads made for one or more readers.  Several I/O threads and
+  * readers may add to the same counters, so they are only changed with atomic adds.
+  */
+typedef struct
+{
+    unsigned long long  bytesRead;      /* Read from files by the I/O threads */
+    unsigned long       reads;
+    unsigned long long  readNsTotal;    /* Time spent in read calls */
+    unsigned long long  readNsMax;
+    unsigned long       stalls;         /* Reads that had to wait for the I/O thread */
+    unsigned long long  stallNsTotal;
+    unsigned long long  stallNsMax;
+    unsigned long       refetches;      /* Seeks outside the bytes held in memory */
+}
+JReadAheadCounters;
+
+/** Bytes handed over by the application rather than read from a file, such as the
+  * output of a decoder or generator upstream in the same process.  They can only be
+  * read once, from the start to the end.
+  */
+typedef struct
+{
+    /** Copies up to bytes into dest, waiting until at least one is ready.  Returns the
+      * number copied, 0 at the end of the stream or -1 on error.  Called by one thread
+      * at a time, which is the I/O thread once read-ahead has started, and closing the
+      * reader waits for a call in progress to return. */
+    long long   (*read)( void *userData, void *dest, size_t bytes );
+    /** Called once the reader is closed, NULL if nothing needs doing */
+    void        (*close)( void *userData );
+    void        *userData;
+}
+JByteSource;
+
+/** Byte ring between a file and whatever parses it.  Once started, an I/O thread
+  * keeps the ring filled from the reader's cursor onwards, so the reader only waits
+  * for the disk when the I/O thread has fallen behind or after a seek outside the
+  * bytes held.  Before it is started the reader fills the ring itself, which makes it
+  * a plain buffered file.  Everything below lock is protected by it; the bytes between
+  * windowStart and fillEnd are read without it, as only a reset requested by the
+  * reader itself lets the I/O thread write over them.
+  * A stream, read from a pipe or a JByteSource, cannot be read twice.  Seeking one
+  * back only works within the bytes still held, which is there for the decoder's
+  * header parsing; the player refuses every backward seek in a stream.  Seeking it
+  * forward is done by reading up to the target and dropping what was read.
+  */
+typedef struct
+{
+    /* Set up in JReadAheadOpen and JReadAheadStart, read-only while the thread runs */
+    int             fd;                 /* -1 when reading source */
+    JByteSource     source;
+    int             bStream;            /* Bytes can only be read in order */
+    sf_count_t      fileSize;           /* JREADAHEAD_UNKNOWN_LENGTH for a stream */
+    unsigned char   *data;
+    size_t          capacity;           /* Bytes in data, a power of two */
+    size_t          historyBytes;       /* Bytes kept behind the cursor for the short
+                                         * seeks back header parsing makes */
+
+    sf_count_t      position;           /* Cursor of the reader, only used by it */
+
+    JMutex          lock;
+    sf_count_t      windowStart;        /* File offset of the oldest byte held */
+    sf_count_t      fillEnd;            /* File offset after the newest byte held */
+    sf_count_t      resetOffset;        /* Where the reader wants the ring to restart */
+    int             bReset;
+    int             bEnd;               /* Reading at fillEnd failed or found no more */
+    int             bReaderWaiting;     /* Each side sets its flag before waiting on */
+    int             bFillerWaiting;     /* its event, so the other only signals then */
+
+    JThread         thread;
+    JEvent          dataEvent;          /* Bytes were added or the ring was reset */
+    JEvent          spaceEvent;         /* Room was freed or a reset was requested */
+    int             bRunning;
+    volatile int    bTimeToQuit;
+
+    const volatile int *bCancel;        /* Set by the owner to stop waiting for data */
+    JReadAheadCounters *counters;       /* Points at ownCounters unless shared */
+    JReadAheadCounters ownCounters;
+}
+JReadAhead;
+
+/** @brief Opens a file to be read through a ring, without starting the I/O thread.
+  * JReadAheadClose must be called to free resources allocated by JReadAheadOpen.
+  * @param filePath Path of the file.  Pipes and other files that are not regular
+  * files are read as streams, and "-" reads standard input.
+  * @return Pointer to a JReadAhead, returns NULL on failure
+  */
+JReadAhead* JReadAheadOpen( const char *filePath );
+
+/** @brief Same as JReadAheadOpen for a stream of bytes from the application
+  * @param source Routines to read the stream with, copied.  source->close is called
+  * when the reader is closed, or before returning if opening fails.
+  * @return Pointer to a JReadAhead, returns NULL on failure
+  */
+JReadAhead* JReadAheadOpenSource( const JByteSource *source );
+
+/** @brief Grows the ring to bytes and starts the I/O thread filling it
+  * @param bytes Bytes to read ahead, rounded up to a power of two and kept between
+  * JREADAHEAD_MIN_BYTES and JREADAHEAD_MAX_BYTES
+  * @param counters Counters to add to instead of the reader's own, or NULL
+  * @return 0 on success, non-zero on failure, after which reads carry on without
+  * the thread
+  */
+int JReadAheadStart( JReadAhead *reader, size_t bytes, JReadAheadCounters *counters );
+
+/** @brief Copies bytes from the cursor, waiting for the I/O thread if they have not
+  * been read yet
+  * @return Number of bytes copied, less than bytes at the end of the file or on error
+  */
+sf_count_t JReadAheadRead( JReadAhead *reader, void *dest, sf_count_t bytes );
+
+/** @brief Moves the cursor, with the same arguments as fseek.  No data is read
+  * until the next JReadAheadRead.  A stream cannot be sought from its end or back
+  * past the bytes still held, and reading it more than the size of the ring past
+  * what has been read so far finds no data rather than skipping that far.
+  * @return New offset of the cursor, or -1 on failure
+  */
+sf_count_t JReadAheadSeek( JReadAhead *reader, sf_count_t offset, int whence );
+
+/** @brief Makes reads stop waiting for a stream once *bCancel is set, so that a
+  * thread blocked on a writer gone quiet can be joined.  A read cancelled this way
+  * returns what it has, as at the end of the file.
+  * @param bCancel Flag watched by the reader and its I/O thread, or NULL for none
+  */
+void JReadAheadSetCancelFlag( JReadAhead *reader, const volatile int *bCancel );
+
+/** @brief Returns the offset of the cursor */
+sf_count_t JReadAheadTell( const JReadAhead *reader );
+
+/** @brief Returns the size of the file in bytes, JREADAHEAD_UNKNOWN_LENGTH for a
+  * stream */
+sf_count_t JReadAheadLength( const JReadAhead *reader );
+
+/** @brief Returns TRUE if the reader can go back to any offset, FALSE for a stream */
+int JReadAheadIsSeekable( const JReadAhead *reader );
+
+/** @brief Stops the I/O thread and closes the file
+  * @param readerPtr Pointer to a pointer to a JReadAhead, set to NULL after closing
+  */
+void JReadAheadClose( JReadAhead **readerPtr );
+
+#endif // JREADAHEAD_H_INCLUDED
@@ -0,0 +1,338 @@
+/* JResampler.c Contains routines for sample rate conversion
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "JResampler.h"
+#include "JPlatform.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JRESAMPLE_X86
+#include <immintrin.h>
+#define TARGET_SSE __attribute__(( target( "sse" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2,fma" ) ))
+#endif
+
+#define MAX_PHASES 1024
+#define VECTOR_FLOATS 8                 /* Filters are padded to the widest vector */
+#define HISTORY_FRAMES 4096             /* Input frames taken per call at most */
+
+typedef float (*JDotProduct)( const float *a, const float *b, unsigned length );
+
+static float dotScalar( const float *a, const float *b, unsigned length );
+
+static JDotProduct dotProduct = dotScalar;
+static const char *dotProductName = "scalar";
+
+#ifdef JRESAMPLE_X86
+static float dotSSE( const float *a, const float *b, unsigned length );
+static float dotAVX2( const float *a, const float *b, unsigned length );
+#endif
+
+static void selectKernel( void );
+static double besselI0( double x );
+static unsigned long gcd( unsigned long a, unsigned long b );
+
+
+JResampler* JResamplerCreate( int channels, double inputRate, double outputRate, JResampleQuality quality )
+{
+    static const unsigned baseTaps[] = { 16, 32, 64 };
+    static const double beta[] = { 6.0, 8.0, 10.0 };
+    static const double rolloff[] = { 0.90, 0.94, 0.97 };
+    JResampler  *resampler = NULL;
+    unsigned long inRate = (unsigned long)( inputRate + 0.5 );
+    unsigned long outRate = (unsigned long)( outputRate + 0.5 );
+    unsigned long divisor;
+    double      cutoff;
+    unsigned    p, k;
+    int         c;
+
+    if( channels <= 0 || inRate == 0 || outRate == 0 || quality > JRESAMPLE_BEST )
+        return NULL;
+    selectKernel();
+
+    resampler = (JResampler*)calloc( 1, sizeof(JResampler) );
+    if( resampler == NULL )
+        return NULL;
+    resampler->channels = channels;
+
+    /* Exact ratio when it fits in MAX_PHASES phases, e.g. 44100 to 48000 is 160/147 */
+    divisor = gcd( inRate, outRate );
+    if( outRate / divisor <= MAX_PHASES )
+    {
+        resampler->phases = (unsigned)( outRate / divisor );
+        resampler->step = (unsigned)( inRate / divisor );
+    }
+    else
+    {
+        resampler->phases = MAX_PHASES;
+        resampler->step = (unsigned)( (double)MAX_PHASES * inRate / outRate + 0.5 );
+    }
+
+    /* When downsampling the cutoff moves down with the output rate, so the filter
+     * gets longer to keep the same transition band in output terms */
+    cutoff = rolloff[quality] * ( outRate < inRate ? (double)outRate / inRate : 1.0 );
+    resampler->taps = baseTaps[quality];
+    if( outRate < inRate )
+        resampler->taps = ( (unsigned)( baseTaps[quality] * (double)inRate / outRate ) + 1 ) & ~1u;
+    resampler->tapsPadded = ( resampler->taps + VECTOR_FLOATS - 1 ) & ~( VECTOR_FLOATS - 1 );
+
+    resampler->coefs = (float*)calloc( (size_t)resampler->phases * resampler->tapsPadded, sizeof(float) );
+    resampler->history = (float**)calloc( channels, sizeof(float*) );
+    resampler->historyCapacity = resampler->taps + HISTORY_FRAMES;
+    if( resampler->coefs == NULL || resampler->history == NULL )
+    {
+        printf( "  Error using malloc\n" );
+        JResamplerDestroy( &resampler );
+        return NULL;
+    }
+    for( c=0; c<channels; c++ )
+    {
+        /* Padding past the capacity is read by the vector kernels under zero coefficients */
+        resampler->history[c] = (float*)calloc( resampler->historyCapacity + VECTOR_FLOATS, sizeof(float) );
+        if( resampler->history[c] == NULL )
+        {
+            printf( "  Error using malloc\n" );
+            JResamplerDestroy( &resampler );
+            return NULL;
+        }
+    }
+
+    /* Phase p produces the output p/phases of the way past the centre tap.  Each
+     * phase is normalized to unity gain at DC. */
+    for( p=0; p<resampler->phases; p++ )
+    {
+        float   *row = resampler->coefs + (size_t)p * resampler->tapsPadded;
+        double  sum = 0.0;
+
+        for( k=0; k<resampler->taps; k++ )
+        {
+            const double t = (double)k - ( resampler->taps / 2 - 1 ) - (double)p / resampler->phases;
+            const double x = t / ( resampler->taps / 2 );
+            const double window = ( x > -1.0 && x < 1.0 ) ? besselI0( beta[quality] * sqrt( 1.0 - x * x ) ) / besselI0( beta[quality] ) : 0.0;
+            const double sinc = ( t == 0.0 ) ? 1.0 : sin( M_PI * cutoff * t ) / ( M_PI * cutoff * t );
+
+            row[k] = (float)( cutoff * sinc * window );
+            sum += row[k];
+        }
+        for( k=0; k<resampler->taps; k++ )
+            row[k] = (float)( row[k] / sum );
+    }
+
+    JResamplerReset( resampler );
+    return resampler;
+}
+
+
+void JResamplerReset( JResampler *resampler )
+{
+    int c;
+
+    /* Half a filter of silence puts the first input frame under the centre tap */
+    resampler->historyLength = resampler->taps / 2 - 1;
+    resampler->position = 0;
+    resampler->phase = 0;
+    for( c=0; c<resampler->channels; c++ )
+        memset( resampler->history[c], 0, sizeof(float) * resampler->historyLength );
+    return;
+}
+
+
+unsigned long JResamplerProcess( JResampler *resampler, const float *in, unsigned long inFrames,
+                                 unsigned long *inUsed, float *out, unsigned long outFrames )
+{
+    const int       channels = resampler->channels;
+    const JDotProduct dot = JATOMIC_LOAD_RELAXED( &dotProduct );
+    unsigned long   produced, i;
+    int             c;
+
+    /* Drop input the filter has moved past */
+    if( resampler->position > 0 )
+    {
+        resampler->historyLength -= resampler->position;
+        for( c=0; c<channels; c++ )
+            memmove( resampler->history[c], resampler->history[c] + resampler->position,
+                     sizeof(float) * resampler->historyLength );
+        resampler->position = 0;
+    }
+
+    /* Deinterleave new input so each channel's taps are contiguous */
+    if( inFrames > resampler->historyCapacity - resampler->historyLength )
+        inFrames = resampler->historyCapacity - resampler->historyLength;
+    for( c=0; c<channels; c++ )
+    {
+        float *history = resampler->history[c] + resampler->historyLength;
+
+        for( i=0; i<inFrames; i++ )
+            history[i] = in[i * channels + c];
+    }
+    resampler->historyLength += inFrames;
+    *inUsed = inFrames;
+
+    for( produced=0; produced<outFrames && resampler->position + resampler->taps <= resampler->historyLength; produced++ )
+    {
+        const float *row = resampler->coefs + (size_t)resampler->phase * resampler->tapsPadded;
+
+        for( c=0; c<channels; c++ )
+            *out++ = dot( resampler->history[c] + resampler->position, row, resampler->tapsPadded );
+
+        resampler->phase += resampler->step;
+        resampler->position += resampler->phase / resampler->phases;
+        resampler->phase %= resampler->phases;
+    }
+    return produced;
+}
+
+
+const char* JResamplerGetKernelName( void )
+{
+    selectKernel();
+    return dotProductName;
+}
+
+
+const char* JResampleQualityName( JResampleQuality quality )
+{
+    switch( quality )
+    {
+        case JRESAMPLE_FAST:    return "fast";
+        case JRESAMPLE_MEDIUM:  return "medium";
+        default:                return "best";
+    }
+}
+
+
+void JResamplerDestroy( JResampler **resamplerPtr )
+{
+    JResampler *resampler = *resamplerPtr;
+    int c;
+
+    if( resampler == NULL )
+        return;
+
+    if( resampler->history != NULL )
+    {
+        for( c=0; c<resampler->channels; c++ )
+            free( resampler->history[c] );
+    }
+    free( resampler->history );
+    free( resampler->coefs );
+    free( resampler );
+    *resamplerPtr = NULL;
+
+    return;
+}
+
+
+static void selectKernel( void )
+{
+#ifdef JRESAMPLE_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+    {
+        dotProductName = "avx2";
+        JATOMIC_STORE_RELEASE( &dotProduct, dotAVX2 );
+    }
+    else if( __builtin_cpu_supports( "sse" ) )
+    {
+        dotProductName = "sse";
+        JATOMIC_STORE_RELEASE( &dotProduct, dotSSE );
+    }
+#endif
+    return;
+}
+
+
+/* Zeroth order modified Bessel function of the first kind, for the Kaiser window */
+static double besselI0( double x )
+{
+    double sum = 1.0, term = 1.0;
+    int k;
+
+    for( k=1; k<64 && term > 1e-12 * sum; k++ )
+    {
+        term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+        sum += term;
+    }
+    return sum;
+}
+
+
+static unsigned long gcd( unsigned long a, unsigned long b )
+{
+    while( b != 0 )
+    {
+        unsigned long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+static float dotScalar( const float *a, const float *b, unsigned length )
+{
+    float sum = 0.0f;
+    unsigned i;
+
+    for( i=0; i<length; i++ )
+        sum += a[i] * b[i];
+    return sum;
+}
+
+
+#ifdef JRESAMPLE_X86
+
+/* length is always a multiple of VECTOR_FLOATS */
+
+TARGET_SSE static float dotSSE( const float *a, const float *b, unsigned length )
+{
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    float lanes[4];
+    unsigned i;
+
+    for( i=0; i<length; i+=8 )
+    {
+        sum0 = _mm_add_ps( sum0, _mm_mul_ps( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i ) ) );
+        sum1 = _mm_add_ps( sum1, _mm_mul_ps( _mm_loadu_ps( a + i + 4 ), _mm_loadu_ps( b + i + 4 ) ) );
+    }
+    _mm_storeu_ps( lanes, _mm_add_ps( sum0, sum1 ) );
+    return ( lanes[0] + lanes[1] ) + ( lanes[2] + lanes[3] );
+}
+
+
+TARGET_AVX2 static float dotAVX2( const float *a, const float *b, unsigned length )
+{
+    __m256 sum = _mm256_setzero_ps();
+    __m128 half;
+    unsigned i;
+
+    for( i=0; i<length; i+=8 )
+        sum = _mm256_fmadd_ps( _mm256_loadu_ps( a + i ), _mm256_loadu_ps( b + i ), sum );
+    half = _mm_add_ps( _mm256_castps256_ps128( sum ), _mm256_extractf128_ps( sum, 1 ) );
+    half = _mm_add_ps( half, _mm_movehl_ps( half, half ) );
+    half = _mm_add_ss( half, _mm_shuffle_ps( half, half, 1 ) );
+    return _mm_cvtss_f32( half );
+}
+
+#endif  // JRESAMPLE_X86
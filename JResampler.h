@@ -0,0 +1,81 @@
+/* JResampler.h Header file for the sample rate converter
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JRESAMPLER_H_INCLUDED
+#define JRESAMPLER_H_INCLUDED
+
+/** Quality tiers, trading filter length for CPU time */
+typedef enum
+{
+    JRESAMPLE_FAST,     /* 16 taps, Kaiser beta 6 */
+    JRESAMPLE_MEDIUM,   /* 32 taps, Kaiser beta 8 */
+    JRESAMPLE_BEST      /* 64 taps, Kaiser beta 10 */
+}
+JResampleQuality;
+
+/** Polyphase windowed-sinc sample rate converter for interleaved float frames.
+  * The ratio is kept exact as phases/step when the rates share a large enough
+  * divisor, otherwise it is rounded to MAX_PHASES phases.
+  */
+typedef struct
+{
+    int         channels;
+    unsigned    taps;               /* Filter length in input frames */
+    unsigned    tapsPadded;         /* taps rounded up to a whole vector */
+    unsigned    phases;             /* Output positions between two input frames */
+    unsigned    step;               /* Phases to advance per output frame */
+    float       *coefs;             /* phases rows of tapsPadded coefficients */
+
+    float       **history;          /* Input frames per channel */
+    unsigned long historyCapacity;
+    unsigned long historyLength;    /* Frames in history */
+    unsigned long position;         /* First history frame under the filter */
+    unsigned    phase;
+}
+JResampler;
+
+/** @brief Creates a resampler.  JResamplerDestroy must be called to free resources
+  * allocated by JResamplerCreate.
+  * @return Pointer to a JResampler, returns NULL on failure
+  */
+JResampler* JResamplerCreate( int channels, double inputRate, double outputRate, JResampleQuality quality );
+
+/** @brief Forgets all input, e.g. after seeking */
+void JResamplerReset( JResampler *resampler );
+
+/** @brief Takes as much input as fits and produces up to outFrames frames
+  * @param inUsed Set to the number of input frames taken
+  * @return Number of frames written to out, 0 when more input is needed
+  */
+unsigned long JResamplerProcess( JResampler *resampler, const float *in, unsigned long inFrames,
+                                 unsigned long *inUsed, float *out, unsigned long outFrames );
+
+/** @brief Returns the instruction set the filter uses, e.g. "avx2" */
+const char* JResamplerGetKernelName( void );
+
+/** @brief Returns the name of a quality tier */
+const char* JResampleQualityName( JResampleQuality quality );
+
+/** @brief Frees a resampler created with JResamplerCreate
+  * @param resamplerPtr Pointer to a pointer to a JResampler, set to NULL after freeing
+  */
+void JResamplerDestroy( JResampler **resamplerPtr );
+
+#endif // JRESAMPLER_H_INCLUDED
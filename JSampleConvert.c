@@ -0,0 +1,526 @@
+/* JSampleConvert.c Contains routines for conversion between sample formats
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "JSampleConvert.h"
+#include "JPlatform.h"
+
+/* Vector kernels are compiled with gcc target attributes so the rest of the program
+ * does not need to be built for a newer CPU than it runs on */
+#if defined(__x86_64__) || defined(__i386__)
+#define JSAMPLE_X86
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__(( target( "sse2" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#endif
+
+/* Integer samples are scaled by a power of two both ways, so a 16 bit sample survives
+ * a round trip through float unchanged */
+#define INT16_SCALE 32768.0f
+#define INT24_SCALE 8388608.0f
+#define INT32_SCALE 2147483648.0f
+#define INT32_MAX_FLOAT 2147483520.0f      /* Largest float below 2^31 */
+#define DITHER_SCALE ( 1.0f / 4294967296.0f )
+
+/** Routines that have vector versions */
+typedef struct
+{
+    const char  *name;
+    void (*int16ToFloat)( const short *src, float *dest, size_t samples );
+    void (*int32ToFloat)( const int *src, float *dest, size_t samples );
+    void (*floatToInt16)( const float *src, short *dest, size_t samples, JDither *dither );
+    void (*floatToInt32)( const float *src, int *dest, size_t samples );
+}
+JConvertKernels;
+
+static void int16ToFloatScalar( const short *src, float *dest, size_t samples );
+static void int32ToFloatScalar( const int *src, float *dest, size_t samples );
+static void floatToInt16Scalar( const float *src, short *dest, size_t samples, JDither *dither );
+static void floatToInt32Scalar( const float *src, int *dest, size_t samples );
+
+static const JConvertKernels scalarKernels =
+{
+    "scalar", int16ToFloatScalar, int32ToFloatScalar, floatToInt16Scalar, floatToInt32Scalar
+};
+
+static const JConvertKernels *kernels = &scalarKernels;
+
+#ifdef JSAMPLE_X86
+static void int16ToFloatSSE2( const short *src, float *dest, size_t samples );
+static void int32ToFloatSSE2( const int *src, float *dest, size_t samples );
+static void floatToInt16SSE2( const float *src, short *dest, size_t samples, JDither *dither );
+static void floatToInt32SSE2( const float *src, int *dest, size_t samples );
+static void int16ToFloatAVX2( const short *src, float *dest, size_t samples );
+static void int32ToFloatAVX2( const int *src, float *dest, size_t samples );
+static void floatToInt16AVX2( const float *src, short *dest, size_t samples, JDither *dither );
+static void floatToInt32AVX2( const float *src, int *dest, size_t samples );
+
+static const JConvertKernels sse2Kernels =
+{
+    "sse2", int16ToFloatSSE2, int32ToFloatSSE2, floatToInt16SSE2, floatToInt32SSE2
+};
+
+static const JConvertKernels avx2Kernels =
+{
+    "avx2", int16ToFloatAVX2, int32ToFloatAVX2, floatToInt16AVX2, floatToInt32AVX2
+};
+#endif
+
+
+void JSampleConvertInit( void )
+{
+#ifdef JSAMPLE_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) )
+        JATOMIC_STORE_RELEASE( &kernels, &avx2Kernels );
+    else if( __builtin_cpu_supports( "sse2" ) )
+        JATOMIC_STORE_RELEASE( &kernels, &sse2Kernels );
+#endif
+    return;
+}
+
+
+const char* JSampleConvertGetKernelName( void )
+{
+    return JATOMIC_LOAD_ACQUIRE( &kernels )->name;
+}
+
+
+void JDitherInit( JDither *dither, unsigned seed )
+{
+    int i;
+
+    for( i=0; i<8; i++ )
+    {
+        seed = seed * 1664525u + 1013904223u;
+        dither->state[i] = seed ? seed : 1;     /* xorshift never leaves a zero state */
+    }
+    return;
+}
+
+
+int JSampleFormatBytes( JSampleFormat format )
+{
+    switch( format )
+    {
+        case JSAMPLE_INT16:     return 2;
+        case JSAMPLE_INT24:     return 3;
+        default:                return 4;
+    }
+}
+
+
+int JSampleFormatBits( JSampleFormat format )
+{
+    switch( format )
+    {
+        case JSAMPLE_INT16:     return 16;
+        case JSAMPLE_INT32:     return 32;
+        default:                return 24;
+    }
+}
+
+
+PaSampleFormat JSampleFormatToPa( JSampleFormat format )
+{
+    switch( format )
+    {
+        case JSAMPLE_INT16:     return paInt16;
+        case JSAMPLE_INT24:     return paInt24;
+        case JSAMPLE_INT32:     return paInt32;
+        default:                return paFloat32;
+    }
+}
+
+
+JSampleFormat JSampleFormatFromPa( PaSampleFormat format )
+{
+    switch( format )
+    {
+        case paInt16:           return JSAMPLE_INT16;
+        case paInt24:           return JSAMPLE_INT24;
+        case paInt32:           return JSAMPLE_INT32;
+        default:                return JSAMPLE_FLOAT32;
+    }
+}
+
+
+/* Packed 24 bit samples in host byte order */
+#if JHOST_BIG_ENDIAN
+#define READ_INT24( p )     ( (int)( (unsigned)(p)[0] << 24 | (unsigned)(p)[1] << 16 | (unsigned)(p)[2] << 8 ) >> 8 )
+#define WRITE_INT24( p, v ) ( (p)[0] = (unsigned char)( (v) >> 16 ), (p)[1] = (unsigned char)( (v) >> 8 ), (p)[2] = (unsigned char)(v) )
+#else
+#define READ_INT24( p )     ( (int)( (unsigned)(p)[2] << 24 | (unsigned)(p)[1] << 16 | (unsigned)(p)[0] << 8 ) >> 8 )
+#define WRITE_INT24( p, v ) ( (p)[0] = (unsigned char)(v), (p)[1] = (unsigned char)( (v) >> 8 ), (p)[2] = (unsigned char)( (v) >> 16 ) )
+#endif
+
+static unsigned xorshift( unsigned *state )
+{
+    unsigned x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+
+/* Sum of two uniform values of half an LSB each, a triangular distribution over +-1 LSB */
+static float ditherSample( JDither *dither )
+{
+    const int a = (int)xorshift( &dither->state[0] );
+    const int b = (int)xorshift( &dither->state[0] );
+
+    return ( (float)a + (float)b ) * DITHER_SCALE;
+}
+
+
+static int roundToInt( float x, float min, float max )
+{
+    if( x < min )
+        x = min;
+    if( x > max )
+        x = max;
+    return (int)lrintf( x );    /* Round to nearest even, as the vector kernels do */
+}
+
+
+void JConvertToFloat( const void *src, JSampleFormat srcFormat, float *dest, size_t samples )
+{
+    const JConvertKernels *k = JATOMIC_LOAD_RELAXED( &kernels );
+    const unsigned char *p;
+    size_t i;
+
+    switch( srcFormat )
+    {
+        case JSAMPLE_INT16:
+            k->int16ToFloat( (const short*)src, dest, samples );
+            break;
+        case JSAMPLE_INT24:
+            for( i=0, p=(const unsigned char*)src; i<samples; i++, p+=3 )
+                dest[i] = READ_INT24( p ) * ( 1.0f / INT24_SCALE );
+            break;
+        case JSAMPLE_INT32:
+            k->int32ToFloat( (const int*)src, dest, samples );
+            break;
+        case JSAMPLE_FLOAT32:
+            if( (const void*)dest != src )
+                memcpy( dest, src, samples * sizeof(float) );
+            break;
+    }
+    return;
+}
+
+
+void JConvertFromFloat( const float *src, void *dest, JSampleFormat destFormat, size_t samples, JDither *dither )
+{
+    const JConvertKernels *k = JATOMIC_LOAD_RELAXED( &kernels );
+    unsigned char *p;
+    size_t i;
+
+    switch( destFormat )
+    {
+        case JSAMPLE_INT16:
+            k->floatToInt16( src, (short*)dest, samples, dither );
+            break;
+        case JSAMPLE_INT24:
+            for( i=0, p=(unsigned char*)dest; i<samples; i++, p+=3 )
+            {
+                float x = src[i] * INT24_SCALE;
+                int value;
+
+                if( dither != NULL )
+                    x += ditherSample( dither );
+                value = roundToInt( x, -INT24_SCALE, INT24_SCALE - 1.0f );
+                WRITE_INT24( p, value );
+            }
+            break;
+        case JSAMPLE_INT32:
+            k->floatToInt32( src, (int*)dest, samples );
+            break;
+        case JSAMPLE_FLOAT32:
+            if( dest != (const void*)src )
+                memcpy( dest, src, samples * sizeof(float) );
+            break;
+    }
+    return;
+}
+
+
+static void int16ToFloatScalar( const short *src, float *dest, size_t samples )
+{
+    size_t i;
+
+    for( i=0; i<samples; i++ )
+        dest[i] = src[i] * ( 1.0f / INT16_SCALE );
+    return;
+}
+
+
+static void int32ToFloatScalar( const int *src, float *dest, size_t samples )
+{
+    size_t i;
+
+    for( i=0; i<samples; i++ )
+        dest[i] = src[i] * ( 1.0f / INT32_SCALE );
+    return;
+}
+
+
+static void floatToInt16Scalar( const float *src, short *dest, size_t samples, JDither *dither )
+{
+    size_t i;
+
+    for( i=0; i<samples; i++ )
+    {
+        float x = src[i] * INT16_SCALE;
+
+        if( dither != NULL )
+            x += ditherSample( dither );
+        dest[i] = (short)roundToInt( x, -INT16_SCALE, INT16_SCALE - 1.0f );
+    }
+    return;
+}
+
+
+static void floatToInt32Scalar( const float *src, int *dest, size_t samples )
+{
+    size_t i;
+
+    for( i=0; i<samples; i++ )
+        dest[i] = roundToInt( src[i] * INT32_SCALE, -INT32_SCALE, INT32_MAX_FLOAT );
+    return;
+}
+
+
+#ifdef JSAMPLE_X86
+
+/* The vector versions handle whole vectors and leave the remainder to the scalar
+ * versions.  Rounding is the CPU's default round to nearest even. */
+
+TARGET_SSE2 static __m128 ditherSSE2( __m128i *state )
+{
+    __m128i a, b;
+
+    a = _mm_xor_si128( *state, _mm_slli_epi32( *state, 13 ) );
+    a = _mm_xor_si128( a, _mm_srli_epi32( a, 17 ) );
+    a = _mm_xor_si128( a, _mm_slli_epi32( a, 5 ) );
+    b = _mm_xor_si128( a, _mm_slli_epi32( a, 13 ) );
+    b = _mm_xor_si128( b, _mm_srli_epi32( b, 17 ) );
+    b = _mm_xor_si128( b, _mm_slli_epi32( b, 5 ) );
+    *state = b;
+    return _mm_mul_ps( _mm_add_ps( _mm_cvtepi32_ps( a ), _mm_cvtepi32_ps( b ) ), _mm_set1_ps( DITHER_SCALE ) );
+}
+
+
+TARGET_SSE2 static void int16ToFloatSSE2( const short *src, float *dest, size_t samples )
+{
+    const __m128 scale = _mm_set1_ps( 1.0f / INT16_SCALE );
+    size_t i;
+
+    for( i=0; i+8<=samples; i+=8 )
+    {
+        const __m128i x = _mm_loadu_si128( (const __m128i*)( src + i ) );
+        const __m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 );     /* Sign extend */
+        const __m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 );
+
+        _mm_storeu_ps( dest + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), scale ) );
+        _mm_storeu_ps( dest + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), scale ) );
+    }
+    int16ToFloatScalar( src + i, dest + i, samples - i );
+    return;
+}
+
+
+TARGET_SSE2 static void int32ToFloatSSE2( const int *src, float *dest, size_t samples )
+{
+    const __m128 scale = _mm_set1_ps( 1.0f / INT32_SCALE );
+    size_t i;
+
+    for( i=0; i+4<=samples; i+=4 )
+    {
+        const __m128i x = _mm_loadu_si128( (const __m128i*)( src + i ) );
+
+        _mm_storeu_ps( dest + i, _mm_mul_ps( _mm_cvtepi32_ps( x ), scale ) );
+    }
+    int32ToFloatScalar( src + i, dest + i, samples - i );
+    return;
+}
+
+
+TARGET_SSE2 static void floatToInt16SSE2( const float *src, short *dest, size_t samples, JDither *dither )
+{
+    const __m128 scale = _mm_set1_ps( INT16_SCALE );
+    const __m128 min = _mm_set1_ps( -INT16_SCALE );
+    const __m128 max = _mm_set1_ps( INT16_SCALE );      /* packs saturates 32768 to 32767 */
+    __m128i state = _mm_setzero_si128();
+    size_t i;
+
+    if( dither != NULL )
+        state = _mm_loadu_si128( (const __m128i*)dither->state );
+
+    for( i=0; i+8<=samples; i+=8 )
+    {
+        __m128 a = _mm_mul_ps( _mm_loadu_ps( src + i ), scale );
+        __m128 b = _mm_mul_ps( _mm_loadu_ps( src + i + 4 ), scale );
+
+        if( dither != NULL )
+        {
+            a = _mm_add_ps( a, ditherSSE2( &state ) );
+            b = _mm_add_ps( b, ditherSSE2( &state ) );
+        }
+        a = _mm_min_ps( _mm_max_ps( a, min ), max );
+        b = _mm_min_ps( _mm_max_ps( b, min ), max );
+        _mm_storeu_si128( (__m128i*)( dest + i ), _mm_packs_epi32( _mm_cvtps_epi32( a ), _mm_cvtps_epi32( b ) ) );
+    }
+
+    if( dither != NULL )
+        _mm_storeu_si128( (__m128i*)dither->state, state );
+    floatToInt16Scalar( src + i, dest + i, samples - i, dither );
+    return;
+}
+
+
+TARGET_SSE2 static void floatToInt32SSE2( const float *src, int *dest, size_t samples )
+{
+    const __m128 scale = _mm_set1_ps( INT32_SCALE );
+    const __m128 min = _mm_set1_ps( -INT32_SCALE );
+    const __m128 max = _mm_set1_ps( INT32_MAX_FLOAT );
+    size_t i;
+
+    for( i=0; i+4<=samples; i+=4 )
+    {
+        __m128 x = _mm_mul_ps( _mm_loadu_ps( src + i ), scale );
+
+        x = _mm_min_ps( _mm_max_ps( x, min ), max );
+        _mm_storeu_si128( (__m128i*)( dest + i ), _mm_cvtps_epi32( x ) );
+    }
+    floatToInt32Scalar( src + i, dest + i, samples - i );
+    return;
+}
+
+
+TARGET_AVX2 static __m256 ditherAVX2( __m256i *state )
+{
+    __m256i a, b;
+
+    a = _mm256_xor_si256( *state, _mm256_slli_epi32( *state, 13 ) );
+    a = _mm256_xor_si256( a, _mm256_srli_epi32( a, 17 ) );
+    a = _mm256_xor_si256( a, _mm256_slli_epi32( a, 5 ) );
+    b = _mm256_xor_si256( a, _mm256_slli_epi32( a, 13 ) );
+    b = _mm256_xor_si256( b, _mm256_srli_epi32( b, 17 ) );
+    b = _mm256_xor_si256( b, _mm256_slli_epi32( b, 5 ) );
+    *state = b;
+    return _mm256_mul_ps( _mm256_add_ps( _mm256_cvtepi32_ps( a ), _mm256_cvtepi32_ps( b ) ),
+                          _mm256_set1_ps( DITHER_SCALE ) );
+}
+
+
+TARGET_AVX2 static void int16ToFloatAVX2( const short *src, float *dest, size_t samples )
+{
+    const __m256 scale = _mm256_set1_ps( 1.0f / INT16_SCALE );
+    size_t i;
+
+    for( i=0; i+16<=samples; i+=16 )
+    {
+        const __m256i lo = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( src + i ) ) );
+        const __m256i hi = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)( src + i + 8 ) ) );
+
+        _mm256_storeu_ps( dest + i, _mm256_mul_ps( _mm256_cvtepi32_ps( lo ), scale ) );
+        _mm256_storeu_ps( dest + i + 8, _mm256_mul_ps( _mm256_cvtepi32_ps( hi ), scale ) );
+    }
+    int16ToFloatScalar( src + i, dest + i, samples - i );
+    return;
+}
+
+
+TARGET_AVX2 static void int32ToFloatAVX2( const int *src, float *dest, size_t samples )
+{
+    const __m256 scale = _mm256_set1_ps( 1.0f / INT32_SCALE );
+    size_t i;
+
+    for( i=0; i+8<=samples; i+=8 )
+    {
+        const __m256i x = _mm256_loadu_si256( (const __m256i*)( src + i ) );
+
+        _mm256_storeu_ps( dest + i, _mm256_mul_ps( _mm256_cvtepi32_ps( x ), scale ) );
+    }
+    int32ToFloatScalar( src + i, dest + i, samples - i );
+    return;
+}
+
+
+TARGET_AVX2 static void floatToInt16AVX2( const float *src, short *dest, size_t samples, JDither *dither )
+{
+    const __m256 scale = _mm256_set1_ps( INT16_SCALE );
+    const __m256 min = _mm256_set1_ps( -INT16_SCALE );
+    const __m256 max = _mm256_set1_ps( INT16_SCALE );
+    __m256i state = _mm256_setzero_si256();
+    size_t i;
+
+    if( dither != NULL )
+        state = _mm256_loadu_si256( (const __m256i*)dither->state );
+
+    for( i=0; i+16<=samples; i+=16 )
+    {
+        __m256 a = _mm256_mul_ps( _mm256_loadu_ps( src + i ), scale );
+        __m256 b = _mm256_mul_ps( _mm256_loadu_ps( src + i + 8 ), scale );
+        __m256i packed;
+
+        if( dither != NULL )
+        {
+            a = _mm256_add_ps( a, ditherAVX2( &state ) );
+            b = _mm256_add_ps( b, ditherAVX2( &state ) );
+        }
+        a = _mm256_min_ps( _mm256_max_ps( a, min ), max );
+        b = _mm256_min_ps( _mm256_max_ps( b, min ), max );
+        /* packs works within 128 bit lanes, put the four quarters back in order */
+        packed = _mm256_packs_epi32( _mm256_cvtps_epi32( a ), _mm256_cvtps_epi32( b ) );
+        _mm256_storeu_si256( (__m256i*)( dest + i ), _mm256_permute4x64_epi64( packed, 0xD8 ) );
+    }
+
+    if( dither != NULL )
+        _mm256_storeu_si256( (__m256i*)dither->state, state );
+    floatToInt16Scalar( src + i, dest + i, samples - i, dither );
+    return;
+}
+
+
+TARGET_AVX2 static void floatToInt32AVX2( const float *src, int *dest, size_t samples )
+{
+    const __m256 scale = _mm256_set1_ps( INT32_SCALE );
+    const __m256 min = _mm256_set1_ps( -INT32_SCALE );
+    const __m256 max = _mm256_set1_ps( INT32_MAX_FLOAT );
+    size_t i;
+
+    for( i=0; i+8<=samples; i+=8 )
+    {
+        __m256 x = _mm256_mul_ps( _mm256_loadu_ps( src + i ), scale );
+
+        x = _mm256_min_ps( _mm256_max_ps( x, min ), max );
+        _mm256_storeu_si256( (__m256i*)( dest + i ), _mm256_cvtps_epi32( x ) );
+    }
+    floatToInt32Scalar( src + i, dest + i, samples - i );
+    return;
+}
+
+#endif  // JSAMPLE_X86
@@ -0,0 +1,83 @@
+/* JSampleConvert.h Header file for conversion between sample formats
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JSAMPLECONVERT_H_INCLUDED
+#define JSAMPLECONVERT_H_INCLUDED
+
+#include <stddef.h>
+
+#include "portaudio.h"
+
+/** Format of interleaved samples in host byte order.  JSAMPLE_INT24 samples are
+  * packed into 3 bytes, as PortAudio's paInt24.
+  */
+typedef enum
+{
+    JSAMPLE_INT16,
+    JSAMPLE_INT24,
+    JSAMPLE_INT32,
+    JSAMPLE_FLOAT32
+}
+JSampleFormat;
+
+/** State of the TPDF dither generator, one xorshift generator per vector lane */
+typedef struct
+{
+    unsigned    state[8];
+}
+JDither;
+
+/** @brief Picks the conversion routines for the CPU the program runs on.  Called by
+  * JAudioPlayerCreate, calling it again has no effect.
+  */
+void JSampleConvertInit( void );
+
+/** @brief Returns the instruction set the conversion routines use, e.g. "avx2" */
+const char* JSampleConvertGetKernelName( void );
+
+/** @brief Seeds a dither generator */
+void JDitherInit( JDither *dither, unsigned seed );
+
+/** @brief Returns the size of one sample in bytes */
+int JSampleFormatBytes( JSampleFormat format );
+
+/** @brief Returns the number of significant bits a format carries, 24 for float */
+int JSampleFormatBits( JSampleFormat format );
+
+/** @brief Returns the PortAudio sample format matching format */
+PaSampleFormat JSampleFormatToPa( JSampleFormat format );
+
+/** @brief Returns the sample format matching a PortAudio one, JSAMPLE_FLOAT32 for
+  * those it has none for
+  */
+JSampleFormat JSampleFormatFromPa( PaSampleFormat format );
+
+/** @brief Converts samples to float in the range [-1, 1)
+  * @param samples Number of samples, frames times channels
+  */
+void JConvertToFloat( const void *src, JSampleFormat srcFormat, float *dest, size_t samples );
+
+/** @brief Converts float samples to destFormat, rounding to nearest and clipping
+  * @param dither TPDF dither generator to add one LSB of triangular noise before
+  * rounding, NULL for no dither.  Ignored for JSAMPLE_INT32 and JSAMPLE_FLOAT32.
+  */
+void JConvertFromFloat( const float *src, void *dest, JSampleFormat destFormat, size_t samples, JDither *dither );
+
+#endif // JSAMPLECONVERT_H_INCLUDED
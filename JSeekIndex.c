@@ -0,0 +1,556 @@
+/* JSeekIndex.c Contains routines indexing compressed audio files for fast seeking
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "JSeekIndex.h"
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#ifdef WIN32
+#define FSEEK64 _fseeki64
+#define FTELL64 _ftelli64
+#else
+#define FSEEK64 fseeko
+#define FTELL64 ftello
+#endif
+
+#define SCAN_BUFFER_BYTES ( 1 << 16 )
+#define FLAC_MAX_HEADER_BYTES 16        /* Longest frame header, including its CRC */
+#define POINTS_PER_SECOND 10            /* Most seek points kept per second of audio */
+#define MAX_POINTS ( 0xFFFFFF / 18 )    /* Most points a seek table block can hold */
+
+#define FLAC_BLOCK_STREAMINFO 0
+#define FLAC_BLOCK_PADDING 1
+#define FLAC_BLOCK_SEEKTABLE 3
+#define FLAC_BLOCK_PICTURE 6
+
+static const char sidecarMagic[8] = { 'J', 'S', 'E', 'E', 'K', 'I', 'D', 'X' };
+#define SIDECAR_VERSION 1
+
+/** Fields of the STREAMINFO block needed to read frame headers */
+typedef struct
+{
+    unsigned            minBlockSize;
+    unsigned            sampleRate;
+    unsigned long long  totalSamples;   /* 0 when unknown */
+    int                 bHasSeekTable;
+}
+JFlacInfo;
+
+static int statFile( const char *filePath, long long *size, long long *time );
+static int readMetadata( FILE *file, JSeekIndex *index, JFlacInfo *info );
+static int scanFrames( FILE *file, JSeekIndex *index, const JFlacInfo *info, volatile int *bCancel );
+static int parseFrameHeader( const unsigned char *p, size_t length, const JFlacInfo *info,
+                             unsigned long long *sample, unsigned *blockSize, unsigned *headerBytes );
+static unsigned char crc8( const unsigned char *data, size_t length );
+static int appendSeekTable( JSeekIndex *index );
+static char* sidecarPath( const char *filePath );
+static void putBE( unsigned char *p, unsigned long long value, int bytes );
+static void putLE( unsigned char *p, unsigned long long value, int bytes );
+static unsigned long long getLE( const unsigned char *p, int bytes );
+
+
+int JSeekIndexIsSupported( const SF_INFO *sfInfo )
+{
+    return ( sfInfo->format & SF_FORMAT_TYPEMASK ) == SF_FORMAT_FLAC && sfInfo->seekable;
+}
+
+
+JSeekIndex* JSeekIndexBuild( const char *filePath, volatile int *bCancel )
+{
+    JSeekIndex  *index = NULL;
+    JFlacInfo   info;
+    FILE        *file;
+
+    index = (JSeekIndex*)calloc( 1, sizeof(JSeekIndex) );
+    if( index == NULL )
+        return NULL;
+    if( statFile( filePath, &index->fileSize, &index->fileTime ) )
+    {
+        free( index );
+        return NULL;
+    }
+
+    file = fopen( filePath, "rb" );
+    if( file == NULL )
+    {
+        free( index );
+        return NULL;
+    }
+    /* A file with a seek table of its own is already quick to seek */
+    if( readMetadata( file, index, &info ) || info.bHasSeekTable ||
+        scanFrames( file, index, &info, bCancel ) || appendSeekTable( index ) )
+    {
+        fclose( file );
+        JSeekIndexDestroy( &index );
+        return NULL;
+    }
+    fclose( file );
+    return index;
+}
+
+
+JSeekIndex* JSeekIndexLoad( const char *filePath )
+{
+    JSeekIndex      *index = NULL;
+    JFlacInfo       info;
+    FILE            *file;
+    char            *path;
+    unsigned char   header[40], entry[20];
+    long long       fileSize, fileTime;
+    unsigned        i;
+
+    path = sidecarPath( filePath );
+    if( path == NULL )
+        return NULL;
+    file = fopen( path, "rb" );
+    free( path );
+    if( file == NULL )
+        return NULL;
+
+    if( fread( header, 1, sizeof(header), file ) != sizeof(header) ||
+        memcmp( header, sidecarMagic, sizeof(sidecarMagic) ) != 0 ||
+        getLE( header + 8, 4 ) != SIDECAR_VERSION ||
+        statFile( filePath, &fileSize, &fileTime ) ||
+        (long long)getLE( header + 16, 8 ) != fileSize || (long long)getLE( header + 24, 8 ) != fileTime ||
+        getLE( header + 12, 4 ) == 0 || getLE( header + 12, 4 ) > MAX_POINTS ||
+        ( index = (JSeekIndex*)calloc( 1, sizeof(JSeekIndex) ) ) == NULL )
+    {
+        fclose( file );
+        return NULL;
+    }
+    index->count = (unsigned)getLE( header + 12, 4 );
+    index->fileSize = fileSize;
+    index->fileTime = fileTime;
+    index->audioOffset = (long long)getLE( header + 32, 8 );
+    index->points = (JSeekPoint*)malloc( sizeof(JSeekPoint) * index->count );
+    if( index->points == NULL )
+    {
+        fclose( file );
+        JSeekIndexDestroy( &index );
+        return NULL;
+    }
+    for( i=0; i<index->count; i++ )
+    {
+        if( fread( entry, 1, sizeof(entry), file ) != sizeof(entry) )
+        {
+            fclose( file );
+            JSeekIndexDestroy( &index );
+            return NULL;
+        }
+        index->points[i].sample = getLE( entry, 8 );
+        index->points[i].offset = getLE( entry + 8, 8 );
+        index->points[i].samples = (unsigned)getLE( entry + 16, 4 );
+    }
+    fclose( file );
+
+    /* Only the points are saved, the metadata is read again from the file itself */
+    file = fopen( filePath, "rb" );
+    if( file == NULL || readMetadata( file, index, &info ) ||
+        FTELL64( file ) != index->audioOffset || appendSeekTable( index ) )
+    {
+        if( file != NULL )
+            fclose( file );
+        JSeekIndexDestroy( &index );
+        return NULL;
+    }
+    fclose( file );
+    return index;
+}
+
+
+int JSeekIndexSave( const JSeekIndex *index, const char *filePath )
+{
+    FILE            *file;
+    char            *path;
+    unsigned char   header[40], entry[20];
+    unsigned        i;
+    int             result = 0;
+
+    path = sidecarPath( filePath );
+    if( path == NULL )
+        return -1;
+    file = fopen( path, "wb" );
+    if( file == NULL )
+    {
+        printf( "  Error: Could not write seek index %s\n", path );
+        free( path );
+        return -1;
+    }
+
+    memcpy( header, sidecarMagic, sizeof(sidecarMagic) );
+    putLE( header + 8, SIDECAR_VERSION, 4 );
+    putLE( header + 12, index->count, 4 );
+    putLE( header + 16, (unsigned long long)index->fileSize, 8 );
+    putLE( header + 24, (unsigned long long)index->fileTime, 8 );
+    putLE( header + 32, (unsigned long long)index->audioOffset, 8 );
+    if( fwrite( header, 1, sizeof(header), file ) != sizeof(header) )
+        result = -1;
+    for( i=0; i<index->count && result == 0; i++ )
+    {
+        putLE( entry, index->points[i].sample, 8 );
+        putLE( entry + 8, index->points[i].offset, 8 );
+        putLE( entry + 16, index->points[i].samples, 4 );
+        if( fwrite( entry, 1, sizeof(entry), file ) != sizeof(entry) )
+            result = -1;
+    }
+    if( fclose( file ) != 0 )
+        result = -1;
+
+    /* Never leave a truncated sidecar behind */
+    if( result != 0 )
+        remove( path );
+    free( path );
+    return result;
+}
+
+
+void JSeekIndexDestroy( JSeekIndex **indexPtr )
+{
+    JSeekIndex *index = *indexPtr;
+
+    if( index == NULL )
+        return;
+
+    free( index->points );
+    free( index->header );
+    free( index );
+    *indexPtr = NULL;
+
+    return;
+}
+
+
+static int statFile( const char *filePath, long long *size, long long *time )
+{
+#ifdef WIN32
+    struct _stat64 fileStat;
+
+    if( _stat64( filePath, &fileStat ) != 0 )
+        return -1;
+#else
+    struct stat fileStat;
+
+    if( stat( filePath, &fileStat ) != 0 )
+        return -1;
+#endif
+    *size = (long long)fileStat.st_size;
+    *time = (long long)fileStat.st_mtime;
+    return 0;
+}
+
+
+/* Reads the metadata blocks of a FLAC file, leaving the file at its first frame.  The
+ * blocks are copied to index->header except for padding, pictures and any seek table,
+ * which are not needed to decode. */
+static int readMetadata( FILE *file, JSeekIndex *index, JFlacInfo *info )
+{
+    unsigned char   bytes[10], *header;
+    unsigned long   length;
+    int             bLast = FALSE, type;
+
+    memset( info, 0, sizeof(JFlacInfo) );
+    if( fread( bytes, 1, 4, file ) != 4 )
+        return -1;
+
+    /* Skip an ID3v2 tag in front of the stream, as libFLAC does */
+    if( memcmp( bytes, "ID3", 3 ) == 0 )
+    {
+        if( fread( bytes + 4, 1, 6, file ) != 6 )
+            return -1;
+        length = (unsigned long)( bytes[6] & 0x7F ) << 21 | (unsigned long)( bytes[7] & 0x7F ) << 14 |
+                 (unsigned long)( bytes[8] & 0x7F ) << 7 | ( bytes[9] & 0x7F );
+        if( FSEEK64( file, (long long)length, SEEK_CUR ) != 0 || fread( bytes, 1, 4, file ) != 4 )
+            return -1;
+    }
+    if( memcmp( bytes, "fLaC", 4 ) != 0 )
+        return -1;
+
+    free( index->header );
+    index->header = (unsigned char*)malloc( 4 );
+    if( index->header == NULL )
+        return -1;
+    memcpy( index->header, "fLaC", 4 );
+    index->headerBytes = 4;
+
+    while( !bLast )
+    {
+        if( fread( bytes, 1, 4, file ) != 4 )
+            return -1;
+        bLast = ( bytes[0] & 0x80 ) != 0;
+        type = bytes[0] & 0x7F;
+        length = (unsigned long)bytes[1] << 16 | (unsigned long)bytes[2] << 8 | bytes[3];
+
+        if( type == FLAC_BLOCK_SEEKTABLE && length >= 18 )
+            info->bHasSeekTable = TRUE;
+        if( type == FLAC_BLOCK_PADDING || type == FLAC_BLOCK_SEEKTABLE || type == FLAC_BLOCK_PICTURE )
+        {
+            if( FSEEK64( file, (long long)length, SEEK_CUR ) != 0 )
+                return -1;
+            continue;
+        }
+
+        header = (unsigned char*)realloc( index->header, index->headerBytes + 4 + length );
+        if( header == NULL )
+            return -1;
+        index->header = header;
+        header += index->headerBytes;
+        header[0] = (unsigned char)type;       /* The seek table is appended as the last block */
+        memcpy( header + 1, bytes + 1, 3 );
+        if( fread( header + 4, 1, length, file ) != length )
+            return -1;
+        index->headerBytes += 4 + length;
+
+        if( type == FLAC_BLOCK_STREAMINFO && length >= 18 )
+        {
+            info->minBlockSize = (unsigned)header[4] << 8 | header[5];
+            info->sampleRate = (unsigned)header[14] << 12 | (unsigned)header[15] << 4 | header[16] >> 4;
+            info->totalSamples = (unsigned long long)( header[17] & 0x0F ) << 32 |
+                                 (unsigned long long)header[18] << 24 | (unsigned long long)header[19] << 16 |
+                                 (unsigned long long)header[20] << 8 | header[21];
+        }
+    }
+    if( info->sampleRate == 0 )
+        return -1;
+
+    index->audioOffset = FTELL64( file );
+    return 0;
+}
+
+
+/* Reads the frames from the file position on, adding a point every tenth of a second.
+ * A frame header is only accepted when its CRC matches and it starts at the sample the
+ * previous frame ended at, so sync codes inside frame data are not mistaken for one. */
+static int scanFrames( FILE *file, JSeekIndex *index, const JFlacInfo *info, volatile int *bCancel )
+{
+    unsigned char       *buffer;
+    size_t              length = 0, position = 0, n;
+    long long           bufferOffset = index->audioOffset;
+    unsigned long long  expected = 0, sample, lastPoint = 0;
+    const unsigned long long spacing = info->sampleRate / POINTS_PER_SECOND;
+    unsigned            capacity = 0, blockSize, headerBytes;
+    JSeekPoint          *points;
+    int                 bEnd = FALSE;
+
+    buffer = (unsigned char*)malloc( SCAN_BUFFER_BYTES );
+    if( buffer == NULL )
+        return -1;
+
+    for( ;; )
+    {
+        /* Keep a whole header in the buffer past the position being looked at */
+        if( length - position < FLAC_MAX_HEADER_BYTES && !bEnd )
+        {
+            if( *bCancel )
+                break;
+            memmove( buffer, buffer + position, length - position );
+            bufferOffset += position;
+            length -= position;
+            position = 0;
+            n = fread( buffer + length, 1, SCAN_BUFFER_BYTES - length, file );
+            bEnd = n == 0;
+            length += n;
+        }
+        if( length - position < 2 )
+            break;
+
+        if( buffer[position] != 0xFF || ( buffer[position + 1] & 0xFE ) != 0xF8 ||
+            !parseFrameHeader( buffer + position, length - position, info, &sample, &blockSize, &headerBytes ) ||
+            sample != expected )
+        {
+            position++;
+            continue;
+        }
+
+        if( ( index->count == 0 || sample - lastPoint >= spacing ) && index->count < MAX_POINTS )
+        {
+            if( index->count == capacity )
+            {
+                capacity = capacity ? 2 * capacity : 1024;
+                points = (JSeekPoint*)realloc( index->points, sizeof(JSeekPoint) * capacity );
+                if( points == NULL )
+                    break;
+                index->points = points;
+            }
+            index->points[index->count].sample = sample;
+            index->points[index->count].offset = (unsigned long long)( bufferOffset + (long long)position - index->audioOffset );
+            index->points[index->count].samples = blockSize;
+            index->count++;
+            lastPoint = sample;
+        }
+        expected += blockSize;
+        position += headerBytes;
+        if( info->totalSamples != 0 && expected >= info->totalSamples )
+            break;
+    }
+    free( buffer );
+
+    if( *bCancel || index->count == 0 )
+        return -1;
+    return 0;
+}
+
+
+/* Decodes a frame header at p.  Returns FALSE if it is not a valid header. */
+static int parseFrameHeader( const unsigned char *p, size_t length, const JFlacInfo *info,
+                             unsigned long long *sample, unsigned *blockSize, unsigned *headerBytes )
+{
+    const int       bVariable = p[1] & 1;
+    const unsigned  blockCode = p[2] >> 4, rateCode = p[2] & 0x0F;
+    unsigned long long number;
+    unsigned        n = 5, extra, i;
+
+    if( length < 6 || blockCode == 0 || rateCode == 15 || ( p[3] >> 4 ) > 10 || ( p[3] & 1 ) )
+        return FALSE;
+
+    /* Frame or sample number, coded like UTF-8 with up to 36 bits */
+    if( p[4] < 0x80 )                   { number = p[4]; extra = 0; }
+    else if( ( p[4] & 0xE0 ) == 0xC0 )  { number = p[4] & 0x1F; extra = 1; }
+    else if( ( p[4] & 0xF0 ) == 0xE0 )  { number = p[4] & 0x0F; extra = 2; }
+    else if( ( p[4] & 0xF8 ) == 0xF0 )  { number = p[4] & 0x07; extra = 3; }
+    else if( ( p[4] & 0xFC ) == 0xF8 )  { number = p[4] & 0x03; extra = 4; }
+    else if( ( p[4] & 0xFE ) == 0xFC )  { number = p[4] & 0x01; extra = 5; }
+    else if( p[4] == 0xFE )             { number = 0; extra = 6; }
+    else
+        return FALSE;
+    if( n + extra >= length )
+        return FALSE;
+    for( i=0; i<extra; i++, n++ )
+    {
+        if( ( p[n] & 0xC0 ) != 0x80 )
+            return FALSE;
+        number = number << 6 | ( p[n] & 0x3F );
+    }
+
+    switch( blockCode )
+    {
+        case 1:     *blockSize = 192; break;
+        case 6:     *blockSize = p[n] + 1u; n += 1; break;
+        case 7:     if( n + 1 >= length )
+                        return FALSE;
+                    *blockSize = ( (unsigned)p[n] << 8 | p[n + 1] ) + 1u; n += 2; break;
+        default:    *blockSize = blockCode < 6 ? 576u << ( blockCode - 2 ) : 256u << ( blockCode - 8 ); break;
+    }
+    if( rateCode == 12 )
+        n += 1;
+    else if( rateCode == 13 || rateCode == 14 )
+        n += 2;
+
+    if( n >= length || crc8( p, n ) != p[n] )
+        return FALSE;
+
+    *sample = bVariable ? number : number * info->minBlockSize;
+    *headerBytes = n + 1;
+    return TRUE;
+}
+
+
+/* CRC-8 of FLAC frame headers, polynomial x^8 + x^2 + x + 1 */
+static unsigned char crc8( const unsigned char *data, size_t length )
+{
+    unsigned crc = 0;
+    size_t   i;
+    int      bit;
+
+    for( i=0; i<length; i++ )
+    {
+        crc ^= data[i];
+        for( bit=0; bit<8; bit++ )
+            crc = ( crc & 0x80 ) ? ( crc << 1 ) ^ 0x07 : crc << 1;
+        crc &= 0xFF;
+    }
+    return (unsigned char)crc;
+}
+
+
+/* Adds the points to index->header as a seek table, the last metadata block */
+static int appendSeekTable( JSeekIndex *index )
+{
+    const size_t    length = (size_t)index->count * 18;
+    unsigned char   *header, *point;
+    unsigned        i;
+
+    header = (unsigned char*)realloc( index->header, index->headerBytes + 4 + length );
+    if( header == NULL )
+        return -1;
+    index->header = header;
+    header += index->headerBytes;
+    header[0] = 0x80 | FLAC_BLOCK_SEEKTABLE;
+    putBE( header + 1, length, 3 );
+    for( i=0, point=header+4; i<index->count; i++, point+=18 )
+    {
+        putBE( point, index->points[i].sample, 8 );
+        putBE( point + 8, index->points[i].offset, 8 );
+        putBE( point + 16, index->points[i].samples, 2 );
+    }
+    index->headerBytes += 4 + length;
+    return 0;
+}
+
+
+static char* sidecarPath( const char *filePath )
+{
+    char *path = (char*)malloc( strlen( filePath ) + sizeof(JSEEKINDEX_SIDECAR_SUFFIX) );
+
+    if( path == NULL )
+        return NULL;
+    strcpy( path, filePath );
+    strcat( path, JSEEKINDEX_SIDECAR_SUFFIX );
+    return path;
+}
+
+
+static void putBE( unsigned char *p, unsigned long long value, int bytes )
+{
+    int i;
+
+    for( i=bytes-1; i>=0; i--, value>>=8 )
+        p[i] = (unsigned char)value;
+    return;
+}
+
+
+static void putLE( unsigned char *p, unsigned long long value, int bytes )
+{
+    int i;
+
+    for( i=0; i<bytes; i++, value>>=8 )
+        p[i] = (unsigned char)value;
+    return;
+}
+
+
+static unsigned long long getLE( const unsigned char *p, int bytes )
+{
+    unsigned long long value = 0;
+    int i;
+
+    for( i=bytes-1; i>=0; i-- )
+        value = value << 8 | p[i];
+    return value;
+}
@@ -0,0 +1,86 @@
+/* JSeekIndex.h Header file for seek indexes of compressed audio files
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JSEEKINDEX_H_INCLUDED
+#define JSEEKINDEX_H_INCLUDED
+
+#include <stddef.h>
+
+#include "sndfile.h"
+
+#define JSEEKINDEX_SIDECAR_SUFFIX ".jseek"     /* Appended to the path of the audio file */
+
+/** Position of one FLAC frame, as stored in a FLAC seek table */
+typedef struct
+{
+    unsigned long long  sample;         /* First sample of the frame */
+    unsigned long long  offset;         /* Bytes from the first frame of the file */
+    unsigned            samples;        /* Samples in the frame */
+}
+JSeekPoint;
+
+/** Sample to byte index of a FLAC file without a seek table.  libsndfile decodes FLAC
+  * through libFLAC, which bisects the file to seek unless the file has a seek table.
+  * header holds the metadata of the file with the index added as a seek table, so
+  * that decoding header followed by the frames of the file seeks straight to the
+  * nearest frame.
+  */
+typedef struct
+{
+    JSeekPoint      *points;
+    unsigned        count;
+    long long       audioOffset;        /* Byte offset of the first frame in the file */
+    long long       fileSize;           /* Size and modification time of the file when it */
+    long long       fileTime;           /* was indexed, a sidecar that differs is stale */
+    unsigned char   *header;
+    size_t          headerBytes;
+}
+JSeekIndex;
+
+/** @brief Checks whether files of a format can be indexed.  Only FLAC is: Ogg files
+  * carry granule positions in every page and libsndfile seeks them on its own.
+  */
+int JSeekIndexIsSupported( const SF_INFO *sfInfo );
+
+/** @brief Reads a whole FLAC file and indexes its frames.  Slow, meant to be called
+  * from a background thread.
+  * @param bCancel Checked while reading, the build is abandoned once it is non-zero
+  * @return Pointer to a JSeekIndex, returns NULL on failure, when cancelled or when the
+  * file already has a seek table
+  */
+JSeekIndex* JSeekIndexBuild( const char *filePath, volatile int *bCancel );
+
+/** @brief Loads the index saved next to an audio file by JSeekIndexSave
+  * @return Pointer to a JSeekIndex, returns NULL if there is no sidecar file or it was
+  * made for an older version of the audio file
+  */
+JSeekIndex* JSeekIndexLoad( const char *filePath );
+
+/** @brief Saves an index next to the audio file it was built for
+  * @return 0 on success, non-zero on failure
+  */
+int JSeekIndexSave( const JSeekIndex *index, const char *filePath );
+
+/** @brief Frees an index returned by JSeekIndexBuild or JSeekIndexLoad
+  * @param indexPtr Pointer to a pointer to a JSeekIndex, set to NULL after freeing
+  */
+void JSeekIndexDestroy( JSeekIndex **indexPtr );
+
+#endif // JSEEKINDEX_H_INCLUDED
@@ -0,0 +1,690 @@
+/* JWaveform.c Source file for the waveform overview of audio files
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "JWaveform.h"
+#include "JAudioSource.h"
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#ifdef WIN32
+#define FSEEK64 _fseeki64
+#else
+#define FSEEK64 fseeko
+#endif
+
+#define READ_FRAMES ( JWAVEFORM_BASE_FRAMES * 16 )  /* Frames read at a time */
+#define PROBE_FRAMES 4096               /* Frames read for each overview peak */
+#define HASH_BYTES ( 1 << 16 )          /* Bytes hashed at each end of the file */
+#define SIDECAR_PEAK_BYTES 12
+#define SIDECAR_BLOCK_PEAKS 4096        /* Peaks read or written at a time */
+
+static const char sidecarMagic[8] = { 'J', 'W', 'A', 'V', 'E', 'P', 'K', 'S' };
+#define SIDECAR_VERSION 1
+
+static THREAD_ROUTINE_SIGNATURE workerThread( void *threadArg );
+static void readOverviewPeak( JWaveform *waveform, JAudioSource *source, float *buffer,
+                              sf_count_t *position, unsigned long index );
+static void readChunk( JWaveform *waveform, JAudioSource *source, float *buffer,
+                       sf_count_t *position, unsigned long chunk );
+static void finishLevels( JWaveform *waveform );
+static void summarize( const float *samples, unsigned long count, JPeak *peak );
+static void mergePeaks( const JPeak *peaks, unsigned long count, JPeak *peak );
+static unsigned long peaksPerChunk( const JWaveform *waveform, unsigned level );
+static int identifyFile( const char *filePath, long long *size, long long *time, unsigned long long *hash );
+static int loadSidecar( JWaveform *waveform );
+static int saveSidecar( const JWaveform *waveform );
+static char* sidecarPath( const char *filePath );
+static void putLE( unsigned char *p, unsigned long long value, int bytes );
+static unsigned long long getLE( const unsigned char *p, int bytes );
+
+
+JWaveform* JWaveformCreate( const char *filePath, int bSave )
+{
+    JWaveform       *waveform = NULL;
+    JAudioSource    *source;
+    unsigned long   count;
+    unsigned        i, workers;
+
+    waveform = (JWaveform*)calloc( 1, sizeof(JWaveform) );
+    if( waveform == NULL )
+        return NULL;
+    waveform->bSave = bSave;
+    waveform->startNs = JPlatformGetTimeNs();
+    waveform->filePath = (char*)malloc( strlen( filePath ) + 1 );
+    if( waveform->filePath == NULL )
+    {
+        free( waveform );
+        return NULL;
+    }
+    strcpy( waveform->filePath, filePath );
+
+    source = JAudioSourceOpen( filePath, TRUE );
+    if( source == NULL )
+    {
+        JWaveformDestroy( &waveform );
+        return NULL;
+    }
+    waveform->frames = source->sfInfo.frames;
+    waveform->channels = source->sfInfo.channels;
+    JAudioSourceClose( &source );
+    if( waveform->frames <= 0 || waveform->channels <= 0 ||
+        identifyFile( filePath, &waveform->fileSize, &waveform->fileTime, &waveform->fileHash ) )
+    {
+        JWaveformDestroy( &waveform );
+        return NULL;
+    }
+
+    /* Each level has a quarter of the peaks of the one below, down to a single peak */
+    count = (unsigned long)( ( waveform->frames + JWAVEFORM_BASE_FRAMES - 1 ) / JWAVEFORM_BASE_FRAMES );
+    for( i=0; i<JWAVEFORM_MAX_LEVELS; i++ )
+    {
+        waveform->levels[i].count = count;
+        waveform->levels[i].framesPerPeak = i == 0 ? JWAVEFORM_BASE_FRAMES :
+                                            waveform->levels[i-1].framesPerPeak * JWAVEFORM_LEVEL_FACTOR;
+        waveform->levels[i].peaks = (JPeak*)calloc( count, sizeof(JPeak) );
+        if( waveform->levels[i].peaks == NULL )
+        {
+            printf( "  Error: Cannot allocate memory for waveform\n" );
+            JWaveformDestroy( &waveform );
+            return NULL;
+        }
+        waveform->levelCount = i + 1;
+        if( count == 1 )
+            break;
+        count = ( count + JWAVEFORM_LEVEL_FACTOR - 1 ) / JWAVEFORM_LEVEL_FACTOR;
+    }
+    waveform->chunkLevel = waveform->levelCount - 1 < JWAVEFORM_CHUNK_LEVEL ?
+                           waveform->levelCount - 1 : JWAVEFORM_CHUNK_LEVEL;
+
+    count = waveform->levels[0].count < JWAVEFORM_OVERVIEW_PEAKS ? waveform->levels[0].count : JWAVEFORM_OVERVIEW_PEAKS;
+    waveform->overview.count = count;
+    waveform->overview.framesPerPeak = ( waveform->frames + count - 1 ) / count;
+    waveform->overview.peaks = (JPeak*)calloc( count, sizeof(JPeak) );
+    waveform->overviewReady = (unsigned char*)calloc( count, 1 );
+    waveform->chunkReady = (unsigned char*)calloc( waveform->levels[waveform->chunkLevel].count, 1 );
+    if( waveform->overview.peaks == NULL || waveform->overviewReady == NULL || waveform->chunkReady == NULL )
+    {
+        printf( "  Error: Cannot allocate memory for waveform\n" );
+        JWaveformDestroy( &waveform );
+        return NULL;
+    }
+
+    if( loadSidecar( waveform ) == 0 )
+    {
+        memset( waveform->chunkReady, 1, waveform->levels[waveform->chunkLevel].count );
+        waveform->overviewNs = waveform->completeNs = JPlatformGetTimeNs() - waveform->startNs;
+        waveform->bComplete = TRUE;
+        return waveform;
+    }
+
+    /* The workers only need the disk and the processors the player leaves idle */
+    waveform->itemCount = waveform->overview.count + waveform->levels[waveform->chunkLevel].count;
+    workers = JPlatformGetProcessorCount();
+    if( workers > JWAVEFORM_MAX_WORKERS )
+        workers = JWAVEFORM_MAX_WORKERS;
+    if( workers > waveform->itemCount )
+        workers = (unsigned)waveform->itemCount;
+    for( i=0; i<workers; i++ )
+    {
+        if( JPlatformThreadCreate( &waveform->workers[i], workerThread, waveform ) )
+            break;
+        waveform->workerCount++;
+    }
+    if( waveform->workerCount == 0 )
+    {
+        printf( "  Error creating waveform worker threads\n" );
+        JWaveformDestroy( &waveform );
+        return NULL;
+    }
+    return waveform;
+}
+
+
+unsigned JWaveformGetColumns( JWaveform *waveform, JPeak *columns, unsigned width )
+{
+    int             bComplete = JATOMIC_LOAD_ACQUIRE( &waveform->bComplete );
+    unsigned        topLevel = bComplete ? waveform->levelCount - 1 : waveform->chunkLevel;
+    unsigned        x, level, filled = 0;
+    unsigned long   first, last, i, perChunk;
+    sf_count_t      start, end;
+    const JWaveformLevel *source;
+    int             bReady;
+
+    for( x=0; x<width; x++ )
+    {
+        start = waveform->frames * x / width;
+        end = waveform->frames * ( x + 1 ) / width;
+        if( end <= start )
+            end = start + 1;
+
+        /* Coarsest level whose peaks still fit in the column */
+        level = 0;
+        while( level < topLevel && waveform->levels[level+1].framesPerPeak <= end - start )
+            level++;
+        source = &waveform->levels[level];
+        first = (unsigned long)( start / source->framesPerPeak );
+        last = (unsigned long)( ( end - 1 ) / source->framesPerPeak );
+        if( last >= source->count )
+            last = source->count - 1;
+
+        bReady = TRUE;
+        if( level <= waveform->chunkLevel )
+        {
+            perChunk = peaksPerChunk( waveform, level );
+            for( i=first/perChunk; i<=last/perChunk && bReady; i++ )
+                bReady = JATOMIC_LOAD_ACQUIRE( &waveform->chunkReady[i] );
+        }
+        if( bReady )
+        {
+            mergePeaks( source->peaks + first, last - first + 1, &columns[x] );
+            filled++;
+            continue;
+        }
+
+        i = (unsigned long)( start / waveform->overview.framesPerPeak );
+        if( JATOMIC_LOAD_ACQUIRE( &waveform->overviewReady[i] ) )
+        {
+            columns[x] = waveform->overview.peaks[i];
+            filled++;
+        }
+        else
+            memset( &columns[x], 0, sizeof(JPeak) );
+    }
+    return filled;
+}
+
+
+unsigned long JWaveformGetProgress( JWaveform *waveform )
+{
+    return JATOMIC_LOAD_RELAXED( &waveform->itemsDone ) + JATOMIC_LOAD_ACQUIRE( &waveform->bComplete );
+}
+
+
+int JWaveformIsComplete( JWaveform *waveform )
+{
+    return JATOMIC_LOAD_ACQUIRE( &waveform->bComplete );
+}
+
+
+void JWaveformDestroy( JWaveform **waveformPtr )
+{
+    JWaveform *waveform = *waveformPtr;
+    unsigned i;
+
+    if( waveform == NULL )
+        return;
+
+    waveform->bCancel = TRUE;
+    for( i=0; i<waveform->workerCount; i++ )
+        JPlatformThreadJoin( &waveform->workers[i] );
+
+    for( i=0; i<waveform->levelCount; i++ )
+        free( waveform->levels[i].peaks );
+    free( waveform->overview.peaks );
+    free( waveform->overviewReady );
+    free( waveform->chunkReady );
+    free( waveform->filePath );
+    free( waveform );
+    *waveformPtr = NULL;
+
+    return;
+}
+
+
+/* Takes overview peaks, then chunks, until there are none left.  Every worker has its
+ * own source and seeks it to each item it takes. */
+static THREAD_ROUTINE_SIGNATURE workerThread( void *threadArg )
+{
+    JWaveform       *waveform = (JWaveform*)threadArg;
+    JAudioSource    *source;
+    float           *buffer;
+    sf_count_t      position = 0;
+    unsigned long   item;
+
+    JPlatformThreadSetBackground();
+    source = JAudioSourceOpen( waveform->filePath, TRUE );
+    buffer = (float*)malloc( sizeof(float) * READ_FRAMES * waveform->channels );
+    while( source != NULL && buffer != NULL && !waveform->bCancel )
+    {
+        item = JATOMIC_ADD_RELAXED( &waveform->nextItem, 1 );
+        if( item >= waveform->itemCount )
+            break;
+
+        if( item < waveform->overview.count )
+        {
+            readOverviewPeak( waveform, source, buffer, &position, item );
+            if( JATOMIC_ADD_RELAXED( &waveform->overviewDone, 1 ) + 1 == waveform->overview.count )
+                waveform->overviewNs = JPlatformGetTimeNs() - waveform->startNs;
+        }
+        else
+            readChunk( waveform, source, buffer, &position, item - waveform->overview.count );
+
+        /* Releases this worker's peaks and, for the worker finishing last, acquires
+         * everyone else's before finishLevels reads them */
+        if( JATOMIC_ADD_ACQ_REL( &waveform->itemsDone, 1 ) + 1 == waveform->itemCount )
+            finishLevels( waveform );
+    }
+    free( buffer );
+    JAudioSourceClose( &source );
+    return 0;
+}
+
+
+/* Summarizes a short stretch from the middle of the frames of an overview peak */
+static void readOverviewPeak( JWaveform *waveform, JAudioSource *source, float *buffer,
+                              sf_count_t *position, unsigned long index )
+{
+    sf_count_t start = (sf_count_t)index * waveform->overview.framesPerPeak;
+    sf_count_t frames = waveform->overview.framesPerPeak;
+
+    if( frames > PROBE_FRAMES )
+    {
+        start += ( frames - PROBE_FRAMES ) / 2;
+        frames = PROBE_FRAMES;
+    }
+    if( start + frames > waveform->frames )
+        frames = start < waveform->frames ? waveform->frames - start : 0;
+
+    if( *position != start )
+        *position = JAudioSourceSeek( source, start, SEEK_SET );
+    frames = *position == start ? JAudioSourceReadFloat( source, buffer, frames ) : 0;
+    if( frames > 0 )
+        *position += frames;
+    summarize( buffer, frames > 0 ? (unsigned long)frames * waveform->channels : 0, &waveform->overview.peaks[index] );
+    JATOMIC_STORE_RELEASE( &waveform->overviewReady[index], 1 );
+    return;
+}
+
+
+/* Fills the peaks of one chunk at every level up to chunkLevel.  Frames that cannot be
+ * read are left as silence. */
+static void readChunk( JWaveform *waveform, JAudioSource *source, float *buffer,
+                       sf_count_t *position, unsigned long chunk )
+{
+    JWaveformLevel  *level = &waveform->levels[0];
+    unsigned long   first = chunk * peaksPerChunk( waveform, 0 );
+    unsigned long   last = first + peaksPerChunk( waveform, 0 );
+    unsigned long   peak, below, count, i;
+    sf_count_t      start = (sf_count_t)first * JWAVEFORM_BASE_FRAMES;
+    sf_count_t      frames, offset, read;
+    unsigned        k;
+
+    if( last > level->count )
+        last = level->count;
+    if( *position != start )
+        *position = JAudioSourceSeek( source, start, SEEK_SET );
+
+    /* Read a few peaks' worth of frames at a time */
+    for( peak=first; peak<last; peak+=count )
+    {
+        if( waveform->bCancel )
+            return;
+        count = last - peak;
+        if( count > READ_FRAMES / JWAVEFORM_BASE_FRAMES )
+            count = READ_FRAMES / JWAVEFORM_BASE_FRAMES;
+        frames = *position == (sf_count_t)peak * JWAVEFORM_BASE_FRAMES ?
+                 JAudioSourceReadFloat( source, buffer, (sf_count_t)count * JWAVEFORM_BASE_FRAMES ) : 0;
+        if( frames > 0 )
+            *position += frames;
+        for( i=0; i<count; i++ )
+        {
+            offset = (sf_count_t)i * JWAVEFORM_BASE_FRAMES;
+            read = frames - offset;
+            if( read > JWAVEFORM_BASE_FRAMES )
+                read = JWAVEFORM_BASE_FRAMES;
+            summarize( buffer + offset * waveform->channels, read > 0 ? (unsigned long)read * waveform->channels : 0,
+                       &level->peaks[peak+i] );
+        }
+    }
+
+    for( k=1; k<=waveform->chunkLevel; k++ )
+    {
+        level = &waveform->levels[k];
+        first = chunk * peaksPerChunk( waveform, k );
+        last = first + peaksPerChunk( waveform, k );
+        if( last > level->count )
+            last = level->count;
+        for( peak=first; peak<last; peak++ )
+        {
+            below = peak * JWAVEFORM_LEVEL_FACTOR;
+            i = waveform->levels[k-1].count - below;
+            mergePeaks( waveform->levels[k-1].peaks + below, i < JWAVEFORM_LEVEL_FACTOR ? i : JWAVEFORM_LEVEL_FACTOR,
+                        &level->peaks[peak] );
+        }
+    }
+    JATOMIC_STORE_RELEASE( &waveform->chunkReady[chunk], 1 );
+    return;
+}
+
+
+/* Merges the levels above chunkLevel once every chunk is done, then saves the sidecar */
+static void finishLevels( JWaveform *waveform )
+{
+    JWaveformLevel  *level;
+    unsigned long   peak, below, i;
+    unsigned        k;
+
+    /* Pairs with the release stores of the workers that filled the chunks */
+    for( i=0; i<waveform->levels[waveform->chunkLevel].count; i++ )
+    {
+        if( !JATOMIC_LOAD_ACQUIRE( &waveform->chunkReady[i] ) )
+            return;
+    }
+
+    for( k=waveform->chunkLevel+1; k<waveform->levelCount; k++ )
+    {
+        level = &waveform->levels[k];
+        for( peak=0; peak<level->count; peak++ )
+        {
+            below = peak * JWAVEFORM_LEVEL_FACTOR;
+            i = waveform->levels[k-1].count - below;
+            mergePeaks( waveform->levels[k-1].peaks + below, i < JWAVEFORM_LEVEL_FACTOR ? i : JWAVEFORM_LEVEL_FACTOR,
+                        &level->peaks[peak] );
+        }
+    }
+    waveform->completeNs = JPlatformGetTimeNs() - waveform->startNs;
+    JATOMIC_STORE_RELEASE( &waveform->bComplete, TRUE );
+
+    if( waveform->bSave )
+        saveSidecar( waveform );
+    return;
+}
+
+
+/* Summarizes count interleaved samples, all channels together */
+static void summarize( const float *samples, unsigned long count, JPeak *peak )
+{
+    float   min = 0.0f, max = 0.0f;
+    double  sumSquares = 0.0;
+    unsigned long i;
+
+    if( count > 0 )
+        min = max = samples[0];
+    for( i=0; i<count; i++ )
+    {
+        if( samples[i] < min )
+            min = samples[i];
+        if( samples[i] > max )
+            max = samples[i];
+        sumSquares += (double)samples[i] * samples[i];
+    }
+    peak->min = min;
+    peak->max = max;
+    peak->rms = count > 0 ? (float)sqrt( sumSquares / count ) : 0.0f;
+    return;
+}
+
+
+/* Merges peaks covering equal numbers of frames, count must be at least 1 */
+static void mergePeaks( const JPeak *peaks, unsigned long count, JPeak *peak )
+{
+    float   min = peaks[0].min, max = peaks[0].max;
+    double  sumSquares = 0.0;
+    unsigned long i;
+
+    for( i=0; i<count; i++ )
+    {
+        if( peaks[i].min < min )
+            min = peaks[i].min;
+        if( peaks[i].max > max )
+            max = peaks[i].max;
+        sumSquares += (double)peaks[i].rms * peaks[i].rms;
+    }
+    peak->min = min;
+    peak->max = max;
+    peak->rms = (float)sqrt( sumSquares / count );
+    return;
+}
+
+
+/* Returns the number of peaks of a level in each chunk, level <= chunkLevel */
+static unsigned long peaksPerChunk( const JWaveform *waveform, unsigned level )
+{
+    unsigned long count = 1;
+    unsigned k;
+
+    for( k=level; k<waveform->chunkLevel; k++ )
+        count *= JWAVEFORM_LEVEL_FACTOR;
+    return count;
+}
+
+
+/* Fills in the key a sidecar must match: the size and modification time of the file
+ * and a hash of its first and last bytes, which catches files rewritten in place */
+static int identifyFile( const char *filePath, long long *size, long long *time, unsigned long long *hash )
+{
+#ifdef WIN32
+    struct _stat64 fileStat;
+#else
+    struct stat fileStat;
+#endif
+    unsigned char   *bytes;
+    size_t          count, i;
+    FILE            *file;
+    int             pass;
+
+#ifdef WIN32
+    if( _stat64( filePath, &fileStat ) != 0 )
+        return -1;
+#else
+    if( stat( filePath, &fileStat ) != 0 )
+        return -1;
+#endif
+    *size = (long long)fileStat.st_size;
+    *time = (long long)fileStat.st_mtime;
+
+    file = fopen( filePath, "rb" );
+    if( file == NULL )
+        return -1;
+    bytes = (unsigned char*)malloc( HASH_BYTES );
+    if( bytes == NULL )
+    {
+        fclose( file );
+        return -1;
+    }
+
+    /* 64 bit FNV-1a */
+    *hash = 14695981039346656037ULL;
+    for( pass=0; pass<2; pass++ )
+    {
+        if( pass == 1 && ( *size <= HASH_BYTES || FSEEK64( file, -(long long)HASH_BYTES, SEEK_END ) != 0 ) )
+            break;
+        count = fread( bytes, 1, HASH_BYTES, file );
+        for( i=0; i<count; i++ )
+            *hash = ( *hash ^ bytes[i] ) * 1099511628211ULL;
+    }
+    free( bytes );
+    fclose( file );
+    return 0;
+}
+
+
+/* Reads every level from the sidecar of the file, if it was saved for the same file */
+static int loadSidecar( JWaveform *waveform )
+{
+    unsigned char   header[56], *block;
+    FILE            *file;
+    char            *path;
+    unsigned long   peak, count, i;
+    unsigned        k;
+    unsigned int    bits;
+    float           *values;
+    int             result = 0;
+
+    path = sidecarPath( waveform->filePath );
+    if( path == NULL )
+        return -1;
+    file = fopen( path, "rb" );
+    free( path );
+    if( file == NULL )
+        return -1;
+
+    if( fread( header, 1, sizeof(header), file ) != sizeof(header) ||
+        memcmp( header, sidecarMagic, sizeof(sidecarMagic) ) != 0 ||
+        getLE( header + 8, 4 ) != SIDECAR_VERSION ||
+        getLE( header + 12, 4 ) != waveform->levelCount ||
+        (long long)getLE( header + 16, 8 ) != waveform->fileSize ||
+        (long long)getLE( header + 24, 8 ) != waveform->fileTime ||
+        getLE( header + 32, 8 ) != waveform->fileHash ||
+        (sf_count_t)getLE( header + 40, 8 ) != waveform->frames ||
+        getLE( header + 48, 4 ) != (unsigned long long)waveform->channels )
+    {
+        fclose( file );
+        return -1;
+    }
+
+    block = (unsigned char*)malloc( SIDECAR_PEAK_BYTES * SIDECAR_BLOCK_PEAKS );
+    if( block == NULL )
+    {
+        fclose( file );
+        return -1;
+    }
+    for( k=0; k<waveform->levelCount && result == 0; k++ )
+    {
+        for( peak=0; peak<waveform->levels[k].count && result == 0; peak+=count )
+        {
+            count = waveform->levels[k].count - peak;
+            if( count > SIDECAR_BLOCK_PEAKS )
+                count = SIDECAR_BLOCK_PEAKS;
+            if( fread( block, SIDECAR_PEAK_BYTES, count, file ) != count )
+            {
+                result = -1;
+                break;
+            }
+            values = (float*)( waveform->levels[k].peaks + peak );
+            for( i=0; i<count*3; i++ )
+            {
+                bits = (unsigned int)getLE( block + i * 4, 4 );
+                memcpy( &values[i], &bits, sizeof(float) );
+            }
+        }
+    }
+    free( block );
+    fclose( file );
+    return result;
+}
+
+
+static int saveSidecar( const JWaveform *waveform )
+{
+    unsigned char   header[56], *block;
+    FILE            *file;
+    char            *path;
+    unsigned long   peak, count, i;
+    unsigned        k;
+    unsigned int    bits;
+    const float     *values;
+    int             result = 0;
+
+    path = sidecarPath( waveform->filePath );
+    if( path == NULL )
+        return -1;
+    block = (unsigned char*)malloc( SIDECAR_PEAK_BYTES * SIDECAR_BLOCK_PEAKS );
+    file = block != NULL ? fopen( path, "wb" ) : NULL;
+    if( file == NULL )
+    {
+        /* Files are often played from folders that cannot be written to */
+        free( block );
+        free( path );
+        return -1;
+    }
+
+    memset( header, 0, sizeof(header) );
+    memcpy( header, sidecarMagic, sizeof(sidecarMagic) );
+    putLE( header + 8, SIDECAR_VERSION, 4 );
+    putLE( header + 12, waveform->levelCount, 4 );
+    putLE( header + 16, (unsigned long long)waveform->fileSize, 8 );
+    putLE( header + 24, (unsigned long long)waveform->fileTime, 8 );
+    putLE( header + 32, waveform->fileHash, 8 );
+    putLE( header + 40, (unsigned long long)waveform->frames, 8 );
+    putLE( header + 48, (unsigned long long)waveform->channels, 4 );
+    if( fwrite( header, 1, sizeof(header), file ) != sizeof(header) )
+        result = -1;
+
+    for( k=0; k<waveform->levelCount && result == 0; k++ )
+    {
+        for( peak=0; peak<waveform->levels[k].count && result == 0; peak+=count )
+        {
+            count = waveform->levels[k].count - peak;
+            if( count > SIDECAR_BLOCK_PEAKS )
+                count = SIDECAR_BLOCK_PEAKS;
+            values = (const float*)( waveform->levels[k].peaks + peak );
+            for( i=0; i<count*3; i++ )
+            {
+                memcpy( &bits, &values[i], sizeof(float) );
+                putLE( block + i * 4, bits, 4 );
+            }
+            if( fwrite( block, SIDECAR_PEAK_BYTES, count, file ) != count )
+                result = -1;
+        }
+    }
+    if( fclose( file ) != 0 )
+        result = -1;
+
+    /* Never leave a truncated sidecar behind */
+    if( result != 0 )
+        remove( path );
+    free( block );
+    free( path );
+    return result;
+}
+
+
+static char* sidecarPath( const char *filePath )
+{
+    char *path = (char*)malloc( strlen( filePath ) + sizeof(JWAVEFORM_SIDECAR_SUFFIX) );
+
+    if( path == NULL )
+        return NULL;
+    strcpy( path, filePath );
+    strcat( path, JWAVEFORM_SIDECAR_SUFFIX );
+    return path;
+}
+
+
+static void putLE( unsigned char *p, unsigned long long value, int bytes )
+{
+    int i;
+
+    for( i=0; i<bytes; i++, value>>=8 )
+        p[i] = (unsigned char)value;
+    return;
+}
+
+
+static unsigned long long getLE( const unsigned char *p, int bytes )
+{
+    unsigned long long value = 0;
+    int i;
+
+    for( i=bytes-1; i>=0; i-- )
+        value = value << 8 | p[i];
+    return value;
+}
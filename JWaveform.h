@@ -0,0 +1,124 @@
+/* JWaveform.h Header file for the waveform overview of audio files
+ * Copyright (c) 2017 Jay Biernat
+ *
+ * This file is part of J Audio Player
+ *
+ * J Audio Player is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * J Audio Player is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with J Audio Player.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JWAVEFORM_H_INCLUDED
+#define JWAVEFORM_H_INCLUDED
+
+#include "sndfile.h"
+
+#include "JPlatform.h"
+
+#define JWAVEFORM_SIDECAR_SUFFIX ".jpeaks"     /* Appended to the path of the audio file */
+#define JWAVEFORM_BASE_FRAMES 256       /* Frames summarized by each peak of level 0 */
+#define JWAVEFORM_LEVEL_FACTOR 4        /* Peaks of a level merged into each of the next */
+#define JWAVEFORM_CHUNK_LEVEL 5         /* Each peak of this level is one chunk of work */
+#define JWAVEFORM_MAX_LEVELS 16
+#define JWAVEFORM_OVERVIEW_PEAKS 512    /* Peaks of the overview read before the chunks */
+#define JWAVEFORM_MAX_WORKERS 8
+
+/** Summary of a run of frames over all channels */
+typedef struct
+{
+    float   min;
+    float   max;
+    float   rms;
+}
+JPeak;
+
+/** One level of detail.  Peak i summarizes frames from i * framesPerPeak. */
+typedef struct
+{
+    JPeak       *peaks;
+    unsigned long count;
+    sf_count_t  framesPerPeak;
+}
+JWaveformLevel;
+
+/** Min/max/RMS pyramid of a whole audio file, built by a pool of worker threads that
+  * each open the file on their own, so the audio being played is never touched.
+  * The workers first read short stretches spread over the file into a coarse
+  * overview, then split the file into chunks and fill every level up to chunkLevel
+  * one chunk at a time.  Levels above chunkLevel span several chunks and are merged
+  * once the last chunk is done.  Peaks are published with release stores of their
+  * ready flags, so they can be read while the workers run.
+  * @see JWaveformGetColumns
+  */
+typedef struct
+{
+    char            *filePath;
+    sf_count_t      frames;
+    int             channels;
+    long long       fileSize;           /* Key of the sidecar file */
+    long long       fileTime;
+    unsigned long long fileHash;
+
+    JWaveformLevel  levels[JWAVEFORM_MAX_LEVELS];   /* Finest first */
+    unsigned        levelCount;
+    unsigned        chunkLevel;         /* Highest level filled chunk by chunk */
+    unsigned char   *chunkReady;        /* One flag per peak of chunkLevel */
+    JWaveformLevel  overview;
+    unsigned char   *overviewReady;     /* One flag per overview peak */
+    int             bComplete;          /* Every level is filled */
+
+    unsigned long   nextItem;           /* Overview peaks then chunks, taken by workers */
+    unsigned long   itemsDone;
+    unsigned long   overviewDone;
+    unsigned long   itemCount;
+    unsigned long long startNs;
+    unsigned long long overviewNs;      /* Time taken to read the overview, 0 until done */
+    unsigned long long completeNs;      /* Time taken to fill every level, 0 until done */
+    int             bSave;              /* Write a sidecar once complete */
+
+    JThread         workers[JWAVEFORM_MAX_WORKERS];
+    unsigned        workerCount;
+    volatile int    bCancel;
+}
+JWaveform;
+
+/** @brief Starts building the waveform of an audio file and returns at once.  If a
+  * sidecar saved for the same file is found the waveform is complete straight away.
+  * JWaveformDestroy must be called to free resources allocated by JWaveformCreate.
+  * @param filePath Path of the audio file, copied
+  * @param bSave TRUE to save the waveform next to the file once it is complete
+  * @return Pointer to a JWaveform, returns NULL on failure
+  */
+JWaveform* JWaveformCreate( const char *filePath, int bSave );
+
+/** @brief Summarizes the file in width columns, from the finest level that is ready
+  * for each column without merging more than a few peaks.  Columns whose chunk is
+  * not done yet fall back to the overview.  Safe to call while the workers run.
+  * @param columns Array of width peaks to fill in, empty columns are set to 0
+  * @return Number of columns that were filled in
+  */
+unsigned JWaveformGetColumns( JWaveform *waveform, JPeak *columns, unsigned width );
+
+/** @brief Returns a count that goes up whenever more of the waveform is ready, so
+  * that it only needs to be drawn again when the count has changed */
+unsigned long JWaveformGetProgress( JWaveform *waveform );
+
+/** @brief Checks whether every level of the waveform has been filled */
+int JWaveformIsComplete( JWaveform *waveform );
+
+/** @brief Stops the workers and frees the waveform
+  * @param waveformPtr Pointer to a pointer to a JWaveform, set to NULL after freeing
+  */
+void JWaveformDestroy( JWaveform **waveformPtr );
+
+#endif // JWAVEFORM_H_INCLUDED
@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #ifdef WIN32
@@ -31,6 +32,10 @@
 #include "JAudioPlayer.h"
 #include "JPlayerGUI.h"
 
+#define MAX_CUE_POINTS 16
+#define POSITION_TICK_MS 50     /* Longest wait for events while the tracker is moving */
+#define IDLE_TICK_MS 500        /* Longest wait for events while nothing is moving */
+
 void printLicense( void )
 {
     printf( "\n***********************************************************************\n\n"
@@ -59,29 +64,245 @@ void printLicense( void )
     return;
 }
 
+/** Output file and remaining frames of an offline render */
+typedef struct
+{
+    SNDFILE             *sfPtr;
+    volatile sf_count_t framesLeft;
+}
+JRenderTarget;
+
+/* Called from the null output backend with every rendered buffer */
+void renderSink( const void *frames, unsigned long frameCount, void *userData )
+{
+    JRenderTarget *target = (JRenderTarget*)userData;
+    sf_count_t framesToWrite = target->framesLeft;
+
+    if( framesToWrite > (sf_count_t)frameCount )
+        framesToWrite = frameCount;
+    if( framesToWrite > 0 )
+    {
+        sf_writef_float( target->sfPtr, (const float*)frames, framesToWrite );
+        target->framesLeft -= framesToWrite;
+    }
+    return;
+}
+
+/* Prints the statistics of audioPlayer */
+void printStats( JAudioPlayer *audioPlayer )
+{
+    JAudioPlayerStats stats;
+
+    JAudioPlayerGetStats( audioPlayer, &stats );
+    printf( "Audio player statistics:\n" );
+    JAudioPlayerPrintStats( &stats, stdout );
+    return;
+}
+
+/* Renders the whole audio file through the playback path into outputPath */
+int renderToFile( const char *filePath, const char *outputPath, int statsInterval )
+{
+    JAudioPlayer        *myAudioPlayer;
+    JAudioPlayerConfig  config;
+    JRenderTarget       target;
+    SF_INFO             outputInfo;
+    int                 i;
+
+    JAudioPlayerGetDefaultConfig( &config );
+    config.output.backend = JOUTPUT_NULL;
+    config.output.nullClock = JNULL_CLOCK_FREERUN;
+    config.output.sink = renderSink;
+    config.output.sinkUserData = &target;
+    config.bNativeFormat = FALSE;      /* renderSink writes float frames */
+
+    printf( "Creating audio player...\n" );
+    myAudioPlayer = JAudioPlayerCreate( filePath, &config );
+    if( myAudioPlayer == NULL )
+    {
+        printf( "Failed to create audio player!\n" );
+        return 1;
+    }
+
+    outputInfo.samplerate = myAudioPlayer->sfInfo.samplerate;
+    outputInfo.channels = myAudioPlayer->sfInfo.channels;
+    outputInfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    target.framesLeft = myAudioPlayer->sfInfo.frames;
+    target.sfPtr = sf_open( outputPath, SFM_WRITE, &outputInfo );
+    if( target.sfPtr == NULL )
+    {
+        printf( "Failed to open output file: %s\n", outputPath );
+        JAudioPlayerDestroy( &myAudioPlayer );
+        return 1;
+    }
+
+    printf( "Rendering to %s...\n", outputPath );
+    JAudioPlayerPlay( myAudioPlayer );
+    for( i=1; target.framesLeft > 0; i++ )
+    {
+#ifdef WIN32
+        Sleep( 10 );
+#else
+        usleep( 10000 );
+#endif
+        if( statsInterval > 0 && i % ( statsInterval * 100 ) == 0 )
+            printStats( myAudioPlayer );
+    }
+    if( statsInterval > 0 )
+        printStats( myAudioPlayer );
+
+    JAudioPlayerDestroy( &myAudioPlayer );
+    sf_close( target.sfPtr );
+    printf( "Render finished.\n" );
+
+    return 0;
+}
+
+/* Acts on one event from the player window */
+void handleEvent( const SDL_Event *event, JAudioPlayer *audioPlayer, JPlayerGUI *playerGUI, int *bQuit )
+{
+    JPlayerGUICursorSate cursorState = JPlayerGUIGetCursorState();
+
+    if( cursorState == CURSOR_ON_BACKGROUND )
+        playerGUI->buttonState = NO_BUTTON_PRESSED;
+
+    if( ( event->type == SDL_MOUSEBUTTONDOWN ) &&
+        ( event->button.button == SDL_BUTTON_LEFT ) )
+    {
+        switch( cursorState )
+        {
+            case CURSOR_ON_PLAY_BUTTON:
+                playerGUI->buttonState = PLAY_BUTTON_PRESSED;
+                break;
+            case CURSOR_ON_PAUSE_BUTTON:
+                playerGUI->buttonState = PAUSE_BUTTON_PRESSED;
+                break;
+            case CURSOR_ON_STOP_BUTTON:
+                playerGUI->buttonState = STOP_BUTTON_PRESSED;
+                break;
+            case CURSOR_ON_TRACK:
+                playerGUI->seekerEngaged = TRUE;
+                break;
+            case CURSOR_ON_BACKGROUND:
+                break;
+        }
+    }
+    else if( ( event->type == SDL_MOUSEBUTTONUP ) &&
+             ( event->button.button == SDL_BUTTON_LEFT ) )
+    {
+        if( playerGUI->buttonState == PLAY_BUTTON_PRESSED )
+            JAudioPlayerPlay( audioPlayer );
+        else if( playerGUI->buttonState == STOP_BUTTON_PRESSED )
+            JAudioPlayerStop( audioPlayer );
+        else if( playerGUI->buttonState == PAUSE_BUTTON_PRESSED )
+            JAudioPlayerPause( audioPlayer );
+
+        playerGUI->buttonState = NO_BUTTON_PRESSED;
+
+        if( playerGUI->seekerEngaged )
+        {
+            int x;
+            sf_count_t frameOffset;
+            JPlayPosition position;
+
+            SDL_GetMouseState( &x, NULL );
+            x = ( x > 349 ? 349 : x );
+            x = ( x < 49 ? 49 : x );
+
+            /* The tracker shows the track being heard, so the click is taken within it */
+            JAudioPlayerGetPosition( audioPlayer, &position );
+            frameOffset = (sf_count_t)( ((float)(x - 49) / 300.0) * (float)position.trackFrames );
+            JAudioPlayerSeek( audioPlayer, frameOffset, SEEK_SET );
+            playerGUI->seekerEngaged = FALSE;
+        }
+    }
+    else if( event->type == SDL_WINDOWEVENT )
+        playerGUI->bRedraw = TRUE;
+    else if( event->type == SDL_QUIT )
+        *bQuit = TRUE;
+    return;
+}
+
 int main( int argc, char* argv[] )
 {
     JAudioPlayer    *myAudioPlayer;
+    JAudioPlayerConfig config;
+    JPlayPosition   position;
+    JAudioEngine    *engine;
     JPlayerGUI      *myPlayerGUI;
     SDL_Event       event;
     int             bQuit = FALSE;
+    const char      *filePaths[JPLAYER_QUEUE_SIZE + 1];
+    int             trackIds[JPLAYER_QUEUE_SIZE + 1];
+    int             numFiles = 0;
+    JWaveform       *waveform = NULL;
+    int             waveformTrack = -1;     /* Track the waveform was built for */
+    int             bWaveformReported = FALSE;
+    const char      *renderPath = NULL;
+    int             statsInterval = 0;     /* Seconds between statistics printouts */
+    double          cueSeconds[MAX_CUE_POINTS];
+    int             numCuePoints = 0;
+    Uint32          lastStatsTicks = 0;
+    int             timeout;                /* Longest wait for the next event in ms */
+    int             i;
 
     printLicense();
+    JAudioPlayerGetDefaultConfig( &config );
+
+    for( i=1; i<argc; i++ )
+    {
+        if( strcmp( argv[i], "-r" ) == 0 && i + 1 < argc )
+            renderPath = argv[++i];
+        else if( strcmp( argv[i], "-s" ) == 0 && i + 1 < argc )
+            statsInterval = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-i" ) == 0 )
+            config.bSaveSeekIndex = TRUE;
+        else if( strcmp( argv[i], "-a" ) == 0 && i + 1 < argc )
+            config.producerCpu = atoi( argv[++i] );
+        else if( strcmp( argv[i], "-m" ) == 0 )
+            config.memoryLock = JMEMLOCK_ALL;
+        else if( strcmp( argv[i], "-c" ) == 0 && i + 1 < argc && numCuePoints < MAX_CUE_POINTS )
+            cueSeconds[numCuePoints++] = atof( argv[++i] );
+        else if( numFiles < JPLAYER_QUEUE_SIZE + 1 )
+            filePaths[numFiles++] = argv[i];
+        else
+            break;
+    }
 
-    if( argc != 2 )
+    if( numFiles == 0 || i != argc || ( renderPath != NULL && numFiles > 1 ) )
     {
         printf( "ERROR: Not enough input arguments\n"
-                "Usage: %s audio_file\n", argv[0] );
+                "Usage: %s [-s seconds] [-c seconds]... [-i] [-a cpu] [-m] [-r output_file] audio_file [audio_file...]\n"
+                "  -s  Print playback statistics every given number of seconds\n"
+                "  -c  Cue point in the first file, kept decoded in memory so seeking to it\n"
+                "      is instant.  May be given several times.\n"
+                "  -i  Save the seek index built for FLAC files next to them, as file.jseek\n"
+                "  -a  Run the thread that reads the files on the given processor only\n"
+                "  -m  Lock all of the player's memory into RAM, not just the audio buffer\n"
+                "  -r  Render a single file to a WAV file without a sound device\n"
+                "  Files after the first are played one after the other without gaps\n", argv[0] );
         return 1;
     }
 
+    if( renderPath != NULL )
+        return renderToFile( filePaths[0], renderPath, statsInterval );
+
+    /* Hold PortAudio for the whole run, so it is initialized once and not again for
+     * the stream of the player */
+    engine = JAudioEngineAcquire();
+
     printf( "Creating audio player...\n" );
-    myAudioPlayer = JAudioPlayerCreate( argv[1] );
+    myAudioPlayer = JAudioPlayerCreate( filePaths[0], &config );
     if( myAudioPlayer == NULL )
     {
         printf( "Failed to create audio player!\n" );
+        JAudioEngineRelease( &engine );
         return 1;
     }
+    trackIds[0] = 0;
+    for( i=1; i<numFiles; i++ )
+        trackIds[i] = JAudioPlayerEnqueue( myAudioPlayer, filePaths[i] );
+    for( i=0; i<numCuePoints; i++ )
+        JAudioPlayerAddCuePoint( myAudioPlayer, 0, (sf_count_t)( cueSeconds[i] * myAudioPlayer->sfInfo.samplerate ) );
 
     printf( "Creating audio player GUI...\n" );
     myPlayerGUI = JPlayerGUICreate();
@@ -89,6 +310,7 @@ int main( int argc, char* argv[] )
     {
         printf( "Failed to create audio player GUI!\n" );
         JAudioPlayerDestroy( &myAudioPlayer );
+        JAudioEngineRelease( &engine );
         return 1;
     }
 
@@ -98,72 +320,55 @@ int main( int argc, char* argv[] )
 
     while( !bQuit )
     {
-        /* If end of audio file has been reached, stop stream and reset GUI */
-        if( myAudioPlayer->seekFrames >= myAudioPlayer->sfInfo.frames )
+        /* Build the waveform of each track as it starts to be heard */
+        JAudioPlayerGetPosition( myAudioPlayer, &position );
+        if( (int)position.track != waveformTrack )
+        {
+            waveformTrack = (int)position.track;
+            myPlayerGUI->waveform = NULL;
+            JWaveformDestroy( &waveform );
+            for( i=0; i<numFiles; i++ )
+            {
+                if( trackIds[i] == waveformTrack )
+                    waveform = JWaveformCreate( filePaths[i], TRUE );
+            }
+            myPlayerGUI->waveform = waveform;
+            myPlayerGUI->bRedraw = TRUE;
+            bWaveformReported = FALSE;
+        }
+        if( statsInterval > 0 && waveform != NULL && !bWaveformReported && JWaveformIsComplete( waveform ) )
+        {
+            printf( "Waveform: overview after %.1f ms, complete after %.1f ms\n",
+                    waveform->overviewNs / 1e6, waveform->completeNs / 1e6 );
+            bWaveformReported = TRUE;
+        }
+
+        /* If the end of the last audio file has been heard, rather than just read,
+         * stop stream and reset GUI.  Stopping seeks back to the start, so this only
+         * happens once per ending. */
+        if( position.bEnded && JAudioPlayerGetQueueLength( myAudioPlayer ) == 0 &&
+            myAudioPlayer->state != JPLAYER_STOPPED )
         {
             myPlayerGUI->buttonState = NO_BUTTON_PRESSED;
             myPlayerGUI->seekerEngaged = FALSE;
             JAudioPlayerStop( myAudioPlayer );
-            JPlayerGUIDraw( myPlayerGUI, 0.0 );
-            continue;
         }
 
-        while( SDL_PollEvent( &event) != 0 )
+        /* Sleep until something happens, or until the tracker or the waveform may
+         * have changed */
+        if( myAudioPlayer->state == JPLAYER_PLAYING || ( waveform != NULL && !JWaveformIsComplete( waveform ) ) )
+            timeout = POSITION_TICK_MS;
+        else
+            timeout = IDLE_TICK_MS;
+        if( SDL_WaitEventTimeout( &event, timeout ) )
         {
-            JPlayerGUICursorSate cursorState = JPlayerGUIGetCursorState();
-            if( cursorState == CURSOR_ON_BACKGROUND )
-                myPlayerGUI->buttonState = NO_BUTTON_PRESSED;
-
-            if( ( event.type == SDL_MOUSEBUTTONDOWN ) &&
-                ( event.button.button == SDL_BUTTON_LEFT ) )
+            do
             {
-                switch( cursorState )
-                {
-                    case CURSOR_ON_PLAY_BUTTON:
-                        myPlayerGUI->buttonState = PLAY_BUTTON_PRESSED;
-                        break;
-                    case CURSOR_ON_PAUSE_BUTTON:
-                        myPlayerGUI->buttonState = PAUSE_BUTTON_PRESSED;
-                        break;
-                    case CURSOR_ON_STOP_BUTTON:
-                        myPlayerGUI->buttonState = STOP_BUTTON_PRESSED;
-                        break;
-                    case CURSOR_ON_TRACK:
-                        myPlayerGUI->seekerEngaged = TRUE;
-                        break;
-                    case CURSOR_ON_BACKGROUND:
-                        break;
-                }
+                handleEvent( &event, myAudioPlayer, myPlayerGUI, &bQuit );
             }
-            else if( ( event.type == SDL_MOUSEBUTTONUP ) &&
-                     ( event.button.button == SDL_BUTTON_LEFT ) )
-            {
-                if( myPlayerGUI->buttonState == PLAY_BUTTON_PRESSED )
-                    JAudioPlayerPlay( myAudioPlayer );
-                else if( myPlayerGUI->buttonState == STOP_BUTTON_PRESSED )
-                    JAudioPlayerStop( myAudioPlayer );
-                else if( myPlayerGUI->buttonState == PAUSE_BUTTON_PRESSED )
-                    JAudioPlayerPause( myAudioPlayer );
-
-                myPlayerGUI->buttonState = NO_BUTTON_PRESSED;
-
-                if( myPlayerGUI->seekerEngaged )
-                {
-                    int x;
-                    sf_count_t frameOffset;
-
-                    SDL_GetMouseState( &x, NULL );
-                    x = ( x > 349 ? 349 : x );
-                    x = ( x < 49 ? 49 : x );
-
-                    frameOffset = (sf_count_t)( ((float)(x - 49) / 300.0) * (float)myAudioPlayer->sfInfo.frames );
-                    JAudioPlayerSeek( myAudioPlayer, frameOffset, SEEK_SET );
-                    myPlayerGUI->seekerEngaged = FALSE;
-                }
-            }
-            else if( event.type == SDL_QUIT )
-                bQuit = TRUE;
+            while( SDL_PollEvent( &event ) != 0 );
         }
+
         if( myPlayerGUI->seekerEngaged )
         {
             int x;
@@ -173,12 +378,25 @@ int main( int argc, char* argv[] )
             JPlayerGUIDraw( myPlayerGUI, (float)(x - 49) / 300.0 );
         }
         else
-            JPlayerGUIDraw( myPlayerGUI, (float)myAudioPlayer->seekFrames / (float)myAudioPlayer->sfInfo.frames );
+        {
+            /* Drawn from the position being heard, as the waveform is, rather than from
+             * the producer's cursor, which runs ahead into the next track */
+            JAudioPlayerGetPosition( myAudioPlayer, &position );
+            JPlayerGUIDraw( myPlayerGUI, (float)position.frame / (float)position.trackFrames );
+        }
+
+        if( statsInterval > 0 && SDL_GetTicks() - lastStatsTicks >= (Uint32)statsInterval * 1000 )
+        {
+            printStats( myAudioPlayer );
+            lastStatsTicks = SDL_GetTicks();
+        }
     }
 
     JPlayerGUIDestroy( &myPlayerGUI );
     printf("Audio Player GUI Destroyed\n" );
+    JWaveformDestroy( &waveform );
     JAudioPlayerDestroy( &myAudioPlayer );
+    JAudioEngineRelease( &engine );
     printf( "Audio Player Destroyed\n" );
     printf( "Test finished.\n" );
 